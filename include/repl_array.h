@@ -0,0 +1,57 @@
+#ifndef REPL_ARRAY_H
+#define REPL_ARRAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "repl_value.h"
+#include "repl_number.h"
+
+/* Arrays of doubles, written [1, 2, 3] or made by range and linspace */
+#define ARRAY_ALIGNMENT 32           // Bytes; elements start on an AVX vector boundary
+#define ARRAY_MAX_LENGTH (1 << 28)   // Most elements in one array, 2 GiB of doubles
+#define ARRAY_MAX_CONSTANT 1024      // Longest array a call on constants is folded to
+#define ARRAY_PRINT_EDGE 3           // Elements printed at each end of a long array
+#define ARRAY_BUFFER_SIZE ((2 * ARRAY_PRINT_EDGE + 1) * (NUMBER_BUFFER_SIZE + 2) + 32)  // Elements shown and the length
+
+// An array's elements are contiguous and aligned, in the same allocation
+// as its header. Arrays are never changed once made, so programs and
+// memoized calls can share them.
+typedef struct {
+    HeapObject header;
+    size_t length;
+    double* elements;
+} ArrayObject;
+
+// Bytes allocated for an array of length elements, with room to align them
+#define ARRAY_OBJECT_SIZE(length) \
+    (sizeof(ArrayObject) + ARRAY_ALIGNMENT - 1 + (size_t)(length) * sizeof(double))
+
+// How the operands of an element-wise operation line up
+typedef enum {
+    ARRAY_EACH_ELEMENT,   // Two arrays of the same length
+    ARRAY_SCALAR_LEFT,    // x is one double, paired with every element of y
+    ARRAY_SCALAR_RIGHT    // y is one double
+} ArrayBroadcast;
+
+static inline const ArrayObject* value_array(Value v) {
+    return (const ArrayObject*)value_object(v);
+}
+
+// Array functions. A scalar operand is a real number of any type, which
+// is converted to double and applies to every element.
+ValueStatus repl_array_make(size_t length, double** elements, Value* result);
+ValueStatus repl_array_from_values(const Value* values, int count, Value* result);
+ValueStatus repl_array_range(Value start, Value stop, Value* result);
+ValueStatus repl_array_linspace(Value start, Value stop, Value count, Value* result);
+ValueStatus repl_array_binary(int op, Value a, Value b, Value* result);
+ValueStatus repl_array_unary(int op, Value a, Value* result);
+void repl_array_apply(int op, double* out, const double* x, const double* y, size_t n,
+                      ArrayBroadcast shape);
+ValueStatus repl_array_map(double (*function)(double), Value a, Value* result);
+ValueStatus repl_array_map2(double (*function)(double, double), Value a, Value b, Value* result);
+ValueStatus repl_array_sum(Value a, Value* result);
+ValueStatus repl_array_length(Value a, Value* result);
+bool repl_array_equal(Value a, Value b);
+void repl_array_format(const HeapObject* object, int precision, char* buffer, size_t size);
+
+#endif // REPL_ARRAY_H
@@ -0,0 +1,17 @@
+#ifndef REPL_BENCH_H
+#define REPL_BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Built-in micro-benchmarks, run by the "bench" command */
+#define BENCH_SCRIPT_SIZE (4 * 1024 * 1024)  // Bytes of generated script to lex
+#define BENCH_RUNS 5                         // Repetitions; the fastest is reported
+#define BENCH_VECTOR_LENGTH (1 << 20)        // Elements of the precision benchmark's vectors
+
+// Benchmark functions. Each writes a report to buffer and returns false
+// if it could not run.
+bool repl_bench_lexer(char* buffer, size_t size);
+bool repl_bench_precision(char* buffer, size_t size);
+
+#endif // REPL_BENCH_H
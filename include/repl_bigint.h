@@ -0,0 +1,22 @@
+#ifndef REPL_BIGINT_H
+#define REPL_BIGINT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "repl_value.h"
+
+/* Arbitrary-precision integers for bigint mode (see NumberMode) */
+#define BIGINT_MAX_LIMBS (1 << 20)       // Largest magnitude, 32 Mbit or about 10 million digits
+#define KARATSUBA_THRESHOLD 32           // Limbs from which multiplication uses Karatsuba
+#define DECIMAL_SPLIT_THRESHOLD 64       // Limbs from which decimal output divides and conquers
+
+// Bigint functions. Operands are integer values of any type (bool, int64,
+// uint64 or bigint); results that fit an int64 are returned as one.
+ValueStatus repl_bigint_binary(int op, Value a, Value b, Value* result);
+ValueStatus repl_bigint_unary(int op, Value a, Value* result);
+bool repl_bigint_parse(const char* digits, size_t length, int base, Value* value);
+bool repl_bigint_equal(Value a, Value b);
+uint64_t repl_bigint_bit_length(Value v);
+void repl_bigint_format(const HeapObject* object, char* buffer, size_t size);
+
+#endif // REPL_BIGINT_H
@@ -0,0 +1,40 @@
+#ifndef REPL_BUILTINS_H
+#define REPL_BUILTINS_H
+
+#include "repl_value.h"
+#include "repl_extended.h"
+
+/* Built-in functions such as sqrt and max, called like user functions */
+#define BUILTIN_MAX_ARITY 3      // Most arguments a built-in takes
+
+// A built-in's result from its arguments; pure, so calls with constant
+// arguments are evaluated when compiling
+typedef ValueStatus (*BuiltinFunction)(const Value* args, Value* result);
+
+/*
+ * A built-in is found by name when a call is compiled, and the call
+ * refers to its index in repl_builtins. unary or binary, whichever
+ * matches the arity, is the C function giving the result for double
+ * arguments, which the VM and native code call directly, and which is
+ * applied to each element of an array argument; it is NULL where doubles
+ * need more than that. function handles every other argument type, or is
+ * NULL where converting the arguments to double and calling unary or
+ * binary does. extended names the function for real arguments at
+ * extended precision, or of extended-precision numbers.
+ */
+typedef struct {
+    const char* name;
+    int arity;
+    BuiltinFunction function;
+    double (*unary)(double);
+    double (*binary)(double, double);
+    ExtendedFunction extended;
+} Builtin;
+
+extern const Builtin repl_builtins[];
+
+// Built-in functions. A user function of the same name hides a built-in.
+int repl_find_builtin(const char* name, int length);
+ValueStatus repl_call_builtin(const Builtin* builtin, const Value* args, Value* result);
+
+#endif // REPL_BUILTINS_H
@@ -0,0 +1,80 @@
+#ifndef REPL_COMPILE_H
+#define REPL_COMPILE_H
+
+#include "repl_core.h"
+#include "repl_vm.h"
+#include "repl_jit.h"
+
+/* Expression compiler and compiled-expression cache */
+#define EXPR_CACHE_CAPACITY 128   // Compiled programs kept before the LRU entry is evicted
+#define EXPR_CACHE_BUCKETS 256    // Hash buckets (power of two)
+#define MAX_NESTING_DEPTH 1000    // Deepest parenthesis/operator nesting the parser accepts
+#define INLINE_MAX_INSTRUCTIONS 32 // Largest function body inlined at a call site
+#define INLINE_MAX_DEPTH 8        // Calls inlined within one another
+#define MAX_FUNCTION_LOCALS 64    // Names assigned in one function body
+#define TAIL_CALL_MAX_HOPS 8      // Jumps and moves followed from a call to its return
+#define ARRAY_MAX_LITERAL 255     // Elements written in one array literal, OP_ARRAY's B operand
+
+// A compiled expression: register bytecode plus its constant and variable slot pools
+typedef struct CompiledExpr {
+    Instr* code;
+    int code_length;
+    int* positions;              // Source offset of each instruction, for runtime errors
+    Value* constants;
+    int constant_count;
+    int* slots;                  // Variable slots, indexed by LOADV
+    int slot_count;
+    int register_count;          // Registers the program uses
+    bool calls_functions;        // Contains OP_CALL
+    bool has_statements;         // More than a single expression; never inlined
+    bool stores_variables;       // Contains OP_STOREV, so its result is not reused
+    unsigned int run_count;      // Executions so far, for JIT hotness
+    JitCode* jit;                // Native code, once the program is hot
+    bool jit_failed;             // Native compilation was tried and is unsupported
+    bool has_result;             // result is valid while the slots keep result_versions
+    Value result;
+    unsigned int* result_versions;  // Versions of slots[] when result was computed
+    int* fused_ends;             // Per instruction, the last of the fused run it starts,
+                                 // or -1; NULL when there are none (see repl_fusion.h)
+} CompiledExpr;
+
+typedef struct ExprCacheEntry {
+    char* key;                   // Normalized expression text
+    unsigned int hash;
+    CompiledExpr* expr;
+    struct ExprCacheEntry* bucket_next;
+    struct ExprCacheEntry* lru_prev;  // Towards most recently used
+    struct ExprCacheEntry* lru_next;  // Towards least recently used
+} ExprCacheEntry;
+
+// LRU cache from normalized input text to compiled program
+typedef struct ExprCache {
+    ExprCacheEntry entries[EXPR_CACHE_CAPACITY];
+    ExprCacheEntry* buckets[EXPR_CACHE_BUCKETS];
+    ExprCacheEntry* lru_head;
+    ExprCacheEntry* lru_tail;
+    int count;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long result_hits;   // Evaluations answered from a program's last result
+    unsigned long result_misses;
+} ExprCache;
+
+// Compilation. Errors unwind through repl->error (see repl_error.h).
+CompiledExpr* repl_compile(REPL* repl, const char* expr);
+CompiledExpr* repl_compile_function(REPL* repl, int index);
+void repl_free_compiled(CompiledExpr* compiled);
+void repl_mark_program(const CompiledExpr* program);
+
+// Compiled expression cache
+ExprCache* repl_cache_create(void);
+void repl_cache_destroy(ExprCache* cache);
+void repl_cache_clear(ExprCache* cache);
+char* repl_normalize_expression(const char* expr);
+CompiledExpr* repl_cache_lookup(ExprCache* cache, const char* key);
+bool repl_cached_result(REPL* repl, CompiledExpr* program, Value* result);
+void repl_remember_result(REPL* repl, CompiledExpr* program, Value result);
+void repl_cache_insert(ExprCache* cache, const char* key, CompiledExpr* expr);
+void repl_cache_mark(const ExprCache* cache);
+
+#endif // REPL_COMPILE_H
@@ -0,0 +1,36 @@
+#ifndef REPL_COMPLEX_H
+#define REPL_COMPLEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "repl_value.h"
+#include "repl_number.h"
+
+/* Complex numbers, written with imaginary literals such as 2i or 1.5i */
+#define COMPLEX_BUFFER_SIZE (2 * NUMBER_BUFFER_SIZE + 2)   // Both parts, a sign and the 'i'
+
+// re + im i, in doubles whatever the number mode and precision
+typedef struct {
+    HeapObject header;
+    double re;
+    double im;
+} ComplexObject;
+
+// Complex functions. Operands are complex or real numbers of any type;
+// a real operand is converted to double and has no imaginary part.
+ValueStatus repl_complex_make(double re, double im, Value* result);
+ValueStatus repl_complex_binary(int op, Value a, Value b, Value* result);
+ValueStatus repl_complex_unary(int op, Value a, Value* result);
+double repl_complex_abs(Value z);
+double repl_complex_arg(Value z);
+double repl_complex_imag(Value z);
+ValueStatus repl_complex_conj(Value z, Value* result);
+ValueStatus repl_complex_sqrt(Value z, Value* result);
+ValueStatus repl_complex_sin(Value z, Value* result);
+ValueStatus repl_complex_cos(Value z, Value* result);
+ValueStatus repl_complex_exp(Value z, Value* result);
+ValueStatus repl_complex_log(Value z, Value* result);
+bool repl_complex_equal(Value a, Value b);
+void repl_complex_format(const HeapObject* object, int precision, char* buffer, size_t size);
+
+#endif // REPL_COMPLEX_H
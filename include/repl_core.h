@@ -4,14 +4,18 @@
 #include <SDL.h>
 #include <SDL_ttf.h>
 #include <stdbool.h>
+#include "repl_error.h"
+#include "repl_value.h"
 
 /* Core definitions for the REPL */
 #define MAX_INPUT_LENGTH 1024
 #define MAX_OUTPUT_LENGTH 32768  // Increased buffer size for more history
+#define MAX_RESULT_LENGTH 4096   // Longest result line; longer bigints are abbreviated
+#define LIST_MORE_RESERVE 32     // Room kept for the "...N more" line ending a long listing
 #define MAX_HISTORY_ENTRIES 500  // Increased history entries
-#define MAX_VARIABLES 100
 #define MAX_VARIABLE_NAME 32
 #define MAX_VISIBLE_LINES 100    // Maximum number of lines to show at once
+#define MAX_FUNCTION_PARAMS 16
 
 // Enumeration for view modes
 typedef enum {
@@ -20,11 +24,38 @@ typedef enum {
     VIEW_MODE_PAGED      // Paged view (like 'less' or 'more')
 } ViewMode;
 
-// Variable structure for storing variables
+// Variable store: slots in struct-of-arrays form behind an open-addressing
+// hash index. Compiled expressions refer to variables by slot.
+typedef struct {
+    char** names;                // Interned names, by slot
+    unsigned int* hashes;        // Name hashes, by slot
+    Value* values;               // Values, by slot; undefined for slots only reserved
+    unsigned int* versions;      // Bumped whenever a slot's value changes
+    int count;                   // Slots in use; slots are never reused or moved
+    int capacity;
+    int* index;                  // Hash table of slot + 1; 0 marks an empty bucket
+    int index_capacity;          // Power of two, kept at most half full
+} VariableStore;
+
+// A user-defined function. Compiled programs call functions by index, so
+// entries are never moved or removed; redefinition replaces one in place.
 typedef struct {
     char name[MAX_VARIABLE_NAME];
-    double value;
-} Variable;
+    char params[MAX_FUNCTION_PARAMS][MAX_VARIABLE_NAME];
+    int arity;
+    char* body;                  // Normalized body text, parsed again to inline a call
+    struct CompiledExpr* code;   // Body compiled with parameter i in register i
+    bool pure;                   // Result depends only on the arguments
+    struct MemoTable* memo;      // Results of earlier calls, if pure; allocated on first call
+    unsigned long memo_hits;
+    unsigned long memo_misses;
+} Function;
+
+typedef struct {
+    Function* items;
+    int count;
+    int capacity;
+} FunctionTable;
 
 typedef struct {
     // SDL components
@@ -55,8 +86,17 @@ typedef struct {
     int history_index; // -1 means current input, not from history
     
     // Variables support
-    Variable variables[MAX_VARIABLES];
-    int variable_count;
+    VariableStore variables;
+    FunctionTable functions;
+    int memo_capacity;           // Results remembered per pure function; 0 disables memoization
+    struct VMStack* vm_stack;    // Allocated on first use (see repl_vm.h)
+    
+    // Compiled expression cache (see repl_compile.h)
+    struct ExprCache* expr_cache;
+    bool jit_enabled;            // Compile hot expressions to native code
+    bool ieee_strict;            // Keep NaN and signed-zero semantics when simplifying
+    int output_precision;        // Significant digits printed, or FORMAT_SHORTEST
+    ErrorContext error;          // Recovery point and message of the current evaluation
     
     // Font settings
     int font_size;
@@ -98,6 +138,7 @@ void repl_cleanup(REPL* repl);
 char* repl_evaluate(REPL* repl, const char* input);
 void repl_print(REPL* repl, const char* result, bool is_error);
 void repl_loop(REPL* repl);
+bool repl_interrupt_requested(REPL* repl);
 
 // Helper functions
 void repl_scroll(REPL* repl, int lines);
@@ -0,0 +1,39 @@
+#ifndef REPL_DECIMAL_H
+#define REPL_DECIMAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "repl_value.h"
+
+/* Fixed-point decimals for decimal mode (see NumberMode) */
+#define DECIMAL_MAX_DIGITS 37            // Significant digits of a decimal, scale included
+#define DECIMAL_MAX_SCALE 18             // Most digits after the point
+#define DECIMAL_DEFAULT_SCALE 6          // Digits a quotient is rounded to unless set otherwise
+#define DECIMAL_BUFFER_SIZE 48           // Enough for any decimal
+
+// GCC and Clang have a 128-bit integer type on 64-bit targets
+#if defined(__SIZEOF_INT128__) && !defined(REPL_NO_INT128)
+#define REPL_HAVE_INT128 1
+#endif
+
+#ifdef REPL_HAVE_INT128
+// units / 10^scale, with |units| < 10^DECIMAL_MAX_DIGITS
+typedef struct {
+    HeapObject header;
+    int scale;
+    __int128 units;
+} DecimalObject;
+#endif
+
+// Decimal functions. Operands are decimals or integers of any type; a
+// quotient is rounded half to even to the decimal scale setting.
+bool repl_decimal_available(void);
+int repl_decimal_scale(void);
+void repl_set_decimal_scale(int scale);
+ValueStatus repl_decimal_binary(int op, Value a, Value b, Value* result);
+ValueStatus repl_decimal_unary(int op, Value a, Value* result);
+bool repl_decimal_parse(const char* text, size_t length, Value* value);
+bool repl_decimal_equal(Value a, Value b);
+void repl_decimal_format(const HeapObject* object, char* buffer, size_t size);
+
+#endif // REPL_DECIMAL_H
@@ -0,0 +1,38 @@
+#ifndef REPL_ERROR_H
+#define REPL_ERROR_H
+
+#include <setjmp.h>
+
+/* Non-local error unwinding for compiling and evaluating expressions */
+#define MAX_ERROR_LENGTH 256
+
+// GCC and Clang have a builtin setjmp that saves only the frame and stack
+// pointers and does not go through the C library's _setjmp, so it is
+// unaffected by the Windows alias in setjmp_alias.c. Other compilers use
+// the standard one.
+#if defined(__GNUC__)
+typedef void* ErrorJmpBuf[5];
+#define ERROR_SETJMP(buf)  __builtin_setjmp(buf)
+#define ERROR_LONGJMP(buf) __builtin_longjmp(buf, 1)
+#else
+typedef jmp_buf ErrorJmpBuf;
+#define ERROR_SETJMP(buf)  setjmp(buf)
+#define ERROR_LONGJMP(buf) longjmp(buf, 1)
+#endif
+
+typedef struct ErrorContext {
+    ErrorJmpBuf recover;         // Recovery point of the current evaluation
+    char message[MAX_ERROR_LENGTH];
+    int position;                // Offset of the offending token in the source, -1 if none
+    void (*cleanup)(void*);      // Releases a partial result when unwinding
+    void* cleanup_arg;
+} ErrorContext;
+
+// Set the recovery point. True when an error has unwound back to it; the
+// calling function must not have returned in between.
+#define REPL_ERROR_CAUGHT(ctx) (ERROR_SETJMP((ctx)->recover) != 0)
+
+// Error functions
+_Noreturn void repl_raise_error(ErrorContext* ctx, int position, const char* format, ...);
+
+#endif // REPL_ERROR_H
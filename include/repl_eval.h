@@ -6,6 +6,7 @@
 // Expression evaluation functions
 bool is_command(const char* input);
 bool handle_command(REPL* repl, const char* input);
-double evaluate_expression(REPL* repl, const char* expr, bool* error);
+Value evaluate_expression(REPL* repl, const char* expr, bool* error);
+void repl_collect_garbage(REPL* repl);
 
 #endif // REPL_EVAL_H
\ No newline at end of file
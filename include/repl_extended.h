@@ -0,0 +1,84 @@
+#ifndef REPL_EXTENDED_H
+#define REPL_EXTENDED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "repl_value.h"
+
+/* Extended-precision floating point for the "precision" setting */
+#define DD_DIGITS 31                     // Decimal digits a double-double always holds (106 bits)
+#define QUAD_DIGITS 33                   // Decimal digits a binary128 always holds (113 bits)
+#define EXTENDED_BUFFER_SIZE 64          // Enough for either in any format
+
+// The predefined constants, to more digits than binary128 holds
+#define PI_DIGITS "3.14159265358979323846264338327950288"
+#define E_DIGITS "2.71828182845904523536028747135266250"
+
+// GCC and Clang provide binary128 in software where the target has no
+// hardware for it
+#if defined(__SIZEOF_FLOAT128__) && !defined(REPL_NO_FLOAT128)
+#define REPL_HAVE_FLOAT128 1
+#endif
+
+// An unevaluated sum hi + lo with |lo| <= ulp(hi) / 2: 106 significant bits
+typedef struct {
+    double hi;
+    double lo;
+} DoubleDouble;
+
+typedef struct {
+    HeapObject header;
+    DoubleDouble value;
+} DoubleDoubleObject;
+
+#ifdef REPL_HAVE_FLOAT128
+typedef struct {
+    HeapObject header;
+    __float128 value;
+} QuadObject;
+#endif
+
+// Double-double arithmetic, from error-free transformations
+DoubleDouble repl_dd_add(DoubleDouble a, DoubleDouble b);
+DoubleDouble repl_dd_mul(DoubleDouble a, DoubleDouble b);
+DoubleDouble repl_dd_div(DoubleDouble a, DoubleDouble b);
+
+// The math library functions computed at extended precision
+typedef enum {
+    EXTENDED_NONE,
+    EXTENDED_ACOS,
+    EXTENDED_ASIN,
+    EXTENDED_ATAN,
+    EXTENDED_ATAN2,
+    EXTENDED_CBRT,
+    EXTENDED_CEIL,
+    EXTENDED_COS,
+    EXTENDED_COSH,
+    EXTENDED_EXP,
+    EXTENDED_FLOOR,
+    EXTENDED_HYPOT,
+    EXTENDED_LOG,
+    EXTENDED_LOG10,
+    EXTENDED_LOG2,
+    EXTENDED_ROUND,
+    EXTENDED_SIN,
+    EXTENDED_SINH,
+    EXTENDED_TAN,
+    EXTENDED_TANH,
+    EXTENDED_TRUNC
+} ExtendedFunction;
+
+// Extended functions. Operands are numbers of any type; the result is a
+// double-double or a quad, whichever is wider among the operands and the
+// precision setting.
+bool repl_precision_available(Precision precision);
+ValueStatus repl_extended_binary(int op, Value a, Value b, Value* result);
+ValueStatus repl_extended_unary(int op, Value a, Value* result);
+ValueStatus repl_extended_sqrt(Value a, Value* result);
+ValueStatus repl_extended_function(ExtendedFunction function, Value a, Value b, Value* result);
+bool repl_extended_parse(const char* text, size_t length, Value* value);
+Value repl_extended_constant(const char* digits, Precision precision);
+bool repl_extended_equal(Value a, Value b);
+void repl_extended_format(Value v, int precision, char* buffer, size_t size);
+
+#endif // REPL_EXTENDED_H
@@ -0,0 +1,39 @@
+#ifndef REPL_FUNCTIONS_H
+#define REPL_FUNCTIONS_H
+
+#include "repl_core.h"
+
+/* User-defined functions: "name(a, b) = body" */
+#define MAX_FUNCTIONS 65536      // Calls address functions by Bx
+#define MEMO_DEFAULT_CAPACITY 4096  // Results remembered per pure function
+#define MEMO_MAX_CAPACITY (1 << 20)
+
+/*
+ * Results of a pure function by argument bit patterns. The table is direct
+ * mapped: a result evicts whichever one had the same hash slot, so memory
+ * stays bounded however many distinct arguments are seen.
+ */
+typedef struct MemoTable {
+    int capacity;                // Entries, a power of two
+    int arity;
+    bool* used;
+    Value* results;
+    Value* keys;                 // Arguments of entry i start at keys[i * arity]
+} MemoTable;
+
+// Function management functions
+bool repl_parse_definition(const char* input, Function* definition, const char** error);
+void repl_define_function(REPL* repl, const Function* definition);
+void repl_recompile_functions(REPL* repl);
+int repl_find_function(REPL* repl, const char* name, int length);
+int repl_format_function(const Function* function, char* buffer, size_t size);
+void repl_list_functions(REPL* repl, char* buffer, size_t buffer_size);
+void repl_mark_functions(REPL* repl);
+void repl_free_functions(REPL* repl);
+
+// Memoization of pure functions
+bool repl_memo_lookup(Function* function, const Value* args, Value* result);
+void repl_memo_store(REPL* repl, Function* function, const Value* args, Value result);
+void repl_memo_reset(REPL* repl, int capacity);
+
+#endif // REPL_FUNCTIONS_H
@@ -0,0 +1,22 @@
+#ifndef REPL_FUSION_H
+#define REPL_FUSION_H
+
+#include <stdbool.h>
+#include "repl_core.h"
+#include "repl_value.h"
+
+/* Fused evaluation of element-wise array expressions, a block at a time */
+#define FUSION_BLOCK 512              // Elements per block: 4 KiB of doubles per operand
+#define FUSION_MAX_INSTRUCTIONS 64    // Longest run of instructions fused into one pass
+#define FUSION_MAX_BUFFERS 8          // Intermediate blocks held at once, 32 KiB in all
+
+struct CompiledExpr;
+
+// Fusion. The compiler marks the runs of a program that can be fused,
+// with registers below first_temp holding parameters and locals. The VM
+// hands a run over when its first operation meets an array; false leaves
+// it to be evaluated one instruction at a time.
+void repl_fusion_analyze(struct CompiledExpr* program, int first_temp);
+bool repl_fusion_run(REPL* repl, const struct CompiledExpr* program, int start, Value* regs);
+
+#endif // REPL_FUSION_H
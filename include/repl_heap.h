@@ -0,0 +1,28 @@
+#ifndef REPL_HEAP_H
+#define REPL_HEAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "repl_error.h"
+#include "repl_value.h"
+
+/*
+ * Heap objects referred to by values. Collection is mark and sweep, and
+ * happens between evaluations, when every live object is reachable from
+ * a variable or a cached program, and at the backward jumps of loops,
+ * when the VM's registers are roots too; the caller marks the roots.
+ */
+#define HEAP_MIN_COLLECT 1024    // Objects allocated before the first collection
+#define HEAP_MIN_COLLECT_BYTES (64u << 20)   // Bytes of arrays allocated before the first collection
+
+// Heap functions
+void repl_heap_init(ErrorContext* error);
+HeapObject* repl_heap_allocate(ValueType type, size_t size);
+bool repl_heap_should_collect(void);
+void repl_heap_mark(Value value);
+bool repl_heap_mark_registers(const Value* values, size_t count);
+size_t repl_heap_sweep(void);
+size_t repl_heap_count(void);
+void repl_heap_free_all(void);
+
+#endif // REPL_HEAP_H
@@ -0,0 +1,29 @@
+#ifndef REPL_JIT_H
+#define REPL_JIT_H
+
+#include "repl_core.h"
+#include <stddef.h>
+
+/* Native code generation for hot arithmetic expressions (x86-64 only) */
+#define JIT_HOT_THRESHOLD 4      // Executions before a program is compiled to native code
+
+// Generated code takes the variable value array (VariableStore.values),
+// indexed by slot, and sets *status to non-zero on a runtime error or when
+// a variable it reads does not hold a double. It computes in doubles.
+typedef double (*JitFunction)(const Value* values, int* status);
+
+typedef struct JitCode {
+    void* memory;                // Executable mapping holding code and constants
+    size_t size;
+    JitFunction entry;
+} JitCode;
+
+struct CompiledExpr;
+
+// Native code support
+bool repl_jit_available(void);
+JitCode* repl_jit_compile(const struct CompiledExpr* program);
+void repl_jit_free(JitCode* code);
+Value repl_jit_execute(REPL* repl, const struct CompiledExpr* program);
+
+#endif // REPL_JIT_H
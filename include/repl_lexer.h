@@ -0,0 +1,110 @@
+#ifndef REPL_LEXER_H
+#define REPL_LEXER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "repl_value.h"
+
+/* Streaming lexer: produces one token at a time on demand */
+
+typedef enum {
+    TOKEN_EOF,
+    TOKEN_NUMBER,
+    TOKEN_NAME,
+    TOKEN_PLUS,
+    TOKEN_MINUS,
+    TOKEN_STAR,
+    TOKEN_SLASH,
+    TOKEN_CARET,
+    TOKEN_PERCENT,
+    TOKEN_AMP,
+    TOKEN_PIPE,
+    TOKEN_TILDE,
+    TOKEN_SHL,
+    TOKEN_SHR,
+    TOKEN_LPAREN,
+    TOKEN_RPAREN,
+    TOKEN_COMMA,
+    TOKEN_LT,
+    TOKEN_LE,
+    TOKEN_GT,
+    TOKEN_GE,
+    TOKEN_EQ,
+    TOKEN_NE,
+    TOKEN_AND_AND,
+    TOKEN_OR_OR,
+    TOKEN_BANG,
+    TOKEN_QUESTION,
+    TOKEN_COLON,
+    TOKEN_ASSIGN,
+    TOKEN_SEMICOLON,
+    TOKEN_LBRACE,
+    TOKEN_RBRACE,
+    TOKEN_LBRACKET,
+    TOKEN_RBRACKET,
+    TOKEN_IF,            // Keywords, which are not names
+    TOKEN_ELSE,
+    TOKEN_FOR,
+    TOKEN_WHILE,
+    TOKEN_RETURN,
+    TOKEN_ERROR,         // Character that starts no token
+    TOKEN_COUNT
+} TokenType;
+
+// Tokens refer back into the source text instead of copying it
+typedef struct {
+    TokenType type;
+    const char* start;
+    int length;
+    Value number;        // Value of a TOKEN_NUMBER
+} Token;
+
+/*
+ * Character classes. The table is locale-independent ASCII, so bytes
+ * above 0x7F belong to no class.
+ */
+#define CHAR_SPACE 0x01      // ' ' and '\t' to '\r'
+#define CHAR_DIGIT 0x02      // '0' to '9'
+#define CHAR_ALPHA 0x04      // Letters and '_'
+#define CHAR_WORD  (CHAR_DIGIT | CHAR_ALPHA)
+
+extern const unsigned char repl_char_classes[256];
+#define CHAR_IS(c, classes) ((repl_char_classes[(unsigned char)(c)] & (classes)) != 0)
+
+/*
+ * Classes of a 64-byte window of the source, one bit per byte, computed 16
+ * or 32 bytes per step with SSE2 or AVX2 where the compiler targets them.
+ * Token boundaries are then found with a shift and a bit scan instead of a
+ * branch per byte.
+ */
+#define SCAN_WINDOW 64
+
+typedef struct {
+    const char* base;        // First byte of the window, NULL before the first scan
+    const char* end;         // End of the text; bytes from here on are in no class
+    uint64_t space;          // Bit i set if base[i] is CHAR_SPACE
+    uint64_t digit;
+    uint64_t alpha;
+} CharScanner;
+
+typedef struct {
+    const char* source;
+    const char* cursor;  // First character not yet consumed
+    CharScanner scanner;
+    Token current;
+} Lexer;
+
+// Lexer functions
+void repl_lexer_init(Lexer* lexer, const char* source);
+void repl_lexer_next(Lexer* lexer);
+bool repl_is_keyword(const char* name, size_t length);
+
+// Scanner functions. The scan functions return the first character from
+// p on that is not (while) or is (until) in classes, or end.
+void repl_scanner_init(CharScanner* scanner, const char* end);
+const char* repl_scan_while(CharScanner* scanner, const char* p, int classes);
+const char* repl_scan_until(CharScanner* scanner, const char* p, int classes);
+int repl_scan_width(void);   // Bytes classified per step: 32, 16 or 1
+
+#endif // REPL_LEXER_H
@@ -0,0 +1,18 @@
+#ifndef REPL_NUMBER_H
+#define REPL_NUMBER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Locale-independent conversion between decimal text and doubles */
+#define NUMBER_BUFFER_SIZE 40    // Enough for any double in any supported format
+#define FORMAT_SHORTEST 0        // Precision setting: shortest round-trip digits
+#define FORMAT_MAX_PRECISION 17  // Significant digits that always round-trip
+
+// Number functions
+bool repl_parse_number(const char* text, const char** end, double* value);
+int repl_format_shortest(double value, char* buffer);
+void repl_format_number(double value, int precision, char* buffer, size_t size);
+int repl_format_digits(char* buffer, const char* digits, int length, int k);
+
+#endif // REPL_NUMBER_H
@@ -0,0 +1,19 @@
+#ifndef REPL_RATIONAL_H
+#define REPL_RATIONAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "repl_value.h"
+
+/* Exact fractions for rational mode (see NumberMode) */
+#define RATIONAL_MAX_EXPONENT 100000     // Largest decimal exponent a literal is read exactly with
+
+// Rational functions. Operands are rationals or integers of any type;
+// results with a denominator of 1 are returned as integers.
+ValueStatus repl_rational_binary(int op, Value a, Value b, Value* result);
+ValueStatus repl_rational_unary(int op, Value a, Value* result);
+bool repl_rational_parse(const char* text, size_t length, Value* value);
+bool repl_rational_equal(Value a, Value b);
+void repl_rational_format(const HeapObject* object, char* buffer, size_t size);
+
+#endif // REPL_RATIONAL_H
@@ -0,0 +1,258 @@
+#ifndef REPL_VALUE_H
+#define REPL_VALUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Typed values with C arithmetic: double, int64, uint64 and bool, and the wider numbers of the number modes and precisions */
+
+typedef enum {
+    VALUE_FLOAT,                 // double
+    VALUE_INT,                   // int64_t
+    VALUE_UINT,                  // uint64_t
+    VALUE_BOOL,
+    VALUE_UNDEFINED,             // Contents of a variable slot with no value
+    VALUE_BIGINT,                // Arbitrary-precision integer, always on the heap
+    VALUE_RATIONAL,              // Exact fraction, always on the heap
+    VALUE_DD,                    // Double-double, always on the heap
+    VALUE_QUAD,                  // IEEE binary128, always on the heap
+    VALUE_DECIMAL,               // 128-bit fixed-point decimal, always on the heap
+    VALUE_COMPLEX,               // Pair of doubles, always on the heap
+    VALUE_ARRAY                  // Doubles in contiguous storage, always on the heap
+} ValueType;
+
+/*
+ * A value is NaN-boxed into 8 bytes. A double is stored as its own bits.
+ * Bit patterns from 0xFFF9 << 48 up are negative quiet NaNs that no
+ * arithmetic produces; those carry a tag in bits 48-50 and a 48-bit
+ * payload. Inline tags are the ValueType of the payload: integers that
+ * fit in 48 bits, a bool or the undefined marker. VALUE_TAG_OBJECT holds
+ * a pointer to a heap object (see repl_heap.h), which is how integers
+ * too wide for the payload are stored.
+ */
+typedef struct {
+    uint64_t bits;
+} Value;
+
+#define VALUE_TAG_OBJECT 5
+#define VALUE_BOXED      0xFFF9000000000000ULL   // Lowest tagged bit pattern
+#define VALUE_PAYLOAD    0x0000FFFFFFFFFFFFULL
+#define VALUE_TAGGED(tag, payload) (0xFFF8000000000000ULL | ((uint64_t)(tag) << 48) | (payload))
+
+// Header shared by every heap object; a tagged pointer points at it
+typedef struct HeapObject {
+    struct HeapObject* next;     // All objects, for sweeping
+    ValueType type;              // Type the object holds
+    bool marked;
+} HeapObject;
+
+// An int64 or uint64 too wide for an inline payload
+typedef struct {
+    HeapObject header;
+    uint64_t bits;
+} IntObject;
+
+// An integer outside the int64 range, in bigint mode: a sign and the
+// magnitude in 32-bit limbs, least significant first, with no leading zeros
+typedef struct {
+    HeapObject header;
+    bool negative;
+    uint32_t length;
+    uint32_t limbs[];
+} BigIntObject;
+
+// A fraction in rational mode, in lowest terms: the numerator carries the
+// sign and the denominator is at least 2. Both are int64 or bigint values.
+typedef struct {
+    HeapObject header;
+    Value numerator;
+    Value denominator;
+} RationalObject;
+
+// Outcome of an operation on values
+typedef enum {
+    VALUE_OK,
+    VALUE_DIVISION_BY_ZERO,
+    VALUE_INVALID_OPERANDS,      // e.g. '&' on a double
+    VALUE_TOO_LARGE,             // A result beyond BIGINT_MAX_LIMBS, a decimal or memory
+    VALUE_LENGTH_MISMATCH        // Element-wise operands of different lengths
+} ValueStatus;
+
+/*
+ * How integers behave (the "mode" command). In NUMBER_MODE_INT64 they
+ * wrap as in C; in NUMBER_MODE_BIGINT an int64 result that would wrap
+ * becomes a bigint instead. NUMBER_MODE_RATIONAL also widens, and makes
+ * integer division and decimal literals exact fractions. NUMBER_MODE_DECIMAL
+ * makes them fixed-point decimals, and widens int64 arithmetic to them
+ * rather than to bigints. Value operations have no REPL at hand, so the
+ * mode is process-wide, like the heap.
+ */
+typedef enum {
+    NUMBER_MODE_INT64,
+    NUMBER_MODE_BIGINT,
+    NUMBER_MODE_RATIONAL,
+    NUMBER_MODE_DECIMAL
+} NumberMode;
+
+/*
+ * Precision of floating-point arithmetic (the "precision" command). In
+ * PRECISION_DD and PRECISION_QUAD, decimal literals and every operation
+ * that would give a double give a double-double or binary128 instead.
+ * Process-wide like NumberMode.
+ */
+typedef enum {
+    PRECISION_DOUBLE,
+    PRECISION_DD,
+    PRECISION_QUAD
+} Precision;
+
+// Heap boxing of wide integers, in repl_heap.c
+Value repl_box_integer(ValueType type, uint64_t bits);
+
+// Conversion of heap numbers, in repl_bigint.c, repl_rational.c,
+// repl_extended.c, repl_decimal.c, repl_complex.c and repl_array.c
+double repl_bigint_to_double(const HeapObject* object);
+double repl_rational_to_double(const HeapObject* object);
+double repl_extended_to_double(const HeapObject* object);
+bool repl_extended_is_zero(const HeapObject* object);
+double repl_decimal_to_double(const HeapObject* object);
+bool repl_decimal_is_zero(const HeapObject* object);
+double repl_complex_to_double(const HeapObject* object);
+bool repl_complex_is_zero(const HeapObject* object);
+double repl_array_to_double(const HeapObject* object);
+bool repl_array_is_empty(const HeapObject* object);
+
+static inline bool value_is_float(Value v) {
+    return v.bits < VALUE_BOXED;
+}
+
+static inline unsigned int value_tag(Value v) {
+    return (unsigned int)(v.bits >> 48) & 7;
+}
+
+static inline HeapObject* value_object(Value v) {
+    return (HeapObject*)(uintptr_t)(v.bits & VALUE_PAYLOAD);
+}
+
+static inline bool value_is_object(Value v) {
+    return !value_is_float(v) && value_tag(v) == VALUE_TAG_OBJECT;
+}
+
+// An int64 held inline, the common case the VM tests for first
+static inline bool value_is_small_int(Value v) {
+    return (v.bits >> 48) == (VALUE_TAGGED(VALUE_INT, 0) >> 48);
+}
+
+static inline int64_t value_small_int(Value v) {
+    return (int64_t)(v.bits << 16) >> 16;
+}
+
+static inline ValueType value_type(Value v) {
+    if (value_is_float(v)) return VALUE_FLOAT;
+    unsigned int tag = value_tag(v);
+    return tag == VALUE_TAG_OBJECT ? value_object(v)->type : (ValueType)tag;
+}
+
+static inline double value_as_float(Value v) {
+    double f;
+    memcpy(&f, &v.bits, sizeof(f));
+    return f;
+}
+
+static inline bool value_is_bigint(Value v) {
+    return value_is_object(v) && value_object(v)->type == VALUE_BIGINT;
+}
+
+// Integer bits of an int64, uint64 or bool value
+static inline uint64_t value_as_bits(Value v) {
+    switch (value_tag(v)) {
+        case VALUE_INT:        return (uint64_t)value_small_int(v);
+        case VALUE_TAG_OBJECT: return ((const IntObject*)value_object(v))->bits;
+        default:               return v.bits & VALUE_PAYLOAD;
+    }
+}
+
+// NaNs that would read as tagged are replaced by the default NaN, whose
+// sign and payload are the same
+static inline Value value_float(double f) {
+    Value v;
+    memcpy(&v.bits, &f, sizeof(f));
+    if (v.bits >= VALUE_BOXED) v.bits = 0xFFF8000000000000ULL;
+    return v;
+}
+
+static inline Value value_int(int64_t i) {
+    Value v;
+    v.bits = VALUE_TAGGED(VALUE_INT, (uint64_t)i & VALUE_PAYLOAD);
+    if (value_small_int(v) != i) return repl_box_integer(VALUE_INT, (uint64_t)i);
+    return v;
+}
+
+static inline Value value_uint(uint64_t u) {
+    Value v;
+    if (u > VALUE_PAYLOAD) return repl_box_integer(VALUE_UINT, u);
+    v.bits = VALUE_TAGGED(VALUE_UINT, u);
+    return v;
+}
+
+static inline Value value_bool(bool b) {
+    Value v;
+    v.bits = VALUE_TAGGED(VALUE_BOOL, b ? 1 : 0);
+    return v;
+}
+
+static inline Value value_undefined(void) {
+    Value v;
+    v.bits = VALUE_TAGGED(VALUE_UNDEFINED, 0);
+    return v;
+}
+
+static inline bool value_is_undefined(Value v) {
+    return v.bits == VALUE_TAGGED(VALUE_UNDEFINED, 0);
+}
+
+// C's truth test: non-zero, so -0.0 is false and NaN is true. Bigints
+// and rationals are never zero, and an array is true unless it is empty.
+static inline bool value_is_true(Value v) {
+    if (value_is_float(v)) return value_as_float(v) != 0.0;
+    ValueType type = value_type(v);
+    if (type == VALUE_BIGINT || type == VALUE_RATIONAL) return true;
+    if (type == VALUE_DD || type == VALUE_QUAD) return !repl_extended_is_zero(value_object(v));
+    if (type == VALUE_DECIMAL) return !repl_decimal_is_zero(value_object(v));
+    if (type == VALUE_COMPLEX) return !repl_complex_is_zero(value_object(v));
+    if (type == VALUE_ARRAY) return !repl_array_is_empty(value_object(v));
+    return value_as_bits(v) != 0;
+}
+
+// Conversion to double as C does it for mixed arithmetic; a complex
+// number gives its real part, and an array, which is no one number, NaN
+static inline double value_to_double(Value v) {
+    switch (value_type(v)) {
+        case VALUE_FLOAT:    return value_as_float(v);
+        case VALUE_INT:      return (double)(int64_t)value_as_bits(v);
+        case VALUE_BIGINT:   return repl_bigint_to_double(value_object(v));
+        case VALUE_RATIONAL: return repl_rational_to_double(value_object(v));
+        case VALUE_DD:
+        case VALUE_QUAD:     return repl_extended_to_double(value_object(v));
+        case VALUE_DECIMAL:  return repl_decimal_to_double(value_object(v));
+        case VALUE_COMPLEX:  return repl_complex_to_double(value_object(v));
+        case VALUE_ARRAY:    return repl_array_to_double(value_object(v));
+        default:             return (double)value_as_bits(v);
+    }
+}
+
+// Value functions. op is an OpCode from repl_vm.h.
+NumberMode repl_number_mode(void);
+void repl_set_number_mode(NumberMode mode);
+Precision repl_precision(void);
+void repl_set_precision(Precision precision);
+bool repl_int64_overflows(int op, int64_t x, int64_t y);
+ValueStatus repl_value_binary(int op, Value a, Value b, Value* result);
+ValueStatus repl_value_unary(int op, Value a, Value* result);
+bool repl_value_identical(Value a, Value b);
+const char* repl_value_type_name(Value v);
+void repl_format_value(Value v, int precision, char* buffer, size_t size);
+
+#endif // REPL_VALUE_H
@@ -4,9 +4,14 @@
 #include "repl_core.h"
 
 // Variable management functions
-void repl_set_variable(REPL* repl, const char* name, double value);
-double repl_get_variable(REPL* repl, const char* name, bool* found);
+void repl_set_variable(REPL* repl, const char* name, Value value);
+Value repl_get_variable(REPL* repl, const char* name, bool* found);
 bool repl_is_variable(REPL* repl, const char* name);
+int repl_resolve_variable(REPL* repl, const char* name);
 void repl_list_variables(REPL* repl, char* buffer, size_t buffer_size);
+void repl_clear_variables(REPL* repl);
+void repl_define_constants(REPL* repl);
+void repl_update_constants(REPL* repl, Precision old);
+void repl_free_variables(REPL* repl);
 
 #endif // REPL_VARIABLES_H
\ No newline at end of file
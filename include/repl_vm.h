@@ -0,0 +1,103 @@
+#ifndef REPL_VM_H
+#define REPL_VM_H
+
+#include "repl_core.h"
+#include <stdint.h>
+
+/* Register-based virtual machine for compiled expressions */
+#define VM_MAX_REGISTERS 256     // Registers are addressed by an 8-bit operand
+#define VM_MAX_CONSTANTS 65536   // Constant and name pools are addressed by Bx
+#define VM_MAX_CODE 65536        // Jump targets are addressed by Bx
+#define VM_STACK_SIZE (1 << 17)  // Registers shared by all active calls
+#define VM_MAX_CALL_DEPTH 10000  // Nested function calls before a stack overflow error
+#define VM_POLL_INTERVAL 65536   // Backward jumps and tail calls between checks for an interrupt
+
+/*
+ * Instructions are 32 bits wide: an 8-bit opcode followed by three 8-bit
+ * operands A, B and C, or by A and a 16-bit operand Bx in place of B and C.
+ *
+ *   | C (8) | B (8) | A (8) | op (8) |
+ *   |    Bx (16)    | A (8) | op (8) |
+ */
+typedef uint32_t Instr;
+
+#define INSTR_OP(i)  ((int)((i) & 0xFF))
+#define INSTR_A(i)   ((int)(((i) >> 8) & 0xFF))
+#define INSTR_B(i)   ((int)(((i) >> 16) & 0xFF))
+#define INSTR_C(i)   ((int)(((i) >> 24) & 0xFF))
+#define INSTR_BX(i)  ((int)(((i) >> 16) & 0xFFFF))
+
+#define MAKE_ABC(op, a, b, c) \
+    ((Instr)(op) | ((Instr)(a) << 8) | ((Instr)(b) << 16) | ((Instr)(c) << 24))
+#define MAKE_ABX(op, a, bx) \
+    ((Instr)(op) | ((Instr)(a) << 8) | ((Instr)(bx) << 16))
+
+// Opcodes. R[x] is register x, K[x] is constant x.
+typedef enum {
+    OP_LOADK,    // A Bx   R[A] = K[Bx]
+    OP_LOADV,    // A Bx   R[A] = value of variable slots[Bx]
+    OP_MOVE,     // A B    R[A] = R[B]
+    OP_NEG,      // A B    R[A] = -R[B]
+    OP_ADD,      // A B C  R[A] = R[B] + R[C]
+    OP_SUB,      // A B C  R[A] = R[B] - R[C]
+    OP_MUL,      // A B C  R[A] = R[B] * R[C]
+    OP_DIV,      // A B C  R[A] = R[B] / R[C]
+    OP_POW,      // A B C  R[A] = R[B] ^ R[C]
+    OP_MOD,      // A B C  R[A] = R[B] % R[C]
+    OP_BAND,     // A B C  R[A] = R[B] & R[C]
+    OP_BOR,      // A B C  R[A] = R[B] | R[C]
+    OP_BXOR,     // A B C  R[A] = R[B] ~ R[C] (exclusive or)
+    OP_SHL,      // A B C  R[A] = R[B] << R[C]
+    OP_SHR,      // A B C  R[A] = R[B] >> R[C]
+    OP_BNOT,     // A B    R[A] = ~R[B]
+    OP_NOT,      // A B    R[A] = !R[B], a bool
+    OP_BOOL,     // A B    R[A] = R[B] != 0, a bool
+    OP_ADDK,     // A B C  R[A] = R[B] + K[C]
+    OP_SUBK,     // A B C  R[A] = R[B] - K[C]
+    OP_MULK,     // A B C  R[A] = R[B] * K[C]
+    OP_DIVK,     // A B C  R[A] = R[B] / K[C]
+    OP_POWK,     // A B C  R[A] = R[B] ^ K[C]
+    OP_RSUBK,    // A B C  R[A] = K[C] - R[B]
+    OP_RDIVK,    // A B C  R[A] = K[C] / R[B]
+    OP_LT,       // A B C  R[A] = R[B] < R[C]
+    OP_LE,       // A B C  R[A] = R[B] <= R[C]
+    OP_EQ,       // A B C  R[A] = R[B] == R[C]
+    OP_NE,       // A B C  R[A] = R[B] != R[C]
+    OP_STOREV,   // A Bx   variable slots[Bx] = R[A]
+    OP_JMP,      // Bx     jump to instruction Bx
+    OP_JMPF,     // A Bx   jump to instruction Bx if R[A] is zero
+    OP_JMPT,     // A Bx   jump to instruction Bx if R[A] is not zero
+    OP_CALL,     // A Bx   R[A] = function Bx called with R[A] .. R[A + arity - 1]
+    OP_TAILCALL, // A Bx   restart the running function Bx with R[A] .. R[A + arity - 1]
+    OP_BUILTIN,  // A B    R[A] = built-in B called with R[A] .. R[A + arity - 1]
+    OP_ARRAY,    // A B    R[A] = array of the B values R[A] .. R[A + B - 1]
+    OP_RET,      // A      return R[A]
+    OP_COUNT
+} OpCode;
+
+struct CompiledExpr;
+
+// A function call in progress: where the caller resumes
+typedef struct {
+    const struct CompiledExpr* program;
+    const Instr* pc;             // Instruction after the OP_CALL
+    Value* regs;                 // Caller's register window
+    Function* memoize;           // Pure function whose result to remember, or NULL
+} CallFrame;
+
+/*
+ * Registers and call frames for the VM. A callee's register window starts
+ * at the caller's argument registers, so arguments are passed in place and
+ * the result is returned into the first of them.
+ */
+typedef struct VMStack {
+    Value registers[VM_STACK_SIZE];
+    CallFrame frames[VM_MAX_CALL_DEPTH];
+} VMStack;
+
+// Run a compiled program and return its result. Runtime errors unwind
+// through repl->error.
+Value repl_vm_execute(REPL* repl, const struct CompiledExpr* program);
+void repl_vm_free_stack(REPL* repl);
+
+#endif // REPL_VM_H
@@ -0,0 +1,361 @@
+#include "../include/repl_array.h"
+#include "../include/repl_heap.h"
+#include "../include/repl_vm.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__AVX__)
+#define ARRAY_AVX 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define ARRAY_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/*
+ * Element-wise + - * / run as one pass of vector instructions over the
+ * operands' storage: four doubles per instruction with AVX (which every
+ * AVX2 CPU has), two with SSE2, or one at a time on other targets. Every
+ * array starts on an ARRAY_ALIGNMENT boundary, so the loads and stores are
+ * aligned ones. A scalar operand is broadcast to every element. Division
+ * follows IEEE arithmetic element by element, so x / 0 is an infinity or
+ * NaN rather than an error that would lose the rest of the array. ^ and
+ * the built-in functions call the C library for each element.
+ */
+
+#if defined(ARRAY_AVX)
+typedef __m256d Vector;
+#define VECTOR_WIDTH 4
+#define vector_load   _mm256_load_pd
+#define vector_store  _mm256_store_pd
+#define vector_set1   _mm256_set1_pd
+#define vector_add    _mm256_add_pd
+#define vector_sub    _mm256_sub_pd
+#define vector_mul    _mm256_mul_pd
+#define vector_div    _mm256_div_pd
+#elif defined(ARRAY_SSE2)
+typedef __m128d Vector;
+#define VECTOR_WIDTH 2
+#define vector_load   _mm_load_pd
+#define vector_store  _mm_store_pd
+#define vector_set1   _mm_set1_pd
+#define vector_add    _mm_add_pd
+#define vector_sub    _mm_sub_pd
+#define vector_mul    _mm_mul_pd
+#define vector_div    _mm_div_pd
+#else
+typedef double Vector;
+#define VECTOR_WIDTH 1
+static inline Vector vector_load(const double* p) { return *p; }
+static inline void vector_store(double* p, Vector v) { *p = v; }
+static inline Vector vector_set1(double x) { return x; }
+static inline Vector vector_add(Vector x, Vector y) { return x + y; }
+static inline Vector vector_sub(Vector x, Vector y) { return x - y; }
+static inline Vector vector_mul(Vector x, Vector y) { return x * y; }
+static inline Vector vector_div(Vector x, Vector y) { return x / y; }
+#endif
+
+typedef void (*Kernel)(double* out, const double* x, const double* y, size_t n, ArrayBroadcast shape);
+
+// out[i] = x[i] op y[i] for n elements, vectors first and then the
+// remainder one at a time
+#define DEFINE_KERNEL(name, vector_op, operator)                                                   \
+static void name(double* out, const double* x, const double* y, size_t n, ArrayBroadcast shape) {  \
+    size_t i = 0;                                                                                  \
+    if (shape == ARRAY_SCALAR_LEFT) {                                                              \
+        Vector left = vector_set1(*x);                                                             \
+        for (; i + VECTOR_WIDTH <= n; i += VECTOR_WIDTH) {                                         \
+            vector_store(out + i, vector_op(left, vector_load(y + i)));                            \
+        }                                                                                          \
+        for (; i < n; i++) out[i] = *x operator y[i];                                              \
+    } else if (shape == ARRAY_SCALAR_RIGHT) {                                                      \
+        Vector right = vector_set1(*y);                                                            \
+        for (; i + VECTOR_WIDTH <= n; i += VECTOR_WIDTH) {                                         \
+            vector_store(out + i, vector_op(vector_load(x + i), right));                           \
+        }                                                                                          \
+        for (; i < n; i++) out[i] = x[i] operator *y;                                              \
+    } else {                                                                                       \
+        for (; i + VECTOR_WIDTH <= n; i += VECTOR_WIDTH) {                                         \
+            vector_store(out + i, vector_op(vector_load(x + i), vector_load(y + i)));              \
+        }                                                                                          \
+        for (; i < n; i++) out[i] = x[i] operator y[i];                                            \
+    }                                                                                              \
+}
+
+DEFINE_KERNEL(kernel_add, vector_add, +)
+DEFINE_KERNEL(kernel_sub, vector_sub, -)
+DEFINE_KERNEL(kernel_mul, vector_mul, *)
+DEFINE_KERNEL(kernel_div, vector_div, /)
+
+// Running out of memory, or more than ARRAY_MAX_LENGTH elements, is
+// reported as VALUE_TOO_LARGE, as for bigints. The elements are left for
+// the caller to fill.
+ValueStatus repl_array_make(size_t length, double** elements, Value* result) {
+    if (length > ARRAY_MAX_LENGTH) return VALUE_TOO_LARGE;
+    ArrayObject* array = (ArrayObject*)repl_heap_allocate(VALUE_ARRAY, ARRAY_OBJECT_SIZE(length));
+    if (!array) return VALUE_TOO_LARGE;
+    uintptr_t start = ((uintptr_t)(array + 1) + ARRAY_ALIGNMENT - 1) & ~(uintptr_t)(ARRAY_ALIGNMENT - 1);
+    array->length = length;
+    array->elements = (double*)start;
+    *elements = array->elements;
+    result->bits = VALUE_TAGGED(VALUE_TAG_OBJECT, (uint64_t)(uintptr_t)array);
+    return VALUE_OK;
+}
+
+// A scalar operand as a double, or false if v is not a real number
+static bool real_operand(Value v, double* x) {
+    ValueType type = value_type(v);
+    if (type == VALUE_UNDEFINED || type == VALUE_COMPLEX || type == VALUE_ARRAY) return false;
+    *x = value_to_double(v);
+    return true;
+}
+
+// The elements of an array literal, each a real number
+ValueStatus repl_array_from_values(const Value* values, int count, Value* result) {
+    double x;
+    for (int i = 0; i < count; i++) {
+        if (!real_operand(values[i], &x)) return VALUE_INVALID_OPERANDS;
+    }
+    double* elements;
+    ValueStatus status = repl_array_make((size_t)count, &elements, result);
+    if (status != VALUE_OK) return status;
+    for (int i = 0; i < count; i++) real_operand(values[i], &elements[i]);
+    return VALUE_OK;
+}
+
+// start, start + 1, ... up to but not including stop, as Python's range
+ValueStatus repl_array_range(Value start, Value stop, Value* result) {
+    double first, end;
+    if (!real_operand(start, &first) || !real_operand(stop, &end) || isnan(first) || isnan(end)) {
+        return VALUE_INVALID_OPERANDS;
+    }
+    double span = end - first;
+    if (span > ARRAY_MAX_LENGTH) return VALUE_TOO_LARGE;
+
+    double* elements;
+    size_t length = span > 0.0 ? (size_t)ceil(span) : 0;
+    ValueStatus status = repl_array_make(length, &elements, result);
+    if (status != VALUE_OK) return status;
+    for (size_t i = 0; i < length; i++) elements[i] = first + (double)i;
+    return VALUE_OK;
+}
+
+// count evenly spaced numbers from start to stop, both included. The last
+// is stop itself, whatever rounding the steps add up to.
+ValueStatus repl_array_linspace(Value start, Value stop, Value count, Value* result) {
+    double first, last, n;
+    if (!real_operand(start, &first) || !real_operand(stop, &last) || !real_operand(count, &n) ||
+        n < 0.0 || n != floor(n)) {
+        return VALUE_INVALID_OPERANDS;
+    }
+    if (n > ARRAY_MAX_LENGTH) return VALUE_TOO_LARGE;
+
+    double* elements;
+    size_t length = (size_t)n;
+    ValueStatus status = repl_array_make(length, &elements, result);
+    if (status != VALUE_OK) return status;
+    if (length == 0) return VALUE_OK;
+
+    double step = length > 1 ? (last - first) / (double)(length - 1) : 0.0;
+    for (size_t i = 0; i < length; i++) elements[i] = first + (double)i * step;
+    if (length > 1) elements[length - 1] = last;
+    return VALUE_OK;
+}
+
+// The operands of an element-wise operation, at least one an array. A
+// scalar is held in x_scalar or y_scalar, which x or y then points at.
+typedef struct {
+    const double* x;
+    const double* y;
+    double x_scalar;
+    double y_scalar;
+    size_t length;
+    ArrayBroadcast shape;
+} Operands;
+
+static ValueStatus broadcast(Value a, Value b, Operands* operands) {
+    bool a_array = value_type(a) == VALUE_ARRAY;
+    bool b_array = value_type(b) == VALUE_ARRAY;
+    if (a_array) {
+        operands->x = value_array(a)->elements;
+        operands->length = value_array(a)->length;
+    } else if (real_operand(a, &operands->x_scalar)) {
+        operands->x = &operands->x_scalar;
+    } else {
+        return VALUE_INVALID_OPERANDS;
+    }
+    if (b_array) {
+        operands->y = value_array(b)->elements;
+        operands->length = value_array(b)->length;
+    } else if (real_operand(b, &operands->y_scalar)) {
+        operands->y = &operands->y_scalar;
+    } else {
+        return VALUE_INVALID_OPERANDS;
+    }
+
+    if (a_array && b_array) {
+        if (value_array(a)->length != value_array(b)->length) return VALUE_LENGTH_MISMATCH;
+        operands->shape = ARRAY_EACH_ELEMENT;
+    } else {
+        operands->shape = a_array ? ARRAY_SCALAR_RIGHT : ARRAY_SCALAR_LEFT;
+    }
+    return VALUE_OK;
+}
+
+ValueStatus repl_array_binary(int op, Value a, Value b, Value* result) {
+    Kernel kernel;
+    switch (op) {
+        case OP_ADD: kernel = kernel_add; break;
+        case OP_SUB: kernel = kernel_sub; break;
+        case OP_MUL: kernel = kernel_mul; break;
+        case OP_DIV: kernel = kernel_div; break;
+        case OP_POW: return repl_array_map2(pow, a, b, result);
+        default:
+            // Arrays have no order, remainder or bits, and are compared
+            // with neither == nor !=, which would not give one bool
+            return VALUE_INVALID_OPERANDS;
+    }
+
+    Operands operands;
+    ValueStatus status = broadcast(a, b, &operands);
+    if (status != VALUE_OK) return status;
+    double* elements;
+    status = repl_array_make(operands.length, &elements, result);
+    if (status != VALUE_OK) return status;
+    kernel(elements, operands.x, operands.y, operands.length, operands.shape);
+    return VALUE_OK;
+}
+
+// One operator over n elements, for fused evaluation (see repl_fusion.c),
+// which calls it a block at a time. y is unused by negation.
+void repl_array_apply(int op, double* out, const double* x, const double* y, size_t n,
+                      ArrayBroadcast shape) {
+    size_t x_step = shape == ARRAY_SCALAR_LEFT ? 0 : 1;
+    size_t y_step = shape == ARRAY_SCALAR_RIGHT ? 0 : 1;
+    switch (op) {
+        case OP_ADD: kernel_add(out, x, y, n, shape); break;
+        case OP_SUB: kernel_sub(out, x, y, n, shape); break;
+        case OP_MUL: kernel_mul(out, x, y, n, shape); break;
+        case OP_DIV: kernel_div(out, x, y, n, shape); break;
+        case OP_POW:
+            for (size_t i = 0; i < n; i++) out[i] = pow(x[i * x_step], y[i * y_step]);
+            break;
+        case OP_NEG:
+            for (size_t i = 0; i < n; i++) out[i] = -x[i];
+            break;
+        default:
+            break;
+    }
+}
+
+ValueStatus repl_array_unary(int op, Value a, Value* result) {
+    if (op != OP_NEG || value_type(a) != VALUE_ARRAY) return VALUE_INVALID_OPERANDS;
+    const ArrayObject* array = value_array(a);
+    double* elements;
+    ValueStatus status = repl_array_make(array->length, &elements, result);
+    if (status != VALUE_OK) return status;
+    for (size_t i = 0; i < array->length; i++) elements[i] = -array->elements[i];
+    return VALUE_OK;
+}
+
+// function applied to each element of an array
+ValueStatus repl_array_map(double (*function)(double), Value a, Value* result) {
+    if (value_type(a) != VALUE_ARRAY) return VALUE_INVALID_OPERANDS;
+    const ArrayObject* array = value_array(a);
+    double* elements;
+    ValueStatus status = repl_array_make(array->length, &elements, result);
+    if (status != VALUE_OK) return status;
+    for (size_t i = 0; i < array->length; i++) elements[i] = function(array->elements[i]);
+    return VALUE_OK;
+}
+
+// function applied element-wise to two operands, at least one an array,
+// with a scalar broadcast as for the operators
+ValueStatus repl_array_map2(double (*function)(double, double), Value a, Value b, Value* result) {
+    Operands operands;
+    ValueStatus status = broadcast(a, b, &operands);
+    if (status != VALUE_OK) return status;
+    double* elements;
+    status = repl_array_make(operands.length, &elements, result);
+    if (status != VALUE_OK) return status;
+
+    size_t x_step = operands.shape == ARRAY_SCALAR_LEFT ? 0 : 1;
+    size_t y_step = operands.shape == ARRAY_SCALAR_RIGHT ? 0 : 1;
+    for (size_t i = 0; i < operands.length; i++) {
+        elements[i] = function(operands.x[i * x_step], operands.y[i * y_step]);
+    }
+    return VALUE_OK;
+}
+
+// The sum of the elements, kept as VECTOR_WIDTH interleaved partial sums
+// that are added at the end; an empty array sums to 0.0
+ValueStatus repl_array_sum(Value a, Value* result) {
+    if (value_type(a) != VALUE_ARRAY) return VALUE_INVALID_OPERANDS;
+    const ArrayObject* array = value_array(a);
+    const double* x = array->elements;
+    size_t i = 0;
+
+    Vector partial = vector_set1(0.0);
+    for (; i + VECTOR_WIDTH <= array->length; i += VECTOR_WIDTH) {
+        partial = vector_add(partial, vector_load(x + i));
+    }
+    _Alignas(ARRAY_ALIGNMENT) double lanes[VECTOR_WIDTH];
+    vector_store(lanes, partial);
+
+    double total = 0.0;
+    for (int lane = 0; lane < VECTOR_WIDTH; lane++) total += lanes[lane];
+    for (; i < array->length; i++) total += x[i];
+    *result = value_float(total);
+    return VALUE_OK;
+}
+
+ValueStatus repl_array_length(Value a, Value* result) {
+    if (value_type(a) != VALUE_ARRAY) return VALUE_INVALID_OPERANDS;
+    *result = value_int((int64_t)value_array(a)->length);
+    return VALUE_OK;
+}
+
+// Same length and the same bits in every element
+bool repl_array_equal(Value a, Value b) {
+    const ArrayObject* x = value_array(a);
+    const ArrayObject* y = value_array(b);
+    return x->length == y->length &&
+           memcmp(x->elements, y->elements, x->length * sizeof(double)) == 0;
+}
+
+double repl_array_to_double(const HeapObject* object) {
+    (void)object;
+    return NAN;
+}
+
+bool repl_array_is_empty(const HeapObject* object) {
+    return ((const ArrayObject*)object)->length == 0;
+}
+
+// "[1.0, 2.0, 3.0]", each element as a double is printed. A long array
+// shows ARRAY_PRINT_EDGE elements at each end and its length.
+void repl_array_format(const HeapObject* object, int precision, char* buffer, size_t size) {
+    const ArrayObject* array = (const ArrayObject*)object;
+    bool elide = array->length > 2 * ARRAY_PRINT_EDGE + 1;
+    size_t written = (size_t)snprintf(buffer, size, "[");
+
+    for (size_t i = 0; i < array->length && written < size; i++) {
+        if (elide && i == ARRAY_PRINT_EDGE) {
+            written += (size_t)snprintf(buffer + written, size - written, "..., ");
+            i = array->length - ARRAY_PRINT_EDGE;
+            if (written >= size) break;
+        }
+        char number[NUMBER_BUFFER_SIZE + 2];
+        repl_format_value(value_float(array->elements[i]), precision, number, sizeof(number));
+        written += (size_t)snprintf(buffer + written, size - written, "%s%s", number,
+                                    i + 1 < array->length ? ", " : "");
+    }
+    if (written >= size) return;
+    if (elide) {
+        snprintf(buffer + written, size - written, "] (%zu elements)", array->length);
+    } else {
+        snprintf(buffer + written, size - written, "]");
+    }
+}
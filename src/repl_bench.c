@@ -0,0 +1,279 @@
+#include "../include/repl_bench.h"
+#include "../include/repl_lexer.h"
+#include "../include/repl_extended.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define BENCH_CYCLES 1
+#endif
+
+// Elapsed time and, on x86, time-stamp counter ticks of one run
+typedef struct {
+    double seconds;
+    unsigned long long cycles;
+} BenchTime;
+
+typedef struct {
+    clock_t start_clock;
+    unsigned long long start_cycles;
+} BenchTimer;
+
+static volatile size_t bench_sink;   // Keeps measured loops from being optimized away
+
+static void timer_start(BenchTimer* timer) {
+    timer->start_clock = clock();
+#ifdef BENCH_CYCLES
+    timer->start_cycles = __rdtsc();
+#else
+    timer->start_cycles = 0;
+#endif
+}
+
+static BenchTime timer_stop(const BenchTimer* timer) {
+    BenchTime elapsed;
+#ifdef BENCH_CYCLES
+    elapsed.cycles = __rdtsc() - timer->start_cycles;
+#else
+    elapsed.cycles = 0;
+#endif
+    elapsed.seconds = (double)(clock() - timer->start_clock) / CLOCKS_PER_SEC;
+    return elapsed;
+}
+
+static void keep_fastest(BenchTime* best, BenchTime run) {
+    if (best->seconds == 0.0 || run.seconds < best->seconds) best->seconds = run.seconds;
+    if (best->cycles == 0 || run.cycles < best->cycles) best->cycles = run.cycles;
+}
+
+/*
+ * A generated script of the kind fed to the REPL in bulk: indented lines
+ * of names, integer, hex and decimal literals and operators, separated by
+ * whitespace runs of varying length. A fixed seed keeps runs comparable.
+ */
+static void generate_script(char* script, size_t size) {
+    static const char* const operators[] = { " + ", " - ", " * ", " / ", " % ", " & ", " | ", " << ", "^" };
+    unsigned int seed = 12345;
+    size_t length = 0;
+
+    while (length + 128 < size) {
+        char line[128];
+        int n = 0;
+        int indent = (int)(seed >> 28);
+        n += snprintf(line + n, sizeof(line) - n, "%*s", 4 * indent, "");
+
+        for (int term = 0; term < 4; term++) {
+            seed = seed * 1103515245u + 12345u;
+            switch ((seed >> 16) % 4) {
+                case 0: n += snprintf(line + n, sizeof(line) - n, "value_%u", (seed >> 8) % 1000); break;
+                case 1: n += snprintf(line + n, sizeof(line) - n, "%u", seed >> 12); break;
+                case 2: n += snprintf(line + n, sizeof(line) - n, "0x%X", seed >> 20); break;
+                default: n += snprintf(line + n, sizeof(line) - n, "%u.%03u", (seed >> 20) % 100, seed % 1000); break;
+            }
+            if (term < 3) {
+                n += snprintf(line + n, sizeof(line) - n, "%s", operators[(seed >> 4) % 9]);
+            }
+        }
+        line[n++] = '\n';
+        memcpy(script + length, line, (size_t)n);
+        length += (size_t)n;
+    }
+    script[length] = '\0';
+}
+
+// The whole lexer: every token of the script
+static size_t run_lexer(const char* script) {
+    Lexer lexer;
+    size_t tokens = 0;
+    for (repl_lexer_init(&lexer, script); lexer.current.type != TOKEN_EOF; repl_lexer_next(&lexer)) {
+        tokens++;
+    }
+    return tokens;
+}
+
+// Token boundaries only, with the character scanner: alternate word and
+// whitespace runs, stepping over single punctuation characters
+static size_t run_scanner(const char* script, const char* end) {
+    CharScanner scanner;
+    repl_scanner_init(&scanner, end);
+
+    size_t runs = 0;
+    const char* p = script;
+    while (p < end) {
+        p = repl_scan_while(&scanner, p, CHAR_SPACE);
+        const char* word = repl_scan_while(&scanner, p, CHAR_WORD);
+        p = word > p ? word : p + 1;
+        runs++;
+    }
+    return runs;
+}
+
+// The same boundaries found a byte at a time with <ctype.h>, as the
+// tokenizer used to
+static size_t run_ctype(const char* script, const char* end) {
+    size_t runs = 0;
+    const char* p = script;
+    while (p < end) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        const char* word = p;
+        while (word < end && (isalnum((unsigned char)*word) || *word == '_')) word++;
+        p = word > p ? word : p + 1;
+        runs++;
+    }
+    return runs;
+}
+
+// One report line: throughput in MB/s, and bytes per cycle where the
+// time-stamp counter is available
+static size_t report_line(char* buffer, size_t size, const char* label, size_t bytes, BenchTime time) {
+    double megabytes = bytes / (1024.0 * 1024.0);
+    double rate = time.seconds > 0.0 ? megabytes / time.seconds : 0.0;
+    int written;
+    if (time.cycles > 0) {
+        written = snprintf(buffer, size, "\n  %-18s %6.2f bytes/cycle  %8.0f MB/s", label,
+                           (double)bytes / time.cycles, rate);
+    } else {
+        written = snprintf(buffer, size, "\n  %-18s %8.0f MB/s", label, rate);
+    }
+    return written < 0 || (size_t)written >= size ? size - 1 : (size_t)written;
+}
+
+bool repl_bench_lexer(char* buffer, size_t size) {
+    char* script = (char*)malloc(BENCH_SCRIPT_SIZE);
+    if (!script) {
+        snprintf(buffer, size, "bench: out of memory");
+        return false;
+    }
+    generate_script(script, BENCH_SCRIPT_SIZE);
+    size_t bytes = strlen(script);
+    const char* end = script + bytes;
+
+    BenchTime lexer = {0}, scanner = {0}, ctype = {0};
+    size_t tokens = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        BenchTimer timer;
+
+        timer_start(&timer);
+        tokens = run_lexer(script);
+        keep_fastest(&lexer, timer_stop(&timer));
+
+        timer_start(&timer);
+        bench_sink = run_scanner(script, end);
+        keep_fastest(&scanner, timer_stop(&timer));
+
+        timer_start(&timer);
+        bench_sink = run_ctype(script, end);
+        keep_fastest(&ctype, timer_stop(&timer));
+    }
+    free(script);
+
+    int width = repl_scan_width();
+    size_t length = (size_t)snprintf(buffer, size, "Lexer: %.1f MB script, %lu tokens, %s scanner",
+                                     bytes / (1024.0 * 1024.0), (unsigned long)tokens,
+                                     width == 32 ? "AVX2 32-byte" : width == 16 ? "SSE2 16-byte" : "scalar");
+    if (length >= size) return true;
+    length += report_line(buffer + length, size - length, "Full lexer", bytes, lexer);
+    length += report_line(buffer + length, size - length, "Character scanner", bytes, scanner);
+    report_line(buffer + length, size - length, "Per-byte ctype", bytes, ctype);
+    return true;
+}
+
+/*
+ * A dot product at each precision: one multiply and one add per element,
+ * the pattern of most numeric code. The operands are the same doubles for
+ * all three, so only the arithmetic differs.
+ */
+static double run_double(const double* x, const double* y, int n) {
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) sum += x[i] * y[i];
+    return sum;
+}
+
+static double run_double_double(const double* x, const double* y, int n) {
+    DoubleDouble sum = { 0.0, 0.0 };
+    for (int i = 0; i < n; i++) {
+        DoubleDouble a = { x[i], 0.0 }, b = { y[i], 0.0 };
+        sum = repl_dd_add(sum, repl_dd_mul(a, b));
+    }
+    return sum.hi;
+}
+
+#ifdef REPL_HAVE_FLOAT128
+static double run_quad(const __float128* x, const __float128* y, int n) {
+    __float128 sum = 0;
+    for (int i = 0; i < n; i++) sum += x[i] * y[i];
+    return (double)sum;
+}
+#endif
+
+// One report line: nanoseconds per element, and the slowdown from double
+static size_t report_precision(char* buffer, size_t size, const char* label, int n, BenchTime time, BenchTime base) {
+    int written = snprintf(buffer, size, "\n  %-14s %8.2f ns/element  %6.1fx double", label,
+                           1e9 * time.seconds / n, base.seconds > 0.0 ? time.seconds / base.seconds : 0.0);
+    return written < 0 || (size_t)written >= size ? size - 1 : (size_t)written;
+}
+
+bool repl_bench_precision(char* buffer, size_t size) {
+    int n = BENCH_VECTOR_LENGTH;
+    double* x = (double*)malloc(2 * n * sizeof(double));
+#ifdef REPL_HAVE_FLOAT128
+    __float128* q = (__float128*)malloc(2 * n * sizeof(__float128));
+    if (!q) {
+        free(x);
+        x = NULL;
+    }
+#endif
+    if (!x) {
+        snprintf(buffer, size, "bench: out of memory");
+        return false;
+    }
+    double* y = x + n;
+    unsigned int seed = 12345;
+    for (int i = 0; i < 2 * n; i++) {
+        seed = seed * 1103515245u + 12345u;
+        x[i] = (seed >> 8) / 16777216.0 - 0.5;
+#ifdef REPL_HAVE_FLOAT128
+        q[i] = x[i];
+#endif
+    }
+
+    BenchTime plain = {0}, extended = {0}, quad = {0};
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        BenchTimer timer;
+
+        timer_start(&timer);
+        bench_sink = (size_t)(run_double(x, y, n) != 0.0);
+        keep_fastest(&plain, timer_stop(&timer));
+
+        timer_start(&timer);
+        bench_sink = (size_t)(run_double_double(x, y, n) != 0.0);
+        keep_fastest(&extended, timer_stop(&timer));
+
+#ifdef REPL_HAVE_FLOAT128
+        timer_start(&timer);
+        bench_sink = (size_t)(run_quad(q, q + n, n) != 0.0);
+        keep_fastest(&quad, timer_stop(&timer));
+#endif
+    }
+    free(x);
+
+    size_t length = (size_t)snprintf(buffer, size, "Precision: dot product of %d elements", n);
+    if (length >= size) return true;
+    length += report_precision(buffer + length, size - length, "double", n, plain, plain);
+    length += report_precision(buffer + length, size - length, "double-double", n, extended, plain);
+#ifdef REPL_HAVE_FLOAT128
+    free(q);
+    report_precision(buffer + length, size - length, "binary128", n, quad, plain);
+#else
+    (void)quad;
+    snprintf(buffer + length, size - length, "\n  binary128 is not available with this compiler");
+#endif
+    return true;
+}
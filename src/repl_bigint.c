@@ -0,0 +1,894 @@
+#include "../include/repl_bigint.h"
+#include "../include/repl_heap.h"
+#include "../include/repl_vm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/*
+ * Bigints are a sign and a magnitude in 32-bit limbs, so every partial
+ * product and carry fits a uint64_t in portable C. Any result that fits an
+ * int64 is returned as one: a bigint is never in the int64 range, and
+ * small values stay on the VM's inline paths.
+ *
+ * Multiplication is schoolbook below KARATSUBA_THRESHOLD limbs and
+ * Karatsuba above it, with unbalanced operands cut into balanced pieces.
+ * Division is Knuth's algorithm D. Decimal output splits the number by
+ * 10^(9 * 2^k) recursively, so the digits come from a few large divisions
+ * instead of one pass over the whole number per nine digits. A number too
+ * long to print in full is first divided by a power of ten, so that only
+ * its leading digits are converted.
+ *
+ * Operations report running out of memory as VALUE_TOO_LARGE rather than
+ * unwinding, so no scratch buffer is ever left allocated.
+ */
+
+typedef uint32_t Limb;
+
+#define LIMB_BITS 32
+#define DIGITS_PER_LIMB 9                // 10^9 is the largest power of ten in a limb
+#define TEN_TO_NINE 1000000000u
+
+// An operand: the limbs of a bigint, or of a machine integer kept in small
+typedef struct {
+    const Limb* limbs;
+    size_t length;
+    bool negative;
+    Limb small[2];
+} Operand;
+
+static size_t trim(const Limb* limbs, size_t length) {
+    while (length > 0 && limbs[length - 1] == 0) length--;
+    return length;
+}
+
+static Limb* allocate_limbs(size_t count) {
+    return (Limb*)calloc(count ? count : 1, sizeof(Limb));
+}
+
+static void load_operand(Value v, Operand* operand) {
+    if (value_is_bigint(v)) {
+        const BigIntObject* big = (const BigIntObject*)value_object(v);
+        operand->limbs = big->limbs;
+        operand->length = big->length;
+        operand->negative = big->negative;
+        return;
+    }
+
+    uint64_t magnitude = value_as_bits(v);
+    operand->negative = value_type(v) == VALUE_INT && (int64_t)magnitude < 0;
+    if (operand->negative) magnitude = 0 - magnitude;
+    operand->small[0] = (Limb)magnitude;
+    operand->small[1] = (Limb)(magnitude >> LIMB_BITS);
+    operand->limbs = operand->small;
+    operand->length = trim(operand->small, 2);
+}
+
+// Make a value of a magnitude in r, which this frees: an int64 if it
+// fits, otherwise a new bigint
+static ValueStatus finish(bool negative, Limb* r, size_t length, Value* result) {
+    length = trim(r, length);
+    if (length <= 2) {
+        uint64_t magnitude = length == 0 ? 0 : r[0];
+        if (length == 2) magnitude |= (uint64_t)r[1] << LIMB_BITS;
+        if (magnitude <= (uint64_t)INT64_MAX || (negative && magnitude == (uint64_t)INT64_MAX + 1)) {
+            free(r);
+            *result = value_int(negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude);
+            return VALUE_OK;
+        }
+    }
+
+    BigIntObject* big = NULL;
+    if (length <= BIGINT_MAX_LIMBS) {
+        big = (BigIntObject*)repl_heap_allocate(VALUE_BIGINT, sizeof(BigIntObject) + length * sizeof(Limb));
+    }
+    if (!big) {
+        free(r);
+        return VALUE_TOO_LARGE;
+    }
+    big->negative = negative;
+    big->length = (uint32_t)length;
+    memcpy(big->limbs, r, length * sizeof(Limb));
+    free(r);
+    result->bits = VALUE_TAGGED(VALUE_TAG_OBJECT, (uint64_t)(uintptr_t)big);
+    return VALUE_OK;
+}
+
+static ValueStatus copy_operand(const Operand* a, bool negative, Value* result) {
+    Limb* r = allocate_limbs(a->length);
+    if (!r) return VALUE_TOO_LARGE;
+    memcpy(r, a->limbs, a->length * sizeof(Limb));
+    return finish(negative && a->length > 0, r, a->length, result);
+}
+
+// Magnitudes
+
+static int compare_magnitudes(const Limb* a, size_t an, const Limb* b, size_t bn) {
+    if (an != bn) return an < bn ? -1 : 1;
+    for (size_t i = an; i-- > 0;) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+// r = a + b for an >= bn; returns the carry out of the top limb. r may be a.
+static Limb add_magnitudes(Limb* r, const Limb* a, size_t an, const Limb* b, size_t bn) {
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i < bn; i++) {
+        carry += (uint64_t)a[i] + b[i];
+        r[i] = (Limb)carry;
+        carry >>= LIMB_BITS;
+    }
+    for (; i < an; i++) {
+        carry += a[i];
+        r[i] = (Limb)carry;
+        carry >>= LIMB_BITS;
+    }
+    return (Limb)carry;
+}
+
+// r = a - b for a >= b and an >= bn. r may be a.
+static void subtract_magnitudes(Limb* r, const Limb* a, size_t an, const Limb* b, size_t bn) {
+    uint64_t borrow = 0;
+    size_t i = 0;
+    for (; i < bn; i++) {
+        uint64_t t = (uint64_t)a[i] - b[i] - borrow;
+        r[i] = (Limb)t;
+        borrow = t >> 63;
+    }
+    for (; i < an; i++) {
+        uint64_t t = (uint64_t)a[i] - borrow;
+        r[i] = (Limb)t;
+        borrow = t >> 63;
+    }
+}
+
+// r += a, where r has room for the sum in rn limbs
+static void add_into(Limb* r, size_t rn, const Limb* a, size_t an) {
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i < an; i++) {
+        carry += (uint64_t)r[i] + a[i];
+        r[i] = (Limb)carry;
+        carry >>= LIMB_BITS;
+    }
+    for (; carry && i < rn; i++) {
+        carry += r[i];
+        r[i] = (Limb)carry;
+        carry >>= LIMB_BITS;
+    }
+}
+
+// r = a * b in an + bn limbs
+static void multiply_schoolbook(Limb* r, const Limb* a, size_t an, const Limb* b, size_t bn) {
+    memset(r, 0, (an + bn) * sizeof(Limb));
+    for (size_t i = 0; i < an; i++) {
+        uint64_t digit = a[i], carry = 0;
+        for (size_t j = 0; j < bn; j++) {
+            carry += digit * b[j] + r[i + j];
+            r[i + j] = (Limb)carry;
+            carry >>= LIMB_BITS;
+        }
+        r[i + bn] = (Limb)carry;
+    }
+}
+
+// Scratch limbs multiply_karatsuba needs for n-limb operands
+static size_t karatsuba_scratch(size_t n) {
+    size_t total = 0;
+    while (n >= KARATSUBA_THRESHOLD) {
+        size_t high = n - n / 2;
+        total += 4 * (high + 1);
+        n = high + 1;
+    }
+    return total;
+}
+
+/*
+ * r = a * b for two n-limb operands, r having 2n limbs. With a = a1 B + a0
+ * and b = b1 B + b0, the middle term a1 b0 + a0 b1 is (a0 + a1)(b0 + b1)
+ * less the outer two products, so three half-size products replace four.
+ */
+static void multiply_karatsuba(Limb* r, const Limb* a, const Limb* b, size_t n, Limb* scratch) {
+    if (n < KARATSUBA_THRESHOLD) {
+        multiply_schoolbook(r, a, n, b, n);
+        return;
+    }
+
+    size_t low = n / 2, high = n - low;
+    Limb* sum_a = scratch;                  // a0 + a1, high + 1 limbs
+    Limb* sum_b = sum_a + high + 1;         // b0 + b1
+    Limb* middle = sum_b + high + 1;        // Their product, 2 * high + 2 limbs
+    Limb* next = middle + 2 * high + 2;
+
+    multiply_karatsuba(r, a, b, low, next);
+    multiply_karatsuba(r + 2 * low, a + low, b + low, high, next);
+    sum_a[high] = add_magnitudes(sum_a, a + low, high, a, low);
+    sum_b[high] = add_magnitudes(sum_b, b + low, high, b, low);
+    multiply_karatsuba(middle, sum_a, sum_b, high + 1, next);
+
+    subtract_magnitudes(middle, middle, 2 * high + 2, r, 2 * low);
+    subtract_magnitudes(middle, middle, 2 * high + 2, r + 2 * low, 2 * high);
+    add_into(r + low, 2 * n - low, middle, trim(middle, 2 * high + 2));
+}
+
+// r = a * b in an + bn limbs, r not overlapping either operand. Returns
+// false if there is no memory for scratch space.
+static bool multiply_magnitudes(Limb* r, const Limb* a, size_t an, const Limb* b, size_t bn) {
+    if (an < bn) {
+        const Limb* t = a;
+        a = b;
+        b = t;
+        size_t tn = an;
+        an = bn;
+        bn = tn;
+    }
+    if (bn < KARATSUBA_THRESHOLD) {
+        multiply_schoolbook(r, a, an, b, bn);
+        return true;
+    }
+
+    Limb* scratch = (Limb*)malloc((2 * bn + karatsuba_scratch(bn)) * sizeof(Limb));
+    if (!scratch) return false;
+    if (an == bn) {
+        multiply_karatsuba(r, a, b, bn, scratch);
+        free(scratch);
+        return true;
+    }
+
+    // Cut the longer operand into pieces as long as the shorter one
+    Limb* piece = scratch;
+    memset(r, 0, (an + bn) * sizeof(Limb));
+    size_t offset = 0;
+    for (; offset + bn <= an; offset += bn) {
+        multiply_karatsuba(piece, a + offset, b, bn, scratch + 2 * bn);
+        add_into(r + offset, an + bn - offset, piece, 2 * bn);
+    }
+    free(scratch);
+    if (offset == an) return true;
+
+    size_t rest = an - offset;
+    Limb* tail = allocate_limbs(rest + bn);
+    bool ok = tail && multiply_magnitudes(tail, a + offset, rest, b, bn);
+    if (ok) add_into(r + offset, an + bn - offset, tail, rest + bn);
+    free(tail);
+    return ok;
+}
+
+static int leading_zeros(Limb x) {
+    int n = 0;
+    while (!(x & 0x80000000u)) {
+        x <<= 1;
+        n++;
+    }
+    return n;
+}
+
+/*
+ * q = u / v and r = u % v by Knuth's algorithm D (as in Hacker's Delight),
+ * for un >= vn and a non-zero top limb of v. q gets un - vn + 1 limbs and
+ * r, if not NULL, vn limbs. Returns false if there is no memory.
+ */
+static bool divide_magnitudes(Limb* q, Limb* r, const Limb* u, size_t un, const Limb* v, size_t vn) {
+    if (vn == 1) {
+        uint64_t remainder = 0;
+        for (size_t i = un; i-- > 0;) {
+            uint64_t current = (remainder << LIMB_BITS) | u[i];
+            q[i] = (Limb)(current / v[0]);
+            remainder = current % v[0];
+        }
+        if (r) r[0] = (Limb)remainder;
+        return true;
+    }
+
+    // Shift both so the divisor's top bit is set, which keeps each
+    // estimated quotient limb at most two too large
+    Limb* work = allocate_limbs(un + 1 + vn);
+    if (!work) return false;
+    Limb* un_ = work;
+    Limb* vn_ = work + un + 1;
+    int s = leading_zeros(v[vn - 1]);
+    for (size_t i = vn - 1; i > 0; i--) {
+        vn_[i] = (v[i] << s) | (s ? v[i - 1] >> (LIMB_BITS - s) : 0);
+    }
+    vn_[0] = v[0] << s;
+    un_[un] = s ? u[un - 1] >> (LIMB_BITS - s) : 0;
+    for (size_t i = un - 1; i > 0; i--) {
+        un_[i] = (u[i] << s) | (s ? u[i - 1] >> (LIMB_BITS - s) : 0);
+    }
+    un_[0] = u[0] << s;
+
+    const uint64_t base = (uint64_t)1 << LIMB_BITS;
+    for (size_t j = un - vn + 1; j-- > 0;) {
+        uint64_t numerator = ((uint64_t)un_[j + vn] << LIMB_BITS) | un_[j + vn - 1];
+        uint64_t qhat = numerator / vn_[vn - 1];
+        uint64_t rhat = numerator % vn_[vn - 1];
+        while (qhat >= base || qhat * vn_[vn - 2] > ((rhat << LIMB_BITS) | un_[j + vn - 2])) {
+            qhat--;
+            rhat += vn_[vn - 1];
+            if (rhat >= base) break;
+        }
+
+        // Multiply and subtract
+        int64_t borrow = 0, t;
+        for (size_t i = 0; i < vn; i++) {
+            uint64_t product = qhat * vn_[i];
+            t = (int64_t)un_[i + j] - borrow - (int64_t)(product & 0xFFFFFFFFu);
+            un_[i + j] = (Limb)t;
+            borrow = (int64_t)(product >> LIMB_BITS) - (t >> LIMB_BITS);
+        }
+        t = (int64_t)un_[j + vn] - borrow;
+        un_[j + vn] = (Limb)t;
+
+        // The estimate was one too large: add the divisor back
+        q[j] = (Limb)qhat;
+        if (t < 0) {
+            q[j]--;
+            uint64_t carry = 0;
+            for (size_t i = 0; i < vn; i++) {
+                carry += (uint64_t)un_[i + j] + vn_[i];
+                un_[i + j] = (Limb)carry;
+                carry >>= LIMB_BITS;
+            }
+            un_[j + vn] += (Limb)carry;
+        }
+    }
+
+    if (r) {
+        for (size_t i = 0; i < vn; i++) {
+            r[i] = (un_[i] >> s) | (s ? un_[i + 1] << (LIMB_BITS - s) : 0);
+        }
+    }
+    free(work);
+    return true;
+}
+
+// Signed operations
+
+static int compare(const Operand* a, const Operand* b) {
+    if (a->negative != b->negative) return a->negative ? -1 : 1;
+    int order = compare_magnitudes(a->limbs, a->length, b->limbs, b->length);
+    return a->negative ? -order : order;
+}
+
+// a + b, or a - b when subtract is set
+static ValueStatus add(const Operand* a, const Operand* b, bool subtract, Value* result) {
+    const Operand* x = a;
+    const Operand* y = b;
+    bool x_negative = a->negative;
+    bool y_negative = b->negative != subtract;
+    if (x->length < y->length) {
+        x = b;
+        y = a;
+        x_negative = y_negative;
+        y_negative = a->negative;
+    }
+
+    Limb* r = allocate_limbs(x->length + 1);
+    if (!r) return VALUE_TOO_LARGE;
+    if (x_negative == y_negative) {
+        r[x->length] = add_magnitudes(r, x->limbs, x->length, y->limbs, y->length);
+        return finish(x_negative, r, x->length + 1, result);
+    }
+    if (compare_magnitudes(x->limbs, x->length, y->limbs, y->length) >= 0) {
+        subtract_magnitudes(r, x->limbs, x->length, y->limbs, y->length);
+        return finish(x_negative, r, x->length, result);
+    }
+    // |y| > |x| with no more limbs: the lengths are equal
+    subtract_magnitudes(r, y->limbs, y->length, x->limbs, x->length);
+    return finish(y_negative, r, y->length, result);
+}
+
+static ValueStatus multiply(const Operand* a, const Operand* b, Value* result) {
+    size_t length = a->length + b->length;
+    if (a->length == 0 || b->length == 0) {
+        *result = value_int(0);
+        return VALUE_OK;
+    }
+    if (length > BIGINT_MAX_LIMBS + 1) return VALUE_TOO_LARGE;
+
+    Limb* r = allocate_limbs(length);
+    if (!r || !multiply_magnitudes(r, a->limbs, a->length, b->limbs, b->length)) {
+        free(r);
+        return VALUE_TOO_LARGE;
+    }
+    return finish(a->negative != b->negative, r, length, result);
+}
+
+// Truncating division and its remainder, as in C
+static ValueStatus divide(int op, const Operand* a, const Operand* b, Value* result) {
+    if (b->length == 0) return VALUE_DIVISION_BY_ZERO;
+    if (compare_magnitudes(a->limbs, a->length, b->limbs, b->length) < 0) {
+        if (op == OP_DIV) {
+            *result = value_int(0);
+            return VALUE_OK;
+        }
+        return copy_operand(a, a->negative, result);
+    }
+
+    size_t qn = a->length - b->length + 1;
+    Limb* q = allocate_limbs(qn);
+    Limb* r = allocate_limbs(b->length);
+    if (!q || !r || !divide_magnitudes(q, r, a->limbs, a->length, b->limbs, b->length)) {
+        free(q);
+        free(r);
+        return VALUE_TOO_LARGE;
+    }
+    if (op == OP_DIV) {
+        free(r);
+        return finish(a->negative != b->negative, q, qn, result);
+    }
+    free(q);
+    return finish(a->negative, r, b->length, result);
+}
+
+// Exponentiation by squaring, from the exponent's top bit down
+static ValueStatus power(const Operand* a, const Operand* b, Value base, Value exponent, Value* result) {
+    // A negative exponent has no integer result
+    if (b->negative) {
+        *result = value_float(pow(value_to_double(base), value_to_double(exponent)));
+        return VALUE_OK;
+    }
+
+    bool odd = b->length > 0 && (b->limbs[0] & 1);
+    if (b->length == 0 || (a->length == 1 && a->limbs[0] == 1)) {
+        *result = value_int(b->length > 0 && a->negative && odd ? -1 : 1);
+        return VALUE_OK;
+    }
+    if (a->length == 0) {
+        *result = value_int(0);
+        return VALUE_OK;
+    }
+
+    // Bits of the result, at most; the exponent fits in a limb if it is not too large
+    uint64_t bits = (uint64_t)a->length * LIMB_BITS - (uint64_t)leading_zeros(a->limbs[a->length - 1]);
+    if (b->length > 1 || bits * b->limbs[0] > (uint64_t)BIGINT_MAX_LIMBS * LIMB_BITS) {
+        return VALUE_TOO_LARGE;
+    }
+    Limb e = b->limbs[0];
+    size_t capacity = (size_t)(bits * e / LIMB_BITS) + 4;
+
+    Limb* x = allocate_limbs(capacity);
+    Limb* t = allocate_limbs(capacity);
+    if (!x || !t) {
+        free(x);
+        free(t);
+        return VALUE_TOO_LARGE;
+    }
+    memcpy(x, a->limbs, a->length * sizeof(Limb));
+    size_t xn = a->length;
+    bool ok = true;
+    for (int bit = LIMB_BITS - 2 - leading_zeros(e); bit >= 0 && ok; bit--) {
+        ok = multiply_magnitudes(t, x, xn, x, xn);
+        xn = trim(t, 2 * xn);
+        Limb* swap = x;
+        x = t;
+        t = swap;
+        if (ok && (e >> bit) & 1) {
+            ok = multiply_magnitudes(t, x, xn, a->limbs, a->length);
+            xn = trim(t, xn + a->length);
+            swap = x;
+            x = t;
+            t = swap;
+        }
+    }
+    free(t);
+    if (!ok) {
+        free(x);
+        return VALUE_TOO_LARGE;
+    }
+    return finish(a->negative && odd, x, xn, result);
+}
+
+// r = a >> count for magnitudes; returns the length of r, which has an limbs
+static size_t shift_right_magnitude(Limb* r, const Limb* a, size_t an, uint64_t count) {
+    size_t limbs = (size_t)(count / LIMB_BITS);
+    int bits = (int)(count % LIMB_BITS);
+    if (limbs >= an) return 0;
+    size_t rn = an - limbs;
+    for (size_t i = 0; i < rn; i++) {
+        Limb next = i + limbs + 1 < an ? a[i + limbs + 1] : 0;
+        r[i] = (a[i + limbs] >> bits) | (bits ? next << (LIMB_BITS - bits) : 0);
+    }
+    return trim(r, rn);
+}
+
+// Shifts multiply or floor-divide by a power of two; the count may not be negative
+static ValueStatus shift(int op, const Operand* a, const Operand* b, Value* result) {
+    if (b->negative) return VALUE_INVALID_OPERANDS;
+    if (a->length == 0) {
+        *result = value_int(0);
+        return VALUE_OK;
+    }
+    uint64_t count = b->length == 0 ? 0 : b->limbs[0];
+    if (b->length == 2) count |= (uint64_t)b->limbs[1] << LIMB_BITS;
+
+    if (op == OP_SHL) {
+        if (b->length > 1 || count / LIMB_BITS + a->length > BIGINT_MAX_LIMBS) return VALUE_TOO_LARGE;
+        size_t limbs = (size_t)(count / LIMB_BITS);
+        int bits = (int)(count % LIMB_BITS);
+        size_t rn = a->length + limbs + 1;
+        Limb* r = allocate_limbs(rn);
+        if (!r) return VALUE_TOO_LARGE;
+        for (size_t i = 0; i < a->length; i++) {
+            r[i + limbs] |= a->limbs[i] << bits;
+            if (bits) r[i + limbs + 1] = a->limbs[i] >> (LIMB_BITS - bits);
+        }
+        return finish(a->negative, r, rn, result);
+    }
+
+    if (b->length > 2) count = UINT64_MAX;
+    Limb* r = allocate_limbs(a->length + 1);
+    if (!r) return VALUE_TOO_LARGE;
+    if (!a->negative) {
+        return finish(false, r, shift_right_magnitude(r, a->limbs, a->length, count), result);
+    }
+
+    // Rounding towards minus infinity: -a >> n is -(((a - 1) >> n) + 1)
+    static const Limb one = 1;
+    subtract_magnitudes(r, a->limbs, a->length, &one, 1);
+    size_t rn = shift_right_magnitude(r, r, trim(r, a->length), count);
+    memset(r + rn, 0, (a->length + 1 - rn) * sizeof(Limb));
+    add_into(r, rn + 1, &one, 1);
+    return finish(true, r, rn + 1, result);
+}
+
+static void negate_in_place(Limb* r, size_t n) {
+    uint64_t carry = 1;
+    for (size_t i = 0; i < n; i++) {
+        carry += (Limb)~r[i];
+        r[i] = (Limb)carry;
+        carry >>= LIMB_BITS;
+    }
+}
+
+// The two's complement of an operand in n limbs, more than it needs
+static void to_twos_complement(Limb* r, size_t n, const Operand* a) {
+    memset(r, 0, n * sizeof(Limb));
+    memcpy(r, a->limbs, a->length * sizeof(Limb));
+    if (a->negative) negate_in_place(r, n);
+}
+
+// Bitwise operators act on the infinite two's complement form, as they do
+// on int64 values within its range
+static ValueStatus bitwise(int op, const Operand* a, const Operand* b, Value* result) {
+    size_t n = (a->length > b->length ? a->length : b->length) + 1;
+    Limb* x = allocate_limbs(2 * n);
+    if (!x) return VALUE_TOO_LARGE;
+    Limb* y = x + n;
+    to_twos_complement(x, n, a);
+    to_twos_complement(y, n, b);
+    for (size_t i = 0; i < n; i++) {
+        switch (op) {
+            case OP_BAND: x[i] &= y[i]; break;
+            case OP_BOR:  x[i] |= y[i]; break;
+            default:      x[i] ^= y[i]; break;
+        }
+    }
+
+    bool negative = x[n - 1] >> (LIMB_BITS - 1);
+    if (negative) negate_in_place(x, n);
+    return finish(negative, x, n, result);
+}
+
+ValueStatus repl_bigint_binary(int op, Value a, Value b, Value* result) {
+    Operand x, y;
+    load_operand(a, &x);
+    load_operand(b, &y);
+
+    switch (op) {
+        case OP_ADD: return add(&x, &y, false, result);
+        case OP_SUB: return add(&x, &y, true, result);
+        case OP_MUL: return multiply(&x, &y, result);
+        case OP_DIV:
+        case OP_MOD: return divide(op, &x, &y, result);
+        case OP_POW: return power(&x, &y, a, b, result);
+        case OP_SHL:
+        case OP_SHR: return shift(op, &x, &y, result);
+        case OP_BAND:
+        case OP_BOR:
+        case OP_BXOR: return bitwise(op, &x, &y, result);
+        case OP_LT: *result = value_bool(compare(&x, &y) < 0); return VALUE_OK;
+        case OP_LE: *result = value_bool(compare(&x, &y) <= 0); return VALUE_OK;
+        case OP_EQ: *result = value_bool(compare(&x, &y) == 0); return VALUE_OK;
+        case OP_NE: *result = value_bool(compare(&x, &y) != 0); return VALUE_OK;
+        default: return VALUE_INVALID_OPERANDS;
+    }
+}
+
+ValueStatus repl_bigint_unary(int op, Value a, Value* result) {
+    Operand x;
+    load_operand(a, &x);
+
+    switch (op) {
+        case OP_NEG:
+            return copy_operand(&x, !x.negative, result);
+        case OP_BNOT: {
+            // ~x is -x - 1
+            Operand one = { NULL, 1, true, { 1, 0 } };
+            one.limbs = one.small;
+            x.negative = !x.negative && x.length > 0;
+            return add(&x, &one, false, result);
+        }
+        default:
+            return VALUE_INVALID_OPERANDS;
+    }
+}
+
+/*
+ * Correctly rounded: the top 64 bits, with a sticky bit standing for any
+ * set bit below them, round to 53 the way the whole number would. A
+ * bigint is at least 2^63, so it has those 64 bits.
+ */
+double repl_bigint_to_double(const HeapObject* object) {
+    const BigIntObject* big = (const BigIntObject*)object;
+    size_t n = big->length;
+    uint64_t bits = (uint64_t)n * LIMB_BITS - (uint64_t)leading_zeros(big->limbs[n - 1]);
+    uint64_t low_bit = bits - 64;
+    size_t limb = (size_t)(low_bit / LIMB_BITS);
+    int offset = (int)(low_bit % LIMB_BITS);
+
+    uint64_t top = ((uint64_t)big->limbs[limb + 1] << LIMB_BITS) | big->limbs[limb];
+    top >>= offset;
+    if (offset && limb + 2 < n) top |= (uint64_t)big->limbs[limb + 2] << (64 - offset);
+
+    bool sticky = offset && (big->limbs[limb] & ((1u << offset) - 1));
+    for (size_t i = 0; i < limb && !sticky; i++) sticky = big->limbs[i] != 0;
+
+    double magnitude = ldexp((double)(top | (sticky ? 1 : 0)), (int)(low_bit > 2000 ? 2000 : low_bit));
+    return big->negative ? -magnitude : magnitude;
+}
+
+bool repl_bigint_equal(Value a, Value b) {
+    const BigIntObject* x = (const BigIntObject*)value_object(a);
+    const BigIntObject* y = (const BigIntObject*)value_object(b);
+    return x->negative == y->negative && x->length == y->length &&
+           memcmp(x->limbs, y->limbs, x->length * sizeof(Limb)) == 0;
+}
+
+// Bits in the magnitude of an integer value, 0 for zero
+uint64_t repl_bigint_bit_length(Value v) {
+    Operand x;
+    load_operand(v, &x);
+    if (x.length == 0) return 0;
+    return (uint64_t)x.length * LIMB_BITS - (uint64_t)leading_zeros(x.limbs[x.length - 1]);
+}
+
+// Parsing and formatting
+
+static int digit_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return c - 'A' + 10;
+}
+
+// Digits of an integer literal in base 8, 10 or 16, without prefix or
+// suffix. Literals are short, so octal and decimal ones are read nine
+// digits at a time.
+bool repl_bigint_parse(const char* digits, size_t length, int base, Value* value) {
+    // log2(10) < 3.33 bits per decimal digit, 4 per hex digit
+    size_t capacity = base == 16 ? length / 8 + 1 : length * 10 / 96 + 2;
+    Limb* r = allocate_limbs(capacity);
+    if (!r) return false;
+
+    size_t n = 0;
+    if (base == 16) {
+        for (size_t i = 0; i < length; i++) {
+            size_t position = length - 1 - i;
+            r[i / 8] |= (Limb)digit_value(digits[position]) << (4 * (i % 8));
+        }
+        n = capacity;
+    } else {
+        size_t chunk = length % DIGITS_PER_LIMB ? length % DIGITS_PER_LIMB : DIGITS_PER_LIMB;
+        for (size_t i = 0; i < length; i += chunk, chunk = DIGITS_PER_LIMB) {
+            uint64_t scale = 1, carry = 0;
+            for (size_t j = 0; j < chunk; j++) {
+                carry = carry * base + (uint64_t)digit_value(digits[i + j]);
+                scale *= base;
+            }
+            for (size_t j = 0; j < n; j++) {
+                carry += r[j] * scale;
+                r[j] = (Limb)carry;
+                carry >>= LIMB_BITS;
+            }
+            if (carry) r[n++] = (Limb)carry;
+        }
+    }
+    return finish(false, r, n, value) == VALUE_OK;
+}
+
+// Decimal output. powers[k] is 10^(9 * 2^k).
+typedef struct {
+    Limb* powers[48];
+    size_t lengths[48];
+    char* out;                   // Where the next digit goes
+    bool failed;
+} DecimalWriter;
+
+// Write a by repeated division by 10^9, in exactly width digits if width
+// is not zero
+static void write_digits(DecimalWriter* w, const Limb* a, size_t an, size_t width) {
+    Limb* work = allocate_limbs(an + an * 10 / 9 + 2);
+    if (!work) {
+        w->failed = true;
+        return;
+    }
+    Limb* chunks = work + an;
+    memcpy(work, a, an * sizeof(Limb));
+    size_t n = trim(work, an), count = 0;
+    while (n > 0) {
+        Limb q_chunk[1] = { TEN_TO_NINE };
+        Limb remainder;
+        divide_magnitudes(work, &remainder, work, n, q_chunk, 1);
+        chunks[count++] = remainder;
+        n = trim(work, n);
+    }
+
+    char top[DIGITS_PER_LIMB + 2];
+    int top_length = sprintf(top, "%u", count ? chunks[count - 1] : 0);
+    size_t length = (size_t)top_length + (count ? count - 1 : 0) * DIGITS_PER_LIMB;
+    for (; width > length; width--) *w->out++ = '0';
+    memcpy(w->out, top, (size_t)top_length);
+    w->out += top_length;
+    for (size_t i = count - 1; count > 1 && i-- > 0;) {
+        w->out += sprintf(w->out, "%09u", chunks[i]);
+    }
+    free(work);
+}
+
+// Write a, splitting it by the largest powers[k] below it into a high part
+// and a low part of exactly 9 * 2^k digits, each written the same way
+static void write_decimal(DecimalWriter* w, const Limb* a, size_t an, int k, size_t width) {
+    if (w->failed) return;
+    while (k >= 0 && compare_magnitudes(a, an, w->powers[k], w->lengths[k]) < 0) k--;
+    if (k < 0 || an < DECIMAL_SPLIT_THRESHOLD) {
+        write_digits(w, a, an, width);
+        return;
+    }
+
+    size_t pn = w->lengths[k];
+    size_t low_width = (size_t)DIGITS_PER_LIMB << k;
+    Limb* q = allocate_limbs(an - pn + 1);
+    Limb* r = allocate_limbs(pn);
+    if (!q || !r || !divide_magnitudes(q, r, a, an, w->powers[k], pn)) {
+        w->failed = true;
+    } else {
+        write_decimal(w, q, trim(q, an - pn + 1), k, width > low_width ? width - low_width : 0);
+        write_decimal(w, r, trim(r, pn), k - 1, low_width);
+    }
+    free(q);
+    free(r);
+}
+
+// Decimal digits of a magnitude into text, which has room for 10 per limb;
+// returns the number written, or 0 if there is no memory
+static size_t format_magnitude(const Limb* a, size_t an, char* text) {
+    DecimalWriter w = { { NULL }, { 0 }, text, false };
+    int top = -1;
+
+    // Squares up to about the square root of a, where the split is even
+    w.powers[0] = allocate_limbs(1);
+    if (w.powers[0]) {
+        w.powers[0][0] = TEN_TO_NINE;
+        w.lengths[0] = 1;
+        top = 0;
+    }
+    while (top >= 0 && top + 1 < 48 && w.lengths[top] * 4 <= an) {
+        size_t n = 2 * w.lengths[top];
+        Limb* square = allocate_limbs(n);
+        if (!square || !multiply_magnitudes(square, w.powers[top], w.lengths[top],
+                                            w.powers[top], w.lengths[top])) {
+            free(square);
+            break;
+        }
+        top++;
+        w.powers[top] = square;
+        w.lengths[top] = trim(square, n);
+    }
+
+    if (top < 0) {
+        w.failed = true;
+    } else {
+        write_decimal(&w, a, an, top, 0);
+    }
+    for (int k = 0; k <= top; k++) free(w.powers[k]);
+    return w.failed ? 0 : (size_t)(w.out - text);
+}
+
+// 10^p in limbs, by squaring and multiplying by ten from the top bit of p
+// down, or NULL if there is no memory
+static Limb* power_of_ten(size_t p, size_t* length) {
+    size_t capacity = (size_t)(p * 0.10381025296523008) + 2;  // log2(10) / 32 limbs per digit
+    Limb* r = allocate_limbs(capacity);
+    Limb* square = allocate_limbs(capacity);
+    if (!r || !square) {
+        free(r);
+        free(square);
+        return NULL;
+    }
+
+    size_t n = 1;
+    r[0] = 1;
+    int bit = 0;
+    while ((p >> bit) > 1) bit++;
+    for (; bit >= 0; bit--) {
+        if (n > 1 || r[0] > 1) {
+            if (!multiply_magnitudes(square, r, n, r, n)) {
+                free(r);
+                free(square);
+                return NULL;
+            }
+            n = trim(square, 2 * n);
+            Limb* swap = r;
+            r = square;
+            square = swap;
+        }
+        if ((p >> bit) & 1) {
+            uint64_t carry = 0;
+            for (size_t i = 0; i < n; i++) {
+                carry += (uint64_t)r[i] * 10;
+                r[i] = (Limb)carry;
+                carry >>= LIMB_BITS;
+            }
+            if (carry) r[n++] = (Limb)carry;
+        }
+    }
+    free(square);
+    *length = n;
+    return r;
+}
+
+// The digits of a non-zero magnitude, or if it has many more than wanted,
+// only its first ones, with in *total how many it has. The bit length puts
+// a lower bound on the digits, so dividing by 10^p for p a little below
+// the digits not wanted leaves a quotient of only a few more than wanted,
+// and only that is converted. Returns a malloc'd string, or NULL if there
+// is no memory.
+static char* leading_digits(const Limb* a, size_t an, size_t wanted, size_t* total) {
+    uint64_t bits = (uint64_t)an * LIMB_BITS - (uint64_t)leading_zeros(a[an - 1]);
+    size_t lower_bound = (size_t)((double)(bits - 1) * 0.30102999566398120) + 1;
+    size_t p = lower_bound > wanted + 2 ? lower_bound - wanted - 2 : 0;
+
+    size_t pn = 0;
+    Limb* divisor = p ? power_of_ten(p, &pn) : NULL;
+    if (p && !divisor) return NULL;
+    size_t qn = p ? an - pn + 1 : an;
+    Limb* q = p ? allocate_limbs(qn) : NULL;
+    char* text = (char*)malloc(qn * 10 + 1);
+    size_t digits = 0;
+    if (text && (!p || (q && divide_magnitudes(q, NULL, a, an, divisor, pn)))) {
+        digits = p ? format_magnitude(q, trim(q, qn), text) : format_magnitude(a, an, text);
+    }
+    free(divisor);
+    free(q);
+    if (digits == 0) {
+        free(text);
+        return NULL;
+    }
+    *total = p + digits;
+    return text;
+}
+
+// Decimal text of a bigint. If it does not fit, the leading digits are
+// followed by the number of digits, e.g. "40238726007709377354...(2568 digits)".
+void repl_bigint_format(const HeapObject* object, char* buffer, size_t size) {
+    const BigIntObject* big = (const BigIntObject*)object;
+    const char* sign = big->negative ? "-" : "";
+    size_t digits = 0;
+    char* text = leading_digits(big->limbs, big->length, size, &digits);
+
+    if (!text) {
+        snprintf(buffer, size, "%s(%u-limb integer)", sign, (unsigned)big->length);
+    } else if (strlen(sign) + digits < size) {
+        snprintf(buffer, size, "%s%.*s", sign, (int)digits, text);
+    } else {
+        char suffix[32];
+        int suffix_length = snprintf(suffix, sizeof(suffix), "...(%zu digits)", digits);
+        int keep = (int)size - 1 - suffix_length - (int)strlen(sign);
+        if (keep < 1) keep = 1;
+        snprintf(buffer, size, "%s%.*s%s", sign, keep, text, suffix);
+    }
+    free(text);
+}
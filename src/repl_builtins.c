@@ -0,0 +1,285 @@
+#include "../include/repl_builtins.h"
+#include "../include/repl_complex.h"
+#include "../include/repl_extended.h"
+#include "../include/repl_array.h"
+#include "../include/repl_vm.h"
+#include <string.h>
+#include <math.h>
+
+/*
+ * Built-ins take real or complex arguments, and those of doubles apply
+ * element by element to arrays; range, linspace, len and sum make and
+ * take arrays. abs, re, conj, min, max and the rounding functions keep a
+ * real argument's type where they can, so abs(-3) is 3 and floor(7) is 7
+ * in every number mode, and pow is the ^ operator, so integer powers are
+ * exact, by squaring. The others follow the precision setting like the
+ * operators, computing in double with C's NaN for arguments outside the
+ * real domain such as log(-1), and in repl_extended.c at dd or quad;
+ * sqrt, exp, log, sin and cos also take complex arguments, as
+ * repl_complex.c computes them.
+ */
+
+static bool is_complex(Value v) {
+    return value_type(v) == VALUE_COMPLEX;
+}
+
+static bool is_array(Value v) {
+    return value_type(v) == VALUE_ARRAY;
+}
+
+// Statements give undefined, which is no argument
+static bool is_number(Value v) {
+    return !value_is_undefined(v) && !is_array(v);
+}
+
+// Integer types are whole already
+static bool is_integer(Value v) {
+    ValueType type = value_type(v);
+    return type == VALUE_INT || type == VALUE_UINT || type == VALUE_BIGINT;
+}
+
+static ValueStatus builtin_abs(const Value* args, Value* result) {
+    if (!is_number(args[0])) return VALUE_INVALID_OPERANDS;
+    if (is_complex(args[0])) {
+        *result = value_float(repl_complex_abs(args[0]));
+        return VALUE_OK;
+    }
+    if (value_is_float(args[0])) {
+        *result = value_float(fabs(value_as_float(args[0])));
+        return VALUE_OK;
+    }
+
+    // Other reals negate through the value operations, which widen
+    // INT64_MIN where the number mode does
+    Value negative;
+    ValueStatus status = repl_value_binary(OP_LT, args[0], value_int(0), &negative);
+    if (status != VALUE_OK) return status;
+    if (!value_is_true(negative)) {
+        *result = args[0];
+        return VALUE_OK;
+    }
+    return repl_value_unary(OP_NEG, args[0], result);
+}
+
+static ValueStatus builtin_arg(const Value* args, Value* result) {
+    if (!is_number(args[0])) return VALUE_INVALID_OPERANDS;
+    *result = value_float(repl_complex_arg(args[0]));
+    return VALUE_OK;
+}
+
+static ValueStatus builtin_conj(const Value* args, Value* result) {
+    if (!is_number(args[0])) return VALUE_INVALID_OPERANDS;
+    if (is_complex(args[0])) return repl_complex_conj(args[0], result);
+    *result = args[0];
+    return VALUE_OK;
+}
+
+static ValueStatus builtin_im(const Value* args, Value* result) {
+    if (!is_number(args[0])) return VALUE_INVALID_OPERANDS;
+    *result = value_float(repl_complex_imag(args[0]));
+    return VALUE_OK;
+}
+
+static ValueStatus builtin_re(const Value* args, Value* result) {
+    if (!is_number(args[0])) return VALUE_INVALID_OPERANDS;
+    *result = is_complex(args[0]) ? value_float(value_to_double(args[0])) : args[0];
+    return VALUE_OK;
+}
+
+// A function of a real or complex argument: libm's for a real one
+static ValueStatus real_or_complex(const Value* args, double (*real)(double),
+                                   ValueStatus (*complex)(Value, Value*), Value* result) {
+    if (!is_number(args[0])) return VALUE_INVALID_OPERANDS;
+    if (is_complex(args[0])) return complex(args[0], result);
+    *result = value_float(real(value_to_double(args[0])));
+    return VALUE_OK;
+}
+
+static ValueStatus builtin_cos(const Value* args, Value* result) {
+    return real_or_complex(args, cos, repl_complex_cos, result);
+}
+
+static ValueStatus builtin_exp(const Value* args, Value* result) {
+    return real_or_complex(args, exp, repl_complex_exp, result);
+}
+
+static ValueStatus builtin_log(const Value* args, Value* result) {
+    return real_or_complex(args, log, repl_complex_log, result);
+}
+
+static ValueStatus builtin_sin(const Value* args, Value* result) {
+    return real_or_complex(args, sin, repl_complex_sin, result);
+}
+
+// At double-double or quad precision, or of such a number, a square root
+// is as precise as the arithmetic
+static ValueStatus builtin_sqrt(const Value* args, Value* result) {
+    ValueType type = value_type(args[0]);
+    if (type == VALUE_DD || type == VALUE_QUAD ||
+        (repl_precision() != PRECISION_DOUBLE && is_number(args[0]) && !is_complex(args[0]))) {
+        return repl_extended_sqrt(args[0], result);
+    }
+    return real_or_complex(args, sqrt, repl_complex_sqrt, result);
+}
+
+// Rounding to a whole number leaves integers as they are, and
+// extended-precision numbers at their precision
+static ValueStatus rounding(const Value* args, double (*round_double)(double),
+                            ExtendedFunction extended, Value* result) {
+    if (!is_number(args[0]) || is_complex(args[0])) return VALUE_INVALID_OPERANDS;
+    ValueType type = value_type(args[0]);
+    if (type == VALUE_DD || type == VALUE_QUAD) return repl_extended_function(extended, args[0], args[0], result);
+    *result = is_integer(args[0]) ? args[0] : value_float(round_double(value_to_double(args[0])));
+    return VALUE_OK;
+}
+
+static ValueStatus builtin_ceil(const Value* args, Value* result) {
+    return rounding(args, ceil, EXTENDED_CEIL, result);
+}
+
+static ValueStatus builtin_floor(const Value* args, Value* result) {
+    return rounding(args, floor, EXTENDED_FLOOR, result);
+}
+
+static ValueStatus builtin_round(const Value* args, Value* result) {
+    return rounding(args, round, EXTENDED_ROUND, result);
+}
+
+static ValueStatus builtin_trunc(const Value* args, Value* result) {
+    return rounding(args, trunc, EXTENDED_TRUNC, result);
+}
+
+static ValueStatus builtin_pow(const Value* args, Value* result) {
+    return repl_value_binary(OP_POW, args[0], args[1], result);
+}
+
+// min and max of two reals. As in C arithmetic, a double argument makes
+// the other a double, unless it is wider; NaN is then ignored as by fmin
+// and fmax. Otherwise the result is whichever argument is chosen, with
+// its own type.
+static ValueStatus choose(const Value* args, bool smaller, Value* result) {
+    ValueType x_type = value_type(args[0]), y_type = value_type(args[1]);
+    bool wide = x_type == VALUE_DD || x_type == VALUE_QUAD || y_type == VALUE_DD || y_type == VALUE_QUAD;
+    if ((x_type == VALUE_FLOAT || y_type == VALUE_FLOAT) && !wide &&
+        is_number(args[0]) && is_number(args[1]) && !is_complex(args[0]) && !is_complex(args[1])) {
+        double x = value_to_double(args[0]), y = value_to_double(args[1]);
+        *result = value_float(smaller ? fmin(x, y) : fmax(x, y));
+        return VALUE_OK;
+    }
+    Value below;
+    ValueStatus status = repl_value_binary(OP_LT, args[1], args[0], &below);
+    if (status != VALUE_OK) return status;
+    *result = value_is_true(below) == smaller ? args[1] : args[0];
+    return VALUE_OK;
+}
+
+static ValueStatus builtin_max(const Value* args, Value* result) {
+    return choose(args, false, result);
+}
+
+static ValueStatus builtin_min(const Value* args, Value* result) {
+    return choose(args, true, result);
+}
+
+static ValueStatus builtin_len(const Value* args, Value* result) {
+    return repl_array_length(args[0], result);
+}
+
+static ValueStatus builtin_linspace(const Value* args, Value* result) {
+    return repl_array_linspace(args[0], args[1], args[2], result);
+}
+
+static ValueStatus builtin_range(const Value* args, Value* result) {
+    return repl_array_range(args[0], args[1], result);
+}
+
+static ValueStatus builtin_sum(const Value* args, Value* result) {
+    return repl_array_sum(args[0], result);
+}
+
+// Sorted by name for binary search
+const Builtin repl_builtins[] = {
+    { "abs",      1, builtin_abs,      fabs,  NULL,  EXTENDED_NONE },
+    { "acos",     1, NULL,             acos,  NULL,  EXTENDED_ACOS },
+    { "arg",      1, builtin_arg,      NULL,  NULL,  EXTENDED_NONE },
+    { "asin",     1, NULL,             asin,  NULL,  EXTENDED_ASIN },
+    { "atan",     1, NULL,             atan,  NULL,  EXTENDED_ATAN },
+    { "atan2",    2, NULL,             NULL,  atan2, EXTENDED_ATAN2 },
+    { "cbrt",     1, NULL,             cbrt,  NULL,  EXTENDED_CBRT },
+    { "ceil",     1, builtin_ceil,     ceil,  NULL,  EXTENDED_NONE },
+    { "conj",     1, builtin_conj,     NULL,  NULL,  EXTENDED_NONE },
+    { "cos",      1, builtin_cos,      cos,   NULL,  EXTENDED_COS },
+    { "cosh",     1, NULL,             cosh,  NULL,  EXTENDED_COSH },
+    { "exp",      1, builtin_exp,      exp,   NULL,  EXTENDED_EXP },
+    { "floor",    1, builtin_floor,    floor, NULL,  EXTENDED_NONE },
+    { "hypot",    2, NULL,             NULL,  hypot, EXTENDED_HYPOT },
+    { "im",       1, builtin_im,       NULL,  NULL,  EXTENDED_NONE },
+    { "len",      1, builtin_len,      NULL,  NULL,  EXTENDED_NONE },
+    { "linspace", 3, builtin_linspace, NULL,  NULL,  EXTENDED_NONE },
+    { "log",      1, builtin_log,      log,   NULL,  EXTENDED_LOG },
+    { "log10",    1, NULL,             log10, NULL,  EXTENDED_LOG10 },
+    { "log2",     1, NULL,             log2,  NULL,  EXTENDED_LOG2 },
+    { "max",      2, builtin_max,      NULL,  fmax,  EXTENDED_NONE },
+    { "min",      2, builtin_min,      NULL,  fmin,  EXTENDED_NONE },
+    { "pow",      2, builtin_pow,      NULL,  pow,   EXTENDED_NONE },
+    { "range",    2, builtin_range,    NULL,  NULL,  EXTENDED_NONE },
+    { "re",       1, builtin_re,       NULL,  NULL,  EXTENDED_NONE },
+    { "round",    1, builtin_round,    round, NULL,  EXTENDED_NONE },
+    { "sin",      1, builtin_sin,      sin,   NULL,  EXTENDED_SIN },
+    { "sinh",     1, NULL,             sinh,  NULL,  EXTENDED_SINH },
+    { "sqrt",     1, builtin_sqrt,     sqrt,  NULL,  EXTENDED_NONE },
+    { "sum",      1, builtin_sum,      NULL,  NULL,  EXTENDED_NONE },
+    { "tan",      1, NULL,             tan,   NULL,  EXTENDED_TAN },
+    { "tanh",     1, NULL,             tanh,  NULL,  EXTENDED_TANH },
+    { "trunc",    1, builtin_trunc,    trunc, NULL,  EXTENDED_NONE },
+};
+
+#define BUILTIN_COUNT ((int)(sizeof(repl_builtins) / sizeof(repl_builtins[0])))
+
+int repl_find_builtin(const char* name, int length) {
+    int low = 0, high = BUILTIN_COUNT - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        int order = strncmp(repl_builtins[mid].name, name, length);
+        if (order == 0 && repl_builtins[mid].name[length] != '\0') order = 1;
+        if (order == 0) return mid;
+        if (order < 0) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return -1;
+}
+
+// Real arguments at dd or quad precision, or of either, want the extended
+// function
+static bool wants_extended(const Builtin* builtin, const Value* args) {
+    if (builtin->extended == EXTENDED_NONE) return false;
+    bool wide = repl_precision() != PRECISION_DOUBLE;
+    for (int i = 0; i < builtin->arity; i++) {
+        if (!is_number(args[i]) || is_complex(args[i])) return false;
+        ValueType type = value_type(args[i]);
+        if (type == VALUE_DD || type == VALUE_QUAD) wide = true;
+    }
+    return wide;
+}
+
+// Real-only built-ins convert their arguments to double
+ValueStatus repl_call_builtin(const Builtin* builtin, const Value* args, Value* result) {
+    if (builtin->unary && is_array(args[0])) return repl_array_map(builtin->unary, args[0], result);
+    if (builtin->binary && (is_array(args[0]) || is_array(args[1]))) {
+        return repl_array_map2(builtin->binary, args[0], args[1], result);
+    }
+    if (wants_extended(builtin, args)) {
+        return repl_extended_function(builtin->extended, args[0], args[builtin->arity == 2 ? 1 : 0], result);
+    }
+    if (builtin->function) return builtin->function(args, result);
+    for (int i = 0; i < builtin->arity; i++) {
+        if (!is_number(args[i]) || is_complex(args[i])) return VALUE_INVALID_OPERANDS;
+    }
+    double x = value_to_double(args[0]);
+    double y = builtin->arity == 2 ? value_to_double(args[1]) : 0.0;
+    *result = value_float(builtin->arity == 1 ? builtin->unary(x) : builtin->binary(x, y));
+    return VALUE_OK;
+}
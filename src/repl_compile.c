@@ -0,0 +1,1724 @@
+#include "../include/repl_compile.h"
+#include "../include/repl_lexer.h"
+#include "../include/repl_variables.h"
+#include "../include/repl_heap.h"
+#include "../include/repl_functions.h"
+#include "../include/repl_builtins.h"
+#include "../include/repl_array.h"
+#include "../include/repl_fusion.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Where the value of a compiled subexpression lives
+typedef enum {
+    DESC_CONST,     // In the constant pool, not yet loaded
+    DESC_REG        // In a temporary register
+} DescKind;
+
+typedef struct {
+    DescKind kind;
+    int index;      // Constant index or register number
+    bool negated;   // Register value still has to be negated (unary minus is deferred)
+} ExprDesc;
+
+// A name bound while compiling a function body: a parameter register, or
+// the argument of a call being inlined
+typedef struct {
+    const char* name;
+    int length;
+    ExprDesc value;
+} Binding;
+
+// Operator binding strength, following C's table from loosest to tightest
+typedef enum {
+    PREC_NONE,              // Not an infix operator
+    PREC_COMMA,             // ,
+    PREC_ASSIGNMENT,        // = += -= ...
+    PREC_CONDITIONAL,       // ?:
+    PREC_LOGICAL_OR,        // ||
+    PREC_LOGICAL_AND,       // &&
+    PREC_BITWISE_OR,        // |
+    PREC_BITWISE_XOR,       // ~ (C's ^; here '^' is power)
+    PREC_BITWISE_AND,       // &
+    PREC_EQUALITY,          // == !=
+    PREC_RELATIONAL,        // < <= > >=
+    PREC_SHIFT,             // << >>
+    PREC_ADDITIVE,          // + -
+    PREC_MULTIPLICATIVE,    // * / %
+    PREC_UNARY,             // prefix + - ~ !
+    PREC_POWER              // ^
+} Precedence;
+
+// State shared by the compile functions while emitting bytecode
+typedef struct {
+    REPL* repl;
+    ErrorContext* err;
+    Lexer lexer;
+    int position;   // Source offset recorded with each emitted instruction
+    int depth;      // Current parser recursion depth
+    CompiledExpr* out;
+    int code_capacity;
+    int constant_capacity;
+    int slot_capacity;
+    int free_reg;   // Registers are allocated as a stack
+    int first_temp; // Registers below hold a function's parameters and locals
+    bool ieee_strict; // Only apply rewrites that preserve NaN and signed zeros
+    const Binding* bindings;    // Parameters in scope; none at top level
+    int binding_count;
+    int inlining[INLINE_MAX_DEPTH + 1];  // Functions being compiled or inlined, outermost first
+    int inline_count;
+    int call_position;  // Offset of the outermost inlined call, or -1
+    int function;       // Index of the function being compiled, or -1 at top level
+    int jump_target;    // Latest offset jumped to; code before it must not be rewritten
+} Compiler;
+
+// Forward declarations of helper functions - make these local to the module
+static ExprDesc compile_expr(Compiler* c, Precedence min_prec);
+static ExprDesc compile_call(Compiler* c, const Token* name);
+static void compile_program(Compiler* c);
+static void bind_locals(Compiler* c, Binding* bindings, const char* body);
+static const Binding* find_binding(const Compiler* c, const Token* name);
+static _Noreturn void unexpected_token(Compiler* c, const Token* token);
+static void expect(Compiler* c, TokenType type, const char* expected);
+static void emit(Compiler* c, Instr instr);
+static int to_register(Compiler* c, ExprDesc desc);
+static int add_constant(Compiler* c, Value value);
+static void compact_constants(CompiledExpr* program);
+static void mark_tail_calls(Compiler* c);
+static ExprDesc reg_desc(int reg);
+
+static void release_partial(void* program) {
+    repl_free_compiled((CompiledExpr*)program);
+}
+
+// Start a new program. The caller sets up the names in scope and any
+// registers they occupy.
+static void begin_program(Compiler* c) {
+    c->err = &c->repl->error;
+    c->ieee_strict = c->repl->ieee_strict;
+    c->call_position = -1;
+    c->out = (CompiledExpr*)calloc(1, sizeof(CompiledExpr));
+    if (!c->out) repl_raise_error(c->err, -1, "out of memory");
+    c->out->register_count = c->free_reg;
+
+    // Free the partial program if compilation fails
+    c->err->cleanup = release_partial;
+    c->err->cleanup_arg = c->out;
+}
+
+static CompiledExpr* compile_source(Compiler* c, const char* source) {
+    repl_lexer_init(&c->lexer, source);
+    compile_program(c);
+    if (c->function >= 0) mark_tail_calls(c);
+    compact_constants(c->out);
+    repl_fusion_analyze(c->out, c->first_temp);
+
+    c->err->cleanup = NULL;
+    return c->out;
+}
+
+// Must run inside a recovery point (see repl_error.h): errors unwind to it
+// with the offending token's offset in expr.
+CompiledExpr* repl_compile(REPL* repl, const char* expr) {
+    Compiler c = {0};
+    c.repl = repl;
+    c.function = -1;
+    begin_program(&c);
+    return compile_source(&c, expr);
+}
+
+// Compile the body of a function, with parameter i in register i. Errors
+// unwind like repl_compile's, with offsets in the body.
+CompiledExpr* repl_compile_function(REPL* repl, int index) {
+    const Function* function = &repl->functions.items[index];
+    Binding bindings[MAX_FUNCTION_PARAMS + MAX_FUNCTION_LOCALS];
+    Compiler c = {0};
+    c.repl = repl;
+    c.function = index;
+
+    for (int i = 0; i < function->arity; i++) {
+        bindings[i].name = function->params[i];
+        bindings[i].length = (int)strlen(function->params[i]);
+        bindings[i].value = reg_desc(i);
+    }
+    c.bindings = bindings;
+    c.binding_count = function->arity;
+    c.free_reg = function->arity;
+    c.inlining[c.inline_count++] = index;
+    begin_program(&c);
+    bind_locals(&c, bindings, function->body);
+    c.first_temp = c.free_reg;
+    return compile_source(&c, function->body);
+}
+
+void repl_free_compiled(CompiledExpr* compiled) {
+    if (!compiled) return;
+    free(compiled->code);
+    free(compiled->positions);
+    free(compiled->constants);
+    free(compiled->slots);
+    free(compiled->result_versions);
+    free(compiled->fused_ends);
+    repl_jit_free(compiled->jit);
+    free(compiled);
+}
+
+// Error helpers
+
+#define MAX_TOKEN_QUOTE 32      // Longest token text quoted in a message
+
+static int quote_length(const Token* token) {
+    return token->length < MAX_TOKEN_QUOTE ? token->length : MAX_TOKEN_QUOTE;
+}
+
+static _Noreturn void out_of_memory(Compiler* c) {
+    repl_raise_error(c->err, -1, "out of memory");
+}
+
+// Bytecode emission helpers
+
+static void emit(Compiler* c, Instr instr) {
+
+    CompiledExpr* out = c->out;
+    if (out->code_length == c->code_capacity) {
+        int capacity = c->code_capacity ? c->code_capacity * 2 : 16;
+        Instr* code = (Instr*)realloc(out->code, capacity * sizeof(Instr));
+        if (!code) out_of_memory(c);
+        out->code = code;
+        int* positions = (int*)realloc(out->positions, capacity * sizeof(int));
+        if (!positions) out_of_memory(c);
+        out->positions = positions;
+        c->code_capacity = capacity;
+    }
+    out->positions[out->code_length] = c->position;
+    out->code[out->code_length++] = instr;
+}
+
+static int alloc_register(Compiler* c) {
+    if (c->free_reg >= VM_MAX_REGISTERS) {
+        repl_raise_error(c->err, c->position, "expression is too complex");
+    }
+    int reg = c->free_reg++;
+    if (c->free_reg > c->out->register_count) {
+        c->out->register_count = c->free_reg;
+    }
+    return reg;
+}
+
+// Release the temporaries held by two operands, highest register first
+static void free_operands(Compiler* c, ExprDesc a, ExprDesc b) {
+    int first = a.kind == DESC_REG ? a.index : -1;
+    int second = b.kind == DESC_REG ? b.index : -1;
+    if (first < second) {
+        int tmp = first;
+        first = second;
+        second = tmp;
+    }
+    if (first >= 0 && first == c->free_reg - 1) c->free_reg--;
+    if (second >= 0 && second == c->free_reg - 1) c->free_reg--;
+}
+
+static int to_register(Compiler* c, ExprDesc desc) {
+    if (desc.kind == DESC_REG) {
+        // Apply a deferred negation in place; the register is our temporary
+        if (desc.negated) {
+            emit(c, MAKE_ABC(OP_NEG, desc.index, desc.index, 0));
+        }
+        return desc.index;
+    }
+
+    int reg = alloc_register(c);
+    emit(c, MAKE_ABX(OP_LOADK, reg, desc.index));
+    return reg;
+}
+
+static ExprDesc reg_desc(int reg) {
+    ExprDesc desc = { DESC_REG, reg, false };
+    return desc;
+}
+
+static ExprDesc const_desc(int index) {
+    ExprDesc desc = { DESC_CONST, index, false };
+    return desc;
+}
+
+// Jumps
+
+static int emit_jump(Compiler* c, OpCode op, int reg) {
+    emit(c, MAKE_ABX(op, reg, 0));
+    return c->out->code_length - 1;
+}
+
+// Offset of the next instruction as a jump target
+static int label(Compiler* c) {
+    if (c->out->code_length >= VM_MAX_CODE) {
+        repl_raise_error(c->err, c->position, "program is too long");
+    }
+    c->jump_target = c->out->code_length;
+    return c->out->code_length;
+}
+
+static void patch_jump(Compiler* c, int jump, int target) {
+    if (jump < 0) return;
+    Instr i = c->out->code[jump];
+    c->out->code[jump] = MAKE_ABX(INSTR_OP(i), INSTR_A(i), target);
+}
+
+// Emit a jump taken when cond is true (when_true) or false, and release
+// its register. A constant condition gives an unconditional jump or none,
+// in which case this returns -1.
+static int emit_branch(Compiler* c, ExprDesc cond, bool when_true) {
+    if (cond.kind == DESC_CONST) {
+        if (value_is_true(c->out->constants[cond.index]) != when_true) return -1;
+        return emit_jump(c, OP_JMP, 0);
+    }
+
+    // A pending negation does not change whether a value is zero
+    if (cond.index == c->free_reg - 1) c->free_reg--;
+    return emit_jump(c, when_true ? OP_JMPT : OP_JMPF, cond.index);
+}
+
+// True for instructions whose A operand is only a destination
+static bool writes_register_a(int op) {
+    switch (op) {
+        case OP_STOREV: case OP_JMP: case OP_JMPF: case OP_JMPT:
+        case OP_CALL: case OP_TAILCALL: case OP_BUILTIN: case OP_ARRAY: case OP_RET:
+            return false;
+        default:
+            return true;
+    }
+}
+
+// Leave the value of desc in register target. When the last instruction
+// computed it into the top register, that instruction writes target instead.
+static void store_in(Compiler* c, ExprDesc desc, int target) {
+    CompiledExpr* out = c->out;
+    if (desc.kind == DESC_CONST) {
+        emit(c, MAKE_ABX(OP_LOADK, target, desc.index));
+        return;
+    }
+
+    int reg = to_register(c, desc);
+    if (reg == target) return;
+    Instr* last = &out->code[out->code_length - 1];
+    if (out->code_length > c->jump_target && INSTR_A(*last) == reg && reg == c->free_reg - 1 &&
+        writes_register_a(INSTR_OP(*last))) {
+        *last = (*last & ~(Instr)0xFF00) | ((Instr)target << 8);
+    } else {
+        emit(c, MAKE_ABC(OP_MOVE, target, reg, 0));
+    }
+}
+
+static ExprDesc negate_desc(Compiler* c, ExprDesc desc) {
+    if (desc.kind == DESC_CONST) {
+        Value negated;
+        repl_value_unary(OP_NEG, c->out->constants[desc.index], &negated);
+        return const_desc(add_constant(c, negated));
+    }
+    desc.negated = !desc.negated;
+    return desc;
+}
+
+// True if desc is the int64 constant value
+static bool is_int_constant(Compiler* c, ExprDesc desc, int64_t value) {
+    if (desc.kind != DESC_CONST) return false;
+    Value k = c->out->constants[desc.index];
+    return value_is_small_int(k) && value_small_int(k) == value;
+}
+
+/*
+ * Algebraic identities with one constant operand. Variables can hold any
+ * type, so only int64 constants are matched: x * 1 is x whether x is a
+ * double or an integer, where x * 1.0 would turn an integer x into a
+ * double. The identities hold for every IEEE value including NaN, except
+ * x + 0 and 0 - x, which can change the sign of a zero result and are
+ * only applied when ieee_strict is off. Only constant operands are ever
+ * dropped, so reading an undefined variable still fails.
+ */
+static bool simplify_binary(Compiler* c, OpCode op, ExprDesc left, ExprDesc right,
+                            ExprDesc* result) {
+    bool fast = !c->ieee_strict;
+
+    switch (op) {
+        case OP_ADD:
+            if (fast && is_int_constant(c, right, 0)) { *result = left; return true; }
+            if (fast && is_int_constant(c, left, 0)) { *result = right; return true; }
+            break;
+        case OP_SUB:
+            if (is_int_constant(c, right, 0)) { *result = left; return true; }
+            if (fast && is_int_constant(c, left, 0)) { *result = negate_desc(c, right); return true; }
+            break;
+        case OP_MUL:
+            if (is_int_constant(c, right, 1)) { *result = left; return true; }
+            if (is_int_constant(c, left, 1)) { *result = right; return true; }
+            if (is_int_constant(c, right, -1)) { *result = negate_desc(c, left); return true; }
+            if (is_int_constant(c, left, -1)) { *result = negate_desc(c, right); return true; }
+            break;
+        case OP_DIV:
+            // Not x / -1: an unsigned x divided by -1 converted to uint64 is 0 or 1
+            if (is_int_constant(c, right, 1)) { *result = left; return true; }
+            break;
+        case OP_POW:
+            if (is_int_constant(c, right, 1)) {
+                *result = left;
+                return true;
+            }
+            if (is_int_constant(c, right, 2) && left.kind == DESC_REG) {
+                // x^2 = x*x exactly, and (-x)^2 = x*x
+                left.negated = false;
+                int reg = to_register(c, left);
+                free_operands(c, left, right);
+                int dest = alloc_register(c);
+                emit(c, MAKE_ABC(OP_MUL, dest, reg, reg));
+                *result = reg_desc(dest);
+                return true;
+            }
+            break;
+        default:
+            break;
+    }
+    return false;
+}
+
+// Constants small enough that sums and products of two of them cannot
+// overflow, so merging them never wraps where the original would not
+static bool small_int(Value v) {
+    return value_is_small_int(v) && value_small_int(v) > -2147483648LL && value_small_int(v) < 2147483648LL;
+}
+
+// Merge "x op k2" into the instruction that just computed x = y op k1 when
+// both belong to the same associative family, so 2*pi*3 becomes pi*6. The
+// result can round differently, so this is skipped in IEEE-strict mode.
+// Both constants must be doubles or both small integers: mixing them
+// would change where the conversion to double happens. Nothing is merged
+// across a jump target, where x can also have come from another branch.
+static bool reassociate_constant(Compiler* c, OpCode op, ExprDesc left, ExprDesc right) {
+    CompiledExpr* out = c->out;
+
+    if (c->ieee_strict || out->code_length <= c->jump_target) return false;
+    if (left.kind != DESC_REG || left.index != c->free_reg - 1) return false;
+
+    Instr* last = &out->code[out->code_length - 1];
+    if (INSTR_A(*last) != left.index) return false;
+
+    int last_op = INSTR_OP(*last);
+    Value k1 = out->constants[INSTR_C(*last)];
+    Value k2 = out->constants[right.index];
+    OpCode merged_op;
+    Value merged;
+
+    bool both_float = value_is_float(k1) && value_is_float(k2);
+    if (!both_float && !(small_int(k1) && small_int(k2))) return false;
+
+    if (op == OP_MULK && last_op == OP_MULK) {
+        merged_op = OP_MULK;
+        repl_value_binary(OP_MUL, k1, k2, &merged);
+    } else if ((op == OP_ADDK || op == OP_SUBK) && (last_op == OP_ADDK || last_op == OP_SUBK)) {
+        if (last_op == OP_SUBK) repl_value_unary(OP_NEG, k1, &k1);
+        if (op == OP_SUBK) repl_value_unary(OP_NEG, k2, &k2);
+        merged_op = OP_ADDK;
+        repl_value_binary(OP_ADD, k1, k2, &merged);
+    } else {
+        return false;
+    }
+
+    int index = add_constant(c, merged);
+    if (index > 0xFF) return false;
+
+    *last = MAKE_ABC(merged_op, INSTR_A(*last), INSTR_B(*last), index);
+    return true;
+}
+
+// Emit an arithmetic instruction, using the K forms when one operand is a constant
+static ExprDesc emit_arith(Compiler* c, OpCode op, ExprDesc left, ExprDesc right) {
+    static const OpCode konst_forms[OP_COUNT] = {
+        [OP_ADD] = OP_ADDK, [OP_SUB] = OP_SUBK, [OP_MUL] = OP_MULK,
+        [OP_DIV] = OP_DIVK, [OP_POW] = OP_POWK
+    };
+    // Forms taking the constant on the left; zero where there is none
+    static const OpCode reversed_forms[OP_COUNT] = {
+        [OP_ADD] = OP_ADDK, [OP_SUB] = OP_RSUBK, [OP_MUL] = OP_MULK,
+        [OP_DIV] = OP_RDIVK
+    };
+
+    if (left.kind == DESC_CONST && right.kind == DESC_REG &&
+        reversed_forms[op] && left.index <= 0xFF) {
+        int src = to_register(c, right);
+        free_operands(c, left, right);
+        int dest = alloc_register(c);
+        emit(c, MAKE_ABC(reversed_forms[op], dest, src, left.index));
+        return reg_desc(dest);
+    }
+
+    left = reg_desc(to_register(c, left));
+
+    if (right.kind == DESC_CONST && right.index <= 0xFF && konst_forms[op]) {
+        if (reassociate_constant(c, konst_forms[op], left, right)) {
+            return left;
+        }
+        free_operands(c, left, right);
+        int dest = alloc_register(c);
+        emit(c, MAKE_ABC(konst_forms[op], dest, left.index, right.index));
+        return reg_desc(dest);
+    }
+
+    right = reg_desc(to_register(c, right));
+    free_operands(c, left, right);
+    int dest = alloc_register(c);
+    emit(c, MAKE_ABC(op, dest, left.index, right.index));
+    return reg_desc(dest);
+}
+
+/*
+ * Compile a binary operation: fold constants, apply identities, then emit
+ * it. Deferred negations are applied to their operands first; moving them
+ * through the operation (a + -b = a - b) is not exact once an operand can
+ * be an unsigned integer, whose negation wraps before it is converted to
+ * double. Operations that fail on constants (division by zero, '&' on a
+ * double) are not folded so that they still fail when the program runs.
+ */
+static ExprDesc emit_binary(Compiler* c, OpCode op, ExprDesc left, ExprDesc right) {
+
+    if (left.kind == DESC_CONST && right.kind == DESC_CONST) {
+        Value value;
+        if (repl_value_binary(op, c->out->constants[left.index],
+                              c->out->constants[right.index], &value) == VALUE_OK) {
+            return const_desc(add_constant(c, value));
+        }
+    }
+
+    ExprDesc result;
+    if (simplify_binary(c, op, left, right, &result)) {
+        return result;
+    }
+
+    return emit_arith(c, op, left, right);
+}
+
+// Compile a unary operation other than minus, folding a constant operand
+static ExprDesc emit_unary(Compiler* c, OpCode op, ExprDesc operand) {
+    if (operand.kind == DESC_CONST) {
+        Value value;
+        if (repl_value_unary(op, c->out->constants[operand.index], &value) == VALUE_OK) {
+            return const_desc(add_constant(c, value));
+        }
+    }
+
+    // The operand is our temporary, so the result can replace it
+    int reg = to_register(c, operand);
+    emit(c, MAKE_ABC(op, reg, reg, 0));
+    return reg_desc(reg);
+}
+
+static int add_constant(Compiler* c, Value value) {
+    CompiledExpr* out = c->out;
+
+    // Share pool entries between identical values; 0.0 and -0.0 stay
+    // distinct, and so do 1 and 1.0
+    for (int i = 0; i < out->constant_count; i++) {
+        if (repl_value_identical(out->constants[i], value)) {
+            return i;
+        }
+    }
+
+    if (out->constant_count == c->constant_capacity) {
+        int capacity = c->constant_capacity ? c->constant_capacity * 2 : 8;
+        if (capacity > VM_MAX_CONSTANTS) {
+            repl_raise_error(c->err, c->position, "too many constants");
+        }
+        Value* constants = (Value*)realloc(out->constants, capacity * sizeof(Value));
+        if (!constants) out_of_memory(c);
+        out->constants = constants;
+        c->constant_capacity = capacity;
+    }
+    out->constants[out->constant_count] = value;
+    return out->constant_count++;
+}
+
+// True for the K-form instructions, whose C operand is a constant index
+static bool uses_constant_c(int op) {
+    switch (op) {
+        case OP_ADDK: case OP_SUBK: case OP_MULK: case OP_DIVK:
+        case OP_POWK: case OP_RSUBK: case OP_RDIVK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Folding leaves operands of folded operations in the pool; drop the
+// constants no instruction refers to and renumber the rest
+static void compact_constants(CompiledExpr* program) {
+    int remap[VM_MAX_CONSTANTS];
+    bool* used = (bool*)calloc(program->constant_count ? program->constant_count : 1, sizeof(bool));
+    if (!used) return;
+
+    for (int pc = 0; pc < program->code_length; pc++) {
+        Instr i = program->code[pc];
+        if (INSTR_OP(i) == OP_LOADK) {
+            used[INSTR_BX(i)] = true;
+        } else if (uses_constant_c(INSTR_OP(i))) {
+            used[INSTR_C(i)] = true;
+        }
+    }
+
+    int count = 0;
+    for (int k = 0; k < program->constant_count; k++) {
+        if (used[k]) {
+            program->constants[count] = program->constants[k];
+            remap[k] = count++;
+        }
+    }
+    program->constant_count = count;
+    free(used);
+
+    // Indices only move down, so K operands still fit in eight bits
+    for (int pc = 0; pc < program->code_length; pc++) {
+        Instr i = program->code[pc];
+        int op = INSTR_OP(i);
+        if (op == OP_LOADK) {
+            program->code[pc] = MAKE_ABX(op, INSTR_A(i), remap[INSTR_BX(i)]);
+        } else if (uses_constant_c(op)) {
+            program->code[pc] = MAKE_ABC(op, INSTR_A(i), INSTR_B(i), remap[INSTR_C(i)]);
+        }
+    }
+}
+
+// Bind a variable reference to its slot. Names not yet assigned get an
+// undefined slot, so the program keeps working once they are assigned.
+static int add_slot(Compiler* c, const char* name, int length) {
+    CompiledExpr* out = c->out;
+
+    if (length >= MAX_VARIABLE_NAME) {
+        repl_raise_error(c->err, c->position, "name '%.*s...' is too long",
+                         MAX_TOKEN_QUOTE, name);
+    }
+
+    char buffer[MAX_VARIABLE_NAME];
+    memcpy(buffer, name, length);
+    buffer[length] = '\0';
+
+    int slot = repl_resolve_variable(c->repl, buffer);
+    if (slot < 0) out_of_memory(c);
+
+    // Reuse the entry if the variable is already referenced
+    for (int i = 0; i < out->slot_count; i++) {
+        if (out->slots[i] == slot) {
+            return i;
+        }
+    }
+
+    if (out->slot_count == c->slot_capacity) {
+        int capacity = c->slot_capacity ? c->slot_capacity * 2 : 4;
+        if (capacity > VM_MAX_CONSTANTS) {
+            repl_raise_error(c->err, c->position, "too many variables in one expression");
+        }
+        int* slots = (int*)realloc(out->slots, capacity * sizeof(int));
+        if (!slots) out_of_memory(c);
+        out->slots = slots;
+        c->slot_capacity = capacity;
+    }
+    out->slots[out->slot_count] = slot;
+    return out->slot_count++;
+}
+
+/*
+ * Single-pass Pratt parser. compile_expr() parses a prefix expression and
+ * then keeps absorbing infix operators whose precedence is at least
+ * min_prec, so one loop covers every binary level and only the current
+ * token is held. The levels follow C's table from loosest to tightest;
+ * '^' is power, binds tighter than unary minus (-2^2 = -4) and is
+ * right-associative, so exclusive or is written as a binary '~' at C's
+ * '^' level, as in Lua. Each call returns where its result lives; constants
+ * stay in the pool until an operation needs them in a register.
+ */
+
+typedef struct {
+    Precedence precedence;
+    OpCode op;
+    bool right_assoc;
+    bool swapped;           // Operands are exchanged: a > b is b < a
+} InfixRule;
+
+static const InfixRule infix_rules[TOKEN_COUNT] = {
+    [TOKEN_PLUS]    = { PREC_ADDITIVE,       OP_ADD,  false },
+    [TOKEN_MINUS]   = { PREC_ADDITIVE,       OP_SUB,  false },
+    [TOKEN_STAR]    = { PREC_MULTIPLICATIVE, OP_MUL,  false },
+    [TOKEN_SLASH]   = { PREC_MULTIPLICATIVE, OP_DIV,  false },
+    [TOKEN_PERCENT] = { PREC_MULTIPLICATIVE, OP_MOD,  false },
+    [TOKEN_SHL]     = { PREC_SHIFT,          OP_SHL,  false },
+    [TOKEN_SHR]     = { PREC_SHIFT,          OP_SHR,  false },
+    [TOKEN_AMP]     = { PREC_BITWISE_AND,    OP_BAND, false },
+    [TOKEN_TILDE]   = { PREC_BITWISE_XOR,    OP_BXOR, false },
+    [TOKEN_PIPE]    = { PREC_BITWISE_OR,     OP_BOR,  false },
+    [TOKEN_CARET]   = { PREC_POWER,          OP_POW,  true  },
+    [TOKEN_LT]      = { PREC_RELATIONAL,     OP_LT,   false },
+    [TOKEN_LE]      = { PREC_RELATIONAL,     OP_LE,   false },
+    [TOKEN_GT]      = { PREC_RELATIONAL,     OP_LT,   false, true },
+    [TOKEN_GE]      = { PREC_RELATIONAL,     OP_LE,   false, true },
+    [TOKEN_EQ]      = { PREC_EQUALITY,       OP_EQ,   false },
+    [TOKEN_NE]      = { PREC_EQUALITY,       OP_NE,   false },
+    [TOKEN_AND_AND] = { PREC_LOGICAL_AND,    OP_JMPF, false },
+    [TOKEN_OR_OR]   = { PREC_LOGICAL_OR,     OP_JMPT, false },
+    [TOKEN_QUESTION] = { PREC_CONDITIONAL,   OP_JMPF, true  },
+};
+
+static void advance(Compiler* c) {
+    repl_lexer_next(&c->lexer);
+}
+
+static int token_position(Compiler* c, const Token* token) {
+    // Code inlined from a function body is reported at the call
+    if (c->call_position >= 0) return c->call_position;
+    return (int)(token->start - c->lexer.source);
+}
+
+static _Noreturn void unexpected_token(Compiler* c, const Token* token) {
+    int position = token_position(c, token);
+    if (token->type == TOKEN_EOF) {
+        repl_raise_error(c->err, position, "unexpected end of input");
+    }
+    if (token->type == TOKEN_ERROR && token->length > 1 && token->start[0] == '0' &&
+        token->start[1] != 'x' && token->start[1] != 'X' &&
+        strcspn(token->start, "89") < (size_t)token->length) {
+        repl_raise_error(c->err, position, "invalid digit in octal literal '%.*s'",
+                         quote_length(token), token->start);
+    }
+    if (token->type == TOKEN_ERROR && token->length > 1 && repl_number_mode() == NUMBER_MODE_DECIMAL &&
+        (token->start[0] != '0' || strcspn(token->start, ".eE") < (size_t)token->length)) {
+        repl_raise_error(c->err, position, "decimal literal '%.*s' is too large",
+                         quote_length(token), token->start);
+    }
+    if (token->type == TOKEN_ERROR && token->length > 1) {
+        repl_raise_error(c->err, position, "integer literal '%.*s' is too large",
+                         quote_length(token), token->start);
+    }
+    if (token->type == TOKEN_ERROR) {
+        repl_raise_error(c->err, position, "unexpected character '%c'", *token->start);
+    }
+    repl_raise_error(c->err, position, "unexpected '%.*s'", quote_length(token), token->start);
+}
+
+static _Noreturn void expected_token(Compiler* c, const char* expected, const Token* found) {
+    int position = token_position(c, found);
+    if (found->type == TOKEN_EOF) {
+        repl_raise_error(c->err, position, "expected %s at end of input", expected);
+    }
+    repl_raise_error(c->err, position, "expected %s before '%.*s'", expected,
+                     quote_length(found), found->start);
+}
+
+static const Binding* find_binding(const Compiler* c, const Token* name) {
+    for (int i = 0; i < c->binding_count; i++) {
+        const Binding* binding = &c->bindings[i];
+        if (binding->length == name->length &&
+            memcmp(binding->name, name->start, name->length) == 0) {
+            return binding;
+        }
+    }
+    return NULL;
+}
+
+// Small functions whose own code makes no calls are inlined, unless one is
+// already being compiled or inlined further out, which would recurse
+static bool should_inline(const Compiler* c, int index) {
+    const CompiledExpr* code = c->repl->functions.items[index].code;
+    if (!code || code->calls_functions || code->has_statements ||
+        code->code_length > INLINE_MAX_INSTRUCTIONS) {
+        return false;
+    }
+    if (c->inline_count > INLINE_MAX_DEPTH) return false;
+    for (int i = 0; i < c->inline_count; i++) {
+        if (c->inlining[i] == index) return false;
+    }
+    return true;
+}
+
+/*
+ * Compile the body of a function in place of a call to it: the body is
+ * parsed again with each parameter bound to its argument, so constant
+ * arguments fold through it. Argument registers start at base; they are
+ * dropped afterwards, leaving the result on top of the register stack.
+ */
+static ExprDesc inline_call(Compiler* c, int index, const ExprDesc* args, int base, int position) {
+    const Function* function = &c->repl->functions.items[index];
+    Binding params[MAX_FUNCTION_PARAMS];
+    for (int i = 0; i < function->arity; i++) {
+        params[i].name = function->params[i];
+        params[i].length = (int)strlen(function->params[i]);
+        params[i].value = args[i];
+    }
+
+    // Parse the body in place of the caller's text, then resume the caller
+    Lexer caller_lexer = c->lexer;
+    const Binding* caller_bindings = c->bindings;
+    int caller_binding_count = c->binding_count;
+    int caller_call_position = c->call_position;
+
+    c->bindings = params;
+    c->binding_count = function->arity;
+    if (c->call_position < 0) c->call_position = position;
+    c->inlining[c->inline_count++] = index;
+    repl_lexer_init(&c->lexer, function->body);
+
+    ExprDesc result = compile_expr(c, PREC_COMMA);
+    if (c->lexer.current.type != TOKEN_EOF) {
+        unexpected_token(c, &c->lexer.current);
+    }
+
+    c->inline_count--;
+    c->lexer = caller_lexer;
+    c->bindings = caller_bindings;
+    c->binding_count = caller_binding_count;
+    c->call_position = caller_call_position;
+
+    if (result.kind == DESC_CONST) {
+        c->free_reg = base;
+        return result;
+    }
+    int reg = to_register(c, result);
+    if (reg != base) emit(c, MAKE_ABC(OP_MOVE, base, reg, 0));
+    c->free_reg = base + 1;
+    return reg_desc(base);
+}
+
+// Arrays longer than ARRAY_MAX_CONSTANT are made each time the program
+// runs rather than kept in its constants, which live as long as it is cached
+static bool is_large_array(Value value) {
+    return value_type(value) == VALUE_ARRAY && value_array(value)->length > ARRAY_MAX_CONSTANT;
+}
+
+/*
+ * Compile a call to a built-in. Constant arguments stay in the pool until
+ * all are parsed, so a call on constants is evaluated here; otherwise the
+ * arguments are placed in order from base, last first, since each sits
+ * at or below its place.
+ */
+static ExprDesc compile_builtin_call(Compiler* c, int index, int position) {
+    const Builtin* builtin = &repl_builtins[index];
+    ExprDesc args[BUILTIN_MAX_ARITY];
+    int base = c->free_reg;
+    int count = 0;
+    bool constant = true;
+    advance(c);
+    bool more = c->lexer.current.type != TOKEN_RPAREN;
+    while (more && count < builtin->arity) {
+        ExprDesc arg = compile_expr(c, PREC_ASSIGNMENT);
+        if (arg.kind == DESC_REG) {
+            arg = reg_desc(to_register(c, arg));
+            constant = false;
+        }
+        args[count++] = arg;
+        more = c->lexer.current.type == TOKEN_COMMA;
+        if (more) advance(c);
+    }
+    if (!more && c->lexer.current.type != TOKEN_RPAREN) {
+        expected_token(c, "')'", &c->lexer.current);
+    }
+    if (more || count != builtin->arity) {
+        repl_raise_error(c->err, position, "'%s' takes %d argument%s", builtin->name,
+                         builtin->arity, builtin->arity == 1 ? "" : "s");
+    }
+    advance(c);
+
+    c->position = position;
+    if (constant) {
+        Value values[BUILTIN_MAX_ARITY];
+        Value value;
+        for (int i = 0; i < count; i++) values[i] = c->out->constants[args[i].index];
+        if (repl_call_builtin(builtin, values, &value) == VALUE_OK && !is_large_array(value)) {
+            return const_desc(add_constant(c, value));
+        }
+    }
+
+    while (c->free_reg < base + count) alloc_register(c);
+    for (int i = count - 1; i >= 0; i--) {
+        if (args[i].kind == DESC_CONST) {
+            emit(c, MAKE_ABX(OP_LOADK, base + i, args[i].index));
+        } else if (args[i].index != base + i) {
+            emit(c, MAKE_ABC(OP_MOVE, base + i, args[i].index, 0));
+        }
+    }
+    c->free_reg = base;
+    int dest = alloc_register(c);
+    emit(c, MAKE_ABC(OP_BUILTIN, dest, index, 0));
+    return reg_desc(dest);
+}
+
+// Compile a call, with the current token the '(' after the function name.
+// User functions hide built-ins of the same name.
+static ExprDesc compile_call(Compiler* c, const Token* name) {
+    int position = token_position(c, name);
+    int index = repl_find_function(c->repl, name->start, name->length);
+    if (index < 0) {
+        int builtin = repl_find_builtin(name->start, name->length);
+        if (builtin >= 0) return compile_builtin_call(c, builtin, position);
+        repl_raise_error(c->err, position, "undefined function '%.*s'",
+                         quote_length(name), name->start);
+    }
+    const Function* function = &c->repl->functions.items[index];
+    bool inline_body = should_inline(c, index);
+
+    // Arguments are left on the register stack in order from base. An
+    // inlined call keeps constant arguments in the pool instead.
+    ExprDesc args[MAX_FUNCTION_PARAMS];
+    int base = c->free_reg;
+    int count = 0;
+    advance(c);
+    bool more = c->lexer.current.type != TOKEN_RPAREN;
+    while (more && count < function->arity) {
+        ExprDesc arg = compile_expr(c, PREC_ASSIGNMENT);
+        if (arg.kind == DESC_REG || !inline_body) {
+            arg = reg_desc(to_register(c, arg));
+        }
+        args[count++] = arg;
+        more = c->lexer.current.type == TOKEN_COMMA;
+        if (more) advance(c);
+    }
+    if (!more && c->lexer.current.type != TOKEN_RPAREN) {
+        expected_token(c, "')'", &c->lexer.current);
+    }
+    if (more || count != function->arity) {
+        repl_raise_error(c->err, position, "'%s' takes %d argument%s", function->name,
+                         function->arity, function->arity == 1 ? "" : "s");
+    }
+    advance(c);
+
+    c->position = position;
+    if (inline_body) {
+        return inline_call(c, index, args, base, position);
+    }
+
+    c->free_reg = base;
+    int dest = alloc_register(c);
+    emit(c, MAKE_ABX(OP_CALL, dest, index));
+    c->out->calls_functions = true;
+    return reg_desc(dest);
+}
+
+// Leave an array element in register target, at or above which its
+// temporaries are
+static void place_element(Compiler* c, ExprDesc element, int target) {
+    while (c->free_reg <= target) alloc_register(c);
+    store_in(c, element, target);
+    c->free_reg = target + 1;
+}
+
+/*
+ * Compile an array literal, with the current token its '['. While every
+ * element is a constant they stay in the pool, and a literal of real
+ * constants becomes one constant array. From the first element that is
+ * not, each element is placed in register base + index, the constants
+ * before it only once it is there, and OP_ARRAY collects them.
+ */
+static ExprDesc compile_array(Compiler* c) {
+    int position = token_position(c, &c->lexer.current);
+    uint16_t constants[ARRAY_MAX_LITERAL];
+    int base = c->free_reg;
+    int count = 0;
+    bool constant = true;
+    advance(c);
+    bool more = c->lexer.current.type != TOKEN_RBRACKET;
+    while (more) {
+        if (count == ARRAY_MAX_LITERAL) {
+            repl_raise_error(c->err, position, "array literal has more than %d elements",
+                             ARRAY_MAX_LITERAL);
+        }
+        ExprDesc element = compile_expr(c, PREC_ASSIGNMENT);
+        if (constant && element.kind == DESC_CONST) {
+            constants[count] = (uint16_t)element.index;
+        } else {
+            place_element(c, element, base + count);
+            for (int i = 0; constant && i < count; i++) {
+                emit(c, MAKE_ABX(OP_LOADK, base + i, constants[i]));
+            }
+            constant = false;
+        }
+        count++;
+        more = c->lexer.current.type == TOKEN_COMMA;
+        if (more) advance(c);
+    }
+    expect(c, TOKEN_RBRACKET, "']'");
+
+    c->position = position;
+    if (constant) {
+        bool real = true;
+        for (int i = 0; i < count; i++) {
+            ValueType type = value_type(c->out->constants[constants[i]]);
+            real = real && type != VALUE_COMPLEX && type != VALUE_ARRAY;
+        }
+        double* elements;
+        Value array;
+        if (real && repl_array_make((size_t)count, &elements, &array) == VALUE_OK) {
+            for (int i = 0; i < count; i++) elements[i] = value_to_double(c->out->constants[constants[i]]);
+            return const_desc(add_constant(c, array));
+        }
+        // Left for OP_ARRAY to report
+        for (int i = 0; i < count; i++) place_element(c, const_desc(constants[i]), base + i);
+    }
+
+    c->free_reg = base;
+    int dest = alloc_register(c);
+    emit(c, MAKE_ABC(OP_ARRAY, dest, count, 0));
+    return reg_desc(dest);
+}
+
+static ExprDesc compile_prefix(Compiler* c) {
+    Token token = c->lexer.current;
+
+    switch (token.type) {
+        case TOKEN_NUMBER:
+            advance(c);
+            return const_desc(add_constant(c, token.number));
+
+        case TOKEN_NAME: {
+            advance(c);
+            if (c->lexer.current.type == TOKEN_LPAREN) {
+                return compile_call(c, &token);
+            }
+
+            c->position = token_position(c, &token);
+            const Binding* binding = find_binding(c, &token);
+            if (binding && binding->value.kind == DESC_CONST) {
+                return binding->value;
+            }
+
+            // Copy a bound register so that the operation using the value
+            // can overwrite its operand as with any other temporary
+            int reg = alloc_register(c);
+            if (binding) {
+                emit(c, MAKE_ABC(OP_MOVE, reg, binding->value.index, 0));
+            } else {
+                emit(c, MAKE_ABX(OP_LOADV, reg, add_slot(c, token.start, token.length)));
+            }
+            return reg_desc(reg);
+        }
+
+        case TOKEN_LPAREN: {
+            advance(c);
+            ExprDesc value = compile_expr(c, PREC_COMMA);
+
+            if (c->lexer.current.type != TOKEN_RPAREN) {
+                expected_token(c, "')'", &c->lexer.current);
+            }
+            advance(c);
+            return value;
+        }
+
+        case TOKEN_LBRACKET:
+            return compile_array(c);
+
+        case TOKEN_PLUS:
+            advance(c);
+            return compile_expr(c, PREC_UNARY);
+
+        case TOKEN_MINUS: {
+            advance(c);
+            ExprDesc operand = compile_expr(c, PREC_UNARY);
+            return negate_desc(c, operand);
+        }
+
+        case TOKEN_TILDE: {
+            advance(c);
+            ExprDesc operand = compile_expr(c, PREC_UNARY);
+            c->position = token_position(c, &token);
+            return emit_unary(c, OP_BNOT, operand);
+        }
+
+        case TOKEN_BANG: {
+            advance(c);
+            ExprDesc operand = compile_expr(c, PREC_UNARY);
+            return emit_unary(c, OP_NOT, operand);
+        }
+
+        default:
+            unexpected_token(c, &token);
+    }
+}
+
+static void expect(Compiler* c, TokenType type, const char* expected) {
+    if (c->lexer.current.type != type) {
+        expected_token(c, expected, &c->lexer.current);
+    }
+    advance(c);
+}
+
+// Compile an operand that is never evaluated, for its syntax only, and
+// drop its code. Constants it added are dropped with the pool compaction.
+static void skip_operand(Compiler* c, Precedence prec) {
+    CompiledExpr* out = c->out;
+    int code_length = out->code_length;
+    int free_reg = c->free_reg;
+    int jump_target = c->jump_target;
+    int slot_count = out->slot_count;
+    bool calls_functions = out->calls_functions;
+
+    compile_expr(c, prec);
+
+    out->code_length = code_length;
+    out->slot_count = slot_count;
+    out->calls_functions = calls_functions;
+    c->free_reg = free_reg;
+    c->jump_target = jump_target;
+}
+
+static bool is_comparison(int op) {
+    return op == OP_LT || op == OP_LE || op == OP_EQ || op == OP_NE ||
+           op == OP_NOT || op == OP_BOOL;
+}
+
+// True when every path so far ends by storing a bool into reg
+static bool holds_bool(const Compiler* c, int reg) {
+    const CompiledExpr* out = c->out;
+    if (out->code_length <= c->jump_target) return false;
+    Instr last = out->code[out->code_length - 1];
+    return INSTR_A(last) == reg && is_comparison(INSTR_OP(last));
+}
+
+/*
+ * "a && b" and "a || b" give a bool and evaluate b only when a does not
+ * decide the result. The jump that skips b is taken on a's register,
+ * which then also holds the result: b is compiled into it, so both paths
+ * meet with the value in one place. A constant a decides at compile time.
+ */
+static ExprDesc compile_logical(Compiler* c, ExprDesc left, OpCode jump_op, Precedence prec) {
+    bool decides = jump_op == OP_JMPT;
+
+    if (left.kind == DESC_CONST) {
+        if (value_is_true(c->out->constants[left.index]) == decides) {
+            skip_operand(c, prec);
+            return const_desc(add_constant(c, value_bool(decides)));
+        }
+        ExprDesc right = compile_expr(c, prec);
+        if (right.kind == DESC_REG && !right.negated && holds_bool(c, right.index)) return right;
+        return emit_unary(c, OP_BOOL, right);
+    }
+
+    int reg = to_register(c, left);
+    bool both_bool = holds_bool(c, reg);
+    int skip = emit_jump(c, jump_op, reg);
+    c->free_reg = reg;
+    store_in(c, compile_expr(c, prec), reg);
+    both_bool = both_bool && holds_bool(c, reg) && c->out->code_length - 1 > skip;
+    c->free_reg = reg + 1;
+
+    patch_jump(c, skip, label(c));
+    if (!both_bool) emit(c, MAKE_ABC(OP_BOOL, reg, reg, 0));
+    return reg_desc(reg);
+}
+
+/*
+ * "cond ? a : b". Both branches leave their value in the register the
+ * condition was in. As in C, the middle operand may be any expression
+ * and the last one is parsed at this level, which makes the operator
+ * right-associative. A constant condition compiles only the branch taken.
+ */
+static ExprDesc compile_conditional(Compiler* c, ExprDesc cond) {
+    if (cond.kind == DESC_CONST) {
+        ExprDesc result;
+        if (value_is_true(c->out->constants[cond.index])) {
+            result = compile_expr(c, PREC_COMMA);
+            expect(c, TOKEN_COLON, "':'");
+            skip_operand(c, PREC_CONDITIONAL);
+        } else {
+            skip_operand(c, PREC_COMMA);
+            expect(c, TOKEN_COLON, "':'");
+            result = compile_expr(c, PREC_CONDITIONAL);
+        }
+        return result;
+    }
+
+    int skip = emit_branch(c, cond, false);
+    int base = c->free_reg;
+    store_in(c, compile_expr(c, PREC_COMMA), base);
+    expect(c, TOKEN_COLON, "':'");
+    int end = emit_jump(c, OP_JMP, 0);
+
+    patch_jump(c, skip, label(c));
+    c->free_reg = base;
+    store_in(c, compile_expr(c, PREC_CONDITIONAL), base);
+    patch_jump(c, end, label(c));
+    c->free_reg = base + 1;
+    return reg_desc(base);
+}
+
+static ExprDesc compile_expr(Compiler* c, Precedence min_prec) {
+    // Nesting recurses on the C stack; bound it rather than overflow
+    if (++c->depth > MAX_NESTING_DEPTH) {
+        repl_raise_error(c->err, token_position(c, &c->lexer.current),
+                         "expression is nested too deeply");
+    }
+
+    ExprDesc left = compile_prefix(c);
+
+    for (;;) {
+        const InfixRule* rule = &infix_rules[c->lexer.current.type];
+        if (rule->precedence == PREC_NONE || rule->precedence < min_prec) break;
+
+        int op_position = token_position(c, &c->lexer.current);
+        TokenType type = c->lexer.current.type;
+        advance(c);
+        if (type == TOKEN_QUESTION) {
+            left = compile_conditional(c, left);
+            continue;
+        }
+        if (rule->op == OP_JMPF || rule->op == OP_JMPT) {
+            left = compile_logical(c, left, rule->op, rule->precedence + 1);
+            continue;
+        }
+        Precedence next = rule->right_assoc ? rule->precedence : rule->precedence + 1;
+        ExprDesc right = compile_expr(c, next);
+
+        // Runtime errors in the operation point at the operator
+        c->position = op_position;
+        left = rule->swapped ? emit_binary(c, rule->op, right, left)
+                             : emit_binary(c, rule->op, left, right);
+    }
+
+    c->depth--;
+    return left;
+}
+
+/*
+ * Statements. Control flow compiles to jumps within one program, so loop
+ * bodies are parsed once. The condition of a loop, and the step of a for
+ * loop, come before the body in the text but are emitted after it, so
+ * each iteration takes a single conditional jump back to the top:
+ *
+ *       JMP cond
+ *   top:  body
+ *         step
+ *   cond: JMPT cond, top
+ *
+ * Their tokens are skipped at first and compiled from a saved lexer once
+ * the body is done.
+ */
+
+static void compile_statement(Compiler* c);
+
+// Skip to the next token of type outside parentheses, leaving it current
+static void skip_to(Compiler* c, TokenType type, const char* expected) {
+    int depth = 0;
+    while (depth > 0 || c->lexer.current.type != type) {
+        switch (c->lexer.current.type) {
+            case TOKEN_EOF:
+                expected_token(c, expected, &c->lexer.current);
+            case TOKEN_LPAREN:
+                depth++;
+                break;
+            case TOKEN_RPAREN:
+                if (--depth < 0) expected_token(c, expected, &c->lexer.current);
+                break;
+            default:
+                break;
+        }
+        advance(c);
+    }
+}
+
+// "name = value". Inside a function every assigned name is bound to a
+// register (see bind_locals); at top level it is a variable.
+static ExprDesc compile_assignment(Compiler* c, const Token* name) {
+    int position = token_position(c, name);
+    ExprDesc value = compile_expr(c, PREC_ASSIGNMENT);
+    const Binding* binding = find_binding(c, name);
+    c->position = position;
+
+    if (!binding) {
+        int reg = to_register(c, value);
+        emit(c, MAKE_ABX(OP_STOREV, reg, add_slot(c, name->start, name->length)));
+        c->out->stores_variables = true;
+        return reg_desc(reg);
+    }
+
+    store_in(c, value, binding->value.index);
+    return binding->value;
+}
+
+// An assignment or an expression
+static ExprDesc compile_simple_statement(Compiler* c) {
+    if (c->lexer.current.type == TOKEN_NAME) {
+        Lexer saved = c->lexer;
+        Token name = c->lexer.current;
+        advance(c);
+        if (c->lexer.current.type == TOKEN_ASSIGN) {
+            advance(c);
+            return compile_assignment(c, &name);
+        }
+        c->lexer = saved;
+    }
+    return compile_expr(c, PREC_COMMA);
+}
+
+// Statements end with ';', which may be left out before '}' or the end
+static void end_statement(Compiler* c) {
+    TokenType type = c->lexer.current.type;
+    if (type == TOKEN_SEMICOLON) {
+        advance(c);
+    } else if (type != TOKEN_RBRACE && type != TOKEN_EOF) {
+        expected_token(c, "';'", &c->lexer.current);
+    }
+}
+
+static void compile_return(Compiler* c) {
+    int base = c->free_reg;
+    advance(c);
+    ExprDesc value = compile_expr(c, PREC_COMMA);
+    emit(c, MAKE_ABC(OP_RET, to_register(c, value), 0, 0));
+    c->free_reg = base;
+    end_statement(c);
+}
+
+static void compile_if(Compiler* c) {
+    advance(c);
+    expect(c, TOKEN_LPAREN, "'('");
+    ExprDesc cond = compile_expr(c, PREC_COMMA);
+    expect(c, TOKEN_RPAREN, "')'");
+
+    int skip = emit_branch(c, cond, false);
+    compile_statement(c);
+    if (c->lexer.current.type == TOKEN_ELSE) {
+        advance(c);
+        int end = emit_jump(c, OP_JMP, 0);
+        patch_jump(c, skip, label(c));
+        compile_statement(c);
+        patch_jump(c, end, label(c));
+    } else {
+        patch_jump(c, skip, label(c));
+    }
+}
+
+// Emit the condition of a loop saved in lexer, which jumps back to top;
+// an empty condition loops forever
+static void compile_loop_condition(Compiler* c, const Lexer* lexer, int top,
+                                   TokenType end, const char* expected) {
+    c->lexer = *lexer;
+    ExprDesc cond = const_desc(add_constant(c, value_bool(true)));
+    if (c->lexer.current.type != end) {
+        cond = compile_expr(c, PREC_COMMA);
+    }
+    if (c->lexer.current.type != end) {
+        expected_token(c, expected, &c->lexer.current);
+    }
+    patch_jump(c, emit_branch(c, cond, true), top);
+}
+
+static void compile_while(Compiler* c) {
+    advance(c);
+    expect(c, TOKEN_LPAREN, "'('");
+    Lexer condition = c->lexer;
+    skip_to(c, TOKEN_RPAREN, "')'");
+    advance(c);
+
+    int enter = emit_jump(c, OP_JMP, 0);
+    int top = label(c);
+    compile_statement(c);
+    Lexer after = c->lexer;
+
+    patch_jump(c, enter, label(c));
+    compile_loop_condition(c, &condition, top, TOKEN_RPAREN, "')'");
+    c->lexer = after;
+}
+
+static void compile_for(Compiler* c) {
+    int base = c->free_reg;
+    advance(c);
+    expect(c, TOKEN_LPAREN, "'('");
+    if (c->lexer.current.type != TOKEN_SEMICOLON) {
+        compile_simple_statement(c);
+        c->free_reg = base;
+    }
+    expect(c, TOKEN_SEMICOLON, "';'");
+
+    Lexer condition = c->lexer;
+    skip_to(c, TOKEN_SEMICOLON, "';'");
+    advance(c);
+    Lexer step = c->lexer;
+    skip_to(c, TOKEN_RPAREN, "')'");
+    advance(c);
+
+    int enter = emit_jump(c, OP_JMP, 0);
+    int top = label(c);
+    compile_statement(c);
+    Lexer after = c->lexer;
+
+    c->lexer = step;
+    if (c->lexer.current.type != TOKEN_RPAREN) {
+        compile_simple_statement(c);
+        c->free_reg = base;
+        if (c->lexer.current.type != TOKEN_RPAREN) {
+            expected_token(c, "')'", &c->lexer.current);
+        }
+    }
+    patch_jump(c, enter, label(c));
+    compile_loop_condition(c, &condition, top, TOKEN_SEMICOLON, "';'");
+    c->lexer = after;
+}
+
+static void compile_statement(Compiler* c) {
+    // Statements nest on the C stack like expressions
+    if (++c->depth > MAX_NESTING_DEPTH) {
+        repl_raise_error(c->err, token_position(c, &c->lexer.current),
+                         "statement is nested too deeply");
+    }
+
+    int base = c->free_reg;
+    switch (c->lexer.current.type) {
+        case TOKEN_LBRACE:
+            advance(c);
+            while (c->lexer.current.type != TOKEN_RBRACE) {
+                if (c->lexer.current.type == TOKEN_EOF) {
+                    expected_token(c, "'}'", &c->lexer.current);
+                }
+                compile_statement(c);
+            }
+            advance(c);
+            break;
+        case TOKEN_SEMICOLON:
+            advance(c);
+            break;
+        case TOKEN_IF:
+            compile_if(c);
+            break;
+        case TOKEN_WHILE:
+            compile_while(c);
+            break;
+        case TOKEN_FOR:
+            compile_for(c);
+            break;
+        case TOKEN_RETURN:
+            compile_return(c);
+            break;
+        default:
+            compile_simple_statement(c);
+            c->free_reg = base;
+            end_statement(c);
+            break;
+    }
+
+    c->depth--;
+}
+
+static bool starts_simple_statement(TokenType type) {
+    switch (type) {
+        case TOKEN_LBRACE: case TOKEN_SEMICOLON: case TOKEN_IF:
+        case TOKEN_WHILE: case TOKEN_FOR: case TOKEN_RETURN:
+            return false;
+        default:
+            return true;
+    }
+}
+
+/*
+ * A program is a list of statements. When the last is an expression or
+ * assignment with no ';' after it, the program returns its value, so a
+ * plain expression compiles exactly as before. Otherwise the program
+ * returns undefined unless a return statement is reached.
+ */
+static void compile_program(Compiler* c) {
+    while (c->lexer.current.type != TOKEN_EOF) {
+        if (starts_simple_statement(c->lexer.current.type)) {
+            int base = c->free_reg;
+            ExprDesc value = compile_simple_statement(c);
+            if (c->lexer.current.type == TOKEN_EOF) {
+                emit(c, MAKE_ABC(OP_RET, to_register(c, value), 0, 0));
+                return;
+            }
+            c->free_reg = base;
+            if (c->lexer.current.type != TOKEN_SEMICOLON) {
+                unexpected_token(c, &c->lexer.current);
+            }
+            advance(c);
+        } else {
+            compile_statement(c);
+        }
+        c->out->has_statements = true;
+    }
+
+    int reg = to_register(c, const_desc(add_constant(c, value_undefined())));
+    emit(c, MAKE_ABC(OP_RET, reg, 0, 0));
+}
+
+/*
+ * A call of the function to itself whose result is returned unchanged is
+ * a tail call: OP_TAILCALL restarts the function in the same frame, so
+ * such recursion needs no stack. The result may reach the return through
+ * jumps (the branches of "?:" or "if") and moves. Without a conditional
+ * jump the recursion can never end; it is left to fail with "too many
+ * nested calls" rather than loop forever.
+ */
+static void mark_tail_calls(Compiler* c) {
+    CompiledExpr* out = c->out;
+    bool branches = false;
+    for (int pc = 0; pc < out->code_length && !branches; pc++) {
+        branches = INSTR_OP(out->code[pc]) == OP_JMPF || INSTR_OP(out->code[pc]) == OP_JMPT;
+    }
+    if (!branches) return;
+
+    for (int pc = 0; pc < out->code_length; pc++) {
+        Instr call = out->code[pc];
+        if (INSTR_OP(call) != OP_CALL || INSTR_BX(call) != c->function) continue;
+
+        int reg = INSTR_A(call);
+        int next = pc + 1;
+        for (int hops = 0; hops < TAIL_CALL_MAX_HOPS && next < out->code_length; hops++) {
+            Instr i = out->code[next];
+            if (INSTR_OP(i) == OP_JMP) {
+                next = INSTR_BX(i);
+            } else if (INSTR_OP(i) == OP_MOVE && INSTR_B(i) == reg) {
+                reg = INSTR_A(i);
+                next++;
+            } else {
+                if (INSTR_OP(i) == OP_RET && INSTR_A(i) == reg) {
+                    out->code[pc] = MAKE_ABX(OP_TAILCALL, INSTR_A(call), c->function);
+                }
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * Names assigned anywhere in a function body are local to each call.
+ * Each gets a register, set to 0 on entry; an assigned parameter gets a
+ * copy of it instead, so that parameter registers keep the arguments (see
+ * repl_memo_store). Locals are found by scanning the tokens for "name =".
+ */
+static void bind_locals(Compiler* c, Binding* bindings, const char* body) {
+    int arity = c->repl->functions.items[c->function].arity;
+    Lexer lexer;
+    repl_lexer_init(&lexer, body);
+
+    while (lexer.current.type != TOKEN_EOF) {
+        Token token = lexer.current;
+        repl_lexer_next(&lexer);
+        if (token.type != TOKEN_NAME || lexer.current.type != TOKEN_ASSIGN) continue;
+
+        Binding* binding = (Binding*)find_binding(c, &token);
+        if (binding && binding->value.index >= arity) continue;
+        if (!binding && c->binding_count == MAX_FUNCTION_PARAMS + MAX_FUNCTION_LOCALS) {
+            repl_raise_error(c->err, (int)(token.start - body), "too many local variables");
+        }
+
+        int reg = alloc_register(c);
+        if (binding) {
+            emit(c, MAKE_ABC(OP_MOVE, reg, binding->value.index, 0));
+            binding->value = reg_desc(reg);
+        } else {
+            emit(c, MAKE_ABX(OP_LOADK, reg, add_constant(c, value_int(0))));
+            binding = &bindings[c->binding_count++];
+            binding->name = token.start;
+            binding->length = token.length;
+            binding->value = reg_desc(reg);
+        }
+    }
+}
+
+// Compiled expression cache
+
+// True if removing the space between two characters could join them into
+// one token: two word characters ("1 2" is not "12"), "< <" or "= ="
+static bool joins_token(char prev, char next) {
+    if ((CHAR_IS(prev, CHAR_WORD) || prev == '.') && (CHAR_IS(next, CHAR_WORD) || next == '.')) {
+        return true;
+    }
+    return strchr("<>=!&|", prev) && strchr("<>=&|", next);
+}
+
+// Collapse whitespace so that "x+1", "x + 1" and " x +1 " share one entry.
+// A single space is kept where dropping it would join two tokens. Runs are
+// found with the lexer's character scanner and copied whole.
+char* repl_normalize_expression(const char* expr) {
+    size_t length = strlen(expr);
+    const char* end = expr + length;
+    char* key = (char*)malloc(length + 1);
+    if (!key) return NULL;
+
+    CharScanner scanner;
+    repl_scanner_init(&scanner, end);
+
+    size_t len = 0;
+    const char* p = repl_scan_while(&scanner, expr, CHAR_SPACE);
+    while (p < end) {
+        // Every run after the first follows whitespace
+        if (len > 0 && joins_token(key[len - 1], *p)) {
+            key[len++] = ' ';
+        }
+        const char* run_end = repl_scan_until(&scanner, p, CHAR_SPACE);
+        memcpy(key + len, p, (size_t)(run_end - p));
+        len += (size_t)(run_end - p);
+        p = repl_scan_while(&scanner, run_end, CHAR_SPACE);
+    }
+    key[len] = '\0';
+
+    return key;
+}
+
+static unsigned int hash_key(const char* key) {
+    // FNV-1a
+    unsigned int hash = 2166136261u;
+    for (const char* p = key; *p; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+ExprCache* repl_cache_create(void) {
+    return (ExprCache*)calloc(1, sizeof(ExprCache));
+}
+
+void repl_cache_destroy(ExprCache* cache) {
+    if (!cache) return;
+    repl_cache_clear(cache);
+    free(cache);
+}
+
+// Drop every compiled program, e.g. after a setting that changes code generation
+void repl_cache_clear(ExprCache* cache) {
+    for (int i = 0; i < cache->count; i++) {
+        free(cache->entries[i].key);
+        repl_free_compiled(cache->entries[i].expr);
+    }
+    memset(cache->entries, 0, sizeof(cache->entries));
+    memset(cache->buckets, 0, sizeof(cache->buckets));
+    cache->lru_head = cache->lru_tail = NULL;
+    cache->count = 0;
+}
+
+// Mark the heap objects a program holds as constants or as its result
+void repl_mark_program(const CompiledExpr* program) {
+    for (int k = 0; k < program->constant_count; k++) {
+        repl_heap_mark(program->constants[k]);
+    }
+    if (program->has_result) repl_heap_mark(program->result);
+}
+
+void repl_cache_mark(const ExprCache* cache) {
+    for (int i = 0; i < cache->count; i++) {
+        repl_mark_program(cache->entries[i].expr);
+    }
+}
+
+static void lru_unlink(ExprCache* cache, ExprCacheEntry* entry) {
+    if (entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+    else cache->lru_head = entry->lru_next;
+
+    if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+    else cache->lru_tail = entry->lru_prev;
+
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_push_front(ExprCache* cache, ExprCacheEntry* entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head) cache->lru_head->lru_prev = entry;
+    cache->lru_head = entry;
+    if (!cache->lru_tail) cache->lru_tail = entry;
+}
+
+static void bucket_unlink(ExprCache* cache, ExprCacheEntry* entry) {
+    ExprCacheEntry** link = &cache->buckets[entry->hash & (EXPR_CACHE_BUCKETS - 1)];
+    while (*link && *link != entry) {
+        link = &(*link)->bucket_next;
+    }
+    if (*link) *link = entry->bucket_next;
+    entry->bucket_next = NULL;
+}
+
+CompiledExpr* repl_cache_lookup(ExprCache* cache, const char* key) {
+    unsigned int hash = hash_key(key);
+
+    for (ExprCacheEntry* entry = cache->buckets[hash & (EXPR_CACHE_BUCKETS - 1)];
+         entry; entry = entry->bucket_next) {
+        if (entry->hash == hash && strcmp(entry->key, key) == 0) {
+            // Move to the front of the LRU list
+            if (cache->lru_head != entry) {
+                lru_unlink(cache, entry);
+                lru_push_front(cache, entry);
+            }
+            cache->hits++;
+            return entry->expr;
+        }
+    }
+
+    cache->misses++;
+    return NULL;
+}
+
+void repl_cache_insert(ExprCache* cache, const char* key, CompiledExpr* expr) {
+    char* key_copy = (char*)malloc(strlen(key) + 1);
+    if (!key_copy) {
+        repl_free_compiled(expr);
+        return;
+    }
+    strcpy(key_copy, key);
+
+    ExprCacheEntry* entry;
+    if (cache->count < EXPR_CACHE_CAPACITY) {
+        entry = &cache->entries[cache->count++];
+    } else {
+        // Evict the least recently used program and reuse its entry
+        entry = cache->lru_tail;
+        lru_unlink(cache, entry);
+        bucket_unlink(cache, entry);
+        free(entry->key);
+        repl_free_compiled(entry->expr);
+    }
+
+    entry->key = key_copy;
+    entry->hash = hash_key(key);
+    entry->expr = expr;
+
+    ExprCacheEntry** bucket = &cache->buckets[entry->hash & (EXPR_CACHE_BUCKETS - 1)];
+    entry->bucket_next = *bucket;
+    *bucket = entry;
+
+    lru_push_front(cache, entry);
+}
+
+// Result cache. A program's last result stays valid while every variable
+// it reads keeps the version it had then; assignments bump versions.
+// Programs that call functions read variables the callees name too, which
+// slots[] does not list, and programs that assign variables have an effect
+// beyond their result, so neither kind keeps its result.
+
+bool repl_cached_result(REPL* repl, CompiledExpr* program, Value* result) {
+    ExprCache* cache = repl->expr_cache;
+    const unsigned int* versions = repl->variables.versions;
+
+    if (program->has_result) {
+        bool fresh = true;
+        for (int i = 0; i < program->slot_count; i++) {
+            if (program->result_versions[i] != versions[program->slots[i]]) {
+                fresh = false;
+                break;
+            }
+        }
+        if (fresh) {
+            cache->result_hits++;
+            *result = program->result;
+            return true;
+        }
+    }
+
+    cache->result_misses++;
+    return false;
+}
+
+void repl_remember_result(REPL* repl, CompiledExpr* program, Value result) {
+    if (program->calls_functions || program->stores_variables) return;
+
+    if (!program->result_versions && program->slot_count > 0) {
+        program->result_versions = (unsigned int*)malloc(program->slot_count * sizeof(unsigned int));
+        if (!program->result_versions) return;
+    }
+
+    for (int i = 0; i < program->slot_count; i++) {
+        program->result_versions[i] = repl->variables.versions[program->slots[i]];
+    }
+    program->result = result;
+    program->has_result = true;
+}
@@ -0,0 +1,287 @@
+#include "../include/repl_complex.h"
+#include "../include/repl_heap.h"
+#include "../include/repl_vm.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define COMPLEX_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/*
+ * A complex number is a pair of doubles on the heap. Products and
+ * quotients keep both parts in one SSE2 register where there is one, so
+ * the four products of a complex multiply are two vector multiplies.
+ * Quotients follow C's Annex G: both operands are scaled by powers of two
+ * to magnitudes near 1 first, which is exact, so that squaring the
+ * divisor cannot overflow or underflow when the quotient itself is in
+ * range. A product whose naive form overflows to NaN is redone the same
+ * way. Everything else is the textbook formula.
+ */
+
+typedef struct {
+    double re;
+    double im;
+} Complex;
+
+// Running out of memory is reported as VALUE_TOO_LARGE, as for bigints
+ValueStatus repl_complex_make(double re, double im, Value* result) {
+    ComplexObject* object = (ComplexObject*)repl_heap_allocate(VALUE_COMPLEX, sizeof(ComplexObject));
+    if (!object) return VALUE_TOO_LARGE;
+    object->re = re;
+    object->im = im;
+    result->bits = VALUE_TAGGED(VALUE_TAG_OBJECT, (uint64_t)(uintptr_t)object);
+    return VALUE_OK;
+}
+
+static ValueStatus store(Complex z, Value* result) {
+    return repl_complex_make(z.re, z.im, result);
+}
+
+// A real operand has no imaginary part
+static Complex load(Value v) {
+    if (value_type(v) == VALUE_COMPLEX) {
+        const ComplexObject* object = (const ComplexObject*)value_object(v);
+        return (Complex){ object->re, object->im };
+    }
+    return (Complex){ value_to_double(v), 0.0 };
+}
+
+static bool is_finite(Complex z) {
+    return isfinite(z.re) && isfinite(z.im);
+}
+
+// The power of two that brings the larger part of z to [1, 2), or 0 for
+// zero and non-finite numbers, which scaling cannot help
+static int scale_of(Complex z) {
+    double larger = fmax(fabs(z.re), fabs(z.im));
+    return larger != 0.0 && isfinite(larger) ? ilogb(larger) : 0;
+}
+
+static Complex scale(Complex z, int exponent) {
+    return (Complex){ scalbn(z.re, exponent), scalbn(z.im, exponent) };
+}
+
+// (a + bi)(c + di) = (ac - bd) + (bc + ad)i
+static Complex multiply_naive(Complex x, Complex y) {
+#ifdef COMPLEX_SSE2
+    __m128d ab = _mm_loadu_pd(&x.re);
+    __m128d ac_bc = _mm_mul_pd(ab, _mm_set1_pd(y.re));
+    __m128d bd_ad = _mm_mul_pd(_mm_shuffle_pd(ab, ab, 1), _mm_set1_pd(y.im));
+    __m128d sum = _mm_add_pd(ac_bc, _mm_xor_pd(bd_ad, _mm_set_pd(0.0, -0.0)));
+    Complex z;
+    _mm_storeu_pd(&z.re, sum);
+    return z;
+#else
+    return (Complex){ x.re * y.re - x.im * y.im, x.im * y.re + x.re * y.im };
+#endif
+}
+
+static Complex multiply(Complex x, Complex y) {
+    Complex z = multiply_naive(x, y);
+    if (!is_finite(z) && is_finite(x) && is_finite(y)) {
+        // An overflowing term gave inf - inf; the part it belonged to is
+        // infinite, but the other one may not be
+        int kx = scale_of(x), ky = scale_of(y);
+        z = scale(multiply_naive(scale(x, -kx), scale(y, -ky)), kx + ky);
+    }
+    return z;
+}
+
+// (a + bi) / (c + di) = ((ac + bd) + (bc - ad)i) / (c^2 + d^2), with
+// both operands scaled to near 1 and the quotient scaled back. The
+// divisor is not zero.
+static Complex divide(Complex x, Complex y) {
+    int kx = scale_of(x), ky = scale_of(y);
+    x = scale(x, -kx);
+    y = scale(y, -ky);
+    double denominator = y.re * y.re + y.im * y.im;
+#ifdef COMPLEX_SSE2
+    __m128d ab = _mm_loadu_pd(&x.re);
+    __m128d ac_bc = _mm_mul_pd(ab, _mm_set1_pd(y.re));
+    __m128d bd_ad = _mm_mul_pd(_mm_shuffle_pd(ab, ab, 1), _mm_set1_pd(y.im));
+    __m128d sum = _mm_add_pd(ac_bc, _mm_xor_pd(bd_ad, _mm_set_pd(-0.0, 0.0)));
+    Complex z;
+    _mm_storeu_pd(&z.re, _mm_div_pd(sum, _mm_set1_pd(denominator)));
+#else
+    Complex z = { (x.re * y.re + x.im * y.im) / denominator,
+                  (x.im * y.re - x.re * y.im) / denominator };
+#endif
+    return scale(z, kx - ky);
+}
+
+static bool is_zero(Complex z) {
+    return z.re == 0.0 && z.im == 0.0;
+}
+
+static Complex exponential(Complex z) {
+    // A real argument keeps a zero imaginary part, where inf * sin(0)
+    // would give NaN
+    if (z.im == 0.0) return (Complex){ exp(z.re), z.im };
+    double magnitude = exp(z.re);
+    return (Complex){ magnitude * cos(z.im), magnitude * sin(z.im) };
+}
+
+// The principal value, with the argument in (-pi, pi]
+static Complex logarithm(Complex z) {
+    return (Complex){ log(hypot(z.re, z.im)), atan2(z.im, z.re) };
+}
+
+// The principal value, with a non-negative real part. z is scaled by an
+// even power of two first, so |re| + |z| cannot overflow.
+static Complex square_root(Complex z) {
+    if (is_zero(z)) return (Complex){ 0.0, z.im };
+    int k = scale_of(z) & ~1;
+    z = scale(z, -k);
+    double t = sqrt((fabs(z.re) + hypot(z.re, z.im)) / 2.0);
+    Complex root = z.re >= 0.0 ? (Complex){ t, z.im / (2.0 * t) }
+                               : (Complex){ fabs(z.im) / (2.0 * t), copysign(t, z.im) };
+    return scale(root, k / 2);
+}
+
+// z^n for a whole n >= 0, by squaring. The product starts at the power
+// of z for the lowest set bit of n rather than at 1, since 1 * z would
+// turn an infinite part of z into 0 * inf = NaN, so z^2 is exactly z*z.
+static Complex integer_power(Complex z, double n) {
+    if (n == 0.0) return (Complex){ 1.0, 0.0 };
+    for (; fmod(n, 2.0) == 0.0; n /= 2.0) z = multiply(z, z);
+    Complex product = z;
+    for (;;) {
+        n = floor(n / 2.0);
+        if (n == 0.0) return product;
+        z = multiply(z, z);
+        if (fmod(n, 2.0) == 1.0) product = multiply(product, z);
+    }
+}
+
+/*
+ * z^w. A real power of a real number that has one is C's pow, with no
+ * imaginary part. An integer exponent is done by squaring, exactly as far
+ * as the products are. A negative one inverts the power, or, when that power
+ * overflows or underflows, powers the inverse instead. Other exponents
+ * are exp(w log z). 0^w is 1 for w = 0 and 0 when w has a positive real
+ * part; otherwise it is a division by zero.
+ */
+static ValueStatus power(Complex z, Complex w, Value* result) {
+    static const Complex one = { 1.0, 0.0 };
+    if (is_zero(z)) {
+        if (is_zero(w)) return store(one, result);
+        if (w.re > 0.0) return store((Complex){ 0.0, 0.0 }, result);
+        return VALUE_DIVISION_BY_ZERO;
+    }
+
+    bool integer = w.im == 0.0 && w.re == trunc(w.re);
+    if (z.im == 0.0 && w.im == 0.0 && (z.re > 0.0 || integer)) {
+        return store((Complex){ pow(z.re, w.re), 0.0 }, result);
+    }
+    if (integer && fabs(w.re) <= 9007199254740992.0) {
+        Complex product = integer_power(z, fabs(w.re));
+        if (w.re >= 0.0) return store(product, result);
+        if (is_finite(product) && !is_zero(product)) return store(divide(one, product), result);
+        return store(integer_power(divide(one, z), -w.re), result);
+    }
+    return store(exponential(multiply(w, logarithm(z))), result);
+}
+
+ValueStatus repl_complex_binary(int op, Value a, Value b, Value* result) {
+    Complex x = load(a), y = load(b);
+    switch (op) {
+        case OP_ADD: return store((Complex){ x.re + y.re, x.im + y.im }, result);
+        case OP_SUB: return store((Complex){ x.re - y.re, x.im - y.im }, result);
+        case OP_MUL: return store(multiply(x, y), result);
+        case OP_DIV:
+            if (is_zero(y)) return VALUE_DIVISION_BY_ZERO;
+            return store(divide(x, y), result);
+        case OP_POW: return power(x, y, result);
+        case OP_EQ:
+            *result = value_bool(x.re == y.re && x.im == y.im);
+            return VALUE_OK;
+        case OP_NE:
+            *result = value_bool(x.re != y.re || x.im != y.im);
+            return VALUE_OK;
+        default:
+            // Complex numbers have no order, remainder or bits
+            return VALUE_INVALID_OPERANDS;
+    }
+}
+
+ValueStatus repl_complex_unary(int op, Value a, Value* result) {
+    Complex z = load(a);
+    if (op != OP_NEG) return VALUE_INVALID_OPERANDS;
+    return store((Complex){ -z.re, -z.im }, result);
+}
+
+double repl_complex_abs(Value z) {
+    Complex x = load(z);
+    return hypot(x.re, x.im);
+}
+
+double repl_complex_arg(Value z) {
+    Complex x = load(z);
+    return atan2(x.im, x.re);
+}
+
+double repl_complex_imag(Value z) {
+    return load(z).im;
+}
+
+ValueStatus repl_complex_conj(Value z, Value* result) {
+    Complex x = load(z);
+    return store((Complex){ x.re, -x.im }, result);
+}
+
+ValueStatus repl_complex_sqrt(Value z, Value* result) {
+    return store(square_root(load(z)), result);
+}
+
+// sin(a + bi) = sin a cosh b + i cos a sinh b
+ValueStatus repl_complex_sin(Value z, Value* result) {
+    Complex x = load(z);
+    return store((Complex){ sin(x.re) * cosh(x.im), cos(x.re) * sinh(x.im) }, result);
+}
+
+// cos(a + bi) = cos a cosh b - i sin a sinh b
+ValueStatus repl_complex_cos(Value z, Value* result) {
+    Complex x = load(z);
+    return store((Complex){ cos(x.re) * cosh(x.im), -sin(x.re) * sinh(x.im) }, result);
+}
+
+ValueStatus repl_complex_exp(Value z, Value* result) {
+    return store(exponential(load(z)), result);
+}
+
+ValueStatus repl_complex_log(Value z, Value* result) {
+    return store(logarithm(load(z)), result);
+}
+
+bool repl_complex_equal(Value a, Value b) {
+    Complex x = load(a), y = load(b);
+    return memcmp(&x, &y, sizeof(Complex)) == 0;
+}
+
+double repl_complex_to_double(const HeapObject* object) {
+    return ((const ComplexObject*)object)->re;
+}
+
+bool repl_complex_is_zero(const HeapObject* object) {
+    const ComplexObject* z = (const ComplexObject*)object;
+    return z->re == 0.0 && z->im == 0.0;
+}
+
+// "a+bi" or "a-bi", each part as a double is printed but without the
+// ".0"; a purely imaginary number prints as "bi", which reads back as the
+// same value
+void repl_complex_format(const HeapObject* object, int precision, char* buffer, size_t size) {
+    const ComplexObject* z = (const ComplexObject*)object;
+    char re_text[NUMBER_BUFFER_SIZE], im_text[NUMBER_BUFFER_SIZE];
+    const char* sign = signbit(z->im) ? "-" : "+";
+    repl_format_number(fabs(z->im), precision, im_text, sizeof(im_text));
+    if (z->re == 0.0 && !signbit(z->re)) {
+        snprintf(buffer, size, "%s%si", signbit(z->im) ? "-" : "", im_text);
+        return;
+    }
+    repl_format_number(z->re, precision, re_text, sizeof(re_text));
+    snprintf(buffer, size, "%s%s%si", re_text, sign, im_text);
+}
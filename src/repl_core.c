@@ -2,6 +2,10 @@
 #include "../include/repl_input.h"
 #include "../include/repl_ui.h"
 #include "../include/repl_variables.h"
+#include "../include/repl_compile.h"
+#include "../include/repl_heap.h"
+#include "../include/repl_functions.h"
+#include "../include/repl_number.h"
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -112,13 +116,32 @@ REPL* repl_init(const char* title, int width, int height) {
     repl->history_count = 0;
     repl->history_index = -1; // -1 means current input, not from history
     
-    // Initialize variables
-    memset(repl->variables, 0, sizeof(repl->variables));
-    repl->variable_count = 0;
+    // Initialize variables and the heap their values may point into
+    memset(&repl->variables, 0, sizeof(repl->variables));
+    memset(&repl->functions, 0, sizeof(repl->functions));
+    repl->vm_stack = NULL;
+    repl_heap_init(&repl->error);
     
     // Set up some default variables
-    repl_set_variable(repl, "pi", 3.14159265358979323846);
-    repl_set_variable(repl, "e", 2.71828182845904523536);
+    repl_define_constants(repl);
+    
+    // Initialize the compiled expression cache
+    repl->expr_cache = repl_cache_create();
+    if (!repl->expr_cache) {
+        fprintf(stderr, "Failed to allocate expression cache\n");
+        repl_free_variables(repl);
+        TTF_CloseFont(repl->font);
+        SDL_DestroyRenderer(repl->renderer);
+        SDL_DestroyWindow(repl->window);
+        free(repl);
+        TTF_Quit();
+        SDL_Quit();
+        return NULL;
+    }
+    repl->jit_enabled = true;
+    repl->ieee_strict = false;
+    repl->output_precision = FORMAT_SHORTEST;
+    repl->memo_capacity = MEMO_DEFAULT_CAPACITY;
     
     // Initialize colors - modern dark theme with higher contrast
     repl->bg_color = (SDL_Color){30, 30, 44, 255}; // Deep blue-gray background
@@ -159,6 +182,11 @@ REPL* repl_init(const char* title, int width, int height) {
 }
 
 void repl_cleanup(REPL* repl) {
+    repl_cache_destroy(repl->expr_cache);
+    repl_free_functions(repl);
+    repl_free_variables(repl);
+    repl_vm_free_stack(repl);
+    repl_heap_free_all();
     if (repl->font) TTF_CloseFont(repl->font);
     if (repl->renderer) SDL_DestroyRenderer(repl->renderer);
     if (repl->window) SDL_DestroyWindow(repl->window);
@@ -168,16 +196,34 @@ void repl_cleanup(REPL* repl) {
 }
 
 void repl_print(REPL* repl, const char* result, bool is_error) {
+    // A result too long for the buffer is cut short, leaving room for the
+    // input line and the prompt
+    size_t input_length = strlen(repl->input_buffer);
+    size_t result_length = strlen(result);
+    if (result_length > MAX_OUTPUT_LENGTH - input_length - 16) {
+        result_length = MAX_OUTPUT_LENGTH - input_length - 16;
+    }
+
+    // Drop the oldest lines if the new ones would not fit
+    size_t needed = input_length + result_length + 16;
+    size_t length = strlen(repl->output_buffer);
+    if (length + needed >= MAX_OUTPUT_LENGTH) {
+        const char* keep = repl->output_buffer + (length + needed - MAX_OUTPUT_LENGTH);
+        const char* newline = strchr(keep, '\n');
+        keep = newline ? newline + 1 : repl->output_buffer + length;
+        memmove(repl->output_buffer, keep, strlen(keep) + 1);
+    }
+    
     // Append input to output buffer
     strcat(repl->output_buffer, repl->input_buffer);
     strcat(repl->output_buffer, "\n");
     
     // Append result to output buffer
-    if (strlen(result) > 0) {
+    if (result_length > 0) {
         if (is_error) {
             strcat(repl->output_buffer, "Error: ");
         }
-        strcat(repl->output_buffer, result);
+        strncat(repl->output_buffer, result, result_length);
         strcat(repl->output_buffer, "\n");
     }
     
@@ -209,6 +255,25 @@ void repl_print(REPL* repl, const char* result, bool is_error) {
     }
 }
 
+// True if Escape has been pressed or the window closed since the
+// evaluation started. The VM asks every so often while a loop runs; the
+// events are looked at no more than every 50 ms and left in the queue.
+bool repl_interrupt_requested(REPL* repl) {
+    static Uint32 last_check;
+    Uint32 now = SDL_GetTicks();
+    if (now - last_check < 50) return false;
+    last_check = now;
+
+    SDL_PumpEvents();
+    if (SDL_HasEvent(SDL_QUIT)) return true;
+    SDL_Event events[64];
+    int count = SDL_PeepEvents(events, 64, SDL_PEEKEVENT, SDL_KEYDOWN, SDL_KEYDOWN);
+    for (int e = 0; e < count; e++) {
+        if (events[e].key.keysym.sym == SDLK_ESCAPE) return true;
+    }
+    return SDL_GetKeyboardState(NULL)[SDL_SCANCODE_ESCAPE] != 0;
+}
+
 // Calculate the number of visible lines that can fit in the output area
 void repl_calculate_visible_lines(REPL* repl) {
     // Calculate line height
@@ -332,13 +397,35 @@ void repl_show_help(REPL* repl) {
         "Commands:\n"
         "  help      - Show this help message\n"
         "  clear     - Clear the console\n"
-        "  vars      - Display all defined variables\n"
+        "  vars      - Display all defined variables and functions\n"
         "  version   - Display version information\n"
+        "  stats     - Show compiled expression cache, heap and memo statistics\n"
+        "  cache stats - Show result cache hit rate\n"
+        "  jit on|off - Toggle native code for hot expressions\n"
+        "  strict on|off - Keep IEEE NaN/signed-zero semantics when simplifying\n"
+        "  format shortest|N - Print shortest round-trip digits or N significant digits\n"
+        "  memo on|off|N - Remember up to N results of each pure function\n"
+        "  mode int64|bigint|rational - Wrap integers, widen them, or keep exact fractions\n"
+        "  mode decimal [N] - Exact fixed-point decimals, quotients rounded to N places\n"
+        "  precision double|dd|quad - Decimals as doubles, double-doubles or binary128\n"
+        "  bench lex - Measure lexer throughput on a generated script\n"
+        "  bench precision - Compare double, double-double and binary128 speed\n"
         "  exit/quit - Exit the REPL\n"
         "\n"
         "Expressions:\n"
-        "  Arithmetic: 5 + 3, 10 * (3 + 2), etc.\n"
+        "  Arithmetic: 5 + 3, 10 * (3 + 2), 2^10, etc.\n"
+        "  Integers: 7 / 2, 7 % 2, 0xFF & 0x0F, 1 << 40, ~0u (a ~ b is xor)\n"
         "  Variables: x = 5, pi, e (predefined)\n"
+        "  Functions: f(x) = x^2 + 3*x, g(a, b) = f(a) * b, then g(2, 3)\n"
+        "  Complex: (1 + 2i) * (3 - 4i), abs(3+4i), arg, conj, exp, log, re, im\n"
+        "  Math: sqrt, cbrt, sin, cos, tan, asin, acos, atan, atan2(y, x), sinh,\n"
+        "        cosh, tanh, log2, log10, pow, hypot, min, max, floor, ceil, round, trunc\n"
+        "  Arrays: a = [1, 2, 3], a * 2 + 1, range(0, 10), linspace(0, 1, 5), len(a), sum(a)\n"
+        "  Comparisons: x < 1, x <= 1, x == 1, x != 1 (true or false)\n"
+        "  Logic: x > 0 && x < 10, x == 0 || y == 0, !x (right side only if needed)\n"
+        "  Conditional: x < 0 ? -x : x\n"
+        "  Statements: s = 0; for (i = 1; i <= 10; i = i + 1) s = s + i; s\n"
+        "  Loops in functions: f(n) = { while (n > 1) n = n / 2; return n; }\n"
         "\n"
         "Keyboard Shortcuts:\n"
         "  Up/Down        - Navigate command history\n"
@@ -348,7 +435,7 @@ void repl_show_help(REPL* repl) {
         "  PageUp/PageDown - Scroll output by pages\n"
         "  Alt+V          - Toggle view mode (scroll/fixed/paged)\n"
         "  Alt+S          - Toggle auto-scroll\n"
-        "  Escape         - Clear current input\n"
+        "  Escape         - Clear current input, or stop a running loop\n"
         "\n"
         "Mouse Controls:\n"
         "  Mouse wheel    - Scroll output\n"
@@ -0,0 +1,428 @@
+#include "../include/repl_decimal.h"
+#include "../include/repl_heap.h"
+#include "../include/repl_vm.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/*
+ * A decimal is a whole number of units of 10^-scale held in a 128-bit
+ * integer, so 0.1 + 0.2 is 1 + 2 tenths and sums, differences and
+ * products are exact integer operations with no heap-allocated digits.
+ * Operands are aligned to the larger scale by multiplying by a power of
+ * ten, and a product's scale is the sum of its operands'. Only quotients,
+ * and products beyond DECIMAL_MAX_SCALE places, are rounded, half to even
+ * as ledgers do. Magnitudes stay below 10^37, which leaves room to
+ * multiply a remainder by 10 in long division; results beyond that are
+ * VALUE_TOO_LARGE rather than a slower wider type.
+ */
+
+static int division_scale = DECIMAL_DEFAULT_SCALE;
+
+int repl_decimal_scale(void) {
+    return division_scale;
+}
+
+void repl_set_decimal_scale(int scale) {
+    division_scale = scale;
+}
+
+#ifdef REPL_HAVE_INT128
+
+typedef __int128 Int128;
+typedef unsigned __int128 Uint128;
+
+// A decimal operand, unboxed
+typedef struct {
+    Int128 units;
+    int scale;
+} Decimal;
+
+// 10^n for 0 <= n <= 38; 10^38 is the largest power of ten in 128 bits
+static Uint128 power_of_ten(int n) {
+    static Uint128 powers[39];
+    if (powers[0] == 0) {
+        powers[0] = 1;
+        for (int i = 1; i < 39; i++) powers[i] = powers[i - 1] * 10;
+    }
+    return powers[n];
+}
+
+#define DECIMAL_LIMIT power_of_ten(DECIMAL_MAX_DIGITS)
+
+static Uint128 magnitude(Int128 units) {
+    return units < 0 ? -(Uint128)units : (Uint128)units;
+}
+
+// A 256-bit magnitude in 64-bit words, least significant first, for
+// products and for rounding digits away
+typedef struct {
+    uint64_t words[4];
+} Wide;
+
+static Wide wide_from(Uint128 x) {
+    Wide w = { { (uint64_t)x, (uint64_t)(x >> 64), 0, 0 } };
+    return w;
+}
+
+static void wide_add_at(Wide* w, int index, Uint128 x) {
+    for (; index < 4 && x != 0; index++) {
+        Uint128 sum = (Uint128)w->words[index] + (uint64_t)x;
+        w->words[index] = (uint64_t)sum;
+        x = (x >> 64) + (sum >> 64);
+    }
+}
+
+static Wide wide_multiply(Uint128 x, Uint128 y) {
+    uint64_t x0 = (uint64_t)x, x1 = (uint64_t)(x >> 64);
+    uint64_t y0 = (uint64_t)y, y1 = (uint64_t)(y >> 64);
+    Wide w = { { 0, 0, 0, 0 } };
+    wide_add_at(&w, 0, (Uint128)x0 * y0);
+    wide_add_at(&w, 1, (Uint128)x0 * y1);
+    wide_add_at(&w, 1, (Uint128)x1 * y0);
+    wide_add_at(&w, 2, (Uint128)x1 * y1);
+    return w;
+}
+
+// Divide in place by d < 2^64 and return the remainder
+static uint64_t wide_divide(Wide* w, uint64_t d) {
+    Uint128 remainder = 0;
+    for (int i = 3; i >= 0; i--) {
+        Uint128 current = (remainder << 64) | w->words[i];
+        w->words[i] = (uint64_t)(current / d);
+        remainder = current % d;
+    }
+    return (uint64_t)remainder;
+}
+
+/*
+ * Drop the last count digits of w, rounding half to even; sticky says
+ * nonzero digits were already dropped below those. The result is false
+ * if it does not fit a decimal.
+ */
+static bool round_digits(Wide w, int count, bool sticky, Uint128* result) {
+    if (count > 0) {
+        for (; count > 1; ) {
+            int step = count - 1 > 19 ? 19 : count - 1;
+            if (wide_divide(&w, (uint64_t)power_of_ten(step)) != 0) sticky = true;
+            count -= step;
+        }
+        uint64_t digit = wide_divide(&w, 10);
+        if (digit > 5 || (digit == 5 && (sticky || (w.words[0] & 1)))) wide_add_at(&w, 0, 1);
+    }
+    if (w.words[2] != 0 || w.words[3] != 0) return false;
+    *result = ((Uint128)w.words[1] << 64) | w.words[0];
+    return *result < DECIMAL_LIMIT;
+}
+
+// Running out of memory is reported as VALUE_TOO_LARGE, as for bigints
+static ValueStatus store(bool negative, Uint128 units, int scale, Value* result) {
+    if (units >= DECIMAL_LIMIT) return VALUE_TOO_LARGE;
+    DecimalObject* object = (DecimalObject*)repl_heap_allocate(VALUE_DECIMAL, sizeof(DecimalObject));
+    if (!object) return VALUE_TOO_LARGE;
+    object->units = negative ? -(Int128)units : (Int128)units;
+    object->scale = scale;
+    result->bits = VALUE_TAGGED(VALUE_TAG_OBJECT, (uint64_t)(uintptr_t)object);
+    return VALUE_OK;
+}
+
+// An integer that fits is a decimal with scale 0
+static bool load(Value v, Decimal* d) {
+    d->scale = 0;
+    switch (value_type(v)) {
+        case VALUE_INT:
+        case VALUE_BOOL:
+            d->units = (int64_t)value_as_bits(v);
+            return true;
+        case VALUE_UINT:
+            d->units = value_as_bits(v);
+            return true;
+        case VALUE_BIGINT: {
+            const BigIntObject* big = (const BigIntObject*)value_object(v);
+            if (big->length > 4) return false;
+            Uint128 units = 0;
+            for (int i = (int)big->length - 1; i >= 0; i--) {
+                if (units >> 96) return false;
+                units = (units << 32) | big->limbs[i];
+            }
+            if (units >= DECIMAL_LIMIT) return false;
+            d->units = big->negative ? -(Int128)units : (Int128)units;
+            return true;
+        }
+        case VALUE_DECIMAL: {
+            const DecimalObject* object = (const DecimalObject*)value_object(v);
+            d->units = object->units;
+            d->scale = object->scale;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// units * 10^count, or false beyond 10^38
+static bool scale_up(Int128 units, int count, Int128* result) {
+    Uint128 m = magnitude(units);
+    if (count > 38 || (m != 0 && m > (power_of_ten(38) - 1) / power_of_ten(count))) return false;
+    Int128 scaled = (Int128)(m * power_of_ten(count));
+    *result = units < 0 ? -scaled : scaled;
+    return true;
+}
+
+// Sign of a - b, aligning scales. An operand too large to align is larger
+// in magnitude than the other, which is already below 10^37.
+static int compare(Decimal a, Decimal b) {
+    Int128 x = a.units, y = b.units;
+    if (a.scale < b.scale && !scale_up(a.units, b.scale - a.scale, &x)) return a.units < 0 ? -1 : 1;
+    if (b.scale < a.scale && !scale_up(b.units, a.scale - b.scale, &y)) return b.units < 0 ? 1 : -1;
+    return x < y ? -1 : x > y;
+}
+
+static ValueStatus add(Decimal a, Decimal b, Value* result) {
+    int scale = a.scale > b.scale ? a.scale : b.scale;
+    Int128 x, y, sum;
+    if (!scale_up(a.units, scale - a.scale, &x) || !scale_up(b.units, scale - b.scale, &y) ||
+        __builtin_add_overflow(x, y, &sum)) {
+        return VALUE_TOO_LARGE;
+    }
+    return store(sum < 0, magnitude(sum), scale, result);
+}
+
+// Exact unless the scale passes DECIMAL_MAX_SCALE, where it is rounded
+static ValueStatus multiply(Decimal a, Decimal b, Decimal* result) {
+    int scale = a.scale + b.scale;
+    int drop = scale > DECIMAL_MAX_SCALE ? scale - DECIMAL_MAX_SCALE : 0;
+    Uint128 product;
+    if (!round_digits(wide_multiply(magnitude(a.units), magnitude(b.units)), drop, false, &product)) {
+        return VALUE_TOO_LARGE;
+    }
+    result->units = (a.units < 0) != (b.units < 0) ? -(Int128)product : (Int128)product;
+    result->scale = scale - drop;
+    return VALUE_OK;
+}
+
+// a / b rounded half to even at the scale setting: long division for the
+// digits the quotient gains, rounding for the ones it loses
+static ValueStatus divide(Decimal a, Decimal b, Value* result) {
+    if (b.units == 0) return VALUE_DIVISION_BY_ZERO;
+    Uint128 x = magnitude(a.units), y = magnitude(b.units);
+    bool negative = (a.units < 0) != (b.units < 0);
+    int scale = division_scale;
+    int gained = scale - a.scale + b.scale;
+
+    Uint128 quotient = x / y, remainder = x % y;
+    if (gained < 0) {
+        if (!round_digits(wide_from(quotient), -gained, remainder != 0, &quotient)) return VALUE_TOO_LARGE;
+        return store(negative && quotient != 0, quotient, scale, result);
+    }
+    for (int i = 0; i < gained; i++) {
+        if (quotient >= DECIMAL_LIMIT) return VALUE_TOO_LARGE;
+        remainder *= 10;
+        quotient = quotient * 10 + remainder / y;
+        remainder %= y;
+    }
+    if (2 * remainder > y || (2 * remainder == y && (quotient & 1))) quotient++;
+    return store(negative && quotient != 0, quotient, scale, result);
+}
+
+// The remainder of truncating division, with the sign of a, as fmod gives
+static ValueStatus modulo(Decimal a, Decimal b, Value* result) {
+    if (b.units == 0) return VALUE_DIVISION_BY_ZERO;
+    int scale = a.scale > b.scale ? a.scale : b.scale;
+    Int128 x, y;
+    if (!scale_up(a.units, scale - a.scale, &x) || !scale_up(b.units, scale - b.scale, &y)) {
+        return VALUE_TOO_LARGE;
+    }
+    Int128 r = x % y;
+    return store(r < 0, magnitude(r), scale, result);
+}
+
+// Squaring for an integer exponent; a negative one divides 1 by the power.
+// Any other exponent gives a double, as in int64 mode.
+static ValueStatus power(Value base, Decimal a, Decimal b, Value exponent, Value* result) {
+    Uint128 whole = magnitude(b.units) / power_of_ten(b.scale);
+    if (whole * power_of_ten(b.scale) != magnitude(b.units) || whole > INT64_MAX) {
+        *result = value_float(pow(value_to_double(base), value_to_double(exponent)));
+        return VALUE_OK;
+    }
+
+    Decimal p = { 1, 0 }, square = a;
+    for (uint64_t n = (uint64_t)whole; n; n >>= 1) {
+        ValueStatus status = VALUE_OK;
+        if (n & 1) status = multiply(p, square, &p);
+        if (status == VALUE_OK && n > 1) status = multiply(square, square, &square);
+        if (status != VALUE_OK) return status;
+    }
+    if (b.units < 0) {
+        Decimal one = { 1, 0 };
+        return divide(one, p, result);
+    }
+    return store(p.units < 0, magnitude(p.units), p.scale, result);
+}
+
+bool repl_decimal_available(void) {
+    return true;
+}
+
+ValueStatus repl_decimal_binary(int op, Value a, Value b, Value* result) {
+    Decimal x, y;
+    if (!load(a, &x) || !load(b, &y)) {
+        ValueType other = value_type(a) == VALUE_DECIMAL ? value_type(b) : value_type(a);
+        return other == VALUE_BIGINT ? VALUE_TOO_LARGE : VALUE_INVALID_OPERANDS;
+    }
+    switch (op) {
+        case OP_ADD: return add(x, y, result);
+        case OP_SUB:
+            y.units = -y.units;
+            return add(x, y, result);
+        case OP_MUL: {
+            Decimal product;
+            ValueStatus status = multiply(x, y, &product);
+            if (status != VALUE_OK) return status;
+            return store(product.units < 0, magnitude(product.units), product.scale, result);
+        }
+        case OP_DIV: return divide(x, y, result);
+        case OP_MOD: return modulo(x, y, result);
+        case OP_POW: return power(a, x, y, b, result);
+        case OP_LT:  *result = value_bool(compare(x, y) < 0); return VALUE_OK;
+        case OP_LE:  *result = value_bool(compare(x, y) <= 0); return VALUE_OK;
+        case OP_EQ:  *result = value_bool(compare(x, y) == 0); return VALUE_OK;
+        case OP_NE:  *result = value_bool(compare(x, y) != 0); return VALUE_OK;
+        default: return VALUE_INVALID_OPERANDS;
+    }
+}
+
+ValueStatus repl_decimal_unary(int op, Value a, Value* result) {
+    Decimal x;
+    if (op != OP_NEG || !load(a, &x)) return VALUE_INVALID_OPERANDS;
+    return store(x.units > 0, magnitude(x.units), x.scale, result);
+}
+
+/*
+ * A decimal literal read straight into units: the digits are the units
+ * and the digits after the point the scale, which an exponent shifts.
+ * Digits past DECIMAL_MAX_SCALE places are rounded away. Returns false
+ * for a literal too large for a decimal, which the lexer reports.
+ */
+bool repl_decimal_parse(const char* text, size_t length, Value* value) {
+    Uint128 units = 0;
+    int digits = 0;
+    long scale = 0;
+    bool point = false, sticky = false;
+    size_t i = 0;
+
+    for (; i < length && text[i] != 'e' && text[i] != 'E'; i++) {
+        if (text[i] == '.') {
+            point = true;
+            continue;
+        }
+        int digit = text[i] - '0';
+        if (digits == DECIMAL_MAX_DIGITS + 1) {
+            // Beyond what any decimal holds: only rounding can use these
+            if (digit != 0) sticky = true;
+            if (!point) scale--;
+            continue;
+        }
+        if (digits > 0 || digit != 0) digits++;
+        units = units * 10 + (Uint128)digit;
+        if (point) scale++;
+    }
+    if (i < length) {
+        bool negative = text[++i] == '-';
+        if (text[i] == '-' || text[i] == '+') i++;
+        long exponent = 0;
+        for (; i < length; i++) {
+            if (exponent < 100000) exponent = exponent * 10 + (text[i] - '0');
+        }
+        scale += negative ? exponent : -exponent;
+    }
+
+    if (scale < 0) {
+        Int128 scaled;
+        if (!scale_up((Int128)units, (int)(scale < -38 ? 39 : -scale), &scaled) || (Uint128)scaled >= DECIMAL_LIMIT) {
+            return false;
+        }
+        return store(false, (Uint128)scaled, 0, value) == VALUE_OK;
+    }
+    // Rounding away more than 40 digits of a 38-digit number leaves 0
+    int result_scale = scale > DECIMAL_MAX_SCALE ? DECIMAL_MAX_SCALE : (int)scale;
+    long drop = scale - result_scale;
+    if (!round_digits(wide_from(units), drop > 40 ? 40 : (int)drop, sticky, &units)) return false;
+    return store(false, units, result_scale, value) == VALUE_OK;
+}
+
+// Same units at the same scale, so 1.5 and 1.50 differ as 1 and 1.0 do
+bool repl_decimal_equal(Value a, Value b) {
+    const DecimalObject* x = (const DecimalObject*)value_object(a);
+    const DecimalObject* y = (const DecimalObject*)value_object(b);
+    return x->scale == y->scale && x->units == y->units;
+}
+
+double repl_decimal_to_double(const HeapObject* object) {
+    const DecimalObject* decimal = (const DecimalObject*)object;
+    return (double)decimal->units / (double)power_of_ten(decimal->scale);
+}
+
+bool repl_decimal_is_zero(const HeapObject* object) {
+    return ((const DecimalObject*)object)->units == 0;
+}
+
+// Every digit of the scale, so amounts print as 1.50 rather than 1.5
+void repl_decimal_format(const HeapObject* object, char* buffer, size_t size) {
+    const DecimalObject* decimal = (const DecimalObject*)object;
+    char digits[DECIMAL_BUFFER_SIZE];
+    int length = 0;
+    Uint128 units = magnitude(decimal->units);
+    do {
+        digits[length++] = (char)('0' + (int)(units % 10));
+        units /= 10;
+    } while (units != 0 || length <= decimal->scale);
+
+    char text[DECIMAL_BUFFER_SIZE];
+    char* out = text;
+    if (decimal->units < 0) *out++ = '-';
+    for (int i = length - 1; i >= 0; i--) {
+        *out++ = digits[i];
+        if (i == decimal->scale && i > 0) *out++ = '.';
+    }
+    *out = '\0';
+    snprintf(buffer, size, "%s", text);
+}
+
+#else // !REPL_HAVE_INT128
+
+// Without a 128-bit integer type there is no decimal mode
+
+bool repl_decimal_available(void) {
+    return false;
+}
+
+ValueStatus repl_decimal_binary(int op, Value a, Value b, Value* result) {
+    return VALUE_INVALID_OPERANDS;
+}
+
+ValueStatus repl_decimal_unary(int op, Value a, Value* result) {
+    return VALUE_INVALID_OPERANDS;
+}
+
+bool repl_decimal_parse(const char* text, size_t length, Value* value) {
+    return false;
+}
+
+bool repl_decimal_equal(Value a, Value b) {
+    return false;
+}
+
+double repl_decimal_to_double(const HeapObject* object) {
+    return 0.0;
+}
+
+bool repl_decimal_is_zero(const HeapObject* object) {
+    return true;
+}
+
+void repl_decimal_format(const HeapObject* object, char* buffer, size_t size) {
+    snprintf(buffer, size, "decimal");
+}
+
+#endif
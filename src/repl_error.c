@@ -0,0 +1,21 @@
+#include "../include/repl_error.h"
+#include <stdio.h>
+#include <stdarg.h>
+
+// Record the message, release any partial result and unwind to the
+// recovery point set by REPL_ERROR_CAUGHT
+_Noreturn void repl_raise_error(ErrorContext* ctx, int position, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(ctx->message, sizeof(ctx->message), format, args);
+    va_end(args);
+    ctx->position = position;
+
+    if (ctx->cleanup) {
+        void (*cleanup)(void*) = ctx->cleanup;
+        ctx->cleanup = NULL;
+        cleanup(ctx->cleanup_arg);
+    }
+
+    ERROR_LONGJMP(ctx->recover);
+}
@@ -1,29 +1,20 @@
 #include "../include/repl_eval.h"
 #include "../include/repl_variables.h"
 #include "../include/repl_ui.h"
+#include "../include/repl_compile.h"
+#include "../include/repl_heap.h"
+#include "../include/repl_functions.h"
+#include "../include/repl_number.h"
+#include "../include/repl_lexer.h"
+#include "../include/repl_bench.h"
+#include "../include/repl_extended.h"
+#include "../include/repl_decimal.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
 
-// Define tokenization helpers
-#define TOKEN_NUMBER 0
-#define TOKEN_OPERATOR 1
-#define TOKEN_VARIABLE 2
-#define TOKEN_COMMAND 3
-#define TOKEN_ERROR 4
-
-typedef struct {
-    int type;
-    union {
-        double number;
-        char op;
-        char var_name[MAX_VARIABLE_NAME];
-        char command[MAX_VARIABLE_NAME];
-    } value;
-} Token;
-
 // Built-in commands
 static const char* HELP_CMD = "help";
 static const char* CLEAR_CMD = "clear";
@@ -31,16 +22,35 @@ static const char* EXIT_CMD = "exit";
 static const char* QUIT_CMD = "quit";
 static const char* VARS_CMD = "vars";
 static const char* VERSION_CMD = "version";
+static const char* STATS_CMD = "stats";
+
+// Built-in commands taking an argument
+static const char* JIT_CMD = "jit";
+static const char* STRICT_CMD = "strict";
+static const char* FORMAT_CMD = "format";
+static const char* CACHE_CMD = "cache";
+static const char* BENCH_CMD = "bench";
+static const char* MEMO_CMD = "memo";
+static const char* MODE_CMD = "mode";
+static const char* PRECISION_CMD = "precision";
 
 // Forward declarations of helper functions - make these local to the module
-static void tokenize(REPL* repl, const char* expr, Token* tokens, int* token_count, bool* error);
-static double parse_expression(REPL* repl, Token* tokens, int* pos, int token_count, bool* error);
-static double parse_term(REPL* repl, Token* tokens, int* pos, int token_count, bool* error);
-static double parse_factor(REPL* repl, Token* tokens, int* pos, int token_count, bool* error);
+static Value execute_program(REPL* repl, CompiledExpr* program);
+static void collect_garbage(REPL* repl);
+static void define_function(REPL* repl, Function* definition, const char* line, char* result, size_t size);
+static int source_offset(const char* text, const char* key, int offset);
+static void format_error(REPL* repl, char* buffer, size_t size, int offset);
+static const char* command_argument(const char* input, const char* name);
+static bool argument_equals(const char* arg, const char* word);
+static bool is_statement(const char* input);
 
 // Enhanced evaluator function
 char* repl_evaluate(REPL* repl, const char* input) {
-    static char result[MAX_INPUT_LENGTH];
+    static char result[MAX_RESULT_LENGTH];
+    const char* line = input;    // Error columns count from the start of the line
+    
+    // Between evaluations every live value is in a variable or a cached program
+    collect_garbage(repl);
     
     // Trim leading/trailing whitespace
     while (isspace(*input)) input++;
@@ -59,225 +69,235 @@ char* repl_evaluate(REPL* repl, const char* input) {
         }
     }
     
-    // Check if input is an assignment (var = expression)
+    // Check if input defines a function: name(params) = expression
+    Function definition;
+    const char* definition_error;
+    if (repl_parse_definition(input, &definition, &definition_error)) {
+        if (definition_error) {
+            snprintf(result, sizeof(result), "Error evaluating: %s", definition_error);
+        } else {
+            define_function(repl, &definition, line, result, sizeof(result));
+        }
+        return result;
+    }
+    
+    // Check if input is an assignment (var = expression); "x == 1" is not
     char var_name[MAX_VARIABLE_NAME] = {0};
     int expr_start = 0;
-    if (sscanf(input, "%31[a-zA-Z0-9_] = %n", var_name, &expr_start) == 1 && expr_start != 0) {
+    if (!is_statement(input) &&
+        sscanf(input, "%31[a-zA-Z0-9_] = %n", var_name, &expr_start) == 1 && expr_start != 0 &&
+        input[expr_start] != '=') {
         // This is a variable assignment
         bool error = false;
-        double value = evaluate_expression(repl, input + expr_start, &error);
+        Value value = evaluate_expression(repl, input + expr_start, &error);
         
-        if (!error) {
+        if (!error && value_is_undefined(value)) {
+            snprintf(result, sizeof(result), "Error evaluating: no value to assign to '%s'", var_name);
+        } else if (!error) {
             repl_set_variable(repl, var_name, value);
-            sprintf(result, "%s = %.6g", var_name, value);
+            int length = snprintf(result, sizeof(result), "%s = ", var_name);
+            repl_format_value(value, repl->output_precision, result + length, sizeof(result) - length);
         } else {
-            sprintf(result, "Error evaluating expression: %s", input + expr_start);
+            format_error(repl, result, sizeof(result), (int)(input - line) + expr_start);
         }
         return result;
     }
     
     // Otherwise, evaluate as an expression
     bool error = false;
-    double value = evaluate_expression(repl, input, &error);
+    Value value = evaluate_expression(repl, input, &error);
     
     if (error) {
-        sprintf(result, "Error evaluating: %s", input);
+        format_error(repl, result, sizeof(result), (int)(input - line));
+    } else if (value_is_undefined(value)) {
+        // Statements that return nothing print nothing
+        strcpy(result, "");
     } else {
-        // Check if result is close to an integer
-        if (fabs(value - round(value)) < 1e-10) {
-            sprintf(result, "%.0f", value);
-        } else {
-            sprintf(result, "%.6g", value);
-        }
+        repl_format_value(value, repl->output_precision, result, sizeof(result));
     }
     
     return result;
 }
 
-// Expression evaluation functions
-double evaluate_expression(REPL* repl, const char* expr, bool* error) {
-    Token tokens[100]; // Assume max 100 tokens
-    int token_count = 0;
-    
-    tokenize(repl, expr, tokens, &token_count, error);
-    if (*error) return 0.0;
-    
-    int pos = 0;
-    double result = parse_expression(repl, tokens, &pos, token_count, error);
-    
-    // Make sure all tokens were consumed
-    if (pos != token_count && !*error) {
-        *error = true;
-    }
-    
-    return result;
+// True if input is more than one expression: several statements, a block,
+// or a statement starting with a keyword. These are compiled whole rather
+// than taken as "name = expression".
+static bool is_statement(const char* input) {
+    if (strpbrk(input, ";{")) return true;
+    const char* end = input;
+    while (CHAR_IS(*end, CHAR_WORD)) end++;
+    return repl_is_keyword(input, (size_t)(end - input));
 }
 
-static void tokenize(REPL* repl, const char* expr, Token* tokens, int* token_count, bool* error) {
-    *token_count = 0;
+// Expression evaluation functions
+// On error, sets *error and leaves the message and its offset in expr in
+// repl->error. Compiling and running raise errors by unwinding to the
+// single recovery point here, so the success path carries no error checks.
+Value evaluate_expression(REPL* repl, const char* expr, bool* error) {
+    ErrorContext* err = &repl->error;
+    char* volatile key = NULL;
     *error = false;
-    
-    while (*expr) {
-        // Skip whitespace
-        if (isspace(*expr)) {
-            expr++;
-            continue;
-        }
-        
-        // Check for numbers
-        if (isdigit(*expr) || *expr == '.') {
-            char* end;
-            double val = strtod(expr, &end);
-            tokens[*token_count].type = TOKEN_NUMBER;
-            tokens[*token_count].value.number = val;
-            (*token_count)++;
-            expr = end;
-            continue;
-        }
-        
-        // Check for operators
-        if (*expr == '+' || *expr == '-' || *expr == '*' || *expr == '/' || 
-            *expr == '^' || *expr == '(' || *expr == ')') {
-            tokens[*token_count].type = TOKEN_OPERATOR;
-            tokens[*token_count].value.op = *expr;
-            (*token_count)++;
-            expr++;
-            continue;
-        }
-        
-        // Check for variables/functions
-        if (isalpha(*expr) || *expr == '_') {
-            int i = 0;
-            char name[MAX_VARIABLE_NAME] = {0};
-            
-            while ((isalnum(*expr) || *expr == '_') && i < MAX_VARIABLE_NAME - 1) {
-                name[i++] = *expr++;
-            }
-            name[i] = '\0';
-            
-            // Check if it's a variable
-            if (repl_is_variable(repl, name)) {
-                tokens[*token_count].type = TOKEN_VARIABLE;
-                strcpy(tokens[*token_count].value.var_name, name);
-            } else {
-                tokens[*token_count].type = TOKEN_ERROR;
-                *error = true;
-                sprintf(tokens[*token_count].value.var_name, "Unknown variable: %s", name);
-            }
-            
-            (*token_count)++;
-            continue;
+
+    if (REPL_ERROR_CAUGHT(err)) {
+        // Positions refer to the normalized key; translate them back to expr
+        if (err->position >= 0) {
+            err->position = source_offset(expr, key, err->position);
         }
-        
-        // Unknown token
+        free(key);
         *error = true;
-        return;
+        return value_int(0);
     }
-}
 
-static double parse_expression(REPL* repl, Token* tokens, int* pos, int token_count, bool* error) {
-    double left = parse_term(repl, tokens, pos, token_count, error);
-    if (*error) return 0.0;
-    
-    while (*pos < token_count) {
-        if (tokens[*pos].type != TOKEN_OPERATOR) break;
-        
-        char op = tokens[*pos].value.op;
-        if (op != '+' && op != '-') break;
-        
-        (*pos)++;
-        double right = parse_term(repl, tokens, pos, token_count, error);
-        if (*error) return 0.0;
-        
-        if (op == '+') left += right;
-        else left -= right;
+    key = repl_normalize_expression(expr);
+    if (!key) repl_raise_error(err, -1, "out of memory");
+
+    // Reuse the compiled program if this text has been seen before
+    CompiledExpr* program = repl_cache_lookup(repl->expr_cache, key);
+    if (!program) {
+        program = repl_compile(repl, key);
+        repl_cache_insert(repl->expr_cache, key, program);
     }
-    
-    return left;
+
+    // Unchanged inputs give the previous result without running anything.
+    // Failed runs unwind past repl_remember_result, so errors are never cached.
+    Value value;
+    if (!repl_cached_result(repl, program, &value)) {
+        value = execute_program(repl, program);
+        repl_remember_result(repl, program, value);
+    }
+    free(key);
+    return value;
 }
 
-static double parse_term(REPL* repl, Token* tokens, int* pos, int token_count, bool* error) {
-    double left = parse_factor(repl, tokens, pos, token_count, error);
-    if (*error) return 0.0;
-    
-    while (*pos < token_count) {
-        if (tokens[*pos].type != TOKEN_OPERATOR) break;
-        
-        char op = tokens[*pos].value.op;
-        if (op != '*' && op != '/') break;
-        
-        (*pos)++;
-        double right = parse_factor(repl, tokens, pos, token_count, error);
-        if (*error) return 0.0;
-        
-        if (op == '*') left *= right;
-        else {
-            if (right == 0.0) {
-                *error = true;
-                return 0.0;
-            }
-            left /= right;
+// Compile a definition and add it to the function table, describing the
+// outcome in result. line is the whole input, for error columns.
+static void define_function(REPL* repl, Function* definition, const char* line, char* result, size_t size) {
+    ErrorContext* err = &repl->error;
+    const char* body = definition->body;
+    char* volatile key = NULL;
+
+    if (REPL_ERROR_CAUGHT(err)) {
+        if (err->position >= 0) {
+            err->position = source_offset(body, key, err->position);
         }
+        free(key);
+        format_error(repl, result, size, (int)(body - line));
+        return;
     }
-    
-    return left;
+
+    key = repl_normalize_expression(body);
+    if (!key) repl_raise_error(err, -1, "out of memory");
+
+    definition->body = key;
+    repl_define_function(repl, definition);
+    repl_format_function(definition, result, size);
+    free(key);
 }
 
-static double parse_factor(REPL* repl, Token* tokens, int* pos, int token_count, bool* error) {
-    if (*pos >= token_count) {
-        *error = true;
-        return 0.0;
+// Offset in text of the character at offset in its normalized key.
+// Normalizing only drops whitespace, so the n-th non-space character is
+// the same in both.
+static int source_offset(const char* text, const char* key, int offset) {
+    int n = 0;
+    for (int i = 0; i < offset && key[i]; i++) {
+        if (!CHAR_IS(key[i], CHAR_SPACE)) n++;
     }
-    
-    if (tokens[*pos].type == TOKEN_NUMBER) {
-        return tokens[(*pos)++].value.number;
+
+    const char* p = text;
+    for (;;) {
+        while (CHAR_IS(*p, CHAR_SPACE)) p++;
+        if (*p == '\0' || n == 0) break;
+        p++;
+        n--;
     }
-    
-    if (tokens[*pos].type == TOKEN_VARIABLE) {
-        bool found;
-        double value = repl_get_variable(repl, tokens[*pos].value.var_name, &found);
-        if (!found) {
-            *error = true;
-            return 0.0;
-        }
-        (*pos)++;
-        return value;
+    return (int)(p - text);
+}
+
+// Describe the error in repl->error; offset is where the evaluated
+// expression starts in the input line
+static void format_error(REPL* repl, char* buffer, size_t size, int offset) {
+    const ErrorContext* err = &repl->error;
+    if (err->position >= 0) {
+        snprintf(buffer, size, "Error at column %d: %s", offset + err->position + 1, err->message);
+    } else {
+        snprintf(buffer, size, "Error evaluating: %s", err->message);
     }
-    
-    if (tokens[*pos].type == TOKEN_OPERATOR && tokens[*pos].value.op == '(') {
-        (*pos)++; // Skip opening parenthesis
-        double value = parse_expression(repl, tokens, pos, token_count, error);
-        if (*error) return 0.0;
-        
-        if (*pos >= token_count || tokens[*pos].type != TOKEN_OPERATOR || tokens[*pos].value.op != ')') {
-            *error = true;
-            return 0.0;
-        }
-        
-        (*pos)++; // Skip closing parenthesis
-        return value;
+}
+
+// Free heap objects that no variable, function or cached program refers to, once
+// enough have been allocated
+static void collect_garbage(REPL* repl) {
+    if (repl_heap_should_collect()) repl_collect_garbage(repl);
+}
+
+// Mark the roots outside the VM, which marks its own first when it
+// collects within a loop, and free every object they do not reach
+void repl_collect_garbage(REPL* repl) {
+    const VariableStore* store = &repl->variables;
+    for (int i = 0; i < store->count; i++) {
+        repl_heap_mark(store->values[i]);
     }
-    
-    // Unary operators
-    if (tokens[*pos].type == TOKEN_OPERATOR) {
-        if (tokens[*pos].value.op == '+') {
-            (*pos)++;
-            return parse_factor(repl, tokens, pos, token_count, error);
+    repl_mark_functions(repl);
+    repl_cache_mark(repl->expr_cache);
+    repl_heap_sweep();
+}
+
+// Run a program as native code once it is hot, otherwise on the VM. Native
+// code computes doubles inline, so extended precision stays on the VM.
+static Value execute_program(REPL* repl, CompiledExpr* program) {
+    if (repl->jit_enabled && !program->jit_failed && repl_precision() == PRECISION_DOUBLE) {
+        if (!program->jit && ++program->run_count >= JIT_HOT_THRESHOLD) {
+            program->jit = repl_jit_compile(program);
+            program->jit_failed = (program->jit == NULL);
         }
-        if (tokens[*pos].value.op == '-') {
-            (*pos)++;
-            return -parse_factor(repl, tokens, pos, token_count, error);
+        if (program->jit) {
+            return repl_jit_execute(repl, program);
         }
     }
-    
-    *error = true;
-    return 0.0;
+    return repl_vm_execute(repl, program);
+}
+
+// Return the argument of "name" or "name <words>", or NULL if input is
+// not that command. Anything beyond words (e.g. "jit = 1") is not a command,
+// except a signed number after the first word, as in "mode decimal -1", so
+// that a bad one gets the command's usage message.
+static const char* command_argument(const char* input, const char* name) {
+    size_t length = strlen(name);
+    if (strncmp(input, name, length) != 0) return NULL;
+
+    const char* arg = input + length;
+    if (*arg != '\0' && !isspace(*arg)) return NULL;
+    while (isspace(*arg)) arg++;
+
+    for (const char* c = arg; *c; c++) {
+        bool sign = (*c == '-' || *c == '+') && c > arg && isspace(c[-1]) && isdigit(c[1]);
+        if (!isalnum(*c) && !isspace(*c) && !sign) return NULL;
+    }
+    return arg;
+}
+
+// Compare a command argument with a word, ignoring trailing whitespace
+static bool argument_equals(const char* arg, const char* word) {
+    size_t length = strlen(word);
+    if (strncmp(arg, word, length) != 0) return false;
+    for (arg += length; *arg; arg++) {
+        if (!isspace(*arg)) return false;
+    }
+    return true;
 }
 
 bool is_command(const char* input) {
     // Skip leading whitespace
     while (isspace(*input)) input++;
     
+    // Commands with arguments
+    if (command_argument(input, JIT_CMD) || command_argument(input, STRICT_CMD) ||
+        command_argument(input, FORMAT_CMD) || command_argument(input, CACHE_CMD) ||
+        command_argument(input, BENCH_CMD) || command_argument(input, MEMO_CMD) ||
+        command_argument(input, MODE_CMD) || command_argument(input, PRECISION_CMD)) {
+        return true;
+    }
+    
     // Check if the input contains any whitespace or operators
     for (const char* c = input; *c; c++) {
         if (isspace(*c) || *c == '=' || *c == '+' || *c == '-' || *c == '*' || *c == '/') {
@@ -291,11 +311,13 @@ bool is_command(const char* input) {
             strcmp(input, EXIT_CMD) == 0 ||
             strcmp(input, QUIT_CMD) == 0 ||
             strcmp(input, VARS_CMD) == 0 ||
-            strcmp(input, VERSION_CMD) == 0);
+            strcmp(input, VERSION_CMD) == 0 ||
+            strcmp(input, STATS_CMD) == 0);
 }
 
 bool handle_command(REPL* repl, const char* input) {
     static char result_buffer[MAX_OUTPUT_LENGTH];
+    const char* arg;
     
     // Skip leading whitespace
     while (isspace(*input)) input++;
@@ -317,7 +339,10 @@ bool handle_command(REPL* repl, const char* input) {
         return true;
     }
     else if (strcmp(input, VARS_CMD) == 0) {
-        repl_list_variables(repl, result_buffer, sizeof(result_buffer));
+        // The listing and the command line must fit in the output together
+        size_t size = sizeof(result_buffer) - strlen(input) - 64;
+        repl_list_variables(repl, result_buffer, size);
+        repl_list_functions(repl, result_buffer, size);
         repl_print(repl, result_buffer, false);
         return true;
     }
@@ -326,6 +351,280 @@ bool handle_command(REPL* repl, const char* input) {
         repl_print(repl, result_buffer, false);
         return true;
     }
+    else if (strcmp(input, STATS_CMD) == 0) {
+        ExprCache* cache = repl->expr_cache;
+        unsigned long lookups = cache->hits + cache->misses;
+        snprintf(result_buffer, sizeof(result_buffer),
+                 "Compile cache: %d/%d entries, %lu hits, %lu misses (%.1f%% hit rate)",
+                 cache->count, EXPR_CACHE_CAPACITY, cache->hits, cache->misses,
+                 lookups ? 100.0 * cache->hits / lookups : 0.0);
+        
+        int native = 0;
+        for (int i = 0; i < cache->count; i++) {
+            if (cache->entries[i].expr->jit) native++;
+        }
+        int pure = 0;
+        unsigned long memo_hits = 0, memo_misses = 0;
+        for (int i = 0; i < repl->functions.count; i++) {
+            const Function* function = &repl->functions.items[i];
+            if (function->pure) pure++;
+            memo_hits += function->memo_hits;
+            memo_misses += function->memo_misses;
+        }
+        unsigned long calls = memo_hits + memo_misses;
+        
+        size_t length = strlen(result_buffer);
+        snprintf(result_buffer + length, sizeof(result_buffer) - length,
+                 "\nNative code: %d cached programs (JIT %s)\nHeap: %lu objects"
+                 "\nMemoization: %d pure functions, %lu hits, %lu misses (%.1f%% hit rate)", native,
+                 repl->jit_enabled ? "on" : "off", (unsigned long)repl_heap_count(),
+                 pure, memo_hits, memo_misses, calls ? 100.0 * memo_hits / calls : 0.0);
+        repl_print(repl, result_buffer, false);
+        return true;
+    }
+    else if ((arg = command_argument(input, JIT_CMD)) != NULL) {
+        if (!repl_jit_available()) {
+            strcpy(result_buffer, "JIT: native code is not supported on this platform");
+        } else if (argument_equals(arg, "on")) {
+            repl->jit_enabled = true;
+            strcpy(result_buffer, "JIT enabled");
+        } else if (argument_equals(arg, "off")) {
+            repl->jit_enabled = false;
+            strcpy(result_buffer, "JIT disabled");
+        } else if (*arg == '\0') {
+            sprintf(result_buffer, "JIT is %s", repl->jit_enabled ? "on" : "off");
+        } else {
+            strcpy(result_buffer, "Usage: jit on|off");
+            repl_print(repl, result_buffer, true);
+            return true;
+        }
+        repl_print(repl, result_buffer, false);
+        return true;
+    }
+    else if ((arg = command_argument(input, STRICT_CMD)) != NULL) {
+        bool strict = repl->ieee_strict;
+        if (argument_equals(arg, "on")) {
+            strict = true;
+        } else if (argument_equals(arg, "off")) {
+            strict = false;
+        } else if (*arg != '\0') {
+            strcpy(result_buffer, "Usage: strict on|off");
+            repl_print(repl, result_buffer, true);
+            return true;
+        }
+        
+        // Programs were simplified under the old setting
+        if (strict != repl->ieee_strict) {
+            repl->ieee_strict = strict;
+            repl_cache_clear(repl->expr_cache);
+        }
+        sprintf(result_buffer, "IEEE-strict simplification is %s", strict ? "on" : "off");
+        repl_print(repl, result_buffer, false);
+        return true;
+    }
+    else if ((arg = command_argument(input, CACHE_CMD)) != NULL) {
+        if (*arg != '\0' && !argument_equals(arg, "stats")) {
+            strcpy(result_buffer, "Usage: cache stats");
+            repl_print(repl, result_buffer, true);
+            return true;
+        }
+        
+        ExprCache* cache = repl->expr_cache;
+        unsigned long evaluations = cache->result_hits + cache->result_misses;
+        unsigned long lookups = cache->hits + cache->misses;
+        int results = 0;
+        for (int i = 0; i < cache->count; i++) {
+            if (cache->entries[i].expr->has_result) results++;
+        }
+        snprintf(result_buffer, sizeof(result_buffer),
+                 "Result cache: %d results held, %lu hits, %lu misses (%.1f%% hit rate)\n"
+                 "Compile cache: %lu hits, %lu misses (%.1f%% hit rate)",
+                 results, cache->result_hits, cache->result_misses,
+                 evaluations ? 100.0 * cache->result_hits / evaluations : 0.0,
+                 cache->hits, cache->misses,
+                 lookups ? 100.0 * cache->hits / lookups : 0.0);
+        repl_print(repl, result_buffer, false);
+        return true;
+    }
+    else if ((arg = command_argument(input, BENCH_CMD)) != NULL) {
+        bool ran;
+        if (argument_equals(arg, "lex")) {
+            ran = repl_bench_lexer(result_buffer, sizeof(result_buffer));
+        } else if (argument_equals(arg, "precision")) {
+            ran = repl_bench_precision(result_buffer, sizeof(result_buffer));
+        } else {
+            strcpy(result_buffer, "Usage: bench lex|precision");
+            repl_print(repl, result_buffer, true);
+            return true;
+        }
+        repl_print(repl, result_buffer, !ran);
+        return true;
+    }
+    else if ((arg = command_argument(input, MEMO_CMD)) != NULL) {
+        int capacity = repl->memo_capacity;
+        if (argument_equals(arg, "off")) {
+            capacity = 0;
+        } else if (argument_equals(arg, "on")) {
+            capacity = MEMO_DEFAULT_CAPACITY;
+        } else if (isdigit(*arg)) {
+            char* end;
+            long entries = strtol(arg, &end, 10);
+            bool valid = entries >= 1 && entries <= MEMO_MAX_CAPACITY && argument_equals(end, "");
+            capacity = valid ? 1 : -1;
+            while (valid && capacity < entries) capacity *= 2;
+        } else if (*arg != '\0') {
+            capacity = -1;
+        }
+        
+        if (capacity < 0) {
+            sprintf(result_buffer, "Usage: memo on|off|1-%d", MEMO_MAX_CAPACITY);
+            repl_print(repl, result_buffer, true);
+            return true;
+        }
+        if (capacity != repl->memo_capacity) {
+            repl_memo_reset(repl, capacity);
+        }
+        
+        if (capacity == 0) {
+            strcpy(result_buffer, "Memoization of pure functions is off");
+        } else {
+            sprintf(result_buffer, "Pure functions remember up to %d results each", capacity);
+        }
+        repl_print(repl, result_buffer, false);
+        return true;
+    }
+    else if ((arg = command_argument(input, MODE_CMD)) != NULL) {
+        NumberMode old_mode = repl_number_mode();
+        NumberMode mode = old_mode;
+        int old_scale = repl_decimal_scale();
+        int scale = old_scale;
+        if (argument_equals(arg, "int64")) {
+            mode = NUMBER_MODE_INT64;
+        } else if (argument_equals(arg, "bigint")) {
+            mode = NUMBER_MODE_BIGINT;
+        } else if (argument_equals(arg, "rational")) {
+            mode = NUMBER_MODE_RATIONAL;
+        } else if (strncmp(arg, "decimal", 7) == 0 && (arg[7] == '\0' || isspace(arg[7]))) {
+            // "decimal N" also sets the places quotients are rounded to
+            char* end = (char*)arg + 7;
+            long places = isdigit(*(end + strspn(end, " \t"))) ? strtol(end, &end, 10) : scale;
+            mode = NUMBER_MODE_DECIMAL;
+            scale = places >= 0 && places <= DECIMAL_MAX_SCALE && argument_equals(end, "") ? (int)places : -1;
+        } else if (*arg != '\0') {
+            scale = -1;
+        }
+        if (scale < 0) {
+            sprintf(result_buffer, "Usage: mode int64|bigint|rational|decimal [0-%d]", DECIMAL_MAX_SCALE);
+            repl_print(repl, result_buffer, true);
+            return true;
+        }
+        if (mode == NUMBER_MODE_DECIMAL && !repl_decimal_available()) {
+            strcpy(result_buffer, "mode: decimal needs 128-bit integers, which this compiler lacks");
+            repl_print(repl, result_buffer, true);
+            return true;
+        }
+        
+        // Literals and constants were folded under the old mode, in cached
+        // programs and in functions alike
+        if (mode != old_mode || scale != old_scale) {
+            ErrorContext* err = &repl->error;
+            if (REPL_ERROR_CAUGHT(err)) {
+                repl_set_number_mode(old_mode);
+                repl_set_decimal_scale(old_scale);
+                snprintf(result_buffer, sizeof(result_buffer), "%s", err->message);
+                repl_print(repl, result_buffer, true);
+                return true;
+            }
+            repl_set_number_mode(mode);
+            repl_set_decimal_scale(scale);
+            repl_recompile_functions(repl);
+        }
+        
+        if (mode == NUMBER_MODE_DECIMAL) {
+            sprintf(result_buffer, "Decimals are exact fixed-point: quotients round half to even at %d places", scale);
+        } else if (mode == NUMBER_MODE_RATIONAL) {
+            strcpy(result_buffer, "Arithmetic is exact: decimals and integer division give fractions");
+        } else if (mode == NUMBER_MODE_BIGINT) {
+            strcpy(result_buffer, "Integers are arbitrary-precision: int64 results that overflow become bigints");
+        } else {
+            strcpy(result_buffer, "Integers are int64 and wrap on overflow");
+        }
+        repl_print(repl, result_buffer, false);
+        return true;
+    }
+    else if ((arg = command_argument(input, PRECISION_CMD)) != NULL) {
+        Precision old_precision = repl_precision();
+        Precision precision = old_precision;
+        if (argument_equals(arg, "double")) {
+            precision = PRECISION_DOUBLE;
+        } else if (argument_equals(arg, "dd")) {
+            precision = PRECISION_DD;
+        } else if (argument_equals(arg, "quad")) {
+            precision = PRECISION_QUAD;
+        } else if (*arg != '\0') {
+            strcpy(result_buffer, "Usage: precision double|dd|quad");
+            repl_print(repl, result_buffer, true);
+            return true;
+        }
+        if (!repl_precision_available(precision)) {
+            strcpy(result_buffer, "precision: quad needs __float128, which this compiler lacks");
+            repl_print(repl, result_buffer, true);
+            return true;
+        }
+        
+        // Decimal literals were read at the old precision, like the number
+        // mode's literals
+        if (precision != old_precision) {
+            ErrorContext* err = &repl->error;
+            if (REPL_ERROR_CAUGHT(err)) {
+                repl_set_precision(old_precision);
+                snprintf(result_buffer, sizeof(result_buffer), "%s", err->message);
+                repl_print(repl, result_buffer, true);
+                return true;
+            }
+            repl_set_precision(precision);
+            repl_recompile_functions(repl);
+            repl_update_constants(repl, old_precision);
+        }
+        
+        if (precision == PRECISION_QUAD) {
+            sprintf(result_buffer, "Decimals are IEEE binary128, %d significant digits", QUAD_DIGITS);
+        } else if (precision == PRECISION_DD) {
+            sprintf(result_buffer, "Decimals are double-doubles, %d significant digits", DD_DIGITS);
+        } else {
+            strcpy(result_buffer, "Decimals are doubles, 15 to 17 significant digits");
+        }
+        repl_print(repl, result_buffer, false);
+        return true;
+    }
+    else if ((arg = command_argument(input, FORMAT_CMD)) != NULL) {
+        int precision = repl->output_precision;
+        if (argument_equals(arg, "shortest")) {
+            precision = FORMAT_SHORTEST;
+        } else if (isdigit(*arg)) {
+            char* end;
+            long digits = strtol(arg, &end, 10);
+            bool valid = digits >= 1 && digits <= FORMAT_MAX_PRECISION && argument_equals(end, "");
+            precision = valid ? (int)digits : -1;
+        } else if (*arg != '\0') {
+            precision = -1;
+        }
+        
+        if (precision < 0) {
+            sprintf(result_buffer, "Usage: format shortest|1-%d", FORMAT_MAX_PRECISION);
+            repl_print(repl, result_buffer, true);
+            return true;
+        }
+        repl->output_precision = precision;
+        
+        if (repl->output_precision == FORMAT_SHORTEST) {
+            strcpy(result_buffer, "Results are printed with the shortest digits that read back exactly");
+        } else {
+            sprintf(result_buffer, "Results are printed with %d significant digits", repl->output_precision);
+        }
+        repl_print(repl, result_buffer, false);
+        return true;
+    }
     
     return false;
 }
\ No newline at end of file
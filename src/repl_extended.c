@@ -0,0 +1,1082 @@
+#include "../include/repl_extended.h"
+#include "../include/repl_heap.h"
+#include "../include/repl_number.h"
+#include "../include/repl_vm.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/*
+ * A double-double is the unevaluated sum of two doubles, which carries
+ * 106 significant bits. Its arithmetic is built from error-free
+ * transformations: two_sum and two_prod return a rounded result together
+ * with its exact rounding error, and the errors are folded back into the
+ * low part. Every operation is a dozen or two hardware instructions,
+ * against a software routine per operation for binary128.
+ *
+ * Binary128 uses the compiler's __float128 where there is one. Its math
+ * functions take a double-double result as the first guess for a Newton
+ * step, or sum the same series in binary128.
+ */
+
+// Error-free transformations
+
+// a + b exactly as s + e
+static inline DoubleDouble two_sum(double a, double b) {
+    double s = a + b;
+    double v = s - a;
+    DoubleDouble r = { s, (a - (s - v)) + (b - v) };
+    return r;
+}
+
+// The same for |a| >= |b|, in three operations instead of six
+static inline DoubleDouble quick_two_sum(double a, double b) {
+    double s = a + b;
+    DoubleDouble r = { s, b - (s - a) };
+    return r;
+}
+
+// a * b exactly as p + e. A fused multiply-add gives the error directly;
+// without hardware FMA, Dekker's splitting into 26-bit halves is far
+// faster than the library's software fma.
+#ifdef FP_FAST_FMA
+static inline DoubleDouble two_prod(double a, double b) {
+    double p = a * b;
+    DoubleDouble r = { p, fma(a, b, -p) };
+    return r;
+}
+#else
+#define SPLITTER 134217729.0             // 2^27 + 1
+#define SPLIT_LIMIT 6.69692879491417e+299 // 2^996: larger values are scaled to split
+
+static inline void split(double a, double* hi, double* lo) {
+    if (a > SPLIT_LIMIT || a < -SPLIT_LIMIT) {
+        a *= 3.7252902984619140625e-09;  // 2^-28
+        double t = SPLITTER * a;
+        *hi = (t - (t - a)) * 268435456.0;
+        *lo = (a - (t - (t - a))) * 268435456.0;
+        return;
+    }
+    double t = SPLITTER * a;
+    *hi = t - (t - a);
+    *lo = a - *hi;
+}
+
+static inline DoubleDouble two_prod(double a, double b) {
+    double a_hi, a_lo, b_hi, b_lo;
+    double p = a * b;
+    split(a, &a_hi, &a_lo);
+    split(b, &b_hi, &b_lo);
+    DoubleDouble r = { p, ((a_hi * b_hi - p) + a_hi * b_lo + a_lo * b_hi) + a_lo * b_lo };
+    return r;
+}
+#endif
+
+// Double-double arithmetic. A non-finite high part makes the low part
+// meaningless, so it is dropped.
+
+static inline DoubleDouble dd(double hi, double lo) {
+    DoubleDouble r = { hi, lo };
+    return r;
+}
+
+static inline DoubleDouble finite_or_not(DoubleDouble r, double hi) {
+    return isfinite(hi) ? r : dd(hi, 0.0);
+}
+
+DoubleDouble repl_dd_add(DoubleDouble a, DoubleDouble b) {
+    DoubleDouble s = two_sum(a.hi, b.hi);
+    DoubleDouble t = two_sum(a.lo, b.lo);
+    s.lo += t.hi;
+    s = quick_two_sum(s.hi, s.lo);
+    s.lo += t.lo;
+    return finite_or_not(quick_two_sum(s.hi, s.lo), a.hi + b.hi);
+}
+
+static DoubleDouble dd_neg(DoubleDouble a) {
+    return dd(-a.hi, -a.lo);
+}
+
+static DoubleDouble dd_sub(DoubleDouble a, DoubleDouble b) {
+    return repl_dd_add(a, dd_neg(b));
+}
+
+DoubleDouble repl_dd_mul(DoubleDouble a, DoubleDouble b) {
+    DoubleDouble p = two_prod(a.hi, b.hi);
+    p.lo += a.hi * b.lo + a.lo * b.hi;
+    return finite_or_not(quick_two_sum(p.hi, p.lo), p.hi);
+}
+
+static DoubleDouble dd_mul_double(DoubleDouble a, double b) {
+    DoubleDouble p = two_prod(a.hi, b);
+    p.lo += a.lo * b;
+    return finite_or_not(quick_two_sum(p.hi, p.lo), p.hi);
+}
+
+// Long division: each quotient digit is a double, and three give more
+// than 106 bits
+DoubleDouble repl_dd_div(DoubleDouble a, DoubleDouble b) {
+    double q1 = a.hi / b.hi;
+    if (!isfinite(q1)) return dd(q1, 0.0);
+    DoubleDouble r = dd_sub(a, dd_mul_double(b, q1));
+    double q2 = r.hi / b.hi;
+    r = dd_sub(r, dd_mul_double(b, q2));
+    double q3 = r.hi / b.hi;
+    return repl_dd_add(quick_two_sum(q1, q2), dd(q3, 0.0));
+}
+
+static int dd_compare(DoubleDouble a, DoubleDouble b) {
+    if (a.hi != b.hi) return a.hi < b.hi ? -1 : 1;
+    if (a.lo != b.lo) return a.lo < b.lo ? -1 : 1;
+    return 0;
+}
+
+static DoubleDouble dd_floor(DoubleDouble a) {
+    double hi = floor(a.hi);
+    if (hi != a.hi) return dd(hi, 0.0);
+    return quick_two_sum(hi, floor(a.lo));
+}
+
+// a^n by squaring, for a non-negative integer n
+static DoubleDouble dd_power(DoubleDouble a, unsigned long n) {
+    DoubleDouble result = dd(1.0, 0.0);
+    while (n) {
+        if (n & 1) result = repl_dd_mul(result, a);
+        a = repl_dd_mul(a, a);
+        n >>= 1;
+    }
+    return result;
+}
+
+static const DoubleDouble DD_LN2 = { 6.931471805599452862e-01, 2.319046813846299558e-17 };
+
+static DoubleDouble dd_ldexp(DoubleDouble a, int k) {
+    return dd(ldexp(a.hi, k), ldexp(a.lo, k));
+}
+
+// e^r - 1 for |r| <= ln 2 / 2, to full precision near 0. r is divided by
+// 2^10 so that the Taylor series converges in a few terms, and the result
+// is squared back up through (e^2x - 1) = (e^x - 1)(e^x + 1), which loses
+// nothing near 0.
+static DoubleDouble dd_expm1_reduced(DoubleDouble r) {
+    r = dd_ldexp(r, -10);
+    DoubleDouble sum = r, term = r;
+    for (int n = 2; n < 30; n++) {
+        term = repl_dd_div(repl_dd_mul(term, r), dd(n, 0.0));
+        sum = repl_dd_add(sum, term);
+        if (fabs(term.hi) < 1e-33 * fabs(sum.hi)) break;
+    }
+    for (int i = 0; i < 10; i++) {
+        sum = repl_dd_mul(sum, repl_dd_add(sum, dd(2.0, 0.0)));
+    }
+    return sum;
+}
+
+// e^a: with a = k ln 2 + r, e^a = 2^k e^r
+static DoubleDouble dd_exp(DoubleDouble a) {
+    if (a.hi > 709.8) return dd(INFINITY, 0.0);
+    if (a.hi < -745.2) return dd(0.0, 0.0);
+    if (isnan(a.hi)) return a;
+
+    double k = floor(a.hi / DD_LN2.hi + 0.5);
+    DoubleDouble r = dd_sub(a, dd_mul_double(DD_LN2, k));
+    DoubleDouble sum = repl_dd_add(dd_expm1_reduced(r), dd(1.0, 0.0));
+    return dd_ldexp(sum, (int)k);
+}
+
+/*
+ * ln a by one Newton step from the double logarithm, which doubles its
+ * 53 correct bits. With a = m 2^e and m within a factor sqrt 2 of 1, ln m
+ * is x' = x + (m - 1 - (e^x - 1)) / e^x, where m - 1 is exact, so that
+ * nothing is lost near 1.
+ */
+static DoubleDouble dd_log(DoubleDouble a) {
+    if (a.hi <= 0.0 || !isfinite(a.hi)) return dd(log(a.hi), 0.0);
+    int e = ilogb(a.hi);
+    DoubleDouble m = dd_ldexp(a, -e);
+    if (m.hi > 1.4142135623730951) {
+        m = dd_ldexp(m, -1);
+        e++;
+    }
+    DoubleDouble x = dd(log(m.hi), 0.0);
+    DoubleDouble expm1 = dd_expm1_reduced(x);
+    DoubleDouble step = repl_dd_div(dd_sub(dd_sub(m, dd(1.0, 0.0)), expm1), repl_dd_add(expm1, dd(1.0, 0.0)));
+    return repl_dd_add(repl_dd_add(x, step), dd_mul_double(DD_LN2, e));
+}
+
+// a^b as C's pow does it: exact squaring for integer exponents, e^(b ln a)
+// otherwise, and a NaN for a negative base with a non-integer exponent
+static DoubleDouble dd_pow(DoubleDouble a, DoubleDouble b) {
+    bool integral = dd_compare(dd_floor(b), b) == 0 && fabs(b.hi) < 2147483648.0;
+    if (integral) {
+        DoubleDouble p = dd_power(a, (unsigned long)fabs(b.hi));
+        return b.hi < 0 ? repl_dd_div(dd(1.0, 0.0), p) : p;
+    }
+    if (a.hi == 0.0 || a.hi < 0.0 || !isfinite(a.hi) || !isfinite(b.hi)) {
+        return dd(pow(a.hi, b.hi), 0.0);
+    }
+    return dd_exp(repl_dd_mul(b, dd_log(a)));
+}
+
+// sqrt a by one Newton step from the double square root, which doubles
+// its 53 correct bits: x' = x + (a - x^2) / 2x. a is scaled to near 1 by
+// an even power of two first so that the low half of x^2 cannot underflow.
+static DoubleDouble dd_sqrt(DoubleDouble a) {
+    if (a.hi <= 0.0 || !isfinite(a.hi)) return dd(sqrt(a.hi), 0.0);
+    int k = ilogb(a.hi) & ~1;
+    a = dd(ldexp(a.hi, -k), ldexp(a.lo, -k));
+    double x = sqrt(a.hi);
+    DoubleDouble residual = dd_sub(a, two_prod(x, x));
+    DoubleDouble root = quick_two_sum(x, residual.hi / (2.0 * x));
+    return dd(ldexp(root.hi, k / 2), ldexp(root.lo, k / 2));
+}
+
+// A power of ten; exact up to 10^45
+static DoubleDouble dd_pow10(int n) {
+    DoubleDouble p = dd_power(dd(10.0, 0.0), (unsigned long)(n < 0 ? -n : n));
+    return n < 0 ? repl_dd_div(dd(1.0, 0.0), p) : p;
+}
+
+// The math library: each function from the double one and a correction,
+// or from exp and log
+
+static const DoubleDouble DD_LN10 = { 2.302585092994045901e+00, -2.170756223382249351e-16 };
+static const DoubleDouble DD_PI_2 = { 1.570796326794896558e+00, 6.123233995736766036e-17 };
+
+// What the double-doubles leave out, for binary128 and argument reduction
+#define LN2_TAIL 5.707708438416212066e-34
+#define LN10_TAIL -9.984262454465776570e-33
+#define PI_2_TAIL -1.497384904859169833e-33
+
+/*
+ * sin a and cos a. a less the nearest multiple k of pi/2 leaves
+ * |r| <= pi/4, where both Taylor series converge in a dozen terms. k times
+ * each of the first two parts of pi/2 is exact, so r keeps its 106 bits
+ * up to |a| near 2^52. k mod 4 then picks the quadrant.
+ */
+static void dd_sincos(DoubleDouble a, DoubleDouble* s, DoubleDouble* c) {
+    if (!isfinite(a.hi) || fabs(a.hi) > 0x1p52) {
+        *s = dd(sin(a.hi), 0.0);
+        *c = dd(cos(a.hi), 0.0);
+        return;
+    }
+    double k = floor(a.hi / DD_PI_2.hi + 0.5);
+    DoubleDouble r = dd_sub(a, two_prod(k, DD_PI_2.hi));
+    r = dd_sub(r, two_prod(k, DD_PI_2.lo));
+    r = dd_sub(r, dd(k * PI_2_TAIL, 0.0));
+
+    DoubleDouble r2 = repl_dd_mul(r, r);
+    DoubleDouble sine = r, cosine = dd(1.0, 0.0);
+    DoubleDouble sine_term = r, cosine_term = dd(1.0, 0.0);
+    for (int n = 2; n < 60; n += 2) {
+        cosine_term = repl_dd_div(dd_neg(repl_dd_mul(cosine_term, r2)), dd((double)(n - 1) * n, 0.0));
+        sine_term = repl_dd_div(dd_neg(repl_dd_mul(sine_term, r2)), dd((double)n * (n + 1), 0.0));
+        cosine = repl_dd_add(cosine, cosine_term);
+        sine = repl_dd_add(sine, sine_term);
+        if (fabs(cosine_term.hi) < 1e-33 && fabs(sine_term.hi) < 1e-33 * fabs(sine.hi)) break;
+    }
+
+    int quadrant = (int)(k - 4.0 * floor(k / 4.0));
+    switch (quadrant) {
+        case 0: *s = sine; *c = cosine; break;
+        case 1: *s = cosine; *c = dd_neg(sine); break;
+        case 2: *s = dd_neg(sine); *c = dd_neg(cosine); break;
+        default: *s = dd_neg(cosine); *c = sine; break;
+    }
+}
+
+/*
+ * atan2(y, x) by one Newton step from the double angle t. With y and x
+ * at an angle t + d, y cos t - x sin t and x cos t + y sin t are sin d
+ * and cos d times the same length, so d is atan of their ratio, which is
+ * the ratio itself to 106 bits for |d| near 2^-53.
+ */
+static DoubleDouble dd_atan2(DoubleDouble y, DoubleDouble x) {
+    double t = atan2(y.hi, x.hi);
+    if (!isfinite(y.hi) || !isfinite(x.hi) || (y.hi == 0.0 && x.hi == 0.0)) return dd(t, 0.0);
+    int k = ilogb(fabs(y.hi) > fabs(x.hi) ? y.hi : x.hi);
+    y = dd_ldexp(y, -k);
+    x = dd_ldexp(x, -k);
+    DoubleDouble s, c;
+    dd_sincos(dd(t, 0.0), &s, &c);
+    DoubleDouble num = dd_sub(repl_dd_mul(y, c), repl_dd_mul(x, s));
+    DoubleDouble den = repl_dd_add(repl_dd_mul(x, c), repl_dd_mul(y, s));
+    return repl_dd_add(dd(t, 0.0), repl_dd_div(num, den));
+}
+
+// sqrt(1 - a^2) as (1 - a)(1 + a), which is exact near |a| = 1
+static DoubleDouble dd_cosine_of_sine(DoubleDouble a) {
+    DoubleDouble one = dd(1.0, 0.0);
+    return dd_sqrt(repl_dd_mul(dd_sub(one, a), repl_dd_add(one, a)));
+}
+
+static DoubleDouble dd_asin(DoubleDouble a) {
+    if (fabs(a.hi) > 1.0) return dd(asin(a.hi), 0.0);
+    return dd_atan2(a, dd_cosine_of_sine(a));
+}
+
+static DoubleDouble dd_acos(DoubleDouble a) {
+    if (fabs(a.hi) > 1.0) return dd(acos(a.hi), 0.0);
+    return dd_atan2(dd_cosine_of_sine(a), a);
+}
+
+// sinh a from e^a, except near 0, where e^a - e^-a cancels and the odd
+// Taylor series converges fast instead
+static DoubleDouble dd_sinh(DoubleDouble a) {
+    if (!isfinite(a.hi) || a.hi == 0.0) return dd(sinh(a.hi), 0.0);
+    if (fabs(a.hi) >= 0.5) {
+        DoubleDouble e = dd_exp(a);
+        return dd_ldexp(dd_sub(e, repl_dd_div(dd(1.0, 0.0), e)), -1);
+    }
+    DoubleDouble a2 = repl_dd_mul(a, a), sum = a, term = a;
+    for (int n = 3; n < 60; n += 2) {
+        term = repl_dd_div(repl_dd_mul(term, a2), dd((double)(n - 1) * n, 0.0));
+        sum = repl_dd_add(sum, term);
+        if (fabs(term.hi) < 1e-33 * fabs(sum.hi)) break;
+    }
+    return sum;
+}
+
+static DoubleDouble dd_cosh(DoubleDouble a) {
+    if (!isfinite(a.hi)) return dd(cosh(a.hi), 0.0);
+    DoubleDouble e = dd_exp(a);
+    return dd_ldexp(repl_dd_add(e, repl_dd_div(dd(1.0, 0.0), e)), -1);
+}
+
+// Beyond 40, tanh is 1 to 115 bits
+static DoubleDouble dd_tanh(DoubleDouble a) {
+    if (fabs(a.hi) > 40.0 || isnan(a.hi)) return dd(tanh(a.hi), 0.0);
+    return repl_dd_div(dd_sinh(a), dd_cosh(a));
+}
+
+// cbrt a by one Newton step from the double cube root, with a scaled by a
+// power of eight to near 1: x' = x - (x^3 - a) / 3x^2
+static DoubleDouble dd_cbrt(DoubleDouble a) {
+    if (a.hi == 0.0 || !isfinite(a.hi)) return dd(cbrt(a.hi), 0.0);
+    int k = ilogb(a.hi) / 3;
+    a = dd_ldexp(a, -3 * k);
+    DoubleDouble x = dd(cbrt(a.hi), 0.0);
+    DoubleDouble x2 = repl_dd_mul(x, x);
+    DoubleDouble residual = dd_sub(repl_dd_mul(x2, x), a);
+    x = dd_sub(x, repl_dd_div(residual, dd_mul_double(x2, 3.0)));
+    return dd_ldexp(x, k);
+}
+
+// sqrt(a^2 + b^2) with both scaled by a power of two to near 1 first, so
+// that the squares neither overflow nor underflow
+static DoubleDouble dd_hypot(DoubleDouble a, DoubleDouble b) {
+    if (!isfinite(a.hi) || !isfinite(b.hi)) return dd(hypot(a.hi, b.hi), 0.0);
+    if (a.hi == 0.0 && b.hi == 0.0) return dd(0.0, 0.0);
+    int k = ilogb(fabs(a.hi) > fabs(b.hi) ? a.hi : b.hi);
+    a = dd_ldexp(a, -k);
+    b = dd_ldexp(b, -k);
+    return dd_ldexp(dd_sqrt(repl_dd_add(repl_dd_mul(a, a), repl_dd_mul(b, b))), k);
+}
+
+static DoubleDouble dd_ceil(DoubleDouble a) {
+    return dd_neg(dd_floor(dd_neg(a)));
+}
+
+static DoubleDouble dd_trunc(DoubleDouble a) {
+    return a.hi < 0.0 ? dd_ceil(a) : dd_floor(a);
+}
+
+// Halfway cases round away from zero, as C's round does
+static DoubleDouble dd_round(DoubleDouble a) {
+    DoubleDouble whole = dd_trunc(a);
+    DoubleDouble fraction = dd_sub(a, whole);
+    if (a.hi < 0.0) fraction = dd_neg(fraction);
+    if (dd_compare(fraction, dd(0.5, 0.0)) < 0) return whole;
+    return repl_dd_add(whole, dd(a.hi < 0.0 ? -1.0 : 1.0, 0.0));
+}
+
+// Binary128
+
+#ifdef REPL_HAVE_FLOAT128
+typedef __float128 Quad;
+
+static Quad quad_power(Quad a, unsigned long n) {
+    Quad result = 1;
+    while (n) {
+        if (n & 1) result *= a;
+        a *= a;
+        n >>= 1;
+    }
+    return result;
+}
+
+static Quad quad_pow10(int n) {
+    Quad p = quad_power(10, (unsigned long)(n < 0 ? -n : n));
+    return n < 0 ? 1 / p : p;
+}
+
+static DoubleDouble quad_to_dd(Quad q) {
+    double hi = (double)q;
+    return isfinite(hi) ? dd(hi, (double)(q - hi)) : dd(hi, 0.0);
+}
+
+static Quad dd_to_quad(DoubleDouble a) {
+    return (Quad)a.hi + a.lo;
+}
+
+static Quad quad_abs(Quad a) {
+    return a < 0 ? -a : a;
+}
+
+// a 2^k, in steps a double can hold
+static Quad quad_ldexp(Quad a, int k) {
+    for (; k > 1000; k -= 1000) a *= 0x1p1000;
+    for (; k < -1000; k += 1000) a *= 0x1p-1000;
+    return a * ldexp(1.0, k);
+}
+
+// The exponent of a finite nonzero a, possibly one high
+static int quad_ilogb(Quad a) {
+    int e = 0;
+    for (; quad_abs(a) >= 0x1p1000; e += 1000) a *= 0x1p-1000;
+    for (; quad_abs(a) < 0x1p-1000; e -= 1000) a *= 0x1p1000;
+    return e + ilogb((double)a);
+}
+
+// e^r - 1 for |r| <= ln 2 / 2 by its Taylor series
+static Quad quad_expm1_reduced(Quad r) {
+    Quad sum = r, term = r;
+    for (int n = 2; n < 40; n++) {
+        term = term * r / n;
+        sum += term;
+        if (quad_abs(term) < 1e-36 * quad_abs(sum)) break;
+    }
+    return sum;
+}
+
+// e^a as dd_exp computes it. k ln 2 is exact through its first two parts
+// for any k a binary128 can be scaled by.
+static Quad quad_exp(Quad a) {
+    if (a > 11357) return INFINITY;  // ln 2^16384 is 11356.5
+    if (a < -11434) return 0;        // ln 2^-16494 is -11433.0
+    if (a != a) return a;
+    double k = floor((double)a / DD_LN2.hi + 0.5);
+    Quad r = a - (Quad)k * DD_LN2.hi - (Quad)k * DD_LN2.lo - (Quad)k * LN2_TAIL;
+    return quad_ldexp(1 + quad_expm1_reduced(r), (int)k);
+}
+
+// ln a as dd_log computes it, by a Newton step from the double-double
+// logarithm
+static Quad quad_log(Quad a) {
+    if (!(a > 0) || a - a != 0) return dd_to_quad(dd_log(quad_to_dd(a)));
+    int e = quad_ilogb(a);
+    Quad m = quad_ldexp(a, -e);
+    if (m > 1.4142135623730951) {
+        m /= 2;
+        e++;
+    }
+    Quad x = dd_to_quad(dd_log(quad_to_dd(m)));
+    Quad expm1 = quad_expm1_reduced(x);
+    x += (m - 1 - expm1) / (1 + expm1);
+    return x + ((Quad)e * DD_LN2.hi + (Quad)e * DD_LN2.lo + (Quad)e * LN2_TAIL);
+}
+
+static Quad quad_pow(Quad a, Quad b) {
+    Quad whole = (Quad)(long long)b;
+    if (whole == b && b > -2147483648.0 && b < 2147483648.0) {
+        Quad p = quad_power(a, (unsigned long)(b < 0 ? -b : b));
+        return b < 0 ? 1 / p : p;
+    }
+    if (!(a > 0) || a - a != 0 || b - b != 0) return dd_to_quad(dd_pow(quad_to_dd(a), quad_to_dd(b)));
+    return quad_exp(b * quad_log(a));
+}
+
+// One Newton step in binary128 from the double-double root, of a scaled
+// by an even power of two into the range of a double
+static Quad quad_sqrt(Quad a) {
+    if (!(a > 0) || a - a != 0) return dd_to_quad(dd_sqrt(quad_to_dd(a)));
+    int k = quad_ilogb(a) & ~1;
+    a = quad_ldexp(a, -k);
+    Quad x = dd_to_quad(dd_sqrt(quad_to_dd(a)));
+    return quad_ldexp((x + a / x) / 2, k / 2);
+}
+
+// sin a and cos a as dd_sincos computes them
+static void quad_sincos(Quad a, Quad* s, Quad* c) {
+    if (!(quad_abs(a) < 0x1p52)) {
+        DoubleDouble sine, cosine;
+        dd_sincos(quad_to_dd(a), &sine, &cosine);
+        *s = dd_to_quad(sine);
+        *c = dd_to_quad(cosine);
+        return;
+    }
+    double k = floor((double)a / DD_PI_2.hi + 0.5);
+    Quad r = a - (Quad)k * DD_PI_2.hi - (Quad)k * DD_PI_2.lo - (Quad)k * PI_2_TAIL;
+
+    Quad r2 = r * r;
+    Quad sine = r, cosine = 1, sine_term = r, cosine_term = 1;
+    for (int n = 2; n < 60; n += 2) {
+        cosine_term = -cosine_term * r2 / ((n - 1) * n);
+        sine_term = -sine_term * r2 / (n * (n + 1));
+        cosine += cosine_term;
+        sine += sine_term;
+        if (quad_abs(cosine_term) < 1e-36 && quad_abs(sine_term) < 1e-36 * quad_abs(sine)) break;
+    }
+
+    int quadrant = (int)(k - 4.0 * floor(k / 4.0));
+    switch (quadrant) {
+        case 0: *s = sine; *c = cosine; break;
+        case 1: *s = cosine; *c = -sine; break;
+        case 2: *s = -sine; *c = -cosine; break;
+        default: *s = -cosine; *c = sine; break;
+    }
+}
+
+// atan2(y, x) as dd_atan2 computes it, from the double-double angle of y
+// and x scaled into the range of a double
+static Quad quad_atan2(Quad y, Quad x) {
+    if (y - y != 0 || x - x != 0 || (y == 0 && x == 0)) {
+        return dd_to_quad(dd_atan2(quad_to_dd(y), quad_to_dd(x)));
+    }
+    int k = quad_ilogb(quad_abs(y) > quad_abs(x) ? y : x);
+    y = quad_ldexp(y, -k);
+    x = quad_ldexp(x, -k);
+    Quad t = dd_to_quad(dd_atan2(quad_to_dd(y), quad_to_dd(x))), s, c;
+    quad_sincos(t, &s, &c);
+    return t + (y * c - x * s) / (x * c + y * s);
+}
+
+static Quad quad_asin(Quad a) {
+    if (!(quad_abs(a) <= 1)) return dd_to_quad(dd_asin(quad_to_dd(a)));
+    return quad_atan2(a, quad_sqrt((1 - a) * (1 + a)));
+}
+
+static Quad quad_acos(Quad a) {
+    if (!(quad_abs(a) <= 1)) return dd_to_quad(dd_acos(quad_to_dd(a)));
+    return quad_atan2(quad_sqrt((1 - a) * (1 + a)), a);
+}
+
+static Quad quad_sinh(Quad a) {
+    if (a - a != 0 || a == 0) return a;
+    if (quad_abs(a) >= 0.5) {
+        Quad e = quad_exp(a);
+        return (e - 1 / e) / 2;
+    }
+    Quad a2 = a * a, sum = a, term = a;
+    for (int n = 3; n < 60; n += 2) {
+        term = term * a2 / ((n - 1) * n);
+        sum += term;
+        if (quad_abs(term) < 1e-36 * quad_abs(sum)) break;
+    }
+    return sum;
+}
+
+static Quad quad_cosh(Quad a) {
+    if (a - a != 0) return quad_abs(a);
+    Quad e = quad_exp(a);
+    return (e + 1 / e) / 2;
+}
+
+// Beyond 40, tanh is 1 to 115 bits
+static Quad quad_tanh(Quad a) {
+    if (a != a) return a;
+    if (quad_abs(a) > 40) return a < 0 ? -1 : 1;
+    return quad_sinh(a) / quad_cosh(a);
+}
+
+// One Newton step in binary128 from the double-double cube root, of a
+// scaled by a power of eight into the range of a double
+static Quad quad_cbrt(Quad a) {
+    if (a - a != 0 || a == 0) return a;
+    int k = quad_ilogb(a) / 3;
+    a = quad_ldexp(a, -3 * k);
+    Quad x = dd_to_quad(dd_cbrt(quad_to_dd(a)));
+    x -= (x * x * x - a) / (3 * x * x);
+    return quad_ldexp(x, k);
+}
+
+static Quad quad_hypot(Quad a, Quad b) {
+    a = quad_abs(a);
+    b = quad_abs(b);
+    if (a - a != 0 || b - b != 0) return a == INFINITY || b == INFINITY ? INFINITY : a + b;
+    if (a == 0 && b == 0) return 0;
+    int k = quad_ilogb(a > b ? a : b);
+    a = quad_ldexp(a, -k);
+    b = quad_ldexp(b, -k);
+    return quad_ldexp(quad_sqrt(a * a + b * b), k);
+}
+
+#define QUAD_WHOLE 5192296858534827628530496329220096.0  // 2^112: every binary128 from here up is whole
+
+// Rounding is exact in binary128, through a 128-bit integer
+static Quad quad_round(ExtendedFunction function, Quad a) {
+    if (!(a > -QUAD_WHOLE && a < QUAD_WHOLE)) return a;
+    Quad whole = (Quad)(__int128)a;
+    switch (function) {
+        case EXTENDED_CEIL:
+            if (whole < a) whole += 1;
+            break;
+        case EXTENDED_FLOOR:
+            if (whole > a) whole -= 1;
+            break;
+        case EXTENDED_ROUND:
+            if (a - whole >= 0.5) whole += 1;
+            if (whole - a >= 0.5) whole -= 1;
+            break;
+        default:
+            break;
+    }
+    // A zero keeps the argument's sign, as ceil(-0.5) is -0 in C
+    return whole == 0 ? a * 0 : whole;
+}
+#endif
+
+bool repl_precision_available(Precision precision) {
+#ifdef REPL_HAVE_FLOAT128
+    (void)precision;
+    return true;
+#else
+    return precision != PRECISION_QUAD;
+#endif
+}
+
+// Values
+
+// Running out of memory is reported as VALUE_TOO_LARGE, as for bigints
+static ValueStatus box(HeapObject* object, Value* result) {
+    if (!object) return VALUE_TOO_LARGE;
+    result->bits = VALUE_TAGGED(VALUE_TAG_OBJECT, (uint64_t)(uintptr_t)object);
+    return VALUE_OK;
+}
+
+static ValueStatus value_dd(DoubleDouble a, Value* result) {
+    DoubleDoubleObject* object = (DoubleDoubleObject*)repl_heap_allocate(VALUE_DD, sizeof(DoubleDoubleObject));
+    if (object) object->value = a;
+    return box(&object->header, result);
+}
+
+// An integer of up to 64 bits as an exact double-double, from its two halves
+static DoubleDouble dd_from_halves(double high, uint32_t low) {
+    return two_sum(high * 4294967296.0, (double)low);
+}
+
+static DoubleDouble to_dd(Value v) {
+    switch (value_type(v)) {
+        case VALUE_INT:
+        case VALUE_BOOL: {
+            int64_t i = (int64_t)value_as_bits(v);
+            return dd_from_halves((double)(i >> 32), (uint32_t)i);
+        }
+        case VALUE_UINT: {
+            uint64_t u = value_as_bits(v);
+            return dd_from_halves((double)(u >> 32), (uint32_t)u);
+        }
+        case VALUE_RATIONAL: {
+            const RationalObject* rational = (const RationalObject*)value_object(v);
+            return repl_dd_div(to_dd(rational->numerator), to_dd(rational->denominator));
+        }
+        case VALUE_DD:
+            return ((const DoubleDoubleObject*)value_object(v))->value;
+#ifdef REPL_HAVE_FLOAT128
+        case VALUE_QUAD:
+            return quad_to_dd(((const QuadObject*)value_object(v))->value);
+#endif
+        default:
+            return dd(value_to_double(v), 0.0);
+    }
+}
+
+#ifdef REPL_HAVE_FLOAT128
+static ValueStatus value_quad(Quad q, Value* result) {
+    QuadObject* object = (QuadObject*)repl_heap_allocate(VALUE_QUAD, sizeof(QuadObject));
+    if (object) object->value = q;
+    return box(&object->header, result);
+}
+
+static Quad to_quad(Value v) {
+    switch (value_type(v)) {
+        case VALUE_INT:
+        case VALUE_BOOL:
+            return (Quad)(int64_t)value_as_bits(v);
+        case VALUE_UINT:
+            return (Quad)value_as_bits(v);
+        case VALUE_RATIONAL: {
+            const RationalObject* rational = (const RationalObject*)value_object(v);
+            return to_quad(rational->numerator) / to_quad(rational->denominator);
+        }
+        case VALUE_QUAD:
+            return ((const QuadObject*)value_object(v))->value;
+        default:
+            return dd_to_quad(to_dd(v));
+    }
+}
+#endif
+
+double repl_extended_to_double(const HeapObject* object) {
+#ifdef REPL_HAVE_FLOAT128
+    if (object->type == VALUE_QUAD) return (double)((const QuadObject*)object)->value;
+#endif
+    return ((const DoubleDoubleObject*)object)->value.hi;
+}
+
+bool repl_extended_is_zero(const HeapObject* object) {
+#ifdef REPL_HAVE_FLOAT128
+    if (object->type == VALUE_QUAD) return ((const QuadObject*)object)->value == 0;
+#endif
+    return ((const DoubleDoubleObject*)object)->value.hi == 0.0;
+}
+
+// Binary128 if either operand or the precision setting asks for it
+static bool wants_quad(Value a, Value b) {
+#ifdef REPL_HAVE_FLOAT128
+    return repl_precision() == PRECISION_QUAD || value_type(a) == VALUE_QUAD || value_type(b) == VALUE_QUAD;
+#else
+    (void)a;
+    (void)b;
+    return false;
+#endif
+}
+
+#ifdef REPL_HAVE_FLOAT128
+static ValueStatus quad_binary(int op, Quad a, Quad b, Value* result) {
+    switch (op) {
+        case OP_ADD: return value_quad(a + b, result);
+        case OP_SUB: return value_quad(a - b, result);
+        case OP_MUL: return value_quad(a * b, result);
+        case OP_DIV:
+            if (b == 0) return VALUE_DIVISION_BY_ZERO;
+            return value_quad(a / b, result);
+        case OP_POW: return value_quad(quad_pow(a, b), result);
+        case OP_LT:  *result = value_bool(a < b); return VALUE_OK;
+        case OP_LE:  *result = value_bool(a <= b); return VALUE_OK;
+        case OP_EQ:  *result = value_bool(a == b); return VALUE_OK;
+        case OP_NE:  *result = value_bool(a != b); return VALUE_OK;
+        default: return VALUE_INVALID_OPERANDS;
+    }
+}
+#endif
+
+// Operators as for doubles: no '%' or bitwise operators
+ValueStatus repl_extended_binary(int op, Value a, Value b, Value* result) {
+#ifdef REPL_HAVE_FLOAT128
+    if (wants_quad(a, b)) return quad_binary(op, to_quad(a), to_quad(b), result);
+#endif
+    (void)wants_quad;
+    DoubleDouble x = to_dd(a), y = to_dd(b);
+    switch (op) {
+        case OP_ADD: return value_dd(repl_dd_add(x, y), result);
+        case OP_SUB: return value_dd(dd_sub(x, y), result);
+        case OP_MUL: return value_dd(repl_dd_mul(x, y), result);
+        case OP_DIV:
+            if (y.hi == 0.0) return VALUE_DIVISION_BY_ZERO;
+            return value_dd(repl_dd_div(x, y), result);
+        case OP_POW: return value_dd(dd_pow(x, y), result);
+        // A NaN compares unequal to everything, itself included
+        case OP_LT:  *result = value_bool(x.hi < y.hi || (x.hi == y.hi && x.lo < y.lo)); return VALUE_OK;
+        case OP_LE:  *result = value_bool(x.hi < y.hi || (x.hi == y.hi && x.lo <= y.lo)); return VALUE_OK;
+        case OP_EQ:  *result = value_bool(x.hi == y.hi && x.lo == y.lo); return VALUE_OK;
+        case OP_NE:  *result = value_bool(!(x.hi == y.hi && x.lo == y.lo)); return VALUE_OK;
+        default: return VALUE_INVALID_OPERANDS;
+    }
+}
+
+ValueStatus repl_extended_unary(int op, Value a, Value* result) {
+    if (op != OP_NEG) return VALUE_INVALID_OPERANDS;
+#ifdef REPL_HAVE_FLOAT128
+    if (wants_quad(a, a)) return value_quad(-to_quad(a), result);
+#endif
+    return value_dd(dd_neg(to_dd(a)), result);
+}
+
+ValueStatus repl_extended_sqrt(Value a, Value* result) {
+#ifdef REPL_HAVE_FLOAT128
+    if (wants_quad(a, a)) return value_quad(quad_sqrt(to_quad(a)), result);
+#endif
+    return value_dd(dd_sqrt(to_dd(a)), result);
+}
+
+#ifdef REPL_HAVE_FLOAT128
+static ValueStatus quad_function(ExtendedFunction function, Quad a, Quad b, Value* result) {
+    Quad r;
+    switch (function) {
+        case EXTENDED_ACOS:  r = quad_acos(a); break;
+        case EXTENDED_ASIN:  r = quad_asin(a); break;
+        case EXTENDED_ATAN:  r = quad_atan2(a, 1); break;
+        case EXTENDED_ATAN2: r = quad_atan2(a, b); break;
+        case EXTENDED_CBRT:  r = quad_cbrt(a); break;
+        case EXTENDED_COS:   quad_sincos(a, &b, &r); break;
+        case EXTENDED_COSH:  r = quad_cosh(a); break;
+        case EXTENDED_EXP:   r = quad_exp(a); break;
+        case EXTENDED_HYPOT: r = quad_hypot(a, b); break;
+        case EXTENDED_LOG:   r = quad_log(a); break;
+        case EXTENDED_LOG10: r = quad_log(a) / ((Quad)DD_LN10.hi + DD_LN10.lo + LN10_TAIL); break;
+        case EXTENDED_LOG2:  r = quad_log(a) / ((Quad)DD_LN2.hi + DD_LN2.lo + LN2_TAIL); break;
+        case EXTENDED_SIN:   quad_sincos(a, &r, &b); break;
+        case EXTENDED_SINH:  r = quad_sinh(a); break;
+        case EXTENDED_TAN:   quad_sincos(a, &r, &b); r /= b; break;
+        case EXTENDED_TANH:  r = quad_tanh(a); break;
+        default: r = quad_round(function, a); break;
+    }
+    return value_quad(r, result);
+}
+#endif
+
+// The math library, in binary128 if either operand or the precision
+// setting asks for it
+ValueStatus repl_extended_function(ExtendedFunction function, Value a, Value b, Value* result) {
+    if (function == EXTENDED_NONE) return VALUE_INVALID_OPERANDS;
+#ifdef REPL_HAVE_FLOAT128
+    if (wants_quad(a, b)) return quad_function(function, to_quad(a), to_quad(b), result);
+#endif
+    DoubleDouble x = to_dd(a), y = to_dd(b), r;
+    switch (function) {
+        case EXTENDED_ACOS:  r = dd_acos(x); break;
+        case EXTENDED_ASIN:  r = dd_asin(x); break;
+        case EXTENDED_ATAN:  r = dd_atan2(x, dd(1.0, 0.0)); break;
+        case EXTENDED_ATAN2: r = dd_atan2(x, y); break;
+        case EXTENDED_CBRT:  r = dd_cbrt(x); break;
+        case EXTENDED_CEIL:  r = dd_ceil(x); break;
+        case EXTENDED_COS:   dd_sincos(x, &y, &r); break;
+        case EXTENDED_COSH:  r = dd_cosh(x); break;
+        case EXTENDED_EXP:   r = dd_exp(x); break;
+        case EXTENDED_FLOOR: r = dd_floor(x); break;
+        case EXTENDED_HYPOT: r = dd_hypot(x, y); break;
+        case EXTENDED_LOG:   r = dd_log(x); break;
+        case EXTENDED_LOG10: r = repl_dd_div(dd_log(x), DD_LN10); break;
+        case EXTENDED_LOG2:  r = repl_dd_div(dd_log(x), DD_LN2); break;
+        case EXTENDED_ROUND: r = dd_round(x); break;
+        case EXTENDED_SIN:   dd_sincos(x, &r, &y); break;
+        case EXTENDED_SINH:  r = dd_sinh(x); break;
+        case EXTENDED_TAN:   dd_sincos(x, &r, &y); r = repl_dd_div(r, y); break;
+        case EXTENDED_TANH:  r = dd_tanh(x); break;
+        case EXTENDED_TRUNC: r = dd_trunc(x); break;
+        default: return VALUE_INVALID_OPERANDS;
+    }
+    return value_dd(r, result);
+}
+
+/*
+ * A decimal literal at the current precision: the digits are gathered
+ * into an integer, which is exact up to 31 digits, then scaled by a power
+ * of ten. text is a literal the double parser accepted.
+ */
+bool repl_extended_parse(const char* text, size_t length, Value* value) {
+    size_t i = 0;
+    long exponent = 0;
+    bool point = false;
+    DoubleDouble m = dd(0.0, 0.0);
+#ifdef REPL_HAVE_FLOAT128
+    bool quad = repl_precision() == PRECISION_QUAD;
+    Quad q = 0;
+#endif
+
+    for (; i < length && text[i] != 'e' && text[i] != 'E'; i++) {
+        if (text[i] == '.') {
+            point = true;
+            continue;
+        }
+        int digit = text[i] - '0';
+#ifdef REPL_HAVE_FLOAT128
+        if (quad) q = q * 10 + digit;
+#endif
+        m = repl_dd_add(dd_mul_double(m, 10.0), dd(digit, 0.0));
+        if (point) exponent--;
+    }
+    if (i < length) {
+        bool negative = text[++i] == '-';
+        if (text[i] == '-' || text[i] == '+') i++;
+        long written = 0;
+        for (; i < length; i++) {
+            if (written < 100000) written = written * 10 + (text[i] - '0');
+        }
+        exponent += negative ? -written : written;
+    }
+
+#ifdef REPL_HAVE_FLOAT128
+    if (quad) {
+        // binary128 reaches 10^4932, so no second step is needed before that
+        Quad scaled = exponent < 0 ? q / quad_power(10, (unsigned long)-exponent)
+                                   : q * quad_power(10, (unsigned long)exponent);
+        return value_quad(scaled, value) == VALUE_OK;
+    }
+#endif
+
+    // Scaling is in steps of at most 10^300, so that each power of ten is
+    // finite, with m kept near 1 and its power of two counted in scale.
+    // No low word is then subnormal until the end, where the result is
+    // rounded once, to zero for exponents far below the double range.
+    int scale = 0;
+    while (exponent != 0 && m.hi != 0.0 && isfinite(m.hi)) {
+        int step = exponent < -300 ? -300 : exponent > 300 ? 300 : (int)exponent;
+        m = step < 0 ? repl_dd_div(m, dd_pow10(-step)) : repl_dd_mul(m, dd_pow10(step));
+        exponent -= step;
+        int k = ilogb(m.hi);
+        m = dd(ldexp(m.hi, -k), ldexp(m.lo, -k));
+        scale += k;
+    }
+    double hi = ldexp(m.hi, scale);
+    m = isfinite(hi) ? quick_two_sum(hi, ldexp(m.lo, scale)) : dd(hi, 0.0);
+    return value_dd(m, value) == VALUE_OK;
+}
+
+// A constant given to more digits than binary128 holds, at a precision
+Value repl_extended_constant(const char* digits, Precision precision) {
+    Precision saved = repl_precision();
+    const char* end;
+    double number;
+    repl_parse_number(digits, &end, &number);
+    Value value = value_float(number);
+    if (precision == PRECISION_DOUBLE) return value;
+
+    repl_set_precision(precision);
+    repl_extended_parse(digits, strlen(digits), &value);
+    repl_set_precision(saved);
+    return value;
+}
+
+bool repl_extended_equal(Value a, Value b) {
+#ifdef REPL_HAVE_FLOAT128
+    if (value_type(a) == VALUE_QUAD) {
+        return memcmp(&((const QuadObject*)value_object(a))->value,
+                      &((const QuadObject*)value_object(b))->value, sizeof(Quad)) == 0;
+    }
+#endif
+    const DoubleDouble* x = &((const DoubleDoubleObject*)value_object(a))->value;
+    const DoubleDouble* y = &((const DoubleDoubleObject*)value_object(b))->value;
+    return memcmp(x, y, sizeof(DoubleDouble)) == 0;
+}
+
+// Formatting
+
+/*
+ * Digits of a positive finite value scaled into [1, 10), one per step of
+ * taking the integer part and multiplying the rest by 10, with one digit
+ * more than wanted for rounding. The scaling and the steps are inexact in
+ * the last bits, which can leave a digit at -1 or 10; carries fix that.
+ * Returns the decimal exponent of the first digit.
+ */
+static int round_digits(int* digits, int count, int exponent) {
+    for (int i = count; i > 0; i--) {
+        if (i == count && digits[i] >= 5) digits[i - 1]++;
+        if (digits[i - 1] > 9) {
+            digits[i - 1] -= 10;
+            if (i > 1) digits[i - 2]++;
+            else {
+                memmove(digits + 1, digits, (size_t)count * sizeof(int));
+                digits[0] = 1;
+                exponent++;
+            }
+        } else if (digits[i - 1] < 0 && i > 1) {
+            digits[i - 1] += 10;
+            digits[i - 2]--;
+        }
+    }
+    return exponent;
+}
+
+static int dd_digits(DoubleDouble x, int* digits, int count) {
+    int exponent = (int)floor(log10(x.hi));
+    int first = exponent < -300 ? -300 : exponent > 300 ? 300 : exponent;
+    DoubleDouble r = first > 0 ? repl_dd_div(x, dd_pow10(first)) : repl_dd_mul(x, dd_pow10(-first));
+    if (exponent != first) r = repl_dd_mul(r, dd_pow10(first - exponent));
+    if (dd_compare(r, dd(10.0, 0.0)) >= 0) {
+        r = repl_dd_div(r, dd(10.0, 0.0));
+        exponent++;
+    } else if (dd_compare(r, dd(1.0, 0.0)) < 0) {
+        r = dd_mul_double(r, 10.0);
+        exponent--;
+    }
+
+    for (int i = 0; i <= count; i++) {
+        int d = (int)dd_floor(r).hi;
+        digits[i] = d;
+        r = dd_mul_double(dd_sub(r, dd(d, 0.0)), 10.0);
+    }
+    return round_digits(digits, count, exponent);
+}
+
+#ifdef REPL_HAVE_FLOAT128
+static int quad_digits(Quad x, int* digits, int count) {
+    // Scale into double range first, where log10 can estimate the exponent
+    int exponent = 0;
+    while (x > 1e300) {
+        x /= quad_pow10(300);
+        exponent += 300;
+    }
+    while (x < 1e-300) {
+        x *= quad_pow10(300);
+        exponent -= 300;
+    }
+    int estimate = (int)floor(log10((double)x));
+    Quad r = x * quad_pow10(-estimate);
+    exponent += estimate;
+    if (r >= 10) {
+        r /= 10;
+        exponent++;
+    } else if (r < 1) {
+        r *= 10;
+        exponent--;
+    }
+
+    for (int i = 0; i <= count; i++) {
+        int d = (int)r;
+        if ((Quad)d > r) d--;
+        digits[i] = d;
+        r = (r - d) * 10;
+    }
+    return round_digits(digits, count, exponent);
+}
+#endif
+
+// Like a double: the shortest form at full precision, which here means
+// trailing zeros dropped, or precision significant digits
+void repl_extended_format(Value v, int precision, char* buffer, size_t size) {
+    bool quad = value_type(v) == VALUE_QUAD;
+    int count = precision == FORMAT_SHORTEST ? (quad ? QUAD_DIGITS : DD_DIGITS) : precision;
+    int digits[QUAD_DIGITS + 2];
+    char text[EXTENDED_BUFFER_SIZE];
+    char* out = text;
+    int exponent;
+
+#ifdef REPL_HAVE_FLOAT128
+    if (quad) {
+        Quad q = ((const QuadObject*)value_object(v))->value;
+        // The conversion keeps the sign, a zero's included
+        double approximation = (double)q;
+        if (signbit(approximation) && q == q) {
+            *out++ = '-';
+            q = -q;
+        }
+        if (q != q || q == 0 || (q - q) != 0) {
+            snprintf(out, sizeof(text) - 1, "%s", q != q ? "nan" : q == 0 ? "0" : "inf");
+            snprintf(buffer, size, "%s", text);
+            return;
+        }
+        exponent = quad_digits(q, digits, count);
+    } else
+#endif
+    {
+        DoubleDouble x = to_dd(v);
+        if (signbit(x.hi) && !isnan(x.hi)) {
+            *out++ = '-';
+            x = dd_neg(x);
+        }
+        if (!isfinite(x.hi) || x.hi == 0.0) {
+            snprintf(out, sizeof(text) - 1, "%s", isnan(x.hi) ? "nan" : isinf(x.hi) ? "inf" : "0");
+            snprintf(buffer, size, "%s", text);
+            return;
+        }
+        // Below 2^-969 the low word is subnormal, and the pair holds
+        // fewer than 106 bits: those from the leading one down to 2^-1074
+        int bits = ilogb(x.hi) + 1075;
+        if (precision == FORMAT_SHORTEST && bits < 106) {
+            count = (int)(bits * 0.30103);
+            if (count < 1) count = 1;
+        }
+        exponent = dd_digits(x, digits, count);
+    }
+
+    char characters[QUAD_DIGITS + 1];
+    int length = count;
+    for (int i = 0; i < count; i++) characters[i] = (char)('0' + digits[i]);
+    if (precision == FORMAT_SHORTEST) {
+        while (length > 1 && characters[length - 1] == '0') length--;
+    }
+    repl_format_digits(out, characters, length, exponent - length + 1);
+    snprintf(buffer, size, "%s", text);
+}
@@ -0,0 +1,414 @@
+#include "../include/repl_functions.h"
+#include "../include/repl_compile.h"
+#include "../include/repl_heap.h"
+#include "../include/repl_lexer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Copy a name of length characters, or return false if it is too long
+static bool copy_name(char* dest, const char* name, size_t length) {
+    if (length >= MAX_VARIABLE_NAME) return false;
+    memcpy(dest, name, length);
+    dest[length] = '\0';
+    return true;
+}
+
+/*
+ * Recognize "name(a, b) = body" with definition->body pointing into input.
+ * Returns false if input is not a function definition. A definition whose
+ * names are unusable returns true with *error set.
+ */
+bool repl_parse_definition(const char* input, Function* definition, const char** error) {
+    const char* names[MAX_FUNCTION_PARAMS + 1];
+    size_t lengths[MAX_FUNCTION_PARAMS + 1];
+    int count = 0;
+    const char* p = input;
+
+    *error = NULL;
+    if (!CHAR_IS(*p, CHAR_ALPHA)) return false;
+    while (CHAR_IS(*p, CHAR_WORD)) p++;
+    size_t name_length = (size_t)(p - input);
+    while (CHAR_IS(*p, CHAR_SPACE)) p++;
+    if (*p++ != '(') return false;
+
+    while (CHAR_IS(*p, CHAR_SPACE)) p++;
+    if (*p != ')') {
+        for (;;) {
+            if (!CHAR_IS(*p, CHAR_ALPHA)) return false;
+            const char* param = p;
+            while (CHAR_IS(*p, CHAR_WORD)) p++;
+            if (count <= MAX_FUNCTION_PARAMS) {
+                names[count] = param;
+                lengths[count] = (size_t)(p - param);
+            }
+            count++;
+
+            while (CHAR_IS(*p, CHAR_SPACE)) p++;
+            if (*p == ')') break;
+            if (*p++ != ',') return false;
+            while (CHAR_IS(*p, CHAR_SPACE)) p++;
+        }
+    }
+    p++;
+    while (CHAR_IS(*p, CHAR_SPACE)) p++;
+    if (p[0] != '=' || p[1] == '=') return false;
+    definition->body = (char*)p + 1;
+
+    if (!copy_name(definition->name, input, name_length)) {
+        *error = "function name is too long";
+        return true;
+    }
+    if (repl_is_keyword(input, name_length)) {
+        *error = "a keyword cannot name a function";
+        return true;
+    }
+    if (count > MAX_FUNCTION_PARAMS) {
+        *error = "too many parameters";
+        return true;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!copy_name(definition->params[i], names[i], lengths[i])) {
+            *error = "parameter name is too long";
+            return true;
+        }
+        if (repl_is_keyword(names[i], lengths[i])) {
+            *error = "a keyword cannot name a parameter";
+            return true;
+        }
+        for (int j = 0; j < i; j++) {
+            if (strcmp(definition->params[i], definition->params[j]) == 0) {
+                *error = "duplicate parameter name";
+                return true;
+            }
+        }
+    }
+    definition->arity = count;
+    return true;
+}
+
+// Index of the function called name, or -1. Functions are few and only
+// looked up while compiling, so a linear search is enough.
+int repl_find_function(REPL* repl, const char* name, int length) {
+    const FunctionTable* table = &repl->functions;
+    for (int i = 0; i < table->count; i++) {
+        const char* candidate = table->items[i].name;
+        if (strncmp(candidate, name, length) == 0 && candidate[length] == '\0') {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * A function is pure if its code reads no variables and calls only pure
+ * functions; its result then depends on nothing but the arguments. Calls
+ * may be cyclic, so impurity is spread to callers until nothing changes.
+ */
+static void update_purity(FunctionTable* table) {
+    for (int i = 0; i < table->count; i++) {
+        table->items[i].pure = table->items[i].code->slot_count == 0;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < table->count; i++) {
+            Function* function = &table->items[i];
+            if (!function->pure || !function->code->calls_functions) continue;
+            const CompiledExpr* code = function->code;
+            for (int pc = 0; pc < code->code_length; pc++) {
+                Instr instr = code->code[pc];
+                if (INSTR_OP(instr) == OP_CALL && !table->items[INSTR_BX(instr)].pure) {
+                    function->pure = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Compile every function again into a new array, first (unless it is -1)
+ * ahead of the others and installed at once, so that they see its size
+ * when inlining. On an error the new code is freed and the error passed
+ * on; an error in a function other than first is reported against that
+ * function rather than at a position in its body.
+ */
+static CompiledExpr** compile_functions(REPL* repl, int first) {
+    FunctionTable* table = &repl->functions;
+    ErrorContext* err = &repl->error;
+    CompiledExpr** codes = (CompiledExpr**)calloc(table->count ? table->count : 1, sizeof(CompiledExpr*));
+    if (!codes) repl_raise_error(err, -1, "out of memory");
+
+    volatile int compiling = first;
+    ErrorJmpBuf outer;
+    memcpy(outer, err->recover, sizeof(outer));
+    if (REPL_ERROR_CAUGHT(err)) {
+        if (compiling != first) {
+            char message[MAX_ERROR_LENGTH];
+            snprintf(message, sizeof(message), "'%s' would no longer compile: %.190s",
+                     table->items[compiling].name, err->message);
+            memcpy(err->message, message, sizeof(message));
+            err->position = -1;
+        }
+        for (int i = 0; i < table->count; i++) {
+            repl_free_compiled(codes[i]);
+        }
+        free(codes);
+        memcpy(err->recover, outer, sizeof(outer));
+        ERROR_LONGJMP(err->recover);
+    }
+
+    if (first >= 0) {
+        codes[first] = repl_compile_function(repl, first);
+        table->items[first].code = codes[first];
+    }
+    for (int i = 0; i < table->count; i++) {
+        if (i == first) continue;
+        compiling = i;
+        codes[i] = repl_compile_function(repl, i);
+    }
+    memcpy(err->recover, outer, sizeof(outer));
+    return codes;
+}
+
+// Replace the code of every function but skip with codes, which is freed.
+// Cached programs may have inlined or called the old code, and remembered
+// results may depend on it.
+static void install_functions(REPL* repl, CompiledExpr** codes, int skip) {
+    FunctionTable* table = &repl->functions;
+    for (int i = 0; i < table->count; i++) {
+        if (i == skip) continue;
+        repl_free_compiled(table->items[i].code);
+        table->items[i].code = codes[i];
+    }
+    free(codes);
+
+    repl_cache_clear(repl->expr_cache);
+    update_purity(table);
+    repl_memo_reset(repl, repl->memo_capacity);
+}
+
+/*
+ * Define or redefine a function from a definition with a normalized body.
+ * Every other function is compiled again, since it may have inlined the
+ * old body or called it with the old arity; if any of them no longer
+ * compiles the definition is rejected and the table is left as it was.
+ * Errors unwind through repl->error with offsets in the new body.
+ */
+void repl_define_function(REPL* repl, const Function* definition) {
+    FunctionTable* table = &repl->functions;
+    ErrorContext* err = &repl->error;
+
+    size_t body_length = strlen(definition->body);
+    char* body = (char*)malloc(body_length + 1);
+    if (!body) repl_raise_error(err, -1, "out of memory");
+    memcpy(body, definition->body, body_length + 1);
+
+    int index = repl_find_function(repl, definition->name, (int)strlen(definition->name));
+    bool is_new = index < 0;
+    if (is_new) {
+        if (table->count == MAX_FUNCTIONS) {
+            free(body);
+            repl_raise_error(err, -1, "too many functions");
+        }
+        if (table->count == table->capacity) {
+            int capacity = table->capacity ? table->capacity * 2 : 8;
+            Function* items = (Function*)realloc(table->items, capacity * sizeof(Function));
+            if (!items) {
+                free(body);
+                repl_raise_error(err, -1, "out of memory");
+            }
+            table->items = items;
+            table->capacity = capacity;
+        }
+        index = table->count++;
+        memset(&table->items[index], 0, sizeof(Function));
+    }
+
+    Function saved = table->items[index];
+    Function* function = &table->items[index];
+    memcpy(function->name, definition->name, sizeof(function->name));
+    memcpy(function->params, definition->params, sizeof(function->params));
+    function->arity = definition->arity;
+    function->body = body;
+
+    // Undo the definition on any error, then pass the error on to the
+    // caller's recovery point
+    ErrorJmpBuf outer;
+    memcpy(outer, err->recover, sizeof(outer));
+    if (REPL_ERROR_CAUGHT(err)) {
+        free(body);
+        table->items[index] = saved;
+        if (is_new) table->count--;
+        memcpy(err->recover, outer, sizeof(outer));
+        ERROR_LONGJMP(err->recover);
+    }
+    CompiledExpr** codes = compile_functions(repl, index);
+    memcpy(err->recover, outer, sizeof(outer));
+
+    repl_free_compiled(saved.code);
+    free(saved.body);
+    install_functions(repl, codes, index);
+    function->memo_hits = 0;
+    function->memo_misses = 0;
+}
+
+// Compile every function again after something their code depends on has
+// changed, such as the number mode. On an error the old code is kept.
+void repl_recompile_functions(REPL* repl) {
+    install_functions(repl, compile_functions(repl, -1), -1);
+}
+
+// "name(a, b) = body"; returns the length written, as snprintf does
+int repl_format_function(const Function* function, char* buffer, size_t size) {
+    char params[MAX_FUNCTION_PARAMS * (MAX_VARIABLE_NAME + 2)] = "";
+    for (int i = 0; i < function->arity; i++) {
+        if (i > 0) strcat(params, ", ");
+        strcat(params, function->params[i]);
+    }
+    return snprintf(buffer, size, "%s(%s) = %s", function->name, params, function->body);
+}
+
+void repl_list_functions(REPL* repl, char* buffer, size_t buffer_size) {
+    const FunctionTable* table = &repl->functions;
+    if (!buffer || buffer_size == 0 || table->count == 0) return;
+
+    size_t offset = strlen(buffer);
+    int written = snprintf(buffer + offset, buffer_size - offset, "Functions:\n");
+    if (written < 0 || (size_t)written >= buffer_size - offset) return;
+    offset += written;
+
+    for (int i = 0; i < table->count; i++) {
+        size_t remaining = buffer_size - offset;
+        if (remaining < LIST_MORE_RESERVE) break;
+        remaining -= LIST_MORE_RESERVE;
+
+        const Function* function = &table->items[i];
+        unsigned long calls = function->memo_hits + function->memo_misses;
+        written = snprintf(buffer + offset, remaining, "  ");
+        written += repl_format_function(function, buffer + offset + written, remaining - written);
+        if (function->pure && calls > 0 && written < (int)remaining) {
+            written += snprintf(buffer + offset + written, remaining - written,
+                                "  [pure, %lu calls, %.1f%% memo hits]", calls,
+                                100.0 * function->memo_hits / calls);
+        } else if (function->pure && written < (int)remaining) {
+            written += snprintf(buffer + offset + written, remaining - written, "  [pure]");
+        }
+        if (written + 1 >= (int)remaining) {
+            snprintf(buffer + offset, remaining + LIST_MORE_RESERVE, "  ...%d more\n", table->count - i);
+            break;
+        }
+        buffer[offset + written++] = '\n';
+        buffer[offset + written] = '\0';
+        offset += written;
+    }
+}
+
+// Mark heap objects held by function code and remembered results
+void repl_mark_functions(REPL* repl) {
+    const FunctionTable* table = &repl->functions;
+    for (int i = 0; i < table->count; i++) {
+        repl_mark_program(table->items[i].code);
+
+        const MemoTable* memo = table->items[i].memo;
+        if (!memo) continue;
+        for (int slot = 0; slot < memo->capacity; slot++) {
+            if (!memo->used[slot]) continue;
+            repl_heap_mark(memo->results[slot]);
+            for (int arg = 0; arg < memo->arity; arg++) {
+                repl_heap_mark(memo->keys[(size_t)slot * memo->arity + arg]);
+            }
+        }
+    }
+}
+
+void repl_free_functions(REPL* repl) {
+    FunctionTable* table = &repl->functions;
+    for (int i = 0; i < table->count; i++) {
+        free(table->items[i].memo);
+        free(table->items[i].body);
+        repl_free_compiled(table->items[i].code);
+    }
+    free(table->items);
+    memset(table, 0, sizeof(*table));
+}
+
+// Memoization
+
+static unsigned int memo_hash(const Value* args, int arity) {
+    uint64_t hash = 0x9E3779B97F4A7C15ULL;
+    for (int i = 0; i < arity; i++) {
+        hash = (hash ^ args[i].bits) * 0xFF51AFD7ED558CCDULL;
+        hash ^= hash >> 32;
+    }
+    return (unsigned int)hash;
+}
+
+// One allocation holding the table, results, keys and used flags
+static MemoTable* create_memo(int capacity, int arity) {
+    size_t results_size = (size_t)capacity * sizeof(Value);
+    size_t keys_size = (size_t)capacity * arity * sizeof(Value);
+    MemoTable* memo = (MemoTable*)calloc(1, sizeof(MemoTable) + results_size + keys_size + capacity);
+    if (!memo) return NULL;
+
+    memo->capacity = capacity;
+    memo->arity = arity;
+    memo->results = (Value*)(memo + 1);
+    memo->keys = memo->results + capacity;
+    memo->used = (bool*)(memo->keys + (size_t)capacity * arity);
+    return memo;
+}
+
+/*
+ * Look up the result of calling a pure function with args, which are
+ * compared by bit pattern: -0.0 and 0.0 are different arguments, and so
+ * are two boxed integers with the same value. Counts the hit or miss.
+ */
+bool repl_memo_lookup(Function* function, const Value* args, Value* result) {
+    const MemoTable* memo = function->memo;
+    if (memo) {
+        unsigned int slot = memo_hash(args, memo->arity) & (memo->capacity - 1);
+        const Value* key = memo->keys + (size_t)slot * memo->arity;
+        bool found = memo->used[slot];
+        for (int i = 0; found && i < memo->arity; i++) {
+            found = key[i].bits == args[i].bits;
+        }
+        if (found) {
+            *result = memo->results[slot];
+            function->memo_hits++;
+            return true;
+        }
+    }
+    function->memo_misses++;
+    return false;
+}
+
+// Remember a result, replacing whichever shared its slot. Memoization is
+// only an optimization, so running out of memory just skips it.
+void repl_memo_store(REPL* repl, Function* function, const Value* args, Value result) {
+    MemoTable* memo = function->memo;
+    if (!memo) {
+        memo = create_memo(repl->memo_capacity, function->arity);
+        if (!memo) return;
+        function->memo = memo;
+    }
+
+    unsigned int slot = memo_hash(args, memo->arity) & (memo->capacity - 1);
+    memcpy(memo->keys + (size_t)slot * memo->arity, args, memo->arity * sizeof(Value));
+    memo->results[slot] = result;
+    memo->used[slot] = true;
+}
+
+// Forget all remembered results and set the number kept per function, a
+// power of two, or 0 to stop memoizing
+void repl_memo_reset(REPL* repl, int capacity) {
+    FunctionTable* table = &repl->functions;
+    for (int i = 0; i < table->count; i++) {
+        free(table->items[i].memo);
+        table->items[i].memo = NULL;
+    }
+    repl->memo_capacity = capacity;
+}
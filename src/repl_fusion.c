@@ -0,0 +1,340 @@
+#include "../include/repl_fusion.h"
+#include "../include/repl_compile.h"
+#include "../include/repl_builtins.h"
+#include "../include/repl_array.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Evaluated one operator at a time, a*b + c*d - e on arrays makes four
+ * passes over memory, each writing a temporary as large as its operands,
+ * and for arrays of millions of elements memory bandwidth rather than
+ * arithmetic sets the speed. The compiler marks runs of element-wise
+ * instructions that compute one value, and when the VM meets an array at
+ * the start of one it hands the rest of the run here. The run is then
+ * evaluated FUSION_BLOCK elements at a time: each operation applies to a
+ * block of its operands, intermediate results stay in block buffers that
+ * fit in L1, and only the final result is written out in full. Every
+ * element goes through the same double operations, in the same order, as
+ * it would one operator at a time, so the results are identical.
+ *
+ * A run fuses once it is known to succeed: any operand the array
+ * operations would reject, such as arrays of different lengths or a
+ * complex number, leaves it to the VM, which reports the error at the
+ * instruction that fails.
+ */
+
+// Operations with an element-wise result: the arithmetic operators but
+// %, and built-ins with a C function for doubles
+static bool computes(Instr i) {
+    switch (INSTR_OP(i)) {
+        case OP_NEG: case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_POW:
+        case OP_ADDK: case OP_SUBK: case OP_MULK: case OP_DIVK: case OP_POWK:
+        case OP_RSUBK: case OP_RDIVK:
+            return true;
+        case OP_BUILTIN: {
+            const Builtin* builtin = &repl_builtins[INSTR_B(i)];
+            return (builtin->arity == 1 && builtin->unary) || (builtin->arity == 2 && builtin->binary);
+        }
+        default:
+            return false;
+    }
+}
+
+// Instructions that only move values, which a run may contain between
+// its operations
+static bool moves(Instr i) {
+    int op = INSTR_OP(i);
+    return op == OP_LOADK || op == OP_LOADV || op == OP_MOVE;
+}
+
+/*
+ * A run from start computes one value, in the register its last
+ * operation writes. Each instruction before that writes the same register
+ * or a temporary above it: temporaries are allocated as a stack, and an
+ * operation's result goes in the lowest register of its operands, so none
+ * of them is in use once the run is over and fusion need not write them.
+ * A run has at least two operations, or there is nothing to fuse, and is
+ * recorded as the index of its last instruction.
+ */
+void repl_fusion_analyze(CompiledExpr* program, int first_temp) {
+    int* ends = NULL;
+    for (int start = 0; start < program->code_length; start++) {
+        if (!computes(program->code[start])) continue;
+
+        int end = -1, operations = 0;
+        int lowest = VM_MAX_REGISTERS;      // Lowest register written so far
+        int local = -1;                     // A parameter or local written so far
+        for (int pc = start; pc < program->code_length && pc - start < FUSION_MAX_INSTRUCTIONS; pc++) {
+            Instr i = program->code[pc];
+            int dest = INSTR_A(i);
+            if (computes(i)) {
+                operations++;
+                if (operations >= 2 && lowest >= dest && (local < 0 || local == dest)) end = pc;
+            } else if (!moves(i)) {
+                break;
+            }
+            if (dest < first_temp) {
+                if (local >= 0 && local != dest) break;
+                local = dest;
+            }
+            if (dest < lowest) lowest = dest;
+        }
+        if (end < 0) continue;
+
+        // Fusion only saves time, so a program without room for it runs
+        // one instruction at a time
+        if (!ends) {
+            ends = (int*)malloc(program->code_length * sizeof(int));
+            if (!ends) return;
+            for (int pc = 0; pc < program->code_length; pc++) ends[pc] = -1;
+        }
+        ends[start] = end;
+    }
+    program->fused_ends = ends;
+}
+
+// A register's value during a run
+typedef enum {
+    OPERAND_SCALAR,          // A number, the same for every element
+    OPERAND_ARRAY,           // An array the run reads
+    OPERAND_BLOCK            // A block computed by one of the run's steps
+} OperandKind;
+
+typedef struct {
+    OperandKind kind;
+    Value value;             // The scalar or array
+    int step;                // The step computing a block
+} Operand;
+
+// An operation of the run with an array result, applied to each block
+typedef struct {
+    int op;                  // An operator, or OP_BUILTIN
+    const Builtin* builtin;
+    Operand x;
+    Operand y;               // Unused by negation and unary built-ins
+    double x_scalar;         // x or y as a double, when it is a scalar
+    double y_scalar;
+    ArrayBroadcast shape;
+    int last_use;            // The last step reading the result
+    int buffer;              // Block buffer for the result; -1 for the run's result
+} Step;
+
+typedef struct {
+    Value* regs;
+    Operand operands[VM_MAX_REGISTERS];
+    bool written[VM_MAX_REGISTERS];   // operands[] is set; otherwise regs[] holds the value
+    Step steps[FUSION_MAX_INSTRUCTIONS];
+    int step_count;
+    size_t length;           // Elements in every array and block
+    bool has_length;
+} Plan;
+
+static Operand value_operand(Value v) {
+    Operand operand = { value_type(v) == VALUE_ARRAY ? OPERAND_ARRAY : OPERAND_SCALAR, v, -1 };
+    return operand;
+}
+
+static Operand read_register(const Plan* plan, int reg) {
+    return plan->written[reg] ? plan->operands[reg] : value_operand(plan->regs[reg]);
+}
+
+static void write_register(Plan* plan, int reg, Operand operand) {
+    plan->operands[reg] = operand;
+    plan->written[reg] = true;
+}
+
+// An operand of a step: a real scalar, which is converted to double as
+// the array operations convert it, or an array of the run's length
+static bool prepare(Plan* plan, Operand operand, double* scalar) {
+    switch (operand.kind) {
+        case OPERAND_SCALAR: {
+            ValueType type = value_type(operand.value);
+            if (type == VALUE_UNDEFINED || type == VALUE_COMPLEX) return false;
+            *scalar = value_to_double(operand.value);
+            return true;
+        }
+        case OPERAND_ARRAY: {
+            size_t length = value_array(operand.value)->length;
+            if (!plan->has_length) {
+                plan->length = length;
+                plan->has_length = true;
+            }
+            return length == plan->length;
+        }
+        default:
+            plan->steps[operand.step].last_use = plan->step_count;
+            return true;
+    }
+}
+
+// One operation of the run. On scalars it is done once, now, exactly as
+// the VM would; otherwise it becomes a step.
+static bool plan_operation(Plan* plan, int op, const Builtin* builtin, int arity,
+                           Operand x, Operand y, int dest) {
+    if (x.kind == OPERAND_SCALAR && (arity == 1 || y.kind == OPERAND_SCALAR)) {
+        Value args[2] = { x.value, y.value };
+        Value value;
+        ValueStatus status = builtin ? repl_call_builtin(builtin, args, &value)
+                           : arity == 1 ? repl_value_unary(op, x.value, &value)
+                           : repl_value_binary(op, x.value, y.value, &value);
+        if (status != VALUE_OK) return false;
+        write_register(plan, dest, value_operand(value));
+        return true;
+    }
+
+    Step* step = &plan->steps[plan->step_count];
+    step->op = op;
+    step->builtin = builtin;
+    step->x = x;
+    step->y = arity == 2 ? y : value_operand(value_float(0.0));
+    step->x_scalar = step->y_scalar = 0.0;
+    if (!prepare(plan, step->x, &step->x_scalar) || !prepare(plan, step->y, &step->y_scalar)) {
+        return false;
+    }
+    step->shape = step->x.kind == OPERAND_SCALAR ? ARRAY_SCALAR_LEFT
+                : step->y.kind == OPERAND_SCALAR ? ARRAY_SCALAR_RIGHT : ARRAY_EACH_ELEMENT;
+    step->last_use = plan->step_count;
+    step->buffer = -1;
+
+    Operand result = { OPERAND_BLOCK, value_undefined(), plan->step_count++ };
+    write_register(plan, dest, result);
+    return true;
+}
+
+// Follow the run's instructions, deciding what each computes
+static bool plan_run(Plan* plan, REPL* repl, const CompiledExpr* program, int start, int end) {
+    const Value* k = program->constants;
+    for (int pc = start; pc <= end; pc++) {
+        Instr i = program->code[pc];
+        int a = INSTR_A(i);
+        Operand none = value_operand(value_undefined());
+        bool planned = true;
+        switch (INSTR_OP(i)) {
+            case OP_LOADK:
+                write_register(plan, a, value_operand(k[INSTR_BX(i)]));
+                break;
+            case OP_LOADV: {
+                Value value = repl->variables.values[program->slots[INSTR_BX(i)]];
+                if (value_is_undefined(value)) return false;
+                write_register(plan, a, value_operand(value));
+                break;
+            }
+            case OP_MOVE:
+                write_register(plan, a, read_register(plan, INSTR_B(i)));
+                break;
+            case OP_NEG:
+                planned = plan_operation(plan, OP_NEG, NULL, 1, read_register(plan, INSTR_B(i)), none, a);
+                break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_POW:
+                planned = plan_operation(plan, INSTR_OP(i), NULL, 2, read_register(plan, INSTR_B(i)),
+                                         read_register(plan, INSTR_C(i)), a);
+                break;
+            case OP_ADDK: case OP_SUBK: case OP_MULK: case OP_DIVK: case OP_POWK: {
+                static const int operators[] = { OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW };
+                planned = plan_operation(plan, operators[INSTR_OP(i) - OP_ADDK], NULL, 2,
+                                         read_register(plan, INSTR_B(i)),
+                                         value_operand(k[INSTR_C(i)]), a);
+                break;
+            }
+            case OP_RSUBK: case OP_RDIVK:
+                planned = plan_operation(plan, INSTR_OP(i) == OP_RSUBK ? OP_SUB : OP_DIV, NULL, 2,
+                                         value_operand(k[INSTR_C(i)]),
+                                         read_register(plan, INSTR_B(i)), a);
+                break;
+            case OP_BUILTIN: {
+                const Builtin* builtin = &repl_builtins[INSTR_B(i)];
+                Operand y = builtin->arity == 2 ? read_register(plan, a + 1) : none;
+                planned = plan_operation(plan, OP_BUILTIN, builtin, builtin->arity,
+                                         read_register(plan, a), y, a);
+                break;
+            }
+            default:
+                return false;
+        }
+        if (!planned) return false;
+    }
+    return true;
+}
+
+// Give each step a block buffer, reusing those whose steps' results have
+// been read for the last time; the run's result goes straight to memory
+static bool assign_buffers(Plan* plan) {
+    bool in_use[FUSION_MAX_BUFFERS] = { false };
+    for (int s = 0; s < plan->step_count; s++) {
+        Step* step = &plan->steps[s];
+        const Operand* inputs[2] = { &step->x, &step->y };
+        for (int n = 0; n < 2; n++) {
+            if (inputs[n]->kind != OPERAND_BLOCK) continue;
+            const Step* input = &plan->steps[inputs[n]->step];
+            if (input->last_use == s) in_use[input->buffer] = false;
+        }
+        if (s == plan->step_count - 1) break;
+
+        // Operations are element by element, so a result may overwrite
+        // the block of an operand it has finished with
+        int buffer = 0;
+        while (buffer < FUSION_MAX_BUFFERS && in_use[buffer]) buffer++;
+        if (buffer == FUSION_MAX_BUFFERS) return false;
+        step->buffer = buffer;
+        in_use[buffer] = step->last_use > s;
+    }
+    return true;
+}
+
+// Where a step finds an operand's elements from offset on
+static const double* operand_block(const Plan* plan, const Operand* operand, const double* scalar,
+                                   size_t offset, double (*buffers)[FUSION_BLOCK]) {
+    switch (operand->kind) {
+        case OPERAND_ARRAY: return value_array(operand->value)->elements + offset;
+        case OPERAND_BLOCK: return buffers[plan->steps[operand->step].buffer];
+        default: return scalar;
+    }
+}
+
+static void apply(const Step* step, double* out, const double* x, const double* y, size_t n) {
+    if (step->op != OP_BUILTIN) {
+        repl_array_apply(step->op, out, x, y, n, step->shape);
+    } else if (step->builtin->arity == 1) {
+        for (size_t i = 0; i < n; i++) out[i] = step->builtin->unary(x[i]);
+    } else {
+        size_t x_step = step->shape == ARRAY_SCALAR_LEFT ? 0 : 1;
+        size_t y_step = step->shape == ARRAY_SCALAR_RIGHT ? 0 : 1;
+        for (size_t i = 0; i < n; i++) out[i] = step->builtin->binary(x[i * x_step], y[i * y_step]);
+    }
+}
+
+// Evaluate the run from start, leaving its result in its register
+bool repl_fusion_run(REPL* repl, const CompiledExpr* program, int start, Value* regs) {
+    int end = program->fused_ends[start];
+    Plan plan;
+    plan.regs = regs;
+    plan.step_count = 0;
+    plan.has_length = false;
+    memset(plan.written, 0, sizeof(plan.written));
+    if (!plan_run(&plan, repl, program, start, end)) return false;
+
+    int dest = INSTR_A(program->code[end]);
+    Operand final = read_register(&plan, dest);
+    if (final.kind != OPERAND_BLOCK || final.step != plan.step_count - 1 || !assign_buffers(&plan)) {
+        return false;
+    }
+
+    Value result;
+    double* elements;
+    if (repl_array_make(plan.length, &elements, &result) != VALUE_OK) return false;
+
+    _Alignas(ARRAY_ALIGNMENT) double buffers[FUSION_MAX_BUFFERS][FUSION_BLOCK];
+    for (size_t offset = 0; offset < plan.length; offset += FUSION_BLOCK) {
+        size_t n = plan.length - offset < FUSION_BLOCK ? plan.length - offset : FUSION_BLOCK;
+        for (int s = 0; s < plan.step_count; s++) {
+            const Step* step = &plan.steps[s];
+            double* out = step->buffer < 0 ? elements + offset : buffers[step->buffer];
+            const double* x = operand_block(&plan, &step->x, &step->x_scalar, offset, buffers);
+            const double* y = operand_block(&plan, &step->y, &step->y_scalar, offset, buffers);
+            apply(step, out, x, y, n);
+        }
+    }
+    regs[dest] = result;
+    return true;
+}
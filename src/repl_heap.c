@@ -0,0 +1,139 @@
+#include "../include/repl_heap.h"
+#include "../include/repl_array.h"
+#include <stdlib.h>
+
+// Pure value operations box integers without a REPL at hand, so the heap
+// is process-wide, like the REPL itself
+static struct {
+    HeapObject* objects;
+    size_t count;                // Objects alive
+    size_t collect_at;           // Count that triggers the next collection
+    size_t array_bytes;          // Bytes held by live arrays
+    size_t collect_at_bytes;     // array_bytes that triggers the next collection
+    ErrorContext* error;         // Where allocation failures unwind to
+} heap = { NULL, 0, HEAP_MIN_COLLECT, 0, HEAP_MIN_COLLECT_BYTES, NULL };
+
+void repl_heap_init(ErrorContext* error) {
+    heap.error = error;
+}
+
+// Allocate an object of size bytes, or return NULL if there is no memory
+HeapObject* repl_heap_allocate(ValueType type, size_t size) {
+    HeapObject* object = (HeapObject*)malloc(size);
+    // Tagged pointers carry 48 bits, which holds any user-space address
+    // on x86-64 and AArch64
+    if (!object || (uintptr_t)object > VALUE_PAYLOAD) {
+        free(object);
+        return NULL;
+    }
+    object->type = type;
+    object->marked = false;
+    object->next = heap.objects;
+    heap.objects = object;
+    heap.count++;
+    if (type == VALUE_ARRAY) heap.array_bytes += size;
+    return object;
+}
+
+Value repl_box_integer(ValueType type, uint64_t bits) {
+    IntObject* object = (IntObject*)repl_heap_allocate(type, sizeof(IntObject));
+    if (!object) {
+        if (!heap.error) abort();
+        repl_raise_error(heap.error, -1, "out of memory");
+    }
+    object->bits = bits;
+
+    Value v;
+    v.bits = VALUE_TAGGED(VALUE_TAG_OBJECT, (uint64_t)(uintptr_t)object);
+    return v;
+}
+
+// One array can outweigh thousands of other objects, so the bytes arrays
+// hold also count
+bool repl_heap_should_collect(void) {
+    return heap.count >= heap.collect_at || heap.array_bytes >= heap.collect_at_bytes;
+}
+
+// A rational holds its numerator and denominator, which may be bigints
+void repl_heap_mark(Value value) {
+    if (!value_is_object(value)) return;
+    HeapObject* object = value_object(value);
+    object->marked = true;
+    if (object->type == VALUE_RATIONAL) {
+        const RationalObject* rational = (const RationalObject*)object;
+        repl_heap_mark(rational->numerator);
+        repl_heap_mark(rational->denominator);
+    }
+}
+
+static int compare_addresses(const void* a, const void* b) {
+    uintptr_t x = (uintptr_t)*(HeapObject* const*)a, y = (uintptr_t)*(HeapObject* const*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Registers may still hold values of earlier evaluations whose objects
+// have been freed since, so only those pointing at an object of the heap
+// are marked. Returns false, having marked nothing, if there is no memory
+// to sort the objects by address.
+bool repl_heap_mark_registers(const Value* values, size_t count) {
+    HeapObject** objects = (HeapObject**)malloc((heap.count ? heap.count : 1) * sizeof(HeapObject*));
+    if (!objects) return false;
+    size_t n = 0;
+    for (HeapObject* object = heap.objects; object; object = object->next) objects[n++] = object;
+    qsort(objects, n, sizeof(HeapObject*), compare_addresses);
+
+    for (size_t i = 0; i < count; i++) {
+        if (!value_is_object(values[i])) continue;
+        HeapObject* object = value_object(values[i]);
+        if (bsearch(&object, objects, n, sizeof(HeapObject*), compare_addresses)) {
+            repl_heap_mark(values[i]);
+        }
+    }
+    free(objects);
+    return true;
+}
+
+// Free every unmarked object and clear the marks. The next collection
+// waits until the heap has doubled, so its cost stays proportional to
+// allocation.
+size_t repl_heap_sweep(void) {
+    size_t freed = 0;
+    size_t freed_bytes = 0;
+    HeapObject** link = &heap.objects;
+    while (*link) {
+        HeapObject* object = *link;
+        if (object->marked) {
+            object->marked = false;
+            link = &object->next;
+        } else {
+            *link = object->next;
+            if (object->type == VALUE_ARRAY) {
+                freed_bytes += ARRAY_OBJECT_SIZE(((const ArrayObject*)object)->length);
+            }
+            free(object);
+            freed++;
+        }
+    }
+    heap.count -= freed;
+    heap.collect_at = heap.count * 2 > HEAP_MIN_COLLECT ? heap.count * 2 : HEAP_MIN_COLLECT;
+    heap.array_bytes -= freed_bytes;
+    heap.collect_at_bytes = heap.array_bytes * 2 > HEAP_MIN_COLLECT_BYTES ? heap.array_bytes * 2
+                                                                         : HEAP_MIN_COLLECT_BYTES;
+    return freed;
+}
+
+size_t repl_heap_count(void) {
+    return heap.count;
+}
+
+void repl_heap_free_all(void) {
+    while (heap.objects) {
+        HeapObject* next = heap.objects->next;
+        free(heap.objects);
+        heap.objects = next;
+    }
+    heap.count = 0;
+    heap.collect_at = HEAP_MIN_COLLECT;
+    heap.array_bytes = 0;
+    heap.collect_at_bytes = HEAP_MIN_COLLECT_BYTES;
+}
@@ -0,0 +1,587 @@
+#include "../include/repl_jit.h"
+#include "../include/repl_compile.h"
+#include "../include/repl_variables.h"
+#include "../include/repl_builtins.h"
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_X86_64 1
+#endif
+
+#ifdef JIT_X86_64
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+/*
+ * VM register r lives in xmm r for the whole function; one further xmm
+ * register is kept as scratch. Windows treats xmm6-xmm15 as callee-saved,
+ * so there only xmm0-xmm5 are used.
+ */
+#ifdef _WIN32
+#define JIT_SCRATCH 5
+#else
+#define JIT_SCRATCH 15
+#endif
+#define JIT_MAX_REGISTERS JIT_SCRATCH
+#define JIT_MAX_SLOT ((0x7FFFFFFF - (int)sizeof(Value)) / (int)sizeof(Value))  // Largest slot a disp32 can address
+
+// Stack frame below the saved registers: 32 bytes of call shadow space
+// (required on Windows, harmless elsewhere) then one spill slot per register
+#define JIT_SPILL_BASE 32
+#define JIT_FRAME_SIZE (JIT_SPILL_BASE + 8 * 16)
+
+// Constant pool layout: the 16-byte sign mask first, then the program constants
+#define POOL_SIGN_MASK 0
+#define POOL_CONSTANTS 16
+
+// SSE2 opcodes (second byte after 0x0F)
+#define SSE_MOVSD_LOAD  0x10
+#define SSE_MOVSD_STORE 0x11
+#define SSE_MOVAPD      0x28
+#define SSE_UCOMISD     0x2E
+#define SSE_SQRTSD      0x51
+#define SSE_XORPD       0x57
+#define SSE_ADDSD       0x58
+#define SSE_MULSD       0x59
+#define SSE_SUBSD       0x5C
+#define SSE_DIVSD       0x5E
+
+#define PREFIX_F2 0xF2   // Scalar double
+#define PREFIX_66 0x66   // Packed double
+
+typedef struct {
+    int position;        // Offset of a rel32/disp32 field to patch
+    int target;          // Pool offset (constants) or unused (error jumps)
+} Fixup;
+
+typedef struct {
+    unsigned char* code;
+    int length;
+    int capacity;
+    Fixup* pool_fixups;
+    int pool_fixup_count;
+    int* error_fixups;
+    int error_fixup_count;
+    int fixup_capacity;
+    bool failed;
+} Emitter;
+
+static void emit_byte(Emitter* e, unsigned char byte) {
+    if (e->failed) return;
+    if (e->length == e->capacity) {
+        int capacity = e->capacity ? e->capacity * 2 : 256;
+        unsigned char* code = (unsigned char*)realloc(e->code, capacity);
+        if (!code) {
+            e->failed = true;
+            return;
+        }
+        e->code = code;
+        e->capacity = capacity;
+    }
+    e->code[e->length++] = byte;
+}
+
+static void emit_bytes(Emitter* e, const unsigned char* bytes, int count) {
+    for (int i = 0; i < count; i++) emit_byte(e, bytes[i]);
+}
+
+static void emit_u32(Emitter* e, unsigned int value) {
+    for (int i = 0; i < 4; i++) emit_byte(e, (unsigned char)(value >> (8 * i)));
+}
+
+static void emit_u64(Emitter* e, unsigned long long value) {
+    for (int i = 0; i < 8; i++) emit_byte(e, (unsigned char)(value >> (8 * i)));
+}
+
+static bool reserve_fixup(Emitter* e) {
+    if (e->pool_fixup_count < e->fixup_capacity && e->error_fixup_count < e->fixup_capacity) {
+        return true;
+    }
+    int capacity = e->fixup_capacity ? e->fixup_capacity * 2 : 32;
+    Fixup* pool = (Fixup*)realloc(e->pool_fixups, capacity * sizeof(Fixup));
+    if (pool) e->pool_fixups = pool;
+    int* errors = (int*)realloc(e->error_fixups, capacity * sizeof(int));
+    if (errors) e->error_fixups = errors;
+    if (!pool || !errors) {
+        e->failed = true;
+        return false;
+    }
+    e->fixup_capacity = capacity;
+    return true;
+}
+
+// Prefix, optional REX, 0x0F and the opcode of an SSE instruction
+static void emit_sse_opcode(Emitter* e, unsigned char prefix, unsigned char opcode, int reg, int rm) {
+    emit_byte(e, prefix);
+    unsigned char rex = 0x40 | ((reg & 8) ? 0x04 : 0) | ((rm & 8) ? 0x01 : 0);
+    if (rex != 0x40) emit_byte(e, rex);
+    emit_byte(e, 0x0F);
+    emit_byte(e, opcode);
+}
+
+// op xmm(reg), xmm(rm)
+static void emit_sse_rr(Emitter* e, unsigned char prefix, unsigned char opcode, int reg, int rm) {
+    emit_sse_opcode(e, prefix, opcode, reg, rm);
+    emit_byte(e, (unsigned char)(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+// op xmm(reg), [rip + constant pool entry]
+static void emit_sse_pool(Emitter* e, unsigned char prefix, unsigned char opcode, int reg, int pool_offset) {
+    emit_sse_opcode(e, prefix, opcode, reg, 0);
+    emit_byte(e, (unsigned char)(0x05 | ((reg & 7) << 3)));
+    if (!reserve_fixup(e)) return;
+    e->pool_fixups[e->pool_fixup_count].position = e->length;
+    e->pool_fixups[e->pool_fixup_count].target = pool_offset;
+    e->pool_fixup_count++;
+    emit_u32(e, 0);
+}
+
+// movsd to or from the spill slot of a register: [rsp + disp32]
+static void emit_spill(Emitter* e, unsigned char opcode, int reg, int slot) {
+    emit_sse_opcode(e, PREFIX_F2, opcode, reg, 0);
+    emit_byte(e, (unsigned char)(0x84 | ((reg & 7) << 3)));
+    emit_byte(e, 0x24);
+    emit_u32(e, (unsigned int)(JIT_SPILL_BASE + 8 * slot));
+}
+
+static void emit_move(Emitter* e, int dest, int src) {
+    if (dest != src) emit_sse_rr(e, PREFIX_66, SSE_MOVAPD, dest, src);
+}
+
+static void emit_error_jump(Emitter* e, unsigned char opcode) {
+    if (opcode == 0xE9) {
+        emit_byte(e, 0xE9);                 // jmp rel32
+    } else {
+        emit_byte(e, 0x0F);
+        emit_byte(e, opcode);               // jcc rel32
+    }
+    if (!reserve_fixup(e)) return;
+    e->error_fixups[e->error_fixup_count++] = e->length;
+    emit_u32(e, 0);
+}
+
+// Jump to the error exit if xmm(reg) is zero. NaN compares unordered and
+// divides normally, matching the interpreter.
+static void emit_zero_check(Emitter* e, int reg) {
+    emit_sse_rr(e, PREFIX_66, SSE_XORPD, JIT_SCRATCH, JIT_SCRATCH);
+    emit_sse_rr(e, PREFIX_66, SSE_UCOMISD, reg, JIT_SCRATCH);
+    emit_byte(e, 0x7A);                     // jp over the je
+    emit_byte(e, 6);
+    emit_error_jump(e, 0x84);               // je error
+}
+
+// movsd xmm(reg), [rbx + disp32]: a variable straight from the value
+// array, which NaN-boxing makes the double itself. Every other type is a
+// NaN bit pattern, so one unordered self-compare guards the type; a
+// variable that really holds NaN also takes the error exit and runs on
+// the VM.
+static void emit_load_variable(Emitter* e, int reg, int slot) {
+    emit_sse_opcode(e, PREFIX_F2, SSE_MOVSD_LOAD, reg, 0);
+    emit_byte(e, (unsigned char)(0x80 | ((reg & 7) << 3) | 3));
+    emit_u32(e, (unsigned int)(slot * sizeof(Value)));
+    emit_sse_rr(e, PREFIX_66, SSE_UCOMISD, reg, reg);
+    emit_error_jump(e, 0x8A);               // jp error
+}
+
+static void emit_epilogue(Emitter* e) {
+    static const unsigned char add_rsp[] = { 0x48, 0x81, 0xC4 };
+    static const unsigned char restore[] = {
+        0x41, 0x5C,                         // pop r12
+        0x5B,                               // pop rbx
+        0x5D,                               // pop rbp
+        0xC3                                // ret
+    };
+    emit_bytes(e, add_rsp, sizeof(add_rsp));
+    emit_u32(e, JIT_FRAME_SIZE);
+    emit_bytes(e, restore, sizeof(restore));
+}
+
+static void emit_prologue(Emitter* e) {
+    static const unsigned char save[] = {
+        0x55,                               // push rbp
+        0x48, 0x89, 0xE5,                   // mov rbp, rsp
+        0x53,                               // push rbx
+        0x41, 0x54                          // push r12
+    };
+#ifdef _WIN32
+    static const unsigned char args[] = {
+        0x48, 0x89, 0xCB,                   // mov rbx, rcx (values)
+        0x49, 0x89, 0xD4                    // mov r12, rdx (status)
+    };
+#else
+    static const unsigned char args[] = {
+        0x48, 0x89, 0xFB,                   // mov rbx, rdi (values)
+        0x49, 0x89, 0xF4                    // mov r12, rsi (status)
+    };
+#endif
+    static const unsigned char sub_rsp[] = { 0x48, 0x81, 0xEC };
+
+    emit_bytes(e, save, sizeof(save));
+    emit_bytes(e, sub_rsp, sizeof(sub_rsp));
+    emit_u32(e, JIT_FRAME_SIZE);
+    emit_bytes(e, args, sizeof(args));
+}
+
+// R[a] = R[b] op R[c] with two-operand SSE instructions
+static void emit_arith(Emitter* e, unsigned char opcode, bool commutative, int a, int b, int c) {
+    if (a == b) {
+        emit_sse_rr(e, PREFIX_F2, opcode, a, c);
+    } else if (a == c && commutative) {
+        emit_sse_rr(e, PREFIX_F2, opcode, a, b);
+    } else if (a == c) {
+        emit_move(e, JIT_SCRATCH, b);
+        emit_sse_rr(e, PREFIX_F2, opcode, JIT_SCRATCH, c);
+        emit_move(e, a, JIT_SCRATCH);
+    } else {
+        emit_move(e, a, b);
+        emit_sse_rr(e, PREFIX_F2, opcode, a, c);
+    }
+}
+
+// Where the second argument of a C function call comes from
+typedef enum {
+    CALL_UNARY,          // There is none
+    CALL_REGISTER,       // R[c]
+    CALL_CONSTANT        // K[c]
+} CallOperand;
+
+// R[a] = function(R[b], second) for a C function of doubles, with every
+// live register spilled around the call
+static void emit_call(Emitter* e, int register_count, unsigned long long function,
+                      int a, int b, int c, CallOperand second) {
+    static const unsigned char call_rax[] = { 0xFF, 0xD0 };
+
+    for (int r = 0; r < register_count; r++) {
+        emit_spill(e, SSE_MOVSD_STORE, r, r);
+    }
+    emit_spill(e, SSE_MOVSD_LOAD, 0, b);
+    if (second == CALL_CONSTANT) {
+        emit_sse_pool(e, PREFIX_F2, SSE_MOVSD_LOAD, 1, POOL_CONSTANTS + 8 * c);
+    } else if (second == CALL_REGISTER) {
+        emit_spill(e, SSE_MOVSD_LOAD, 1, c);
+    }
+
+    emit_byte(e, 0x48);                     // mov rax, imm64
+    emit_byte(e, 0xB8);
+    emit_u64(e, function);
+    emit_bytes(e, call_rax, sizeof(call_rax));
+
+    emit_spill(e, SSE_MOVSD_STORE, 0, a);
+    for (int r = 0; r < register_count; r++) {
+        emit_spill(e, SSE_MOVSD_LOAD, r, r);
+    }
+}
+
+static void emit_pow(Emitter* e, int register_count, int a, int b, int c, bool constant_exponent) {
+    double (*pow_fn)(double, double) = pow;
+    emit_call(e, register_count, (unsigned long long)(size_t)pow_fn, a, b, c,
+              constant_exponent ? CALL_CONSTANT : CALL_REGISTER);
+}
+
+// A built-in on doubles in R[a] (and R[a + 1]): sqrt is an instruction,
+// the others a call to their C function
+static void emit_builtin(Emitter* e, int register_count, const Builtin* builtin, int a) {
+    double (*sqrt_fn)(double) = sqrt;
+    if (builtin->unary == sqrt_fn) {
+        emit_sse_rr(e, PREFIX_F2, SSE_SQRTSD, a, a);
+    } else if (builtin->unary) {
+        emit_call(e, register_count, (unsigned long long)(size_t)builtin->unary, a, a, 0, CALL_UNARY);
+    } else {
+        emit_call(e, register_count, (unsigned long long)(size_t)builtin->binary, a, a, a + 1,
+                  CALL_REGISTER);
+    }
+}
+
+/*
+ * Native code computes in doubles only. Variables are guarded to hold
+ * doubles as they are loaded (see emit_load_variable), and integer constants
+ * are converted in the pool, which is exact for an operation that also
+ * has a double operand. Returns false for programs with an operation on
+ * two integers, or any integer-only operator, which stay on the VM. The
+ * pass follows the code in order, which is only sound without jumps, so
+ * programs with statements, comparisons or stores stay on the VM too.
+ */
+static bool computes_in_doubles(const CompiledExpr* program) {
+    bool is_double[VM_MAX_REGISTERS] = {false};
+    const Value* k = program->constants;
+
+    // A complex or array constant makes its operations complex or
+    // element-wise, which the pool's doubles cannot hold
+    for (int i = 0; i < program->constant_count; i++) {
+        ValueType type = value_type(k[i]);
+        if (type == VALUE_COMPLEX || type == VALUE_ARRAY) return false;
+    }
+
+    for (int pc = 0; pc < program->code_length; pc++) {
+        Instr i = program->code[pc];
+        int a = INSTR_A(i);
+        int b = INSTR_B(i);
+        int c = INSTR_C(i);
+
+        switch (INSTR_OP(i)) {
+            case OP_LOADK:
+                is_double[a] = value_is_float(k[INSTR_BX(i)]);
+                break;
+            case OP_LOADV:
+                is_double[a] = true;
+                break;
+            case OP_MOVE:
+                is_double[a] = is_double[b];
+                break;
+            case OP_NEG:
+                if (!is_double[b]) return false;
+                is_double[a] = true;
+                break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_POW:
+                if (!is_double[b] && !is_double[c]) return false;
+                is_double[a] = true;
+                break;
+            case OP_ADDK: case OP_SUBK: case OP_MULK: case OP_DIVK: case OP_POWK:
+            case OP_RSUBK: case OP_RDIVK:
+                if (!is_double[b] && !value_is_float(k[c])) return false;
+                is_double[a] = true;
+                break;
+            case OP_BUILTIN: {
+                // A double argument converts an integer one, as in the VM;
+                // a lone argument must be a double
+                const Builtin* builtin = &repl_builtins[b];
+                if (builtin->unary ? !is_double[a]
+                                   : !builtin->binary || (!is_double[a] && !is_double[a + 1])) {
+                    return false;
+                }
+                is_double[a] = true;
+                break;
+            }
+            case OP_RET:
+                if (!is_double[a]) return false;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool emit_program(Emitter* e, const CompiledExpr* program) {
+    const Value* k = program->constants;
+
+    emit_prologue(e);
+
+    for (int pc = 0; pc < program->code_length && !e->failed; pc++) {
+        Instr i = program->code[pc];
+        int a = INSTR_A(i);
+        int b = INSTR_B(i);
+        int c = INSTR_C(i);
+
+        switch (INSTR_OP(i)) {
+            case OP_LOADK:
+                emit_sse_pool(e, PREFIX_F2, SSE_MOVSD_LOAD, a, POOL_CONSTANTS + 8 * INSTR_BX(i));
+                break;
+            case OP_LOADV:
+                emit_load_variable(e, a, program->slots[INSTR_BX(i)]);
+                break;
+            case OP_MOVE:
+                emit_move(e, a, b);
+                break;
+            case OP_NEG:
+                // Flip the sign bit so that -0.0 and NaN behave as in C
+                emit_move(e, a, b);
+                emit_sse_pool(e, PREFIX_66, SSE_XORPD, a, POOL_SIGN_MASK);
+                break;
+            case OP_ADD:
+                emit_arith(e, SSE_ADDSD, true, a, b, c);
+                break;
+            case OP_SUB:
+                emit_arith(e, SSE_SUBSD, false, a, b, c);
+                break;
+            case OP_MUL:
+                emit_arith(e, SSE_MULSD, true, a, b, c);
+                break;
+            case OP_DIV:
+                emit_zero_check(e, c);
+                emit_arith(e, SSE_DIVSD, false, a, b, c);
+                break;
+            case OP_POW:
+                emit_pow(e, program->register_count, a, b, c, false);
+                break;
+            case OP_ADDK:
+            case OP_SUBK:
+            case OP_MULK:
+            case OP_DIVK: {
+                static const unsigned char opcodes[] = { SSE_ADDSD, SSE_SUBSD, SSE_MULSD, SSE_DIVSD };
+                if (INSTR_OP(i) == OP_DIVK && value_to_double(k[c]) == 0.0) {
+                    emit_error_jump(e, 0xE9);
+                    break;
+                }
+                emit_move(e, a, b);
+                emit_sse_pool(e, PREFIX_F2, opcodes[INSTR_OP(i) - OP_ADDK], a, POOL_CONSTANTS + 8 * c);
+                break;
+            }
+            case OP_POWK:
+                emit_pow(e, program->register_count, a, b, c, true);
+                break;
+            case OP_RSUBK:
+            case OP_RDIVK:
+                if (INSTR_OP(i) == OP_RDIVK) emit_zero_check(e, b);
+                emit_sse_pool(e, PREFIX_F2, SSE_MOVSD_LOAD, JIT_SCRATCH, POOL_CONSTANTS + 8 * c);
+                emit_sse_rr(e, PREFIX_F2, INSTR_OP(i) == OP_RSUBK ? SSE_SUBSD : SSE_DIVSD, JIT_SCRATCH, b);
+                emit_move(e, a, JIT_SCRATCH);
+                break;
+            case OP_BUILTIN:
+                emit_builtin(e, program->register_count, &repl_builtins[b], a);
+                break;
+            case OP_RET:
+                emit_move(e, 0, a);
+                emit_epilogue(e);
+                break;
+            default:
+                return false;
+        }
+    }
+
+    // Error exit: report through *status and return 0
+    int error_label = e->length;
+    static const unsigned char set_status[] = { 0x41, 0xC7, 0x04, 0x24, 0x01, 0x00, 0x00, 0x00 };
+    emit_bytes(e, set_status, sizeof(set_status));   // mov dword [r12], 1
+    emit_sse_rr(e, PREFIX_66, SSE_XORPD, 0, 0);
+    emit_epilogue(e);
+
+    if (e->failed) return false;
+
+    for (int f = 0; f < e->error_fixup_count; f++) {
+        int position = e->error_fixups[f];
+        int rel = error_label - (position + 4);
+        memcpy(e->code + position, &rel, 4);
+    }
+
+    return true;
+}
+
+static void* map_executable(const unsigned char* bytes, size_t size) {
+#ifdef _WIN32
+    void* memory = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!memory) return NULL;
+    memcpy(memory, bytes, size);
+    DWORD old_protect;
+    if (!VirtualProtect(memory, size, PAGE_EXECUTE_READ, &old_protect)) {
+        VirtualFree(memory, 0, MEM_RELEASE);
+        return NULL;
+    }
+    FlushInstructionCache(GetCurrentProcess(), memory, size);
+    return memory;
+#else
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return NULL;
+    memcpy(memory, bytes, size);
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return NULL;
+    }
+    return memory;
+#endif
+}
+
+bool repl_jit_available(void) {
+    return true;
+}
+
+JitCode* repl_jit_compile(const CompiledExpr* program) {
+    if (program->register_count > JIT_MAX_REGISTERS || !computes_in_doubles(program)) {
+        return NULL;
+    }
+    for (int i = 0; i < program->slot_count; i++) {
+        if (program->slots[i] > JIT_MAX_SLOT) return NULL;
+    }
+
+    Emitter e = {0};
+    JitCode* jit = NULL;
+
+    if (emit_program(&e, program)) {
+        // Append the constant pool, 16-byte aligned for the xorpd mask
+        while (e.length % 16 != 0) emit_byte(&e, 0xCC);
+        int pool_start = e.length;
+        emit_u64(&e, 0x8000000000000000ULL);
+        emit_u64(&e, 0x8000000000000000ULL);
+        for (int i = 0; i < program->constant_count; i++) {
+            double constant = value_to_double(program->constants[i]);
+            unsigned long long bits;
+            memcpy(&bits, &constant, sizeof(bits));
+            emit_u64(&e, bits);
+        }
+
+        for (int f = 0; f < e.pool_fixup_count && !e.failed; f++) {
+            int position = e.pool_fixups[f].position;
+            int rel = pool_start + e.pool_fixups[f].target - (position + 4);
+            memcpy(e.code + position, &rel, 4);
+        }
+
+        if (!e.failed) {
+            jit = (JitCode*)malloc(sizeof(JitCode));
+            if (jit) {
+                jit->size = (size_t)e.length;
+                jit->memory = map_executable(e.code, jit->size);
+                if (jit->memory) {
+                    jit->entry = (JitFunction)jit->memory;
+                } else {
+                    free(jit);
+                    jit = NULL;
+                }
+            }
+        }
+    }
+
+    free(e.code);
+    free(e.pool_fixups);
+    free(e.error_fixups);
+    return jit;
+}
+
+void repl_jit_free(JitCode* code) {
+    if (!code) return;
+#ifdef _WIN32
+    VirtualFree(code->memory, 0, MEM_RELEASE);
+#else
+    munmap(code->memory, code->size);
+#endif
+    free(code);
+}
+
+// On any failure, including a variable that is undefined or not a double,
+// the program is run again on the VM, which is pure and reports the error
+// with its source position
+Value repl_jit_execute(REPL* repl, const CompiledExpr* program) {
+    int status = 0;
+    double result = program->jit->entry(repl->variables.values, &status);
+    if (status != 0) {
+        return repl_vm_execute(repl, program);
+    }
+    return value_float(result);
+}
+
+#else // !JIT_X86_64
+
+// Other architectures always run the interpreter
+
+bool repl_jit_available(void) {
+    return false;
+}
+
+JitCode* repl_jit_compile(const CompiledExpr* program) {
+    return NULL;
+}
+
+void repl_jit_free(JitCode* code) {
+}
+
+Value repl_jit_execute(REPL* repl, const CompiledExpr* program) {
+    return repl_vm_execute(repl, program);
+}
+
+#endif // JIT_X86_64
@@ -0,0 +1,409 @@
+#include "../include/repl_lexer.h"
+#include "../include/repl_number.h"
+#include "../include/repl_bigint.h"
+#include "../include/repl_rational.h"
+#include "../include/repl_extended.h"
+#include "../include/repl_decimal.h"
+#include "../include/repl_complex.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#define LEXER_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define LEXER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#define S CHAR_SPACE
+#define D CHAR_DIGIT
+#define A CHAR_ALPHA
+const unsigned char repl_char_classes[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, S, S, S, S, S, 0, 0,     // 0x00
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0x10
+    S, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0x20  !"#$%&'()*+,-./
+    D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0,     // 0x30 0-9 :;<=>?
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,     // 0x40 @A-O
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, A,     // 0x50 P-Z [\]^_
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,     // 0x60 `a-o
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0,     // 0x70 p-z {|}~
+};
+#undef S
+#undef D
+#undef A
+
+// Index of the lowest set bit of a mask, 64 if there is none
+static inline int lowest_bit(uint64_t mask) {
+    if (mask == 0) return 64;
+#if defined(__GNUC__)
+    return __builtin_ctzll(mask);
+#else
+    int n = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/*
+ * Class masks of a block of bytes: bit i is set if byte i is in the class.
+ * Ranges are tested with signed compares, under which bytes above 0x7F are
+ * negative and fall outside every range.
+ */
+#if defined(LEXER_AVX2)
+#define SCAN_WIDTH 32
+
+static inline __m256i in_range(__m256i bytes, char low, char high) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8((char)(low - 1))),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(high + 1)), bytes));
+}
+
+static inline void classify_block(const char* p, uint64_t* space, uint64_t* digit, uint64_t* alpha) {
+    __m256i bytes = _mm256_loadu_si256((const __m256i*)p);
+    // Setting bit 5 maps 'A'-'Z' onto 'a'-'z'
+    __m256i folded = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+    __m256i is_space = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+                                       in_range(bytes, '\t', '\r'));
+    __m256i is_alpha = _mm256_or_si256(in_range(folded, 'a', 'z'),
+                                       _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_')));
+    *space = (uint32_t)_mm256_movemask_epi8(is_space);
+    *digit = (uint32_t)_mm256_movemask_epi8(in_range(bytes, '0', '9'));
+    *alpha = (uint32_t)_mm256_movemask_epi8(is_alpha);
+}
+
+#elif defined(LEXER_SSE2)
+#define SCAN_WIDTH 16
+
+static inline __m128i in_range(__m128i bytes, char low, char high) {
+    return _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8((char)(low - 1))),
+                         _mm_cmpgt_epi8(_mm_set1_epi8((char)(high + 1)), bytes));
+}
+
+static inline void classify_block(const char* p, uint64_t* space, uint64_t* digit, uint64_t* alpha) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+    // Setting bit 5 maps 'A'-'Z' onto 'a'-'z'
+    __m128i folded = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+    __m128i is_space = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+                                    in_range(bytes, '\t', '\r'));
+    __m128i is_alpha = _mm_or_si128(in_range(folded, 'a', 'z'),
+                                    _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_')));
+    *space = (uint32_t)_mm_movemask_epi8(is_space);
+    *digit = (uint32_t)_mm_movemask_epi8(in_range(bytes, '0', '9'));
+    *alpha = (uint32_t)_mm_movemask_epi8(is_alpha);
+}
+
+#else
+#define SCAN_WIDTH 1
+
+static inline void classify_block(const char* p, uint64_t* space, uint64_t* digit, uint64_t* alpha) {
+    unsigned char classes = repl_char_classes[(unsigned char)*p];
+    *space = (classes & CHAR_SPACE) != 0;
+    *digit = (classes & CHAR_DIGIT) != 0;
+    *alpha = (classes & CHAR_ALPHA) != 0;
+}
+#endif
+
+int repl_scan_width(void) {
+    return SCAN_WIDTH;
+}
+
+// Classify the window starting at base. Blocks are loaded only while they
+// lie before end, so nothing past the terminator is read; a short final
+// window goes through the table, leaving bytes past end in no class.
+static void load_window(CharScanner* scanner, const char* base) {
+    uint64_t space = 0, digit = 0, alpha = 0;
+    int available = scanner->end - base < SCAN_WINDOW ? (int)(scanner->end - base) : SCAN_WINDOW;
+    int i = 0;
+
+    if (available == SCAN_WINDOW) {
+        for (; i < SCAN_WINDOW; i += SCAN_WIDTH) {
+            uint64_t s, d, a;
+            classify_block(base + i, &s, &d, &a);
+            space |= s << i;
+            digit |= d << i;
+            alpha |= a << i;
+        }
+    } else {
+        for (; i < available; i++) {
+            unsigned char classes = repl_char_classes[(unsigned char)base[i]];
+            space |= (uint64_t)((classes & CHAR_SPACE) != 0) << i;
+            digit |= (uint64_t)((classes & CHAR_DIGIT) != 0) << i;
+            alpha |= (uint64_t)((classes & CHAR_ALPHA) != 0) << i;
+        }
+    }
+
+    scanner->base = base;
+    scanner->space = space;
+    scanner->digit = digit;
+    scanner->alpha = alpha;
+}
+
+void repl_scanner_init(CharScanner* scanner, const char* end) {
+    scanner->base = NULL;
+    scanner->end = end;
+}
+
+// First character from p on whose class membership is not `inside`
+static inline const char* scan(CharScanner* scanner, const char* p, int classes, bool inside) {
+    for (;;) {
+        if (p >= scanner->end) return scanner->end;
+        if (!scanner->base || p < scanner->base || p >= scanner->base + SCAN_WINDOW) {
+            load_window(scanner, p);
+        }
+
+        int offset = (int)(p - scanner->base);
+        uint64_t members = 0;
+        if (classes & CHAR_SPACE) members |= scanner->space;
+        if (classes & CHAR_DIGIT) members |= scanner->digit;
+        if (classes & CHAR_ALPHA) members |= scanner->alpha;
+
+        // Bits for p onwards; bytes past the window read as not members
+        uint64_t stop = (inside ? ~members : members) >> offset;
+        int found = lowest_bit(stop);
+        if (found < SCAN_WINDOW - offset) return p + found;
+        p = scanner->base + SCAN_WINDOW;
+    }
+}
+
+const char* repl_scan_while(CharScanner* scanner, const char* p, int classes) {
+    return scan(scanner, p, classes, true);
+}
+
+const char* repl_scan_until(CharScanner* scanner, const char* p, int classes) {
+    return scan(scanner, p, classes, false);
+}
+
+// Skip C integer suffixes (u, l, ll in either order and case); true if
+// one of them is unsigned
+static bool skip_integer_suffix(const char** p) {
+    bool is_unsigned = false;
+    for (int i = 0; i < 3; i++) {
+        char c = **p;
+        if ((c == 'u' || c == 'U') && !is_unsigned) {
+            is_unsigned = true;
+        } else if (c != 'l' && c != 'L') {
+            break;
+        }
+        (*p)++;
+    }
+    return is_unsigned;
+}
+
+/*
+ * Number literals follow C: digits alone (or 0x and hex digits) make an
+ * integer, int64 if it fits and has no 'u' suffix, otherwise uint64.
+ * Anything with a '.' or an exponent is a double, and so is a decimal
+ * integer too large for uint64. Returns false for a hex literal that
+ * does not fit 64 bits, with *end after it. In bigint mode an integer
+ * without a suffix that is too large for int64 is a bigint instead, and
+ * in rational mode a decimal with a '.' or an exponent is the exact
+ * fraction it denotes. Decimal mode reads both as fixed-point decimals,
+ * and returns false for one that does not fit rather than losing digits
+ * to a double. Otherwise such a decimal is read at the precision setting.
+ */
+static bool lex_number(CharScanner* scanner, const char* p, const char** end, Value* value) {
+    uint64_t bits = 0;
+    bool overflow = false;
+    bool bigint = repl_number_mode() != NUMBER_MODE_INT64;
+    int base = 10;
+    const char* q;
+
+    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && isxdigit((unsigned char)p[2])) {
+        base = 16;
+        for (q = p + 2; isxdigit((unsigned char)*q); q++) {
+            int digit = CHAR_IS(*q, CHAR_DIGIT) ? *q - '0' : (tolower((unsigned char)*q) - 'a' + 10);
+            if (bits >> 60) overflow = true;
+            bits = (bits << 4) | (uint64_t)digit;
+        }
+    } else {
+        // Digits alone are an integer; a '.' or an exponent makes a double
+        double number;
+        q = repl_scan_while(scanner, p, CHAR_DIGIT);
+        if (q == p || *q == '.' || *q == 'e' || *q == 'E') {
+            if (!repl_parse_number(p, end, &number)) return false;
+            if (*end != q) {
+                size_t length = (size_t)(*end - p);
+                if (repl_number_mode() == NUMBER_MODE_RATIONAL) {
+                    if (repl_rational_parse(p, length, value)) return true;
+                } else if (repl_number_mode() == NUMBER_MODE_DECIMAL) {
+                    return repl_decimal_parse(p, length, value);
+                } else if (repl_precision() != PRECISION_DOUBLE) {
+                    if (repl_extended_parse(p, length, value)) return true;
+                }
+                *value = value_float(number);
+                return true;
+            }
+        }
+        // A leading 0 makes an integer octal, as in C, where 08 is an error
+        if (p[0] == '0' && q - p > 1) base = 8;
+        for (const char* digit = p; digit < q; digit++) {
+            uint64_t n = (uint64_t)(*digit - '0');
+            if (n >= (uint64_t)base) {
+                *end = q;
+                return false;
+            }
+            if (bits > (UINT64_MAX - n) / base) overflow = true;
+            bits = bits * base + n;
+        }
+        const char* suffix = q;
+        skip_integer_suffix(&suffix);
+        if (overflow && base == 10 && (!bigint || suffix != q)) {
+            repl_parse_number(p, end, &number);
+            *value = value_float(number);
+            return true;
+        }
+    }
+
+    const char* digits_end = q;
+    bool is_unsigned = skip_integer_suffix(&q);
+    *end = q;
+    if (bigint && q == digits_end && (overflow || bits > (uint64_t)INT64_MAX)) {
+        const char* digits = base == 16 ? p + 2 : p;
+        if (repl_number_mode() != NUMBER_MODE_DECIMAL) {
+            return repl_bigint_parse(digits, (size_t)(q - digits), base, value);
+        }
+        // Hex and octal literals stay uint64, as in int64 mode
+        if (base == 10) return repl_decimal_parse(p, (size_t)(q - p), value);
+    }
+    if (overflow) return false;
+
+    if (is_unsigned || bits > (uint64_t)INT64_MAX) {
+        *value = value_uint(bits);
+    } else {
+        *value = value_int((int64_t)bits);
+    }
+    return true;
+}
+
+static const struct {
+    const char* word;
+    TokenType type;
+} keywords[] = {
+    { "if", TOKEN_IF }, { "else", TOKEN_ELSE }, { "for", TOKEN_FOR },
+    { "while", TOKEN_WHILE }, { "return", TOKEN_RETURN },
+};
+
+// Keyword token for a name, or TOKEN_NAME
+static TokenType keyword_type(const char* name, size_t length) {
+    if (length < 2 || length > 6) return TOKEN_NAME;
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        if (strncmp(keywords[i].word, name, length) == 0 && keywords[i].word[length] == '\0') {
+            return keywords[i].type;
+        }
+    }
+    return TOKEN_NAME;
+}
+
+bool repl_is_keyword(const char* name, size_t length) {
+    return keyword_type(name, length) != TOKEN_NAME;
+}
+
+void repl_lexer_init(Lexer* lexer, const char* source) {
+    lexer->source = source;
+    lexer->cursor = source;
+    repl_scanner_init(&lexer->scanner, source + strlen(source));
+    repl_lexer_next(lexer);
+}
+
+// Advance to the next token, leaving it in lexer->current
+void repl_lexer_next(Lexer* lexer) {
+    // Skip whitespace
+    const char* p = repl_scan_while(&lexer->scanner, lexer->cursor, CHAR_SPACE);
+
+    Token* token = &lexer->current;
+    token->start = p;
+    token->number = value_int(0);
+
+    if (*p == '\0') {
+        token->type = TOKEN_EOF;
+        token->length = 0;
+        lexer->cursor = p;
+        return;
+    }
+
+    // Numbers
+    if (CHAR_IS(*p, CHAR_DIGIT) || *p == '.') {
+        const char* end;
+        bool ok = lex_number(&lexer->scanner, p, &end, &token->number);
+        if (ok && end[0] == 'i' && !CHAR_IS(end[1], CHAR_WORD)) {
+            // An 'i' suffix makes an imaginary number
+            ok = repl_complex_make(0.0, value_to_double(token->number), &token->number) == VALUE_OK;
+            end++;
+        }
+        if (!ok) {
+            token->type = TOKEN_ERROR;
+            token->length = end > p ? (int)(end - p) : 1;
+            lexer->cursor = p + token->length;
+            return;
+        }
+        token->type = TOKEN_NUMBER;
+        token->length = (int)(end - p);
+        lexer->cursor = end;
+        return;
+    }
+
+    // Names
+    if (CHAR_IS(*p, CHAR_ALPHA)) {
+        const char* end = repl_scan_while(&lexer->scanner, p + 1, CHAR_WORD);
+        token->type = keyword_type(p, (size_t)(end - p));
+        token->length = (int)(end - p);
+        lexer->cursor = end;
+        return;
+    }
+
+    // Two-character operators
+    TokenType pair = TOKEN_ERROR;
+    if (p[1] == '=') {
+        switch (*p) {
+            case '<': pair = TOKEN_LE; break;
+            case '>': pair = TOKEN_GE; break;
+            case '=': pair = TOKEN_EQ; break;
+            case '!': pair = TOKEN_NE; break;
+        }
+    } else if (p[1] == p[0]) {
+        if (*p == '<') pair = TOKEN_SHL;
+        if (*p == '>') pair = TOKEN_SHR;
+        if (*p == '&') pair = TOKEN_AND_AND;
+        if (*p == '|') pair = TOKEN_OR_OR;
+    }
+    if (pair != TOKEN_ERROR) {
+        token->type = pair;
+        token->length = 2;
+        lexer->cursor = p + 2;
+        return;
+    }
+
+    // Operators and punctuation
+    switch (*p) {
+        case '+': token->type = TOKEN_PLUS; break;
+        case '-': token->type = TOKEN_MINUS; break;
+        case '*': token->type = TOKEN_STAR; break;
+        case '/': token->type = TOKEN_SLASH; break;
+        case '^': token->type = TOKEN_CARET; break;
+        case '%': token->type = TOKEN_PERCENT; break;
+        case '&': token->type = TOKEN_AMP; break;
+        case '|': token->type = TOKEN_PIPE; break;
+        case '~': token->type = TOKEN_TILDE; break;
+        case '(': token->type = TOKEN_LPAREN; break;
+        case ')': token->type = TOKEN_RPAREN; break;
+        case ',': token->type = TOKEN_COMMA; break;
+        case '<': token->type = TOKEN_LT; break;
+        case '>': token->type = TOKEN_GT; break;
+        case '=': token->type = TOKEN_ASSIGN; break;
+        case '!': token->type = TOKEN_BANG; break;
+        case '?': token->type = TOKEN_QUESTION; break;
+        case ':': token->type = TOKEN_COLON; break;
+        case ';': token->type = TOKEN_SEMICOLON; break;
+        case '{': token->type = TOKEN_LBRACE; break;
+        case '}': token->type = TOKEN_RBRACE; break;
+        case '[': token->type = TOKEN_LBRACKET; break;
+        case ']': token->type = TOKEN_RBRACKET; break;
+        default:  token->type = TOKEN_ERROR; break;
+    }
+    token->length = 1;
+    lexer->cursor = p + 1;
+}
@@ -0,0 +1,376 @@
+#include "../include/repl_rational.h"
+#include "../include/repl_bigint.h"
+#include "../include/repl_heap.h"
+#include "../include/repl_vm.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/*
+ * A rational is a pair of integer values, each an int64 while it fits and
+ * a bigint beyond that, so the common small fractions never touch bigint
+ * code. Every result is reduced to lowest terms. The sums and products
+ * use Henrici's forms, which take the GCD of the denominators before
+ * multiplying, so intermediate values stay near the size of the result.
+ *
+ * Operations take a sticky status: once one step fails (a bigint too
+ * large), the rest return 0 without doing anything and the status is
+ * reported at the end.
+ */
+
+static bool is_small(Value v, int64_t k) {
+    return value_is_small_int(v) && value_small_int(v) == k;
+}
+
+static bool is_negative(Value v) {
+    if (value_is_bigint(v)) return ((const BigIntObject*)value_object(v))->negative;
+    return (int64_t)value_as_bits(v) < 0;
+}
+
+// a op b on integer values, exactly: on int64 unless an operand or the
+// result leaves its range, otherwise on bigints
+static Value integer(int op, Value a, Value b, ValueStatus* status) {
+    if (*status != VALUE_OK) return value_int(0);
+    if (value_type(a) == VALUE_INT && value_type(b) == VALUE_INT) {
+        int64_t x = (int64_t)value_as_bits(a), y = (int64_t)value_as_bits(b);
+        if (!repl_int64_overflows(op, x, y)) {
+            switch (op) {
+                case OP_ADD: return value_int(x + y);
+                case OP_SUB: return value_int(x - y);
+                case OP_MUL: return value_int(x * y);
+                case OP_DIV: return value_int(x / y);
+                case OP_MOD: return value_int(x % y);
+                default: break;
+            }
+        }
+    }
+
+    Value result = value_int(0);
+    ValueStatus outcome = repl_bigint_binary(op, a, b, &result);
+    if (outcome != VALUE_OK) *status = outcome;
+    return result;
+}
+
+static int compare_integers(Value a, Value b, ValueStatus* status) {
+    if (value_type(a) == VALUE_INT && value_type(b) == VALUE_INT) {
+        int64_t x = (int64_t)value_as_bits(a), y = (int64_t)value_as_bits(b);
+        return x < y ? -1 : x > y;
+    }
+    if (*status != VALUE_OK) return 0;
+    Value less, equal;
+    repl_bigint_binary(OP_LT, a, b, &less);
+    repl_bigint_binary(OP_EQ, a, b, &equal);
+    return value_is_true(less) ? -1 : !value_is_true(equal);
+}
+
+static Value negate(Value v, ValueStatus* status) {
+    return integer(OP_SUB, value_int(0), v, status);
+}
+
+static Value magnitude(Value v, ValueStatus* status) {
+    return is_negative(v) ? negate(v, status) : v;
+}
+
+// An int64 or bigint holding an integer value of any type
+static Value as_integer(Value v, ValueStatus* status) {
+    ValueType type = value_type(v);
+    if (type == VALUE_BOOL || (type == VALUE_UINT && value_as_bits(v) <= (uint64_t)INT64_MAX)) {
+        return value_int((int64_t)value_as_bits(v));
+    }
+    if (type == VALUE_UINT) return integer(OP_ADD, v, value_int(0), status);
+    return v;
+}
+
+#if defined(__GNUC__)
+#define TRAILING_ZEROS(x) __builtin_ctzll(x)
+#else
+static int trailing_zeros(uint64_t x) {
+    int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+}
+#define TRAILING_ZEROS(x) trailing_zeros(x)
+#endif
+
+// Stein's binary GCD: shifts and subtractions instead of divisions
+static uint64_t gcd_words(uint64_t u, uint64_t v) {
+    if (u == 0) return v;
+    if (v == 0) return u;
+    int shift = TRAILING_ZEROS(u | v);
+    u >>= TRAILING_ZEROS(u);
+    do {
+        v >>= TRAILING_ZEROS(v);
+        if (u > v) {
+            uint64_t t = u;
+            u = v;
+            v = t;
+        }
+        v -= u;
+    } while (v != 0);
+    return u << shift;
+}
+
+// GCD of two non-negative integers. While either is a bigint, a
+// Euclidean step brings it down towards word size, where the binary GCD
+// takes over; one step is usually enough, as the remainder is below the
+// smaller operand.
+static Value gcd(Value a, Value b, ValueStatus* status) {
+    while (value_is_bigint(a) || value_is_bigint(b)) {
+        if (is_small(b, 0)) return a;
+        Value remainder = integer(OP_MOD, a, b, status);
+        if (*status != VALUE_OK) return value_int(1);
+        a = b;
+        b = remainder;
+    }
+    return value_int((int64_t)gcd_words(value_as_bits(a), value_as_bits(b)));
+}
+
+// The value n/d, for n and d in lowest terms and d positive
+static Value build(Value n, Value d, ValueStatus* status) {
+    if (*status != VALUE_OK) return value_int(0);
+    if (is_small(d, 1) || is_small(n, 0)) return n;
+
+    RationalObject* object = (RationalObject*)repl_heap_allocate(VALUE_RATIONAL, sizeof(RationalObject));
+    if (!object) {
+        *status = VALUE_TOO_LARGE;
+        return value_int(0);
+    }
+    object->numerator = n;
+    object->denominator = d;
+    Value v;
+    v.bits = VALUE_TAGGED(VALUE_TAG_OBJECT, (uint64_t)(uintptr_t)object);
+    return v;
+}
+
+// The value n/d for any integers with d non-zero
+static Value reduce(Value n, Value d, ValueStatus* status) {
+    if (is_negative(d)) {
+        n = negate(n, status);
+        d = negate(d, status);
+    }
+    Value g = gcd(magnitude(n, status), d, status);
+    if (!is_small(g, 1)) {
+        n = integer(OP_DIV, n, g, status);
+        d = integer(OP_DIV, d, g, status);
+    }
+    return build(n, d, status);
+}
+
+static void load_parts(Value v, Value* n, Value* d, ValueStatus* status) {
+    if (value_type(v) == VALUE_RATIONAL) {
+        const RationalObject* rational = (const RationalObject*)value_object(v);
+        *n = rational->numerator;
+        *d = rational->denominator;
+    } else {
+        *n = as_integer(v, status);
+        *d = value_int(1);
+    }
+}
+
+// a/b + c/d, or a/b - c/d for OP_SUB
+static Value add(int op, Value a, Value b, Value c, Value d, ValueStatus* status) {
+    if (is_small(b, 1) && is_small(d, 1)) return integer(op, a, c, status);
+
+    // With g = gcd(b, d), the sum is (a d/g + c b/g) / (b d/g), and only
+    // a factor of g can be shared by that numerator and denominator
+    Value g = gcd(b, d, status);
+    if (is_small(g, 1)) {
+        Value n = integer(op, integer(OP_MUL, a, d, status), integer(OP_MUL, c, b, status), status);
+        return build(n, integer(OP_MUL, b, d, status), status);
+    }
+    Value b1 = integer(OP_DIV, b, g, status);
+    Value d1 = integer(OP_DIV, d, g, status);
+    Value t = integer(op, integer(OP_MUL, a, d1, status), integer(OP_MUL, c, b1, status), status);
+    if (is_small(t, 0)) return t;
+    Value g2 = gcd(magnitude(t, status), g, status);
+    Value n = integer(OP_DIV, t, g2, status);
+    return build(n, integer(OP_MUL, b1, integer(OP_DIV, d, g2, status), status), status);
+}
+
+// a/b * c/d, cancelling across before multiplying
+static Value multiply(Value a, Value b, Value c, Value d, ValueStatus* status) {
+    if (is_small(a, 0) || is_small(c, 0)) return value_int(0);
+    Value g1 = gcd(magnitude(a, status), d, status);
+    Value g2 = gcd(magnitude(c, status), b, status);
+    Value n = integer(OP_MUL, integer(OP_DIV, a, g1, status), integer(OP_DIV, c, g2, status), status);
+    Value m = integer(OP_MUL, integer(OP_DIV, b, g2, status), integer(OP_DIV, d, g1, status), status);
+    return build(n, m, status);
+}
+
+// a/b divided by c/d, with c non-zero
+static Value divide(Value a, Value b, Value c, Value d, ValueStatus* status) {
+    if (is_negative(c)) {
+        c = negate(c, status);
+        d = negate(d, status);
+    }
+    return multiply(a, b, d, c, status);
+}
+
+// a/b to an integer power e; powers of coprime numbers stay coprime
+static Value power(Value a, Value b, Value e, ValueStatus* status) {
+    if (!is_negative(e)) {
+        return build(integer(OP_POW, a, e, status), integer(OP_POW, b, e, status), status);
+    }
+    e = negate(e, status);
+    if (is_negative(a)) {
+        a = negate(a, status);
+        b = negate(b, status);
+    }
+    return build(integer(OP_POW, b, e, status), integer(OP_POW, a, e, status), status);
+}
+
+ValueStatus repl_rational_binary(int op, Value x, Value y, Value* result) {
+    ValueStatus status = VALUE_OK;
+    Value a, b, c, d;
+    load_parts(x, &a, &b, &status);
+    load_parts(y, &c, &d, &status);
+
+    switch (op) {
+        case OP_ADD:
+        case OP_SUB:
+            *result = add(op, a, b, c, d, &status);
+            break;
+        case OP_MUL:
+            *result = multiply(a, b, c, d, &status);
+            break;
+        case OP_DIV:
+            if (is_small(c, 0)) return VALUE_DIVISION_BY_ZERO;
+            *result = divide(a, b, c, d, &status);
+            break;
+        case OP_MOD: {
+            // Remainder of truncating division, as for integers
+            if (is_small(c, 0)) return VALUE_DIVISION_BY_ZERO;
+            Value q = integer(OP_DIV, integer(OP_MUL, a, d, &status), integer(OP_MUL, b, c, &status), &status);
+            Value n, m;
+            load_parts(multiply(q, value_int(1), c, d, &status), &n, &m, &status);
+            *result = add(OP_SUB, a, b, n, m, &status);
+            break;
+        }
+        case OP_POW:
+            // Only integer powers are rational
+            if (!is_small(d, 1)) {
+                *result = value_float(pow(value_to_double(x), value_to_double(y)));
+                return VALUE_OK;
+            }
+            if (is_small(a, 0) && is_negative(c)) return VALUE_DIVISION_BY_ZERO;
+            *result = power(a, b, c, &status);
+            break;
+        case OP_LT:
+        case OP_LE:
+        case OP_EQ:
+        case OP_NE: {
+            // Denominators are positive, so a/b < c/d when a d < c b
+            int order = compare_integers(integer(OP_MUL, a, d, &status), integer(OP_MUL, c, b, &status), &status);
+            *result = value_bool(op == OP_LT ? order < 0 : op == OP_LE ? order <= 0 :
+                                 op == OP_EQ ? order == 0 : order != 0);
+            break;
+        }
+        default:
+            return VALUE_INVALID_OPERANDS;
+    }
+    return status;
+}
+
+ValueStatus repl_rational_unary(int op, Value x, Value* result) {
+    if (op != OP_NEG) return VALUE_INVALID_OPERANDS;
+    ValueStatus status = VALUE_OK;
+    Value a, b;
+    load_parts(x, &a, &b, &status);
+    *result = build(negate(a, &status), b, &status);
+    return status;
+}
+
+/*
+ * The nearest double, from a quotient with 64 significant bits: the
+ * numerator is scaled by 2^s first, so that numerator and denominator
+ * need not be representable as doubles themselves.
+ */
+double repl_rational_to_double(const HeapObject* object) {
+    const RationalObject* rational = (const RationalObject*)object;
+    Value n = rational->numerator, d = rational->denominator;
+    const int64_t exact = (int64_t)1 << 53;
+    if (value_type(n) == VALUE_INT && value_type(d) == VALUE_INT) {
+        int64_t x = (int64_t)value_as_bits(n), y = (int64_t)value_as_bits(d);
+        if (x > -exact && x < exact && y < exact) return (double)x / (double)y;
+    }
+
+    ValueStatus status = VALUE_OK;
+    int64_t s = 64 - ((int64_t)repl_bigint_bit_length(n) - (int64_t)repl_bigint_bit_length(d));
+    Value q;
+    if (s >= 0) {
+        q = integer(OP_DIV, integer(OP_SHL, n, value_int(s), &status), d, &status);
+    } else {
+        q = integer(OP_DIV, n, integer(OP_SHL, d, value_int(-s), &status), &status);
+    }
+    if (status != VALUE_OK) return NAN;
+    if (s > 4000) s = 4000;
+    if (s < -4000) s = -4000;
+    return ldexp(value_to_double(q), (int)-s);
+}
+
+bool repl_rational_equal(Value a, Value b) {
+    const RationalObject* x = (const RationalObject*)value_object(a);
+    const RationalObject* y = (const RationalObject*)value_object(b);
+    return repl_value_identical(x->numerator, y->numerator) &&
+           repl_value_identical(x->denominator, y->denominator);
+}
+
+/*
+ * A decimal literal as the exact fraction it denotes, e.g. 0.1 as 1/10:
+ * the digits without the point, times or over a power of ten. text is a
+ * literal the double parser accepted. Returns false for exponents beyond
+ * RATIONAL_MAX_EXPONENT, which are left to doubles.
+ */
+bool repl_rational_parse(const char* text, size_t length, Value* value) {
+    char* digits = (char*)malloc(length + 1);
+    if (!digits) return false;
+
+    size_t count = 0, i = 0;
+    long exponent = 0;
+    bool point = false;
+    for (; i < length && text[i] != 'e' && text[i] != 'E'; i++) {
+        if (text[i] == '.') {
+            point = true;
+        } else {
+            digits[count++] = text[i];
+            if (point) exponent--;
+        }
+    }
+    if (i < length) {
+        bool negative = text[++i] == '-';
+        if (text[i] == '-' || text[i] == '+') i++;
+        long written = 0;
+        for (; i < length; i++) {
+            if (written <= RATIONAL_MAX_EXPONENT * 10L) written = written * 10 + (text[i] - '0');
+        }
+        exponent += negative ? -written : written;
+    }
+
+    Value mantissa;
+    bool ok = count > 0 && labs(exponent) <= RATIONAL_MAX_EXPONENT && repl_bigint_parse(digits, count, 10, &mantissa);
+    free(digits);
+    if (!ok) return false;
+
+    ValueStatus status = VALUE_OK;
+    Value scale = integer(OP_POW, value_int(10), value_int(labs(exponent)), &status);
+    if (exponent >= 0) {
+        *value = integer(OP_MUL, mantissa, scale, &status);
+    } else {
+        *value = reduce(mantissa, scale, &status);
+    }
+    return status == VALUE_OK;
+}
+
+// "n/d", each part formatted as an integer
+void repl_rational_format(const HeapObject* object, char* buffer, size_t size) {
+    const RationalObject* rational = (const RationalObject*)object;
+    repl_format_value(rational->numerator, 0, buffer, size);
+    size_t length = strlen(buffer);
+    if (length + 2 < size) {
+        buffer[length++] = '/';
+        repl_format_value(rational->denominator, 0, buffer + length, size - length);
+    }
+}
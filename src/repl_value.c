@@ -0,0 +1,362 @@
+#include "../include/repl_value.h"
+#include "../include/repl_vm.h"
+#include "../include/repl_number.h"
+#include "../include/repl_bigint.h"
+#include "../include/repl_rational.h"
+#include "../include/repl_extended.h"
+#include "../include/repl_decimal.h"
+#include "../include/repl_complex.h"
+#include "../include/repl_array.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+/*
+ * C's usual arithmetic conversions: a double operand makes the operation
+ * double, otherwise an unsigned operand makes it uint64, otherwise it is
+ * int64. Integer arithmetic wraps modulo 2^64 instead of being undefined
+ * on overflow, and shift counts are taken modulo 64. Comparisons convert
+ * the same way and give a bool, which promotes to the 0 or 1 C gives.
+ *
+ * In bigint mode an int64 operation that would wrap is redone on bigints
+ * (repl_bigint.c), and a bigint operand makes the operation bigint unless
+ * the other is a double. Rational mode widens the same way, and integer
+ * division and negative powers give fractions (repl_rational.c); a
+ * rational operand makes the operation rational unless the other is a
+ * double. Decimal mode does the same with fixed-point decimals
+ * (repl_decimal.c), except that shifts and bitwise operators keep
+ * wrapping, since decimals have none.
+ *
+ * At double-double or quad precision an operation that would give a
+ * double gives the wider type instead (repl_extended.c), and so does one
+ * with a double-double or quad operand, whatever the other is.
+ *
+ * A complex operand makes the operation complex (repl_complex.c), on
+ * doubles, whatever the mode, the precision and the other operand. An
+ * array operand makes it element-wise (repl_array.c), also on doubles.
+ */
+
+static NumberMode number_mode = NUMBER_MODE_INT64;
+static Precision float_precision = PRECISION_DOUBLE;
+
+NumberMode repl_number_mode(void) {
+    return number_mode;
+}
+
+void repl_set_number_mode(NumberMode mode) {
+    number_mode = mode;
+}
+
+Precision repl_precision(void) {
+    return float_precision;
+}
+
+void repl_set_precision(Precision setting) {
+    float_precision = setting;
+}
+
+static ValueType common_type(ValueType a, ValueType b) {
+    if (a == VALUE_COMPLEX || b == VALUE_COMPLEX) return VALUE_COMPLEX;
+    if (a == VALUE_QUAD || b == VALUE_QUAD) return VALUE_QUAD;
+    if (a == VALUE_DD || b == VALUE_DD) return VALUE_DD;
+    if (a == VALUE_FLOAT || b == VALUE_FLOAT) return VALUE_FLOAT;
+    if (a == VALUE_DECIMAL || b == VALUE_DECIMAL) return VALUE_DECIMAL;
+    if (a == VALUE_RATIONAL || b == VALUE_RATIONAL) return VALUE_RATIONAL;
+    if (a == VALUE_BIGINT || b == VALUE_BIGINT) return VALUE_BIGINT;
+    if (a == VALUE_UINT || b == VALUE_UINT) return VALUE_UINT;
+    return VALUE_INT;
+}
+
+// Whether an int64 operation has a result outside the int64 range. Shifts
+// count as overflowing when they would lose bits or take the count modulo 64.
+bool repl_int64_overflows(int op, int64_t x, int64_t y) {
+    switch (op) {
+        case OP_ADD: return y > 0 ? x > INT64_MAX - y : x < INT64_MIN - y;
+        case OP_SUB: return y < 0 ? x > INT64_MAX + y : x < INT64_MIN + y;
+        case OP_MUL:
+            if (x == 0 || y == 0) return false;
+            if (x == -1) return y == INT64_MIN;
+            if (y == -1) return x == INT64_MIN;
+            return x > 0 ? (y > 0 ? x > INT64_MAX / y : y < INT64_MIN / x)
+                         : (y > 0 ? x < INT64_MIN / y : x < INT64_MAX / y);
+        case OP_DIV:
+        case OP_MOD: return x == INT64_MIN && y == -1;
+        case OP_POW: {
+            if (y < 2 || x == 0 || x == 1 || x == -1) return false;
+            int64_t result = 1;
+            for (; y > 0; y--) {
+                if (repl_int64_overflows(OP_MUL, result, x)) return true;
+                result *= x;
+            }
+            return false;
+        }
+        case OP_SHL:
+            if (y < 0 || y > 63) return x != 0 || y < 0;
+            return x != (int64_t)((uint64_t)x << y) >> y;
+        case OP_SHR: return y < 0 || y > 63;
+        default: return false;
+    }
+}
+
+// A bool operand is promoted to int, as C does
+static ValueType promoted_type(Value v) {
+    ValueType type = value_type(v);
+    return type == VALUE_BOOL ? VALUE_INT : type;
+}
+
+static bool is_negative(Value v) {
+    if (value_is_bigint(v)) return ((const BigIntObject*)value_object(v))->negative;
+    return value_type(v) == VALUE_INT && (int64_t)value_as_bits(v) < 0;
+}
+
+static Value value_of_type(ValueType type, uint64_t bits) {
+    return type == VALUE_INT ? value_int((int64_t)bits) : value_uint(bits);
+}
+
+// Exponentiation by squaring, wrapping
+static uint64_t power_bits(uint64_t base, uint64_t exponent) {
+    uint64_t result = 1;
+    while (exponent) {
+        if (exponent & 1) result *= base;
+        base *= base;
+        exponent >>= 1;
+    }
+    return result;
+}
+
+static ValueStatus float_binary(int op, double a, double b, Value* result) {
+    switch (op) {
+        case OP_ADD: *result = value_float(a + b); return VALUE_OK;
+        case OP_SUB: *result = value_float(a - b); return VALUE_OK;
+        case OP_MUL: *result = value_float(a * b); return VALUE_OK;
+        case OP_DIV:
+            if (b == 0.0) return VALUE_DIVISION_BY_ZERO;
+            *result = value_float(a / b);
+            return VALUE_OK;
+        case OP_POW: *result = value_float(pow(a, b)); return VALUE_OK;
+        case OP_LT:  *result = value_bool(a < b); return VALUE_OK;
+        case OP_LE:  *result = value_bool(a <= b); return VALUE_OK;
+        case OP_EQ:  *result = value_bool(a == b); return VALUE_OK;
+        case OP_NE:  *result = value_bool(a != b); return VALUE_OK;
+        default: return VALUE_INVALID_OPERANDS;
+    }
+}
+
+ValueStatus repl_value_binary(int op, Value a, Value b, Value* result) {
+    ValueType a_type = promoted_type(a);
+    ValueType b_type = promoted_type(b);
+    if (a_type == VALUE_UNDEFINED || b_type == VALUE_UNDEFINED) return VALUE_INVALID_OPERANDS;
+    if (a_type == VALUE_ARRAY || b_type == VALUE_ARRAY) return repl_array_binary(op, a, b, result);
+
+    ValueType type = common_type(a_type, b_type);
+    if (type == VALUE_COMPLEX) return repl_complex_binary(op, a, b, result);
+    bool exact = number_mode == NUMBER_MODE_RATIONAL || number_mode == NUMBER_MODE_DECIMAL;
+    if (type == VALUE_DD || type == VALUE_QUAD ||
+        (float_precision != PRECISION_DOUBLE && (type == VALUE_FLOAT ||
+         (op == OP_POW && type == VALUE_INT && !exact && is_negative(b))))) {
+        return repl_extended_binary(op, a, b, result);
+    }
+    if (type == VALUE_FLOAT) {
+        return float_binary(op, value_to_double(a), value_to_double(b), result);
+    }
+    if (type == VALUE_RATIONAL ||
+        (number_mode == NUMBER_MODE_RATIONAL && (type == VALUE_INT || type == VALUE_BIGINT) &&
+         (op == OP_DIV || (op == OP_POW && is_negative(b))))) {
+        return repl_rational_binary(op, a, b, result);
+    }
+    if (type == VALUE_DECIMAL ||
+        (number_mode == NUMBER_MODE_DECIMAL && type == VALUE_INT &&
+         (op == OP_DIV || (op == OP_POW && is_negative(b))))) {
+        return repl_decimal_binary(op, a, b, result);
+    }
+    if (type == VALUE_BIGINT) return repl_bigint_binary(op, a, b, result);
+
+    uint64_t x = value_as_bits(a);
+    uint64_t y = value_as_bits(b);
+    if (number_mode != NUMBER_MODE_INT64 && type == VALUE_INT &&
+        repl_int64_overflows(op, (int64_t)x, (int64_t)y)) {
+        if (number_mode != NUMBER_MODE_DECIMAL) return repl_bigint_binary(op, a, b, result);
+        if (op == OP_ADD || op == OP_SUB || op == OP_MUL || op == OP_POW) {
+            return repl_decimal_binary(op, a, b, result);
+        }
+    }
+
+    switch (op) {
+        case OP_ADD: *result = value_of_type(type, x + y); return VALUE_OK;
+        case OP_SUB: *result = value_of_type(type, x - y); return VALUE_OK;
+        case OP_MUL: *result = value_of_type(type, x * y); return VALUE_OK;
+        case OP_DIV:
+        case OP_MOD:
+            if (y == 0) return VALUE_DIVISION_BY_ZERO;
+            if (type == VALUE_UINT) {
+                *result = value_uint(op == OP_DIV ? x / y : x % y);
+            } else if ((int64_t)y == -1) {
+                // INT64_MIN / -1 overflows; wrap like the other operations
+                *result = value_int(op == OP_DIV ? (int64_t)(0 - x) : 0);
+            } else {
+                int64_t p = (int64_t)x, q = (int64_t)y;
+                *result = value_int(op == OP_DIV ? p / q : p % q);
+            }
+            return VALUE_OK;
+        case OP_POW:
+            // A negative exponent has no integer result
+            if (type == VALUE_INT && (int64_t)y < 0) {
+                *result = value_float(pow(value_to_double(a), value_to_double(b)));
+            } else {
+                *result = value_of_type(type, power_bits(x, y));
+            }
+            return VALUE_OK;
+        case OP_BAND: *result = value_of_type(type, x & y); return VALUE_OK;
+        case OP_BOR:  *result = value_of_type(type, x | y); return VALUE_OK;
+        case OP_BXOR: *result = value_of_type(type, x ^ y); return VALUE_OK;
+        case OP_SHL:
+            // Shifts take the type of the left operand
+            *result = value_of_type(a_type, x << (y & 63));
+            return VALUE_OK;
+        case OP_SHR:
+            if (a_type == VALUE_INT) {
+                *result = value_int((int64_t)x >> (y & 63));
+            } else {
+                *result = value_uint(x >> (y & 63));
+            }
+            return VALUE_OK;
+        case OP_LT:
+            *result = value_bool(type == VALUE_INT ? (int64_t)x < (int64_t)y : x < y);
+            return VALUE_OK;
+        case OP_LE:
+            *result = value_bool(type == VALUE_INT ? (int64_t)x <= (int64_t)y : x <= y);
+            return VALUE_OK;
+        case OP_EQ: *result = value_bool(x == y); return VALUE_OK;
+        case OP_NE: *result = value_bool(x != y); return VALUE_OK;
+        default:
+            return VALUE_INVALID_OPERANDS;
+    }
+}
+
+ValueStatus repl_value_unary(int op, Value a, Value* result) {
+    ValueType type = promoted_type(a);
+    if (type == VALUE_UNDEFINED) return VALUE_INVALID_OPERANDS;
+    if ((op == OP_NEG || op == OP_BNOT) && type == VALUE_ARRAY) {
+        return repl_array_unary(op, a, result);
+    }
+    if ((op == OP_NEG || op == OP_BNOT) && type == VALUE_COMPLEX) {
+        return repl_complex_unary(op, a, result);
+    }
+    if ((op == OP_NEG || op == OP_BNOT) && type == VALUE_RATIONAL) {
+        return repl_rational_unary(op, a, result);
+    }
+    if ((op == OP_NEG || op == OP_BNOT) && (type == VALUE_DD || type == VALUE_QUAD)) {
+        return repl_extended_unary(op, a, result);
+    }
+    bool widens = number_mode != NUMBER_MODE_INT64 && op == OP_NEG && type == VALUE_INT &&
+                  (int64_t)value_as_bits(a) == INT64_MIN;
+    if ((op == OP_NEG || op == OP_BNOT) &&
+        (type == VALUE_DECIMAL || (widens && number_mode == NUMBER_MODE_DECIMAL))) {
+        return repl_decimal_unary(op, a, result);
+    }
+    if ((op == OP_NEG || op == OP_BNOT) && (type == VALUE_BIGINT || widens)) {
+        return repl_bigint_unary(op, a, result);
+    }
+
+    switch (op) {
+        case OP_NEG:
+            if (type == VALUE_FLOAT) {
+                *result = value_float(-value_as_float(a));
+            } else {
+                *result = value_of_type(type, 0 - value_as_bits(a));
+            }
+            return VALUE_OK;
+        case OP_BNOT:
+            if (type == VALUE_FLOAT) return VALUE_INVALID_OPERANDS;
+            *result = value_of_type(type, ~value_as_bits(a));
+            return VALUE_OK;
+        case OP_NOT:
+            *result = value_bool(!value_is_true(a));
+            return VALUE_OK;
+        case OP_BOOL:
+            *result = value_bool(value_is_true(a));
+            return VALUE_OK;
+        default:
+            return VALUE_INVALID_OPERANDS;
+    }
+}
+
+// Same type and same bits, so 0.0 and -0.0 differ and so do 1 and 1.0.
+// Wide integers are boxed separately each time, so compare their contents.
+bool repl_value_identical(Value a, Value b) {
+    if (a.bits == b.bits) return true;
+    if (!value_is_object(a) || !value_is_object(b)) return false;
+    if (value_type(a) != value_type(b)) return false;
+    if (value_type(a) == VALUE_BIGINT) return repl_bigint_equal(a, b);
+    if (value_type(a) == VALUE_RATIONAL) return repl_rational_equal(a, b);
+    if (value_type(a) == VALUE_DD || value_type(a) == VALUE_QUAD) return repl_extended_equal(a, b);
+    if (value_type(a) == VALUE_DECIMAL) return repl_decimal_equal(a, b);
+    if (value_type(a) == VALUE_COMPLEX) return repl_complex_equal(a, b);
+    if (value_type(a) == VALUE_ARRAY) return repl_array_equal(a, b);
+    return value_as_bits(a) == value_as_bits(b);
+}
+
+const char* repl_value_type_name(Value v) {
+    switch (value_type(v)) {
+        case VALUE_INT:       return "int64";
+        case VALUE_UINT:      return "uint64";
+        case VALUE_BOOL:      return "bool";
+        case VALUE_UNDEFINED: return "undefined";
+        case VALUE_BIGINT:    return "bigint";
+        case VALUE_RATIONAL:  return "rational";
+        case VALUE_DD:        return "double-double";
+        case VALUE_QUAD:      return "quad";
+        case VALUE_DECIMAL:   return "decimal";
+        case VALUE_COMPLEX:   return "complex";
+        case VALUE_ARRAY:     return "array";
+        default:              return "double";
+    }
+}
+
+// Integers print as C would; doubles that look integral get a ".0" so
+// that 3.0 and 3 can be told apart
+void repl_format_value(Value v, int precision, char* buffer, size_t size) {
+    switch (value_type(v)) {
+        case VALUE_INT:
+            snprintf(buffer, size, "%" PRId64, (int64_t)value_as_bits(v));
+            return;
+        case VALUE_UINT:
+            snprintf(buffer, size, "%" PRIu64, value_as_bits(v));
+            return;
+        case VALUE_BOOL:
+            snprintf(buffer, size, "%s", value_as_bits(v) ? "true" : "false");
+            return;
+        case VALUE_UNDEFINED:
+            snprintf(buffer, size, "undefined");
+            return;
+        case VALUE_BIGINT:
+            repl_bigint_format(value_object(v), buffer, size);
+            return;
+        case VALUE_RATIONAL:
+            repl_rational_format(value_object(v), buffer, size);
+            return;
+        case VALUE_DECIMAL:
+            repl_decimal_format(value_object(v), buffer, size);
+            return;
+        case VALUE_COMPLEX:
+            repl_complex_format(value_object(v), precision, buffer, size);
+            return;
+        case VALUE_ARRAY:
+            repl_array_format(value_object(v), precision, buffer, size);
+            return;
+        default:
+            break;
+    }
+
+    char text[EXTENDED_BUFFER_SIZE];
+    if (value_is_object(v)) {
+        repl_extended_format(v, precision, text, sizeof(text) - 2);
+    } else {
+        repl_format_number(value_as_float(v), precision, text, sizeof(text) - 2);
+    }
+    if (text[strspn(text, "-0123456789")] == '\0') {
+        strcat(text, ".0");
+    }
+    snprintf(buffer, size, "%s", text);
+}
@@ -1,44 +1,136 @@
 #include "../include/repl_variables.h"
+#include "../include/repl_number.h"
+#include "../include/repl_extended.h"
+#include "../include/repl_array.h"
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-void repl_set_variable(REPL* repl, const char* name, double value) {
-    // Check if variable already exists
-    for (int i = 0; i < repl->variable_count; i++) {
-        if (strcmp(repl->variables[i].name, name) == 0) {
-            repl->variables[i].value = value;
-            return;
+#define INITIAL_SLOTS 16
+
+// FNV-1a hash of a variable name
+static unsigned int hash_name(const char* name) {
+    unsigned int hash = 2166136261u;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Slot of a variable by name, or -1 if it has none
+static int find_slot(const VariableStore* store, const char* name, unsigned int hash) {
+    if (store->index_capacity == 0) return -1;
+
+    int mask = store->index_capacity - 1;
+    for (int i = (int)(hash & mask); store->index[i] != 0; i = (i + 1) & mask) {
+        int slot = store->index[i] - 1;
+        if (store->hashes[slot] == hash && strcmp(store->names[slot], name) == 0) {
+            return slot;
         }
     }
-    
-    // Add new variable if space available
-    if (repl->variable_count < MAX_VARIABLES) {
-        strncpy(repl->variables[repl->variable_count].name, name, MAX_VARIABLE_NAME - 1);
-        repl->variables[repl->variable_count].name[MAX_VARIABLE_NAME - 1] = '\0';
-        repl->variables[repl->variable_count].value = value;
-        repl->variable_count++;
+    return -1;
+}
+
+// Double the hash index and reinsert every slot
+static bool grow_index(VariableStore* store) {
+    int capacity = store->index_capacity ? store->index_capacity * 2 : 2 * INITIAL_SLOTS;
+    int* index = (int*)calloc(capacity, sizeof(int));
+    if (!index) return false;
+
+    int mask = capacity - 1;
+    for (int slot = 0; slot < store->count; slot++) {
+        int i = (int)(store->hashes[slot] & mask);
+        while (index[i] != 0) i = (i + 1) & mask;
+        index[i] = slot + 1;
     }
+
+    free(store->index);
+    store->index = index;
+    store->index_capacity = capacity;
+    return true;
 }
 
-double repl_get_variable(REPL* repl, const char* name, bool* found) {
-    for (int i = 0; i < repl->variable_count; i++) {
-        if (strcmp(repl->variables[i].name, name) == 0) {
-            if (found) *found = true;
-            return repl->variables[i].value;
-        }
+// Double the per-slot arrays. Each array is only replaced once it has been
+// reallocated, so a failure part way leaves the store consistent.
+static bool grow_slots(VariableStore* store) {
+    int capacity = store->capacity ? store->capacity * 2 : INITIAL_SLOTS;
+
+    char** names = (char**)realloc(store->names, capacity * sizeof(char*));
+    if (!names) return false;
+    store->names = names;
+
+    unsigned int* hashes = (unsigned int*)realloc(store->hashes, capacity * sizeof(unsigned int));
+    if (!hashes) return false;
+    store->hashes = hashes;
+
+    Value* values = (Value*)realloc(store->values, capacity * sizeof(Value));
+    if (!values) return false;
+    store->values = values;
+
+    unsigned int* versions = (unsigned int*)realloc(store->versions, capacity * sizeof(unsigned int));
+    if (!versions) return false;
+    store->versions = versions;
+
+    store->capacity = capacity;
+    return true;
+}
+
+// Slot for a variable, reserving an undefined one if the name is new.
+// Compiled expressions hold slots, so a slot keeps its index for the life
+// of the REPL. Returns -1 if memory runs out.
+int repl_resolve_variable(REPL* repl, const char* name) {
+    VariableStore* store = &repl->variables;
+    unsigned int hash = hash_name(name);
+
+    int slot = find_slot(store, name, hash);
+    if (slot >= 0) return slot;
+
+    if (store->count == store->capacity && !grow_slots(store)) return -1;
+    if ((store->count + 1) * 2 > store->index_capacity && !grow_index(store)) return -1;
+
+    size_t length = strlen(name);
+    char* interned = (char*)malloc(length + 1);
+    if (!interned) return -1;
+    memcpy(interned, name, length + 1);
+
+    slot = store->count++;
+    store->names[slot] = interned;
+    store->hashes[slot] = hash;
+    store->values[slot] = value_undefined();
+    store->versions[slot] = 0;
+
+    int mask = store->index_capacity - 1;
+    int i = (int)(hash & mask);
+    while (store->index[i] != 0) i = (i + 1) & mask;
+    store->index[i] = slot + 1;
+    return slot;
+}
+
+void repl_set_variable(REPL* repl, const char* name, Value value) {
+    int slot = repl_resolve_variable(repl, name);
+    if (slot < 0) return;
+
+    repl->variables.values[slot] = value;
+    repl->variables.versions[slot]++;
+}
+
+Value repl_get_variable(REPL* repl, const char* name, bool* found) {
+    const VariableStore* store = &repl->variables;
+    int slot = find_slot(store, name, hash_name(name));
+    if (slot >= 0 && !value_is_undefined(store->values[slot])) {
+        if (found) *found = true;
+        return store->values[slot];
     }
     
     if (found) *found = false;
-    return 0.0;
+    return value_int(0);
 }
 
 bool repl_is_variable(REPL* repl, const char* name) {
-    for (int i = 0; i < repl->variable_count; i++) {
-        if (strcmp(repl->variables[i].name, name) == 0) {
-            return true;
-        }
-    }
-    return false;
+    const VariableStore* store = &repl->variables;
+    int slot = find_slot(store, name, hash_name(name));
+    return slot >= 0 && !value_is_undefined(store->values[slot]);
 }
 
 void repl_list_variables(REPL* repl, char* buffer, size_t buffer_size) {
@@ -48,19 +140,25 @@ void repl_list_variables(REPL* repl, char* buffer, size_t buffer_size) {
     snprintf(buffer, buffer_size, "Variables:\n");
     size_t offset = strlen(buffer);
     
-    // Add each variable to the buffer
-    for (int i = 0; i < repl->variable_count; i++) {
-        // Check if we have enough room left in the buffer
+    // Add each variable to the buffer, and once the next one does not fit,
+    // the number of those left out
+    const VariableStore* store = &repl->variables;
+    for (int i = 0; i < store->count; i++) {
+        if (value_is_undefined(store->values[i])) continue;
+
         size_t remaining = buffer_size - offset;
-        if (remaining < 50) break; // Ensure enough space for one more entry plus truncation message
+        if (remaining < LIST_MORE_RESERVE) break;
         
         // Format this variable and add to buffer
-        int written = snprintf(buffer + offset, remaining, "  %s = %.6g\n", 
-                             repl->variables[i].name, repl->variables[i].value);
+        char number[ARRAY_BUFFER_SIZE];
+        repl_format_value(store->values[i], repl->output_precision, number, sizeof(number));
+        int written = snprintf(buffer + offset, remaining - LIST_MORE_RESERVE, "  %s = %s\n",
+                               store->names[i], number);
         
-        if (written < 0 || (size_t)written >= remaining) {
-            // Buffer is full, add truncation message
-            snprintf(buffer + offset, remaining, "...(truncated)");
+        if (written < 0 || (size_t)written >= remaining - LIST_MORE_RESERVE) {
+            int more = 0;
+            for (int j = i; j < store->count; j++) more += !value_is_undefined(store->values[j]);
+            snprintf(buffer + offset, remaining, "  ...%d more\n", more);
             break;
         }
         
@@ -72,10 +170,46 @@ void repl_list_variables(REPL* repl, char* buffer, size_t buffer_size) {
 }
 
 void repl_clear_variables(REPL* repl) {
-    // Reset variable count
-    repl->variable_count = 0;
+    // Undefine every variable but keep the slots, which compiled
+    // expressions may still refer to
+    for (int i = 0; i < repl->variables.count; i++) {
+        repl->variables.values[i] = value_undefined();
+        repl->variables.versions[i]++;
+    }
     
     // Set up default variables again
-    repl_set_variable(repl, "pi", 3.14159265358979323846);
-    repl_set_variable(repl, "e", 2.71828182845904523536);
-}
\ No newline at end of file
+    repl_define_constants(repl);
+}
+
+// The predefined pi and e, at the precision setting
+void repl_define_constants(REPL* repl) {
+    repl_set_variable(repl, "pi", repl_extended_constant(PI_DIGITS, repl_precision()));
+    repl_set_variable(repl, "e", repl_extended_constant(E_DIGITS, repl_precision()));
+}
+
+// After a precision change: pi and e still holding their value at the old
+// precision get the new one, and ones assigned something else are kept
+void repl_update_constants(REPL* repl, Precision old) {
+    static const char* const names[] = { "pi", "e" };
+    static const char* const digits[] = { PI_DIGITS, E_DIGITS };
+    for (int i = 0; i < 2; i++) {
+        bool found;
+        Value value = repl_get_variable(repl, names[i], &found);
+        if (found && repl_value_identical(value, repl_extended_constant(digits[i], old))) {
+            repl_set_variable(repl, names[i], repl_extended_constant(digits[i], repl_precision()));
+        }
+    }
+}
+
+void repl_free_variables(REPL* repl) {
+    VariableStore* store = &repl->variables;
+    for (int i = 0; i < store->count; i++) {
+        free(store->names[i]);
+    }
+    free(store->names);
+    free(store->hashes);
+    free(store->values);
+    free(store->versions);
+    free(store->index);
+    memset(store, 0, sizeof(*store));
+}
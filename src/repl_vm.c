@@ -0,0 +1,598 @@
+#include "../include/repl_vm.h"
+#include "../include/repl_compile.h"
+#include "../include/repl_variables.h"
+#include "../include/repl_functions.h"
+#include "../include/repl_builtins.h"
+#include "../include/repl_array.h"
+#include "../include/repl_fusion.h"
+#include "../include/repl_heap.h"
+#include "../include/repl_eval.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Dispatch uses GCC's labels-as-values ("computed goto") where available:
+ * every handler ends in its own indirect jump, which branch predictors
+ * handle far better than the single shared jump of a switch. Other
+ * compilers, or builds defining REPL_VM_NO_COMPUTED_GOTO, use the switch.
+ */
+#if defined(__GNUC__) && !defined(REPL_VM_NO_COMPUTED_GOTO)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+#ifdef VM_COMPUTED_GOTO
+#define VM_CASE(op)  label_##op:
+#define VM_NEXT()    do { i = *pc++; goto *dispatch_table[INSTR_OP(i)]; } while (0)
+#define VM_BEGIN()   VM_NEXT();
+#define VM_END()
+#else
+#define VM_CASE(op)  case op:
+#define VM_NEXT()    continue
+#define VM_BEGIN()   for (;;) { i = *pc++; switch (INSTR_OP(i)) {
+#define VM_END()     default: goto fail; } }
+#endif
+
+// Source spelling of each operator, for error messages
+static const char* const op_symbols[OP_COUNT] = {
+    [OP_NEG] = "-", [OP_ADD] = "+", [OP_SUB] = "-", [OP_MUL] = "*",
+    [OP_DIV] = "/", [OP_POW] = "^", [OP_MOD] = "%", [OP_BAND] = "&",
+    [OP_BOR] = "|", [OP_BXOR] = "~", [OP_SHL] = "<<", [OP_SHR] = ">>",
+    [OP_BNOT] = "~", [OP_ADDK] = "+", [OP_SUBK] = "-", [OP_MULK] = "*",
+    [OP_DIVK] = "/", [OP_POWK] = "^", [OP_RSUBK] = "-", [OP_RDIVK] = "/",
+    [OP_LT] = "<", [OP_LE] = "<=", [OP_EQ] = "==", [OP_NE] = "!=",
+};
+
+// Report the error raised by the instruction at pc, frames deep in
+// function calls. Kept out of the dispatch loop so that handlers only
+// carry a branch to the fail label; the operation is repeated here to find
+// out what went wrong. Errors inside a function point at the outermost
+// call in the input and name the function.
+static _Noreturn void runtime_error(REPL* repl, const CompiledExpr* program, const Instr* pc,
+                                    const Value* regs, int frames) {
+    static const OpCode base_ops[OP_COUNT] = {
+        [OP_ADDK] = OP_ADD, [OP_SUBK] = OP_SUB, [OP_MULK] = OP_MUL, [OP_DIVK] = OP_DIV,
+        [OP_POWK] = OP_POW, [OP_RSUBK] = OP_SUB, [OP_RDIVK] = OP_DIV,
+    };
+    int position = program->positions[pc - program->code];
+    char where[MAX_VARIABLE_NAME + 16] = "";
+    if (frames > 0) {
+        const CallFrame* outer = &repl->vm_stack->frames[0];
+        const CallFrame* inner = &repl->vm_stack->frames[frames - 1];
+        position = outer->program->positions[outer->pc - 1 - outer->program->code];
+        snprintf(where, sizeof(where), "in '%s': ",
+                 repl->functions.items[INSTR_BX(inner->pc[-1])].name);
+    }
+
+    Instr i = *pc;
+    int op = INSTR_OP(i);
+    if (op == OP_RET) {
+        const CallFrame* inner = &repl->vm_stack->frames[frames - 1];
+        repl_raise_error(&repl->error, position, "function '%s' returned no value",
+                         repl->functions.items[INSTR_BX(inner->pc[-1])].name);
+    }
+    const char* symbol = op_symbols[op];
+    Value lhs, rhs, result;
+    ValueStatus status;
+
+    switch (op) {
+        case OP_LOADV:
+            repl_raise_error(&repl->error, position, "%sundefined variable '%s'", where,
+                             repl->variables.names[program->slots[INSTR_BX(i)]]);
+        case OP_JMP: case OP_JMPF: case OP_JMPT: case OP_TAILCALL:
+            repl_raise_error(&repl->error, position, "%sinterrupted", where);
+        case OP_CALL:
+            repl_raise_error(&repl->error, position, "%stoo many nested calls to '%s'", where,
+                             repl->functions.items[INSTR_BX(i)].name);
+        case OP_BUILTIN: {
+            const Builtin* builtin = &repl_builtins[INSTR_B(i)];
+            const Value* args = regs + INSTR_A(i);
+            status = repl_call_builtin(builtin, args, &result);
+            if (status == VALUE_DIVISION_BY_ZERO) {
+                repl_raise_error(&repl->error, position, "%sdivision by zero in '%s'", where, builtin->name);
+            }
+            if (status == VALUE_TOO_LARGE) {
+                repl_raise_error(&repl->error, position, "%sresult of '%s' is too large", where,
+                                 builtin->name);
+            }
+            if (status == VALUE_LENGTH_MISMATCH) {
+                repl_raise_error(&repl->error, position, "%sarrays of different lengths in '%s'",
+                                 where, builtin->name);
+            }
+            if (builtin->arity == 3) {
+                repl_raise_error(&repl->error, position, "%sinvalid arguments to '%s' (%s, %s and %s)",
+                                 where, builtin->name, repl_value_type_name(args[0]),
+                                 repl_value_type_name(args[1]), repl_value_type_name(args[2]));
+            }
+            if (builtin->arity == 2) {
+                repl_raise_error(&repl->error, position, "%sinvalid arguments to '%s' (%s and %s)",
+                                 where, builtin->name, repl_value_type_name(args[0]),
+                                 repl_value_type_name(args[1]));
+            }
+            repl_raise_error(&repl->error, position, "%sinvalid argument to '%s' (%s)",
+                             where, builtin->name, repl_value_type_name(args[0]));
+        }
+        case OP_ARRAY: {
+            const Value* elements = regs + INSTR_A(i);
+            for (int e = 0; e < INSTR_B(i); e++) {
+                ValueType type = value_type(elements[e]);
+                if (type == VALUE_UNDEFINED || type == VALUE_COMPLEX || type == VALUE_ARRAY) {
+                    repl_raise_error(&repl->error, position, "%sarray element %d is not a real number (%s)",
+                                     where, e + 1, repl_value_type_name(elements[e]));
+                }
+            }
+            repl_raise_error(&repl->error, position, "%sarray is too large", where);
+        }
+        case OP_NEG:
+        case OP_BNOT:
+            if (repl_value_unary(op, regs[INSTR_B(i)], &result) == VALUE_TOO_LARGE) {
+                repl_raise_error(&repl->error, position, "%sresult of '%s' is too large", where, symbol);
+            }
+            repl_raise_error(&repl->error, position, "%sinvalid operand to '%s' (%s)",
+                             where, symbol, repl_value_type_name(regs[INSTR_B(i)]));
+        case OP_RSUBK:
+        case OP_RDIVK:
+            lhs = program->constants[INSTR_C(i)];
+            rhs = regs[INSTR_B(i)];
+            break;
+        case OP_ADDK: case OP_SUBK: case OP_MULK: case OP_DIVK: case OP_POWK:
+            lhs = regs[INSTR_B(i)];
+            rhs = program->constants[INSTR_C(i)];
+            break;
+        default:
+            if (!symbol) repl_raise_error(&repl->error, position, "invalid instruction");
+            lhs = regs[INSTR_B(i)];
+            rhs = regs[INSTR_C(i)];
+            break;
+    }
+
+    status = repl_value_binary(base_ops[op] ? (int)base_ops[op] : op, lhs, rhs, &result);
+    if (status == VALUE_DIVISION_BY_ZERO) {
+        repl_raise_error(&repl->error, position, "%sdivision by zero in '%s'", where, symbol);
+    }
+    if (status == VALUE_TOO_LARGE) {
+        repl_raise_error(&repl->error, position, "%sresult of '%s' is too large", where, symbol);
+    }
+    if (status == VALUE_LENGTH_MISMATCH) {
+        repl_raise_error(&repl->error, position, "%sarrays of different lengths in '%s' (%zu and %zu)",
+                         where, symbol, value_array(lhs)->length, value_array(rhs)->length);
+    }
+    repl_raise_error(&repl->error, position, "%sinvalid operands to '%s' (%s and %s)",
+                     where, symbol, repl_value_type_name(lhs), repl_value_type_name(rhs));
+}
+
+/*
+ * Arithmetic handlers test for two inline int64 or two double operands
+ * inline, so integer-only programs never touch the FPU and double-only
+ * programs skip the conversions. value_int boxes a result that outgrows
+ * the inline payload. Mixed types, wide integers and the rarer operators
+ * go through repl_value_binary. Integer results wrap, computed on uint64
+ * to avoid signed overflow; sums of inline int64 never leave the int64
+ * range, so wrapping only happens in repl_value_binary, which widens to a
+ * bigint instead in bigint mode. At extended precision two doubles give a
+ * wider result, so they go through repl_value_binary too.
+ */
+#define BOTH_INT(x, y)   (value_is_small_int(x) && value_is_small_int(y))
+#define BOTH_FLOAT(x, y) (!extended && value_is_float(x) && value_is_float(y))
+
+/*
+ * An operation on an array that starts a fused run of element-wise
+ * operations evaluates the whole run, a block of elements at a time (see
+ * repl_fusion.c), and pc moves past it. Otherwise, or if the run cannot
+ * be fused, the operation goes on as usual.
+ */
+static inline bool fuse(REPL* repl, const CompiledExpr* program, const Instr** pc, Value* regs) {
+    int start = (int)(*pc - 1 - program->code);
+    if (program->fused_ends[start] < 0 || !repl_fusion_run(repl, program, start, regs)) return false;
+    *pc = program->code + program->fused_ends[start] + 1;
+    return true;
+}
+
+#define IS_ARRAY(v)      (value_type(v) == VALUE_ARRAY)
+#define VM_FUSED(x, y)   (program->fused_ends && (IS_ARRAY(x) || IS_ARRAY(y)) && \
+                          fuse(repl, program, &pc, regs))
+
+#define VM_ARITH(op, x, y, operator) do {                                          \
+    Value lhs = (x), rhs = (y);                                                    \
+    if (BOTH_INT(lhs, rhs)) {                                                      \
+        regs[INSTR_A(i)] = value_int((int64_t)((uint64_t)value_small_int(lhs)       \
+                                               operator (uint64_t)value_small_int(rhs))); \
+    } else if (BOTH_FLOAT(lhs, rhs)) {                                             \
+        regs[INSTR_A(i)] = value_float(value_as_float(lhs) operator value_as_float(rhs)); \
+    } else if (!VM_FUSED(lhs, rhs) &&                                              \
+               repl_value_binary(op, lhs, rhs, &regs[INSTR_A(i)]) != VALUE_OK) {   \
+        goto fail;                                                                 \
+    }                                                                              \
+} while (0)
+
+// Multiplication: two inline int64 are inlined when both fit in 32 bits,
+// so that the product cannot leave the int64 range
+#define VM_MULTIPLY(x, y) do {                                                     \
+    Value lhs = (x), rhs = (y);                                                    \
+    if (BOTH_INT(lhs, rhs) && (uint64_t)(value_small_int(lhs) + INT32_MAX) <= UINT32_MAX && \
+        (uint64_t)(value_small_int(rhs) + INT32_MAX) <= UINT32_MAX) {              \
+        regs[INSTR_A(i)] = value_int(value_small_int(lhs) * value_small_int(rhs)); \
+    } else if (BOTH_FLOAT(lhs, rhs)) {                                             \
+        regs[INSTR_A(i)] = value_float(value_as_float(lhs) * value_as_float(rhs)); \
+    } else if (!VM_FUSED(lhs, rhs) &&                                              \
+               repl_value_binary(OP_MUL, lhs, rhs, &regs[INSTR_A(i)]) != VALUE_OK) { \
+        goto fail;                                                                 \
+    }                                                                              \
+} while (0)
+
+// Division: only two doubles are inlined; integers need the zero and
+// INT64_MIN / -1 checks of repl_value_binary
+#define VM_DIVIDE(x, y) do {                                                       \
+    Value lhs = (x), rhs = (y);                                                    \
+    if (BOTH_FLOAT(lhs, rhs) && value_as_float(rhs) != 0.0) {                      \
+        regs[INSTR_A(i)] = value_float(value_as_float(lhs) / value_as_float(rhs)); \
+    } else if (!VM_FUSED(lhs, rhs) &&                                              \
+               repl_value_binary(OP_DIV, lhs, rhs, &regs[INSTR_A(i)]) != VALUE_OK) { \
+        goto fail;                                                                 \
+    }                                                                              \
+} while (0)
+
+// Bitwise operators: the two inline int64 case is inlined
+#define VM_BITWISE(op, expr) do {                                                  \
+    Value lhs = regs[INSTR_B(i)], rhs = regs[INSTR_C(i)];                          \
+    if (BOTH_INT(lhs, rhs)) {                                                      \
+        uint64_t x = (uint64_t)value_small_int(lhs), y = (uint64_t)value_small_int(rhs); \
+        regs[INSTR_A(i)] = value_int((int64_t)(expr));                             \
+    } else if (repl_value_binary(op, lhs, rhs, &regs[INSTR_A(i)]) != VALUE_OK) {   \
+        goto fail;                                                                 \
+    }                                                                              \
+} while (0)
+
+// Any other binary operation
+#define VM_GENERIC(op, x, y) do {                                                  \
+    Value lhs = (x), rhs = (y);                                                    \
+    if (!VM_FUSED(lhs, rhs) && repl_value_binary(op, lhs, rhs, &regs[INSTR_A(i)]) != VALUE_OK) { \
+        goto fail;                                                                 \
+    }                                                                              \
+} while (0)
+
+// Comparisons: two inline int64 or two doubles are compared inline
+#define VM_COMPARE(op, operator) do {                                              \
+    Value lhs = regs[INSTR_B(i)], rhs = regs[INSTR_C(i)];                          \
+    if (BOTH_INT(lhs, rhs)) {                                                      \
+        regs[INSTR_A(i)] = value_bool(value_small_int(lhs) operator value_small_int(rhs)); \
+    } else if (BOTH_FLOAT(lhs, rhs)) {                                             \
+        regs[INSTR_A(i)] = value_bool(value_as_float(lhs) operator value_as_float(rhs)); \
+    } else if (repl_value_binary(op, lhs, rhs, &regs[INSTR_A(i)]) != VALUE_OK) {   \
+        goto fail;                                                                 \
+    }                                                                              \
+} while (0)
+
+// A loop or a recursion can allocate without bound within one evaluation,
+// so the heap is also collected at backward jumps, calls and returns. The
+// registers up to the running program's, and the programs of every frame,
+// are then roots as well.
+static void collect_while_running(REPL* repl, const CompiledExpr* program, const Value* regs,
+                                  const CallFrame* frames, int depth) {
+    const Value* base = repl->vm_stack->registers;
+    if (!repl_heap_mark_registers(base, (size_t)(regs + program->register_count - base))) return;
+    repl_mark_program(program);
+    for (int d = 0; d < depth; d++) repl_mark_program(frames[d].program);
+    repl_collect_garbage(repl);
+}
+
+// Every VM_POLL_INTERVAL passes through a loop, stop if the user asked
+// to, so that a loop that never ends does not hang the REPL
+#define VM_POLL() do {                                                             \
+    if (--polls == 0) {                                                            \
+        polls = VM_POLL_INTERVAL;                                                  \
+        if (repl_interrupt_requested(repl)) goto fail;                             \
+    }                                                                              \
+} while (0)
+
+// Jump to instruction Bx. A jump that closes a loop first collects if the
+// heap has grown enough, and polls for an interrupt.
+#define VM_JUMP() do {                                                             \
+    const Instr* target = program->code + INSTR_BX(i);                             \
+    if (target < pc) {                                                             \
+        if (repl_heap_should_collect()) {                                          \
+            collect_while_running(repl, program, regs, frames, depth);             \
+        }                                                                          \
+        VM_POLL();                                                                 \
+    }                                                                              \
+    pc = target;                                                                   \
+} while (0)
+
+Value repl_vm_execute(REPL* repl, const CompiledExpr* program) {
+#ifdef VM_COMPUTED_GOTO
+    static const void* const dispatch_table[OP_COUNT] = {
+        [OP_LOADK] = &&label_OP_LOADK,
+        [OP_LOADV] = &&label_OP_LOADV,
+        [OP_MOVE]  = &&label_OP_MOVE,
+        [OP_NEG]   = &&label_OP_NEG,
+        [OP_ADD]   = &&label_OP_ADD,
+        [OP_SUB]   = &&label_OP_SUB,
+        [OP_MUL]   = &&label_OP_MUL,
+        [OP_DIV]   = &&label_OP_DIV,
+        [OP_POW]   = &&label_OP_POW,
+        [OP_MOD]   = &&label_OP_MOD,
+        [OP_BAND]  = &&label_OP_BAND,
+        [OP_BOR]   = &&label_OP_BOR,
+        [OP_BXOR]  = &&label_OP_BXOR,
+        [OP_SHL]   = &&label_OP_SHL,
+        [OP_SHR]   = &&label_OP_SHR,
+        [OP_BNOT]  = &&label_OP_BNOT,
+        [OP_NOT]   = &&label_OP_NOT,
+        [OP_BOOL]  = &&label_OP_BOOL,
+        [OP_ADDK]  = &&label_OP_ADDK,
+        [OP_SUBK]  = &&label_OP_SUBK,
+        [OP_MULK]  = &&label_OP_MULK,
+        [OP_DIVK]  = &&label_OP_DIVK,
+        [OP_POWK]  = &&label_OP_POWK,
+        [OP_RSUBK] = &&label_OP_RSUBK,
+        [OP_RDIVK] = &&label_OP_RDIVK,
+        [OP_LT]    = &&label_OP_LT,
+        [OP_LE]    = &&label_OP_LE,
+        [OP_EQ]    = &&label_OP_EQ,
+        [OP_NE]    = &&label_OP_NE,
+        [OP_STOREV] = &&label_OP_STOREV,
+        [OP_JMP]   = &&label_OP_JMP,
+        [OP_JMPF]  = &&label_OP_JMPF,
+        [OP_JMPT]  = &&label_OP_JMPT,
+        [OP_CALL]  = &&label_OP_CALL,
+        [OP_TAILCALL] = &&label_OP_TAILCALL,
+        [OP_BUILTIN] = &&label_OP_BUILTIN,
+        [OP_ARRAY] = &&label_OP_ARRAY,
+        [OP_RET]   = &&label_OP_RET,
+    };
+#endif
+
+    if (!repl->vm_stack) {
+        repl->vm_stack = (VMStack*)malloc(sizeof(VMStack));
+        if (!repl->vm_stack) repl_raise_error(&repl->error, -1, "out of memory");
+    }
+    CallFrame* frames = repl->vm_stack->frames;
+    const Value* stack_end = repl->vm_stack->registers + VM_STACK_SIZE;
+    int depth = 0;
+    int polls = VM_POLL_INTERVAL;
+
+    Value* regs = repl->vm_stack->registers;
+    const Value* k = program->constants;
+    const Instr* pc = program->code;
+    Instr i;
+    bool extended = repl_precision() != PRECISION_DOUBLE;
+
+    VM_BEGIN()
+
+    VM_CASE(OP_LOADK) {
+        regs[INSTR_A(i)] = k[INSTR_BX(i)];
+        VM_NEXT();
+    }
+    VM_CASE(OP_LOADV) {
+        Value value = repl->variables.values[program->slots[INSTR_BX(i)]];
+        if (value_is_undefined(value)) goto fail;
+        regs[INSTR_A(i)] = value;
+        VM_NEXT();
+    }
+    VM_CASE(OP_MOVE) {
+        regs[INSTR_A(i)] = regs[INSTR_B(i)];
+        VM_NEXT();
+    }
+    VM_CASE(OP_NEG) {
+        Value operand = regs[INSTR_B(i)];
+        if (value_is_float(operand)) {
+            regs[INSTR_A(i)] = value_float(-value_as_float(operand));
+        } else if (!VM_FUSED(operand, operand) &&
+                   repl_value_unary(OP_NEG, operand, &regs[INSTR_A(i)]) != VALUE_OK) {
+            goto fail;
+        }
+        VM_NEXT();
+    }
+    VM_CASE(OP_ADD) {
+        VM_ARITH(OP_ADD, regs[INSTR_B(i)], regs[INSTR_C(i)], +);
+        VM_NEXT();
+    }
+    VM_CASE(OP_SUB) {
+        VM_ARITH(OP_SUB, regs[INSTR_B(i)], regs[INSTR_C(i)], -);
+        VM_NEXT();
+    }
+    VM_CASE(OP_MUL) {
+        VM_MULTIPLY(regs[INSTR_B(i)], regs[INSTR_C(i)]);
+        VM_NEXT();
+    }
+    VM_CASE(OP_DIV) {
+        VM_DIVIDE(regs[INSTR_B(i)], regs[INSTR_C(i)]);
+        VM_NEXT();
+    }
+    VM_CASE(OP_POW) {
+        VM_GENERIC(OP_POW, regs[INSTR_B(i)], regs[INSTR_C(i)]);
+        VM_NEXT();
+    }
+    VM_CASE(OP_MOD) {
+        VM_GENERIC(OP_MOD, regs[INSTR_B(i)], regs[INSTR_C(i)]);
+        VM_NEXT();
+    }
+    VM_CASE(OP_BAND) {
+        VM_BITWISE(OP_BAND, x & y);
+        VM_NEXT();
+    }
+    VM_CASE(OP_BOR) {
+        VM_BITWISE(OP_BOR, x | y);
+        VM_NEXT();
+    }
+    VM_CASE(OP_BXOR) {
+        VM_BITWISE(OP_BXOR, x ^ y);
+        VM_NEXT();
+    }
+    VM_CASE(OP_SHL) {
+        // Inlined for counts below 16, which cannot shift an inline int64
+        // out of range
+        Value lhs = regs[INSTR_B(i)], rhs = regs[INSTR_C(i)];
+        if (BOTH_INT(lhs, rhs) && (uint64_t)value_small_int(rhs) < 16) {
+            regs[INSTR_A(i)] = value_int((int64_t)((uint64_t)value_small_int(lhs) << value_small_int(rhs)));
+        } else if (repl_value_binary(OP_SHL, lhs, rhs, &regs[INSTR_A(i)]) != VALUE_OK) {
+            goto fail;
+        }
+        VM_NEXT();
+    }
+    VM_CASE(OP_SHR) {
+        // Arithmetic shift, as for a signed left operand in C
+        VM_BITWISE(OP_SHR, (int64_t)x >> (y & 63));
+        VM_NEXT();
+    }
+    VM_CASE(OP_BNOT) {
+        if (repl_value_unary(OP_BNOT, regs[INSTR_B(i)], &regs[INSTR_A(i)]) != VALUE_OK) goto fail;
+        VM_NEXT();
+    }
+    VM_CASE(OP_NOT) {
+        regs[INSTR_A(i)] = value_bool(!value_is_true(regs[INSTR_B(i)]));
+        VM_NEXT();
+    }
+    VM_CASE(OP_BOOL) {
+        regs[INSTR_A(i)] = value_bool(value_is_true(regs[INSTR_B(i)]));
+        VM_NEXT();
+    }
+    VM_CASE(OP_ADDK) {
+        VM_ARITH(OP_ADD, regs[INSTR_B(i)], k[INSTR_C(i)], +);
+        VM_NEXT();
+    }
+    VM_CASE(OP_SUBK) {
+        VM_ARITH(OP_SUB, regs[INSTR_B(i)], k[INSTR_C(i)], -);
+        VM_NEXT();
+    }
+    VM_CASE(OP_MULK) {
+        VM_MULTIPLY(regs[INSTR_B(i)], k[INSTR_C(i)]);
+        VM_NEXT();
+    }
+    VM_CASE(OP_DIVK) {
+        VM_DIVIDE(regs[INSTR_B(i)], k[INSTR_C(i)]);
+        VM_NEXT();
+    }
+    VM_CASE(OP_POWK) {
+        VM_GENERIC(OP_POW, regs[INSTR_B(i)], k[INSTR_C(i)]);
+        VM_NEXT();
+    }
+    VM_CASE(OP_RSUBK) {
+        VM_ARITH(OP_SUB, k[INSTR_C(i)], regs[INSTR_B(i)], -);
+        VM_NEXT();
+    }
+    VM_CASE(OP_RDIVK) {
+        VM_DIVIDE(k[INSTR_C(i)], regs[INSTR_B(i)]);
+        VM_NEXT();
+    }
+    VM_CASE(OP_LT) {
+        VM_COMPARE(OP_LT, <);
+        VM_NEXT();
+    }
+    VM_CASE(OP_LE) {
+        VM_COMPARE(OP_LE, <=);
+        VM_NEXT();
+    }
+    VM_CASE(OP_EQ) {
+        VM_COMPARE(OP_EQ, ==);
+        VM_NEXT();
+    }
+    VM_CASE(OP_NE) {
+        VM_COMPARE(OP_NE, !=);
+        VM_NEXT();
+    }
+    VM_CASE(OP_STOREV) {
+        int slot = program->slots[INSTR_BX(i)];
+        repl->variables.values[slot] = regs[INSTR_A(i)];
+        repl->variables.versions[slot]++;
+        VM_NEXT();
+    }
+    VM_CASE(OP_JMP) {
+        VM_JUMP();
+        VM_NEXT();
+    }
+    VM_CASE(OP_JMPF) {
+        if (!value_is_true(regs[INSTR_A(i)])) VM_JUMP();
+        VM_NEXT();
+    }
+    VM_CASE(OP_JMPT) {
+        if (value_is_true(regs[INSTR_A(i)])) VM_JUMP();
+        VM_NEXT();
+    }
+    VM_CASE(OP_CALL) {
+        if (repl_heap_should_collect()) collect_while_running(repl, program, regs, frames, depth);
+        Function* function = &repl->functions.items[INSTR_BX(i)];
+        const CompiledExpr* callee = function->code;
+        Value* window = regs + INSTR_A(i);
+        Function* memoize = NULL;
+        if (function->pure && repl->memo_capacity > 0) {
+            if (repl_memo_lookup(function, window, window)) VM_NEXT();
+            memoize = function;
+        }
+        if (depth == VM_MAX_CALL_DEPTH || window + callee->register_count > stack_end) goto fail;
+
+        frames[depth].program = program;
+        frames[depth].pc = pc;
+        frames[depth].regs = regs;
+        frames[depth].memoize = memoize;
+        depth++;
+
+        program = callee;
+        k = callee->constants;
+        pc = callee->code;
+        regs = window;
+        VM_NEXT();
+    }
+    VM_CASE(OP_TAILCALL) {
+        // A call whose result is returned as is: reuse the frame, so
+        // recursion in tail position runs in constant space
+        VM_POLL();
+        int arity = repl->functions.items[INSTR_BX(i)].arity;
+        memmove(regs, regs + INSTR_A(i), arity * sizeof(Value));
+        pc = program->code;
+        if (repl_heap_should_collect()) collect_while_running(repl, program, regs, frames, depth);
+        VM_NEXT();
+    }
+    VM_CASE(OP_BUILTIN) {
+        // Double arguments go straight to the C function, except at
+        // extended precision
+        const Builtin* builtin = &repl_builtins[INSTR_B(i)];
+        Value* args = regs + INSTR_A(i);
+        if (builtin->unary && !extended && value_is_float(args[0])) {
+            args[0] = value_float(builtin->unary(value_as_float(args[0])));
+        } else if (builtin->binary && BOTH_FLOAT(args[0], args[1])) {
+            args[0] = value_float(builtin->binary(value_as_float(args[0]), value_as_float(args[1])));
+        } else if (!VM_FUSED(args[0], builtin->arity > 1 ? args[1] : args[0])) {
+            Value result;
+            if (repl_call_builtin(builtin, args, &result) != VALUE_OK) goto fail;
+            args[0] = result;
+        }
+        VM_NEXT();
+    }
+    VM_CASE(OP_ARRAY) {
+        Value array;
+        if (repl_array_from_values(regs + INSTR_A(i), INSTR_B(i), &array) != VALUE_OK) goto fail;
+        regs[INSTR_A(i)] = array;
+        VM_NEXT();
+    }
+    VM_CASE(OP_RET) {
+        if (depth == 0) return regs[INSTR_A(i)];
+
+        // The callee's window starts at the caller's destination register.
+        // Its parameter registers still hold the arguments to remember the
+        // result by: only a self tail call writes them, and the result is
+        // then also that of the call with the new arguments. A body that
+        // ends without reaching a return has no result.
+        Value result = regs[INSTR_A(i)];
+        if (value_is_undefined(result)) goto fail;
+        depth--;
+        if (frames[depth].memoize) repl_memo_store(repl, frames[depth].memoize, regs, result);
+        program = frames[depth].program;
+        k = program->constants;
+        pc = frames[depth].pc;
+        regs = frames[depth].regs;
+        regs[INSTR_A(pc[-1])] = result;
+        if (repl_heap_should_collect()) collect_while_running(repl, program, regs, frames, depth);
+        VM_NEXT();
+    }
+
+    VM_END()
+
+fail:
+    runtime_error(repl, program, pc - 1, regs, depth);
+}
+
+void repl_vm_free_stack(REPL* repl) {
+    free(repl->vm_stack);
+    repl->vm_stack = NULL;
+}
@@ -0,0 +1,118 @@
+#include "../include/repl.h"
+#include "../include/repl_compile.h"
+#include "../include/repl_heap.h"
+#include "../include/repl_functions.h"
+#include "../include/repl_number.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Tests of the evaluator, run without a window: each input goes through
+ * repl_evaluate as if typed, and its result line is compared with the
+ * expected text. Commands print through repl_print, stubbed here.
+ */
+
+static int failures;
+
+void repl_print(REPL* repl, const char* result, bool is_error) {
+    repl->input_buffer[0] = '\0';
+}
+
+void repl_show_help(REPL* repl) {
+}
+
+void repl_clear_input(REPL* repl) {
+    repl->input_buffer[0] = '\0';
+}
+
+bool repl_interrupt_requested(REPL* repl) {
+    return false;
+}
+
+static REPL* create_repl(void) {
+    REPL* repl = (REPL*)calloc(1, sizeof(REPL));
+    if (!repl) return NULL;
+    repl_heap_init(&repl->error);
+    repl_define_constants(repl);
+    repl->expr_cache = repl_cache_create();
+    repl->jit_enabled = true;
+    repl->output_precision = FORMAT_SHORTEST;
+    repl->memo_capacity = MEMO_DEFAULT_CAPACITY;
+    repl->running = true;
+    return repl;
+}
+
+static void expect(REPL* repl, const char* input, const char* expected) {
+    const char* result = repl_evaluate(repl, input);
+    if (strcmp(result, expected) != 0) {
+        printf("FAIL: %s\n  expected: %s\n  got:      %s\n", input, expected, result);
+        failures++;
+    }
+}
+
+// Two inputs that must give the same result
+static void expect_same(REPL* repl, const char* input, const char* other) {
+    char expected[MAX_RESULT_LENGTH];
+    snprintf(expected, sizeof(expected), "%s", repl_evaluate(repl, other));
+    expect(repl, input, expected);
+}
+
+// Decimal mode keeps every digit or reports the literal, never a double
+static void test_decimal_literals(REPL* repl) {
+    repl_evaluate(repl, "mode decimal");
+    expect(repl, "99999999999999999999.99", "99999999999999999999.99");
+    expect(repl, "1234567890123456789012345678901234567.5",
+           "Error at column 1: decimal literal '12345678901234567890123456789012' is too large");
+    expect(repl, "1e40", "Error at column 1: decimal literal '1e40' is too large");
+    expect(repl, "x = 2 + 1e40", "Error at column 9: decimal literal '1e40' is too large");
+    expect(repl, "0x1FFFFFFFFFFFFFFFFF",
+           "Error at column 1: integer literal '0x1FFFFFFFFFFFFFFFFF' is too large");
+    repl_evaluate(repl, "mode int64");
+    expect(repl, "1e40", "1e+40");
+}
+
+// Powers agree with repeated multiplication, also where a part overflows
+static void test_complex_powers(REPL* repl) {
+    expect(repl, "(1+2i)^5", "41-38i");
+    expect_same(repl, "(1e300i)^2", "(1e300i)*(1e300i)");
+    expect_same(repl, "(1e200+1e200i)^2", "(1e200+1e200i)*(1e200+1e200i)");
+    repl_evaluate(repl, "w = 1e300i");
+    repl_evaluate(repl, "z = 1e200+1e200i");
+    expect_same(repl, "w^2", "w*w");
+    expect_same(repl, "z^2", "z*z");
+    expect_same(repl, "z^3", "z*z*z");
+    expect_same(repl, "w^4", "(w*w)*(w*w)");
+}
+
+// The math functions follow the precision setting, like the operators
+static void test_extended_functions(REPL* repl) {
+    repl_evaluate(repl, "precision dd");
+    expect(repl, "exp(1)", "2.718281828459045235360287471353");
+    expect(repl, "log(1 + 2.0^-40)", "9.094947017725146476087627994347e-13");
+    expect(repl, "sin(1)", "0.8414709848078965066525023216303");
+    expect(repl, "atan(1) * 4", "3.14159265358979323846264338328");
+    expect(repl, "floor(exp(1) * 1e20)", "271828182845904523536.0");
+    repl_evaluate(repl, "precision quad");
+    expect(repl, "exp(1)", "2.71828182845904523536028747135266");
+    expect(repl, "log10(2)", "0.301029995663981195213738894724493");
+    expect(repl, "cos(1)", "0.540302305868139717400936607442977");
+    expect(repl, "sqrt(10.0^4000)", "1e+2000");
+    repl_evaluate(repl, "precision double");
+    expect(repl, "exp(1)", "2.718281828459045");
+}
+
+int main(void) {
+    REPL* repl = create_repl();
+    if (!repl || !repl->expr_cache) {
+        printf("FAIL: out of memory\n");
+        return 1;
+    }
+
+    test_decimal_literals(repl);
+    test_complex_powers(repl);
+    test_extended_functions(repl);
+
+    if (failures == 0) printf("All tests passed\n");
+    return failures == 0 ? 0 : 1;
+}